@@ -11,14 +11,27 @@
  *****************   gps.h  NMEA sentences   *********************
  *  structures for NMEA sentences
  * LINX-EVM-GPS-R4 streams via UART (RS232) the following 8 NMEA sentences:
- *   1 GPGSA - satellites active - ignored
- *   2 GPGSV x3 - satellites in view data - ignored
+ *   1 GPGSA - satellites active - satellite table, gpssat.c
+ *   2 GPGSV x3 - satellites in view data - satellite table, gpssat.c
  *   5 GPRMC - see below
  *   6 GPVTG - ground speed - ignored
  *   7 GPGGA - see below
  *   8 GPGLL - longitude, latitude - ignored
+ * any talker is accepted (GN = multi-constellation, GL = GLONASS ...)
  */
 
+#include <stdint.h> /* for struct PMTgps fixed point fields */
+#include <time.h>   /* time_t for struct ntpshm */
+
+/**
+ * u-blox UBX binary frames - may arrive on the same port, see ubxdriver.c
+ *   ubxbyte() returns UBXMORE until a frame is complete
+ */
+#define UBXSYNC1 0xB5 /* first byte of every UBX frame, never in NMEA */
+#define UBXMORE 0
+#define UBXGOOD 1
+#define UBXBAD 2
+
 /**
  * map simulations for initialization and testing
  */
@@ -27,6 +40,14 @@
 #define PANORAMA 2
 #define SOLSONA 3
 
+/**
+ * struct PMTgps status
+ */
+#define GPSLOST -1  /* lost satellites */
+#define GPSSTILL 0  /* stationary */
+#define GPSMOVED 1  /* moved since the last fix */
+#define GPSSTALE 2  /* saved fix from before pmtgpsd started, see gpslast.c */
+
 /**
  * struct GPGGA --  NMEA sentence for current fix information
  *   we use 4 items
@@ -71,6 +92,11 @@ struct GPRMC {
   char east;         /* W=west, E=east */
 };
 
+#define PMTGPSVERSION 4 /* struct PMTgps with the ground height */
+#define MAPMAXZOOM 18   /* struct PMTgps tilex, tiley */
+#define MAPZOOMS (MAPMAXZOOM + 1)
+#define GPSNOGROUND INT32_MIN /* struct PMTgps groundmm, no DEM tile */
+
 /**
  * struct PMTgps --  gps data in display format
  *   longitude, latitude is degrees, minutes seconds (not Decimal degrees)
@@ -81,6 +107,7 @@ struct GPRMC {
 struct PMTgps {
   int spinlock;       /* assume atomic like sig_atomic_t. 0=free, 1=locked */
   int status;         /* -1=lost satellites, 0=stationary, 1=moved */
+                      /* 2=stale, last fix saved before this start */
   int latitude;       /* format = ddmmss */
   char latitudeNS;    /* N=north, S=South (default N) */
   int longitude;      /* format = dddmmss */
@@ -99,6 +126,62 @@ struct PMTgps {
                      */
   int meridianlong; /* START longitude of current timezone. END = START + 15 */
                     /* degrees */
+  /*
+   * with pmtgpsd.conf kalman = 1 the position, altitude, speed and track
+   * above are Kalman filtered (gpskalman.c), the fix as received is here.
+   * Without it they are the same.
+   */
+  int rawlatitude;     /* format = ddmmss */
+  char rawlatitudeNS;  /* N=north, S=South */
+  int rawlongitude;    /* format = dddmmss */
+  char rawlongitudeEW; /* E=east, W=west */
+  int rawaltitude;     /* in feet */
+  int rawspeed;        /* in km per hour */
+  int rawtrack;        /* in degrees */
+  float hdop;          /* horizontal dilution of precision, 0 = unknown */
+  int satellites;      /* used in the fix, 0 = unknown */
+  float accuracy;      /* meters, estimated 1 sigma horizontal position */
+
+  /*
+   * version 2: fixed point, no conversion needed and no precision lost
+   * to ddmmss (1 second = 30 m).  Only there if version >= 2 (an older
+   * pmtgpsd leaves the shared memory shorter - check its size with
+   * fstat() first).  sequence is odd while pmtgpsd is writing:
+   *     do {
+   *       seq = gps->sequence;
+   *       __sync_synchronize();
+   *       copy = *gps;
+   *       __sync_synchronize();
+   *     } while ((seq & 1) || gps->sequence != seq);
+   *   see test/testgpsfix.c
+   */
+  int version;           /* PMTGPSVERSION */
+  unsigned int sequence; /* + 2 every fix, odd while writing */
+  int32_t longitude7;    /* 1e-7 degrees  + => East,  - => West */
+  int32_t latitude7;     /* 1e-7 degrees  + => North, - => South */
+  int32_t altitudemm;    /* millimeters above mean sea level */
+  int32_t rawlongitude7; /* raw fix, as above */
+  int32_t rawlatitude7;
+  int32_t rawaltitudemm;
+  int64_t fixtime; /* UTC of the fix, nanoseconds since 1970, 0 = none */
+
+  /*
+   * version 3: map under longitude7, latitude7, see gpsmap.c.  Only
+   * changed when the position moves onto another sheet or tile, then
+   * mapchanges goes up, so a renderer compares one number per redraw.
+   */
+  unsigned int mapchanges; /* + 1 every change of sheet or tile */
+  char mapsheet[8];        /* NTS 1:50000 sheet "031E01", "" = none */
+  uint32_t tilex[MAPZOOMS]; /* Web Mercator tile at zoom 0 ... */
+  uint32_t tiley[MAPZOOMS]; /*   MAPMAXZOOM, x East, y South */
+
+  /*
+   * version 4: ground under longitude7, latitude7 from the elevation
+   * tiles in pmtgpsd.conf demdir, see gpsdem.c.  With demblend > 0
+   * altitude and altitudemm are blended toward it, rawaltitudemm is
+   * still the fix's own.
+   */
+  int32_t groundmm; /* millimeters above mean sea level, GPSNOGROUND */
 };
 
 /**
@@ -109,13 +192,379 @@ struct PMTgps {
  */
 struct linxdata {
   int date;           /* 99999999 = yyyymmdd */
-  float gmt;          /* 999999.999 = UTC hh:mm:ss.sss */
+  float gmt;          /* 999999 = UTC hh:mm:ss, .sss in millisecond */
   double longitude;   /* decimal degrees  + => East,  - => West */
   double latitude;    /* decimal degrees  + => North, - => South */
   float altitude;     /* 9999.9 = altitude meters */
   double declination; /* decimal degrees + => East, - => West */
   float speed;        /* 999.99 = km per hour */
   float track;        /* 999.99 = track angle in degrees True */
+  double received;    /* gpsclock() when the fix's last sentence started */
+                      /* arriving, 0 = no fix */
+  float hdop;         /* horizontal dilution of precision, 0 = unknown */
+  int satellites;     /* used in the fix, 0 = unknown */
+  double realtime;    /* CLOCK_REALTIME, seconds since 1970, when the */
+                      /* same sentence's first byte arrived, 0 = no fix */
+  int millisecond;    /* .sss of gmt, 0 ... 999 (a float gmt is too */
+                      /* coarse for them at 5-10 fixes a second) */
+};
+
+/**
+ * satellite table - shared memory /dev/shm/pmtgpssat, see gpssat.c
+ *   satellites in view from GSV sentences of every talker
+ *   (GP GL GA GB BD GQ GN), used-in-fix from GSA, updated every fix.
+ *
+ *   double buffered: pmtgpsd writes the view readers are NOT reading,
+ *   then points current at it.  To read
+ *     do {
+ *       v = sat->current;   end = sat->view[v].end;
+ *       __sync_synchronize();
+ *       copy = sat->view[v];
+ *       __sync_synchronize();
+ *     } while (sat->view[v].begin != end);
+ *   see test/testgpssat.c
+ */
+#define SATNAME "/pmtgpssat" /* shared memory /dev/shm/pmtgpssat */
+#define MAXSAT 64            /* satellites in view, all constellations */
+
+/* struct gpssat system */
+#define SATOTHER 0
+#define SATGPS 1     /* talker GP, PRN 1-32, SBAS 33-64 */
+#define SATGLONASS 2 /* talker GL, PRN 65-96 */
+#define SATGALILEO 3 /* talker GA */
+#define SATBEIDOU 4  /* talker GB or BD */
+#define SATQZSS 5    /* talker GQ */
+
+/**
+ * struct gpssat -- one satellite in view
+ */
+struct gpssat {
+  short system;    /* SATGPS ... */
+  short prn;       /* satellite number as the receiver sends it */
+  short elevation; /* degrees 0-90, -1 = unknown */
+  short azimuth;   /* degrees True 0-359, -1 = unknown */
+  short snr;       /* signal dB-Hz 0-99, -1 = not tracking */
+  short used;      /* 1 = used in the fix (GSA), 0 = not */
+};
+
+/**
+ * struct gpssatview -- every satellite in view, at each GSV cycle or fix
+ */
+struct gpssatview {
+  unsigned int begin; /* update number, written first */
+  int date;           /* yyyymmdd of the last fix, 0 = no fix yet */
+  int gmt;            /* hhmmss of the last fix */
+  int nsat;           /* entries in sat[] */
+  int nused;          /* satellites used in the fix */
+  float pdop;         /* dilution of precision, 0 = no GSA */
+  float hdop;
+  float vdop;
+  struct gpssat sat[MAXSAT];
+  unsigned int end; /* = begin when view is complete, written last */
+};
+
+/**
+ * struct PMTgpssat -- shared memory /dev/shm/pmtgpssat
+ */
+struct PMTgpssat {
+  int current; /* view[] to read, 0 or 1 */
+  struct gpssatview view[2];
+};
+
+/**
+ * dead reckoning - shared memory /dev/shm/pmtgpsdr, see gpsdr.c
+ *   position predicted drrate times a second (pmtgpsd.conf) from the
+ *   last fix's speed along its gps track or the pmtfxosd compass
+ *   heading, so a map moves smoothly between 1 Hz fixes.
+ *   one record rewritten in place: begin = end when it is whole.
+ *   reader:
+ *     do {
+ *       end = dr->end;
+ *       __sync_synchronize();
+ *       copy = *dr;
+ *       __sync_synchronize();
+ *     } while (dr->begin != end);
+ */
+#define DRNAME "/pmtgpsdr" /* shared memory /dev/shm/pmtgpsdr */
+
+/* struct PMTgpsdr source */
+#define DRNONE 0    /* no fix yet */
+#define DRFIX 1     /* standing still, the fix itself */
+#define DRTRACK 2   /* predicted along the gps track */
+#define DRCOMPASS 3 /* predicted along the compass heading */
+#define DRHOLD 4    /* no fix for too long, prediction stopped */
+
+/* gpsdr.c and gpsnav.c: slower fixes are standing, their track is noise */
+#define GPSMINSPEED 1.0 /* km/hr */
+
+/**
+ * struct PMTgpsdr -- predicted position, shared memory /dev/shm/pmtgpsdr
+ */
+struct PMTgpsdr {
+  unsigned int begin; /* update number, written first */
+  int source;         /* DRNONE ... */
+  double longitude;   /* decimal degrees  + => East,  - => West */
+  double latitude;    /* decimal degrees  + => North, - => South */
+  float altitude;     /* meters, from the fix */
+  float speed;        /* km per hour, from the fix */
+  float heading;      /* degrees True moved along */
+  float age;          /* seconds since the fix arrived */
+  float uncertainty;  /* meters, estimated 1 sigma */
+  int date;           /* yyyymmdd of the fix */
+  int gmt;            /* hhmmss of the fix */
+  unsigned int end;   /* = begin when complete, written last */
+};
+
+/**
+ * trip computer - see gpstrip.c
+ *   odometer, climb and moving time since pmtgpsd started or the last
+ *   kill -USR1 of pmtgpsd, updated every fix on /dev/shm/pmtgpstrip.
+ *   Read it like struct PMTgpsdr (begin = end when it is whole).
+ */
+#define TRIPNAME "/pmtgpstrip" /* shared memory /dev/shm/pmtgpstrip */
+
+/**
+ * struct PMTgpstrip -- trip so far, shared memory /dev/shm/pmtgpstrip
+ */
+struct PMTgpstrip {
+  unsigned int begin;  /* update number, written first */
+  int startdate;       /* yyyymmdd of the first fix of the trip */
+  int startgmt;        /* hhmmss of the first fix of the trip */
+  int date;            /* yyyymmdd of the last fix */
+  int gmt;             /* hhmmss of the last fix */
+  unsigned int fixes;  /* fixes in the trip */
+  unsigned int resets; /* kill -USR1 trip resets */
+  double distance;     /* meters along the ellipsoid, moving fixes only */
+  double ascent;       /* meters climbed, steps under tripclimb ignored */
+  double descent;      /* meters descended, likewise */
+  double movingtime;   /* seconds at tripstill km/hr or more */
+  double stoppedtime;  /* seconds slower */
+  double maxspeed;     /* km per hour */
+  double altitude;     /* meters, altitude the climbs are counted from */
+  unsigned int end;    /* = begin when complete, written last */
+};
+
+/**
+ * route navigation - pmtgpsd.conf navroute, see gpsnav.c
+ *   where the next waypoint of a planned route is, how far off the
+ *   route the fix is and when the end will be reached, updated every
+ *   fix on /dev/shm/pmtgpsnav.  Read it like struct PMTgpsdr (begin =
+ *   end when it is whole).
+ */
+#define NAVNAME "/pmtgpsnav" /* shared memory /dev/shm/pmtgpsnav */
+
+/**
+ * struct PMTgpsnav -- navigation along the route
+ */
+struct PMTgpsnav {
+  unsigned int begin;  /* update number, written first */
+  int waypoints;       /* points in the route, 0 = no route */
+  int waypoint;        /* next one, 1 ... waypoints - 1 */
+  int date;            /* yyyymmdd of the fix */
+  int gmt;             /* hhmmss of the fix */
+  double bearing;      /* degrees True from the fix to the waypoint */
+  double distance;     /* meters from the fix to the waypoint */
+  double crosstrack;   /* meters off the route, + => right of it */
+  double remaining;    /* meters along the route to its end */
+  double eta;          /* seconds to the end at the average speed */
+  int etagmt;          /* hhmmss UTC at the end */
+  double heading;      /* degrees True, compass (pmtfxosd) or gps track */
+  double turn;         /* bearing - heading, -180 ... 180, + => right */
+  unsigned int scans;  /* whole route searches, lost the place */
+  unsigned int end;    /* = begin when complete, written last */
+};
+
+/**
+ * map matching - pmtgpsd.conf trailfile, see gpsmatch.c
+ *   fixes snapped to a trail (or road) network, updated every fix on
+ *   /dev/shm/pmtgpsmatch with the fix as it was.  Read it like struct
+ *   PMTgpsdr (begin = end when it is whole).
+ *
+ *   the network is a binary file made by test/trailbuild from text
+ *   polylines, mapped read only, nothing parsed at start up:
+ *     struct trailfile
+ *     struct trailnode  node[nnode]
+ *     struct trailedge  edge[nedge]
+ *     uint32_t nodestart[nnode + 1]    edges of node n are
+ *     uint32_t nodeedge[2 * nedge]       nodeedge[nodestart[n] ...]
+ *     uint32_t cellstart[gridw * gridh + 1]   edges near grid cell c are
+ *     uint32_t celledge[...]                    celledge[cellstart[c] ...]
+ *   grid cell (x, y) is x + y * gridw, west7 + x * cellx7 ... and
+ *   south7 + y * celly7 ... (1e-7 degrees)
+ */
+#define MATCHNAME "/pmtgpsmatch" /* shared memory /dev/shm/pmtgpsmatch */
+#define TRAILMAGIC 0x4c415254    /* "TRAL" */
+
+/**
+ * struct trailfile -- start of a trail network file
+ */
+struct trailfile {
+  uint32_t magic;   /* TRAILMAGIC */
+  uint32_t nnode;   /* junctions and bends */
+  uint32_t nedge;   /* straight pieces between 2 nodes */
+  uint32_t ntrail;  /* polylines in the text file */
+  int32_t west7;    /* grid corner, 1e-7 degrees */
+  int32_t south7;
+  int32_t cellx7;   /* grid cell, 1e-7 degrees */
+  int32_t celly7;
+  uint32_t gridw;   /* cells */
+  uint32_t gridh;
+};
+
+/**
+ * struct trailnode -- a point of the network
+ */
+struct trailnode {
+  int32_t longitude7; /* 1e-7 degrees */
+  int32_t latitude7;
+};
+
+/**
+ * struct trailedge -- a straight piece of trail
+ */
+struct trailedge {
+  uint32_t from;  /* node */
+  uint32_t to;    /* node */
+  float length;   /* meters */
+  uint32_t trail; /* polyline number, 0 = first in the text file */
+};
+
+/**
+ * struct PMTgpsmatch -- a fix and where it is on the trails
+ */
+struct PMTgpsmatch {
+  unsigned int begin;    /* update number, written first */
+  int date;              /* yyyymmdd of the fix */
+  int gmt;               /* hhmmss of the fix */
+  double longitude;      /* the fix, decimal degrees */
+  double latitude;
+  int matched;           /* 1 => on a trail, 0 => none within trailradius */
+  int trail;             /* trail number, -1 if not matched */
+  double matchlongitude; /* on the trail, = the fix if not matched */
+  double matchlatitude;
+  double offtrail;       /* meters from the fix to the trail */
+  int candidates;        /* trail pieces near the fix */
+  int settledgmt;        /* hhmmss of an older fix, 0 = none */
+  double settledlongitude; /* where it was, now that later fixes */
+  double settledlatitude;  /* have been seen (see gpsmatch.c) */
+  unsigned int breaks;   /* fixes no path led to, matching restarted */
+  unsigned int end;      /* = begin when complete, written last */
+};
+
+/**
+ * geofence events - pmtgpsd.conf fencefile, see gpsfence.c
+ *   /dev/shm/pmtgpsfence holds the last FENCERING enter/exit events.
+ *   Event n (1, 2, 3 ...) is ring[(n - 1) % FENCERING], its number is
+ *   set last, so a reader keeps the last n it read and, while
+ *   n < events, copies ring[n % FENCERING] and uses it if its number is
+ *   n + 1 before and after the copy.  events - n > FENCERING => lost.
+ *   see test/testgpsfence.c
+ */
+#define FENCENAME "/pmtgpsfence"
+#define FENCERING 64
+#define FENCELABEL 32 /* characters in a fence name, with the '\0' */
+#define FENCEENTER 1
+#define FENCEEXIT 2
+
+/**
+ * struct fenceevent -- the fix went into or out of a fence
+ */
+struct fenceevent {
+  unsigned int number;   /* 1, 2, 3 ... 0 while being written */
+  int type;              /* FENCEENTER or FENCEEXIT */
+  int fence;             /* position of the fence in the fence file */
+  char name[FENCELABEL]; /* fence name from the fence file */
+  int date;              /* yyyymmdd of the fix */
+  int gmt;               /* hhmmss of the fix */
+  double longitude;      /* decimal degrees  + => East,  - => West */
+  double latitude;       /* decimal degrees  + => North, - => South */
+};
+
+/**
+ * struct PMTgpsfence -- /dev/shm/pmtgpsfence
+ */
+struct PMTgpsfence {
+  unsigned int events;   /* events so far, the last is number events */
+  int fences;            /* fences loaded */
+  unsigned int reloads;  /* fence file changes loaded */
+  struct fenceevent ring[FENCERING];
+};
+
+/**
+ * binary track log - pmtgpsd.conf tracklog, see gpstrack.c
+ *   tracklog.dat  TRACKCHUNK byte chunks, each a struct trackchunk with
+ *                 the first fix, then every later fix as zig-zag varint
+ *                 deltas: milliseconds, longitude7, latitude7, altitudemm
+ *   tracklog.idx  struct trackindex for each chunk, in the same order,
+ *                 mmap it and binary search for a time
+ *   see test/trackquery.c
+ *   with tracksimplify, tracklog-simple.dat and .idx are the same for
+ *   a simplified track, see gpssimplify.c
+ */
+#define TRACKCHUNK 4096       /* bytes, chunk n is at n * TRACKCHUNK */
+#define TRACKMAGIC 0x4b525450 /* "PTRK" little endian */
+
+/**
+ * struct trackchunk -- start of every chunk in tracklog.dat
+ */
+struct trackchunk {
+  uint32_t magic;     /* TRACKMAGIC */
+  uint16_t nfix;      /* fixes in the chunk, the first is here */
+  uint16_t bytes;     /* bytes of deltas after this header */
+  int64_t first;      /* UTC of the first fix, ns since 1970 */
+  int64_t last;       /* UTC of the last fix */
+  int32_t longitude7; /* first fix, 1e-7 degrees */
+  int32_t latitude7;
+  int32_t altitudemm;
+  int32_t unused;
+};
+
+/**
+ * struct trackindex -- one chunk in tracklog.idx
+ */
+struct trackindex {
+  int64_t first; /* UTC of the first fix, ns since 1970 */
+  int64_t last;  /* UTC of the last fix */
+};
+
+/**
+ * struct trackpoint -- a fix as the track log keeps it
+ */
+struct trackpoint {
+  int64_t ms;          /* UTC, milliseconds since 1970 */
+  int32_t longitude7;  /* 1e-7 degrees */
+  int32_t latitude7;
+  int32_t altitudemm;
+};
+
+/**
+ * NTP SHM reference clock - pmtgpsd.conf ntpunit, see gpsntp.c
+ *   the System V shared memory segment ntpd (refclock 127.127.28.unit)
+ *   and chronyd (refclock SHM unit) read, key NTPSHMKEY + unit.  Every
+ *   device fix: its UTC (clock) and the CLOCK_REALTIME its sentence
+ *   arrived (receive).  Mode 1: count is incremented before and after
+ *   the fields are written, a reader reads again if it changed.
+ *   see test/testgpsntp.c
+ */
+#define NTPSHMKEY 0x4e545030 /* "NTP0" */
+
+/**
+ * struct ntpshm -- the segment, layout fixed by ntpd's refclock_shm.c
+ */
+struct ntpshm {
+  int mode;                   /* 1 => count tells a torn read */
+  volatile int count;         /* incremented before and after writes */
+  time_t clockTimeStampSec;   /* UTC of the fix */
+  int clockTimeStampUSec;
+  time_t receiveTimeStampSec; /* CLOCK_REALTIME it arrived */
+  int receiveTimeStampUSec;
+  int leap;                   /* 0 = no leap second warning */
+  int precision;              /* log2 seconds */
+  int nsamples;               /* samples ntpd takes a poll */
+  volatile int valid;         /* 1 = new sample, the reader clears it */
+  unsigned clockTimeStampNSec; /* nanoseconds of the same */
+  unsigned receiveTimeStampNSec;
+  int dummy[8];
 };
 
 /**
@@ -127,3 +576,54 @@ struct dms {
   int seconds; /* 0-60 */
   char nsew;   /* +latitude=N, -latitude=S, +longitude=E, -longitude=W */
 };
+
+/**
+ * pmtgpsd configuration file - see pmtgpsd/data/pmtgpsd.conf
+ *   one "key = value" per line, # starts a comment.
+ *   missing file or missing keys keep the defaults in gpsconfig.c
+ */
+#define GPSCONFFILE "/usr/share/pmt/pmtgpsd.conf"
+#define GPSCONFNAME 100 /* max length of a file name value */
+
+/**
+ * struct gpsconfig -- values from GPSCONFFILE
+ */
+struct gpsconfig {
+  char wmmfile[GPSCONFNAME];   /* World Magnetic Model, default WMM.COF */
+  char emmfile[GPSCONFNAME];   /* Enhanced Magnetic Model "" => use WMM */
+  char emmsvfile[GPSCONFNAME]; /* EMM secular variation coefficients */
+  double emmbudget; /* nT truncation error allowed, 0 => full degree */
+  char precision[GPSCONFNAME]; /* declination "float" or "double" */
+  char device[GPSCONFNAME];    /* gps serial port, default /dev/ttyS1 */
+  char nmealog[GPSCONFNAME];   /* copy of every sentence, "" => none */
+  double statsinterval;        /* seconds between syslog stats, 0 => none */
+  char routefile[GPSCONFNAME]; /* simulate along a route, "" => Percy Lake */
+  double routespeed;           /* km/hr on routes without times */
+  double simrate;              /* simulated fixes per second */
+  double simscale;             /* simulated seconds per real second */
+  double deviceretry; /* seconds between device opens, 0 => never retry */
+  double baud;        /* receiver baud rate to set, 0 => as found */
+  double fixrate;     /* receiver fixes per second to set, 0 => as is */
+  char nmeaset[GPSCONFNAME]; /* sentences to keep "RMC GGA", "" => as is */
+  char lastfix[GPSCONFNAME]; /* last fix saved across restarts, "" => none */
+  double lastfixsave;        /* seconds between saves, 0 => at stop only */
+  double aiding;             /* 1 => send the saved fix to the receiver */
+  double drrate;   /* dead reckoned positions per second, 0 => none */
+  double drblend;  /* seconds to blend out the jump at a new fix */
+  double drcompass; /* 1 => predict along the compass, 0 => gps track */
+  double kalman;      /* 1 => publish Kalman filtered fixes */
+  double kalmanaccel; /* m/s/s, 1 sigma acceleration the filter allows */
+  char tracklog[GPSCONFNAME]; /* binary track log .dat .idx, "" => none */
+  double tracksync; /* seconds between writes of the open chunk */
+  char fencefile[GPSCONFNAME]; /* geofence polygons, "" => none */
+  double tripstill; /* km/hr, slower is stopped for the trip computer */
+  double tripclimb; /* meters, smaller altitude changes are noise */
+  char navroute[GPSCONFNAME]; /* route to navigate, "" => none */
+  double navspeed; /* km/hr for the ETA until the fixes give one */
+  char trailfile[GPSCONFNAME]; /* binary trail network, "" => none */
+  double trailradius; /* meters, trails farther from a fix are not it */
+  char demdir[GPSCONFNAME]; /* SRTM .hgt elevation tiles, "" => none */
+  double demblend; /* 0 ... 1, share of the DEM in published altitude */
+  double tracksimplify; /* meters, simplified track log, 0 => none */
+  double ntpunit; /* NTP SHM refclock unit for fix times, -1 => none */
+};
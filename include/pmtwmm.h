@@ -0,0 +1,69 @@
+/**
+ * DOC: -- pmtwmm.h -- World Magnetic Model wrapper for pmt daemons
+ *  Peter Thompson Nov 2019
+ *
+ * declination (and the other field elements) from NOAA's WMM or EMM,
+ * implemented in peterpoint.c and wmmfast.c on top of
+ * GeomagnetismLibrary.c
+ *
+ * struct wmmmodel = coefficients, ellipsoid and geoid loaded from a
+ *   model file.  Never changed after wmmopen() or emmopen() so one
+ *   model is shared by any number of threads.
+ * struct wmmstate = per thread evaluation state (time adjusted
+ *   coefficients and the sums over degree for the last latitude).
+ *   Never share a wmmstate between threads.
+ *
+ * typical use:
+ *   model = wmmopen("/usr/share/pmt/WMM.COF");
+ *     or emmopen("EMM2015.COF", "EMM2015SV.COF", 10.0);
+ *   state = wmmstatenew(model);      one per thread
+ *   decl = wmmdeclination(state, longitude, latitude, km, y, m, d);
+ *   wmmstatefree(state);             before wmmclose()
+ *   wmmclose(model);
+ */
+
+#ifndef PMTWMM_H
+#define PMTWMM_H
+
+#include "GeomagnetismHeader.h"
+
+#define WMMFILE "/usr/share/pmt/WMM.COF"
+
+/* wmmprecision() - arithmetic used by wmmdeclination() */
+#define WMMDOUBLE 0 /* as GeomagnetismLibrary.c, default */
+#define WMMSINGLE 1 /* float, within 0.005 degree, default if -DWMMFLOAT */
+
+struct wmmmodel; /* opaque - shared, immutable */
+struct wmmstate; /* opaque - one per thread */
+
+/* model */
+struct wmmmodel *wmmopen(char *cofname);
+struct wmmmodel *emmopen(char *cofname, char *svname, double budget);
+void wmmclose(struct wmmmodel *model);
+int wmmdegree(struct wmmmodel *model);
+
+/* per thread state */
+struct wmmstate *wmmstatenew(struct wmmmodel *model);
+void wmmstatefree(struct wmmstate *state);
+void wmmprecision(struct wmmstate *state, int precision);
+
+/* evaluation - heights above the WGS84 ellipsoid */
+int wmmpoint(struct wmmstate *state, double longitude, double latitude,
+             double heightkm, double decimalyear,
+             MAGtype_GeoMagneticElements *elements);
+int wmmbatch(struct wmmstate *state, int npoints, double *longitude,
+             double *latitude, double *heightkm, double decimalyear,
+             MAGtype_GeoMagneticElements *elements);
+int wmmgrid(struct wmmstate *state, double minlong, double minlat,
+            double step, int ncols, int nrows, double heightkm,
+            double decimalyear, MAGtype_GeoMagneticElements *elements);
+
+/* evaluation - altitude above mean sea level (gps altitude) */
+int wmmelements(struct wmmstate *state, double longitude, double latitude,
+                double altitudekm, int year, int month, int day,
+                MAGtype_GeoMagneticElements *elements);
+double wmmdeclination(struct wmmstate *state, double longitude,
+                      double latitude, double altitudekm, int year, int month,
+                      int day);
+
+#endif /* PMTWMM_H */
@@ -0,0 +1,103 @@
+/**
+ * DOC: -- pmtwmmd.h -- declination query protocol for pmtwmmd daemon
+ *  Peter Thompson Nov 2019
+ *
+ * pmtwmmd keeps one World Magnetic Model resident and answers
+ * declination, inclination and total field queries for any process
+ * on the board, so apps never link GeomagnetismLibrary.c or load
+ * WMM.COF themselves.
+ *
+ * transport: UNIX domain socket WMMSOCKET, SOCK_SEQPACKET
+ *   (message boundaries kept - 1 send() = 1 request)
+ * request:  struct wmmrequest header + count * struct wmmquery
+ * reply:    struct wmmreply header   + count * struct wmmanswer
+ *   answers are in the same order as the queries.
+ *   count is 1 to WMMMAXQUERY per message - batch as many as you can.
+ *   binary, native byte order (client and daemon run on the same board)
+ *
+ * answers come from an LRU cache keyed on the position rounded to
+ * WMMQLATLONG degrees, altitude rounded to WMMQALT meters and the date.
+ * Values are computed at the centre of the rounded cell so the same
+ * query always gets the same answer.
+ *
+ * see test/testwmmdaemon.c for an example client
+ */
+
+#ifndef PMTWMMD_H
+#define PMTWMMD_H
+
+#include <stdint.h>
+
+#define WMMSOCKET "/run/pmtwmmd.sock"
+#define WMMMAGIC 0x574d4d51 /* "WMMQ" */
+#define WMMVERSION 1
+#define WMMMAXQUERY 256 /* queries per message */
+
+/* cache quantization */
+#define WMMQLATLONG 0.01 /* degrees = 1.1 km of latitude */
+#define WMMQALT 100      /* meters */
+
+/* wmmreply.status and wmmanswer.status */
+#define WMMOK 0
+#define WMMBADREQUEST 1 /* wrong magic, version or count */
+#define WMMNOMODEL 2    /* WMM.COF missing - answers are 0.0 */
+#define WMMBADDATE 3    /* date not yyyymmdd, or outside the model */
+#define WMMBADPOSITION 4 /* latitude beyond +-90 or longitude beyond +-360 */
+
+/**
+ * struct wmmquery -- one point
+ */
+struct wmmquery {
+  double longitude; /* decimal degrees  + => East,  - => West */
+  double latitude;  /* decimal degrees  + => North, - => South */
+  float altitude;   /* meters above sea level */
+  int32_t date;     /* yyyymmdd */
+};
+
+/**
+ * struct wmmrequest -- message header from client
+ */
+struct wmmrequest {
+  uint32_t magic;   /* WMMMAGIC */
+  uint16_t version; /* WMMVERSION */
+  uint16_t count;   /* number of struct wmmquery following */
+};
+
+/**
+ * struct wmmanswer -- one result
+ */
+struct wmmanswer {
+  float declination; /* degrees, to West = negative, to East = positive */
+  float inclination; /* degrees, positive down */
+  float totalfield;  /* nT */
+  int32_t status;    /* WMMOK ... */
+};
+
+/**
+ * struct wmmreply -- message header from pmtwmmd
+ */
+struct wmmreply {
+  uint32_t magic;   /* WMMMAGIC */
+  uint16_t version; /* WMMVERSION */
+  uint16_t count;   /* number of struct wmmanswer following */
+  int32_t status;   /* WMMOK or WMMBADREQUEST */
+};
+
+/**
+ * struct wmmkey -- query rounded to a cache cell (used inside pmtwmmd)
+ *   latitude, longitude in units of WMMQLATLONG degrees
+ *   altitude in units of WMMQALT meters
+ */
+struct wmmkey {
+  int32_t latitude;
+  int32_t longitude;
+  int32_t altitude;
+  int32_t date; /* yyyymmdd */
+};
+
+#define WMMREQUESTMAX                                                          \
+  (sizeof(struct wmmrequest) + WMMMAXQUERY * sizeof(struct wmmquery))
+#define WMMREPLYMAX                                                            \
+  (sizeof(struct wmmreply) + WMMMAXQUERY * sizeof(struct wmmanswer))
+
+#endif /* PMTWMMD_H */
@@ -0,0 +1,239 @@
+/**
+ * DOC: -- gpsconfig.c -- read pmtgpsd configuration file
+ * Peter Thompson -- Nov 2019
+ *
+ * GPSCONFFILE (pmtgps.h) holds "key = value" lines, # starts a comment.
+ * The file is optional - every key has a default below, so pmtgpsd
+ * runs exactly as before without it: the last fix file, track log and
+ * NTP SHM segment are off until set.  Unknown keys go to syslog.
+ *
+ * To add a key: add a member to struct gpsconfig in pmtgps.h,
+ * its default to defaults and a line to keys[].
+ *
+ * read once, on the first call to gpsconfig()
+ */
+/* #define MAINFORTESTING /* enable/disable testing with main() below */
+
+#include <ctype.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "pmtgps.h"
+
+#define TEXT 0   /* value is a file name */
+#define NUMBER 1 /* value is a double */
+
+/**
+ * struct gpskey -- one key of the configuration file
+ */
+struct gpskey {
+  char *name;
+  int type;   /* TEXT or NUMBER */
+  int offset; /* offsetof member in struct gpsconfig */
+};
+
+static struct gpskey keys[] = {
+    {"wmmfile", TEXT, offsetof(struct gpsconfig, wmmfile)},
+    {"emmfile", TEXT, offsetof(struct gpsconfig, emmfile)},
+    {"emmsvfile", TEXT, offsetof(struct gpsconfig, emmsvfile)},
+    {"emmbudget", NUMBER, offsetof(struct gpsconfig, emmbudget)},
+    {"precision", TEXT, offsetof(struct gpsconfig, precision)},
+    {"device", TEXT, offsetof(struct gpsconfig, device)},
+    {"nmealog", TEXT, offsetof(struct gpsconfig, nmealog)},
+    {"statsinterval", NUMBER, offsetof(struct gpsconfig, statsinterval)},
+    {"routefile", TEXT, offsetof(struct gpsconfig, routefile)},
+    {"routespeed", NUMBER, offsetof(struct gpsconfig, routespeed)},
+    {"simrate", NUMBER, offsetof(struct gpsconfig, simrate)},
+    {"simscale", NUMBER, offsetof(struct gpsconfig, simscale)},
+    {"deviceretry", NUMBER, offsetof(struct gpsconfig, deviceretry)},
+    {"baud", NUMBER, offsetof(struct gpsconfig, baud)},
+    {"fixrate", NUMBER, offsetof(struct gpsconfig, fixrate)},
+    {"nmeaset", TEXT, offsetof(struct gpsconfig, nmeaset)},
+    {"lastfix", TEXT, offsetof(struct gpsconfig, lastfix)},
+    {"lastfixsave", NUMBER, offsetof(struct gpsconfig, lastfixsave)},
+    {"aiding", NUMBER, offsetof(struct gpsconfig, aiding)},
+    {"drrate", NUMBER, offsetof(struct gpsconfig, drrate)},
+    {"drblend", NUMBER, offsetof(struct gpsconfig, drblend)},
+    {"drcompass", NUMBER, offsetof(struct gpsconfig, drcompass)},
+    {"kalman", NUMBER, offsetof(struct gpsconfig, kalman)},
+    {"kalmanaccel", NUMBER, offsetof(struct gpsconfig, kalmanaccel)},
+    {"tracklog", TEXT, offsetof(struct gpsconfig, tracklog)},
+    {"tracksync", NUMBER, offsetof(struct gpsconfig, tracksync)},
+    {"fencefile", TEXT, offsetof(struct gpsconfig, fencefile)},
+    {"tripstill", NUMBER, offsetof(struct gpsconfig, tripstill)},
+    {"tripclimb", NUMBER, offsetof(struct gpsconfig, tripclimb)},
+    {"navroute", TEXT, offsetof(struct gpsconfig, navroute)},
+    {"navspeed", NUMBER, offsetof(struct gpsconfig, navspeed)},
+    {"trailfile", TEXT, offsetof(struct gpsconfig, trailfile)},
+    {"trailradius", NUMBER, offsetof(struct gpsconfig, trailradius)},
+    {"demdir", TEXT, offsetof(struct gpsconfig, demdir)},
+    {"demblend", NUMBER, offsetof(struct gpsconfig, demblend)},
+    {"tracksimplify", NUMBER, offsetof(struct gpsconfig, tracksimplify)},
+    {"ntpunit", NUMBER, offsetof(struct gpsconfig, ntpunit)},
+};
+#define NKEY (sizeof(keys) / sizeof(keys[0]))
+
+static struct gpsconfig defaults = {
+    "/usr/share/pmt/WMM.COF", /* wmmfile = WMMFILE in pmtwmm.h */
+    "",                       /* emmfile */
+    "",                       /* emmsvfile */
+    0.0,                      /* emmbudget */
+    "",                       /* precision "" => as built, see makefile */
+    "/dev/ttyS1",             /* device = Linx R4 on UART1 */
+    "/var/log/pmtgpsd-nmea.log", /* nmealog */
+    0.0,                         /* statsinterval */
+    "",                          /* routefile */
+    4.0,                         /* routespeed = walking */
+    1.0,                         /* simrate = Linx R4 */
+    1.0,                         /* simscale = real time */
+    30.0,                        /* deviceretry, Linx chip slow to start */
+    0.0,                         /* baud, receiver not configured */
+    0.0,                         /* fixrate */
+    "",                          /* nmeaset */
+    "",                          /* lastfix, not saved */
+    60.0,                        /* lastfixsave */
+    0.0,                         /* aiding, PMTK741 is MediaTek only */
+    0.0,                         /* drrate, no dead reckoning */
+    0.5,                         /* drblend */
+    0.0,                         /* drcompass */
+    0.0,                         /* kalman, raw fixes */
+    1.0,                         /* kalmanaccel, walking or paddling */
+    "",                          /* tracklog, none */
+    60.0,                        /* tracksync */
+    "",                          /* fencefile, none */
+    1.0,                         /* tripstill */
+    5.0,                         /* tripclimb */
+    "",                          /* navroute, none */
+    4.0,                         /* navspeed = walking */
+    "",                          /* trailfile, none */
+    50.0,                        /* trailradius */
+    "",                          /* demdir, none */
+    0.0,                         /* demblend, gps altitude */
+    5.0,                         /* tracksimplify */
+    -1.0,                        /* ntpunit, none */
+};
+
+static struct gpsconfig config;
+static int loaded = 0;
+
+/**
+ * trim() - remove leading and trailing blanks
+ * Return: start of trimmed string
+ */
+static char *trim(char *s) {
+  char *end;
+
+  while (isspace((unsigned char)*s))
+    s++;
+  end = s + strlen(s);
+  while (end > s && isspace((unsigned char)end[-1]))
+    *--end = '\0';
+  return s;
+}
+
+/**
+ * setkey() - store one value
+ * Return: 1 if key known, 0 otherwise
+ */
+static int setkey(char *name, char *value) {
+  char *member;
+  size_t i;
+
+  for (i = 0; i < NKEY; i++) {
+    if (strcmp(name, keys[i].name) != 0)
+      continue;
+    member = (char *)&config + keys[i].offset;
+    if (keys[i].type == NUMBER)
+      *(double *)member = atof(value);
+    else {
+      strncpy(member, value, GPSCONFNAME - 1);
+      member[GPSCONFNAME - 1] = '\0';
+    }
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * gpsconfig() - pmtgpsd configuration
+ * Return: configuration, defaults if GPSCONFFILE cannot be read
+ */
+struct gpsconfig *gpsconfig(void) {
+  char line[200], *name, *value, *hash;
+  FILE *fp;
+  int lineno = 0;
+
+  if (loaded)
+    return &config;
+  loaded = 1;
+  config = defaults;
+
+  fp = fopen(GPSCONFFILE, "r");
+  if (!fp)
+    return &config; /* optional file */
+  while (fgets(line, sizeof(line), fp)) {
+    lineno++;
+    hash = strchr(line, '#');
+    if (hash)
+      *hash = '\0';
+    name = trim(line);
+    if (*name == '\0')
+      continue;
+    value = strchr(name, '=');
+    if (value)
+      *value++ = '\0';
+    if (!value || !setkey(trim(name), trim(value)))
+      syslog(LOG_NOTICE, "%s line %d ignored: %s\n", GPSCONFFILE, lineno,
+             name);
+  }
+  fclose(fp);
+  return &config;
+}
+
+#ifdef MAINFORTESTING
+int main() {
+  struct gpsconfig *c = gpsconfig();
+
+  printf("wmmfile   = %s\n", c->wmmfile);
+  printf("emmfile   = %s\n", c->emmfile);
+  printf("emmsvfile = %s\n", c->emmsvfile);
+  printf("emmbudget = %.3f nT\n", c->emmbudget);
+  printf("precision = %s\n", c->precision);
+  printf("device    = %s\n", c->device);
+  printf("nmealog   = %s\n", c->nmealog);
+  printf("statsinterval = %.1f s\n", c->statsinterval);
+  printf("routefile = %s\n", c->routefile);
+  printf("routespeed = %.1f km/hr\n", c->routespeed);
+  printf("simrate   = %.1f Hz\n", c->simrate);
+  printf("simscale  = %.1f\n", c->simscale);
+  printf("deviceretry = %.1f s\n", c->deviceretry);
+  printf("baud      = %.0f\n", c->baud);
+  printf("fixrate   = %.1f Hz\n", c->fixrate);
+  printf("nmeaset   = %s\n", c->nmeaset);
+  printf("lastfix   = %s\n", c->lastfix);
+  printf("lastfixsave = %.1f s\n", c->lastfixsave);
+  printf("aiding    = %.0f\n", c->aiding);
+  printf("drrate    = %.1f Hz\n", c->drrate);
+  printf("drblend   = %.2f s\n", c->drblend);
+  printf("drcompass = %.0f\n", c->drcompass);
+  printf("kalman    = %.0f\n", c->kalman);
+  printf("kalmanaccel = %.2f m/s/s\n", c->kalmanaccel);
+  printf("tracklog  = %s\n", c->tracklog);
+  printf("tracksync = %.1f s\n", c->tracksync);
+  printf("fencefile = %s\n", c->fencefile);
+  printf("tripstill = %.1f km/hr\n", c->tripstill);
+  printf("tripclimb = %.1f m\n", c->tripclimb);
+  printf("navroute  = %s\n", c->navroute);
+  printf("navspeed  = %.1f km/hr\n", c->navspeed);
+  printf("trailfile = %s\n", c->trailfile);
+  printf("trailradius = %.1f m\n", c->trailradius);
+  printf("demdir    = %s\n", c->demdir);
+  printf("demblend  = %.2f\n", c->demblend);
+  printf("tracksimplify = %.1f m\n", c->tracksimplify);
+  printf("ntpunit   = %.0f\n", c->ntpunit);
+  return 0;
+}
+#endif
@@ -0,0 +1,320 @@
+/**
+ * DOC: -- gpsdem.c -- ground height from SRTM elevation tiles
+ * Peter Thompson -- Nov 2019
+ *
+ * GGA altitude is 2-3 times worse than the horizontal position, the
+ * ground under a hiker is known far better.  With pmtgpsd.conf demdir
+ * gpsdem() gives the height of a digital elevation model at a position
+ * and gpsrun.c publishes it (struct PMTgps groundmm).  The published
+ * altitude stays the gps one unless demblend is set, then it is blended
+ * toward the ground (0.8 = mostly the DEM, for a hiker on the ground,
+ * not for a plane or a paddler on a lake).
+ *
+ * tiles are SRTM .hgt files as downloaded: 1 x 1 degree named for the
+ * south west corner, e.g. N45W079.hgt, square 1201 (3") or 3601 (1")
+ * big endian int16 meters above EGM96 mean sea level (as GGA altitude),
+ * rows north to south, -32768 = no data.
+ *
+ * a tile is mapped read only the first time a fix is on it, DEMTILES
+ * stay mapped (least recently used unmapped), and a tile that is not
+ * in demdir is remembered as missing so it is not looked for again at
+ * every fix.  A lookup on the last tile is a few compares and 4 reads
+ * (bilinear interpolation), well under a microsecond once the pages
+ * are touched (see main() below).
+ */
+/* #define MAINFORTESTING /* enable/disable testing with main() below */
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pmtgps.h"
+
+#define TRUE 1
+#define FALSE 0
+#define DEMTILES 8       /* tiles mapped at once */
+#define DEMVOID (-32768) /* SRTM no data */
+
+/**
+ * struct demtile -- one 1 x 1 degree tile, mapped or missing
+ */
+struct demtile {
+  int south;        /* degrees, corner */
+  int west;
+  int n;            /* samples a side, 0 = not in demdir */
+  int16_t *height;  /* mapped file, NULL = not in demdir */
+  unsigned long used; /* lookups counter when last used */
+};
+
+static struct demtile tile[DEMTILES];
+static int ntile;
+static struct demtile *last; /* tile of the last lookup */
+static unsigned long lookups;
+static char dir[GPSCONFNAME];
+
+/**
+ * be16() - SRTM sample, big endian on disk
+ * Return: meters
+ */
+static inline int be16(const int16_t *p) {
+  const unsigned char *b = (const unsigned char *)p;
+
+  return (int16_t)(b[0] << 8 | b[1]);
+}
+
+/**
+ * demmap() - find or map the tile with this corner
+ * Return: the tile, its height NULL if not in demdir
+ */
+static struct demtile *demmap(int south, int west) {
+  char name[GPSCONFNAME + 32];
+  struct demtile *t;
+  struct stat st;
+  void *base;
+  int i, fd;
+
+  for (i = 0; i < ntile; i++)
+    if (tile[i].south == south && tile[i].west == west)
+      return &tile[i];
+
+  /* a free slot, or the least recently used */
+  if (ntile < DEMTILES)
+    t = &tile[ntile++];
+  else {
+    t = &tile[0];
+    for (i = 1; i < DEMTILES; i++)
+      if (tile[i].used < t->used)
+        t = &tile[i];
+    if (t->height)
+      munmap(t->height, (size_t)t->n * t->n * 2);
+  }
+  t->south = south;
+  t->west = west;
+  t->n = 0;
+  t->height = NULL;
+
+  snprintf(name, sizeof(name), "%s/%c%02d%c%03d.hgt", dir,
+           south >= 0 ? 'N' : 'S', abs(south), west >= 0 ? 'E' : 'W',
+           abs(west));
+  fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return t; /* missing, remembered */
+  fstat(fd, &st);
+  if (st.st_size == 1201 * 1201 * 2)
+    t->n = 1201;
+  else if (st.st_size == 3601 * 3601 * 2)
+    t->n = 3601;
+  else {
+    syslog(LOG_NOTICE, "elevation tile %s is not SRTM 1201 or 3601", name);
+    close(fd);
+    return t;
+  }
+  base = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    syslog(LOG_NOTICE, "elevation tile %s mmap error = %m", name);
+    t->n = 0;
+    return t;
+  }
+  madvise(base, st.st_size, MADV_RANDOM); /* a fix needs 2 rows */
+  t->height = base;
+  syslog(LOG_INFO, "elevation tile %s, %d x %d", name, t->n, t->n);
+  return t;
+}
+
+/**
+ * gpsdem() - ground height at a position
+ * @longitude, latitude  decimal degrees
+ * Return: meters above mean sea level, NAN if no tile (or no data)
+ */
+double gpsdem(double longitude, double latitude) {
+  struct demtile *t;
+  const int16_t *p;
+  double x, y, fx, fy, w[4], sum, weight;
+  int south, west, row, col, h[4], i;
+
+  if (dir[0] == '\0')
+    return NAN;
+  south = (int)floor(latitude);
+  west = (int)floor(longitude);
+  t = last;
+  if (!t || t->south != south || t->west != west)
+    last = t = demmap(south, west);
+  t->used = ++lookups;
+  if (!t->height)
+    return NAN;
+
+  y = (south + 1 - latitude) * (t->n - 1); /* rows from the north edge */
+  x = (longitude - west) * (t->n - 1);
+  row = (int)y;
+  col = (int)x;
+  if (row > t->n - 2)
+    row = t->n - 2;
+  if (col > t->n - 2)
+    col = t->n - 2;
+  fy = y - row;
+  fx = x - col;
+  p = t->height + (size_t)row * t->n + col;
+  h[0] = be16(p);
+  h[1] = be16(p + 1);
+  h[2] = be16(p + t->n);
+  h[3] = be16(p + t->n + 1);
+  w[0] = (1.0 - fx) * (1.0 - fy);
+  w[1] = fx * (1.0 - fy);
+  w[2] = (1.0 - fx) * fy;
+  w[3] = fx * fy;
+  if (h[0] != DEMVOID && h[1] != DEMVOID && h[2] != DEMVOID &&
+      h[3] != DEMVOID)
+    return w[0] * h[0] + w[1] * h[1] + w[2] * h[2] + w[3] * h[3];
+
+  /* no data at some corners: the others, weighted the same way */
+  sum = weight = 0.0;
+  for (i = 0; i < 4; i++)
+    if (h[i] != DEMVOID) {
+      sum += w[i] * h[i];
+      weight += w[i];
+    }
+  return weight > 0.0 ? sum / weight : NAN;
+}
+
+/**
+ * gpsdemopen() - where the elevation tiles are
+ * @directory  pmtgpsd.conf demdir, "" => no ground height
+ * Return: TRUE if there is a demdir
+ */
+int gpsdemopen(char *directory) {
+  struct stat st;
+
+  dir[0] = '\0';
+  if (directory[0] == '\0')
+    return FALSE;
+  if (stat(directory, &st) < 0 || !S_ISDIR(st.st_mode)) {
+    syslog(LOG_NOTICE, "elevation tiles %s error = %m", directory);
+    return FALSE;
+  }
+  snprintf(dir, sizeof(dir), "%s", directory);
+  return TRUE;
+}
+
+/**
+ * gpsdemclose() - unmap the tiles
+ * Return: nothing
+ */
+void gpsdemclose(void) {
+  int i;
+
+  for (i = 0; i < ntile; i++)
+    if (tile[i].height)
+      munmap(tile[i].height, (size_t)tile[i].n * tile[i].n * 2);
+  ntile = 0;
+  last = NULL;
+  dir[0] = '\0';
+}
+
+#ifdef MAINFORTESTING
+/*
+ * benchmark: a made up 1" tile N45W079.hgt in /tmp (a tilted plane, so
+ * bilinear interpolation must give it back exactly, with a hole of no
+ * data), then random lookups on it and a walk East off it onto a tile
+ * that is not there (remembered missing, no open() per lookup).
+ * gcc -O2 gpsdem.c -I../../include -lm
+ */
+#define NLOOKUP 10000000
+
+static double now(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* plane: 1000 m + 1 m per sample East - 1 m per sample South */
+static void maketile(char *name) {
+  static unsigned char row[3601 * 2];
+  FILE *fp;
+  int r, c, h;
+
+  fp = fopen(name, "wb");
+  for (r = 0; r < 3601; r++) {
+    for (c = 0; c < 3601; c++) {
+      h = 1000 + c - r;
+      if (r >= 1000 && r < 1010 && c >= 1000 && c < 1010)
+        h = DEMVOID;
+      row[2 * c] = (unsigned char)(h >> 8);
+      row[2 * c + 1] = (unsigned char)h;
+    }
+    fwrite(row, 1, sizeof(row), fp);
+  }
+  fclose(fp);
+}
+
+int main() {
+  double t, first, warm, walk, longitude, latitude, h, worst, sum;
+  int i, voids, missing;
+
+  maketile("/tmp/N45W079.hgt");
+  gpsdemopen("/tmp");
+
+  t = now();
+  h = gpsdem(-78.5, 45.5);
+  first = now() - t;
+
+  /* exact on the plane, away from the hole */
+  worst = 0.0;
+  voids = 0;
+  srand(1);
+  for (i = 0; i < 1000000; i++) {
+    longitude = -79.0 + rand() / (RAND_MAX + 1.0);
+    latitude = 45.0 + rand() / (RAND_MAX + 1.0);
+    h = gpsdem(longitude, latitude);
+    if (isnan(h)) {
+      voids++;
+      continue;
+    }
+    h -= 1000.0 + (longitude + 79.0) * 3600.0 - (46.0 - latitude) * 3600.0;
+    if (fabs(latitude - 45.72) < 0.01 && fabs(longitude + 78.72) < 0.01)
+      continue; /* next to the hole */
+    if (fabs(h) > worst)
+      worst = fabs(h);
+  }
+
+  /* warm: random lookups on the tile, every page touched by now */
+  sum = 0.0;
+  t = now();
+  for (i = 0; i < NLOOKUP; i++) {
+    h = gpsdem(-79.0 + (i % 9973) / 9973.0, 45.0 + (i % 9967) / 9967.0);
+    if (!isnan(h))
+      sum += h;
+  }
+  warm = (now() - t) / NLOOKUP;
+
+  /* 0.4 cm steps East, off the tile at -78 */
+  missing = 0;
+  t = now();
+  for (i = 0; i < NLOOKUP; i++) {
+    h = gpsdem(-78.3 + i * 5e-8, 45.5);
+    if (isnan(h))
+      missing++;
+    else
+      sum += h;
+  }
+  walk = (now() - t) / NLOOKUP;
+
+  printf("first lookup (maps the tile) %.0f us, then %.0f ns random, "
+         "%.0f ns walking (%d%% off the tiles)\n",
+         first * 1e6, warm * 1e9, walk * 1e9, missing / (NLOOKUP / 100));
+  printf("plane error %.2g m, %d lookups all no data, checksum %.0f\n",
+         worst, voids, sum);
+  gpsdemclose();
+  unlink("/tmp/N45W079.hgt");
+  return 0;
+}
+#endif
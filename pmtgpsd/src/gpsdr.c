@@ -0,0 +1,288 @@
+/**
+ * DOC: -- gpsdr.c -- dead reckoning between gps fixes
+ * Peter Thompson -- Nov 2019
+ *
+ * the Linx R4 gives a fix once a second, so a map drawn from
+ * /dev/shm/pmtgps moves in steps.  With pmtgpsd.conf drrate > 0 a
+ * thread here wakes drrate times a second and moves the last fix on by
+ *   distance = speed * (now - time the fix arrived)
+ *   along     the fix's gps track, or with drcompass = 1 the pmtfxosd
+ *             compass heading (/dev/shm/pmtfxos, magnetic + declination)
+ * and writes it with an uncertainty estimate to /dev/shm/pmtgpsdr
+ * (struct PMTgpsdr in pmtgps.h).
+ *
+ * when the next fix comes the prediction is usually a few meters off.
+ * Instead of jumping, the difference is kept and blended out over
+ * drblend seconds: output = new fix moved on + difference * e^(-t/drblend)
+ *
+ * uncertainty, 1 sigma meters, grows with the time since the fix:
+ *   sqrt(FIXERROR^2 + (SPEEDERROR * age)^2 + (distance * HEADINGERROR)^2)
+ * after DRMAXAGE seconds without a fix prediction stops (DRHOLD).
+ *
+ * the compass is read here for gpsnav.c too, gpsdrcompass(): one
+ * mapping of /dev/shm/pmtfxos for pmtgpsd, with or without drrate.
+ */
+
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pmtfxos.h"
+#include "pmtgps.h"
+
+#define TRUE 1
+#define FALSE 0
+#define FXOSNAME "/pmtfxos"  /* as pmtfxosd/src/fxos8700run.c */
+#define EARTHRADIUS 6371000.0 /* meters, mean */
+#define DEG2RAD(x) ((x) * M_PI / 180.0)
+#define RAD2DEG(x) ((x) * 180.0 / M_PI)
+#define DRMAXAGE 5.0      /* seconds without a fix before DRHOLD */
+#define DRMAXJUMP 50.0    /* meters, a bigger jump is not blended */
+#define FIXERROR 5.0      /* meters, 1 sigma of a fix */
+#define SPEEDERROR 0.3    /* m/s, 1 sigma of the gps speed */
+#define HEADINGERROR 0.17 /* radians (10 degrees), track or compass */
+
+/* Function Prototypes */
+struct gpsconfig *gpsconfig(void);
+double gpsclock(void);
+
+static struct PMTgpsdr *drnow; /* shared memory, NULL if not open */
+static struct PMTfxos *fxos;   /* compass, NULL until pmtfxosd runs */
+static pthread_mutex_t fxoslock = PTHREAD_MUTEX_INITIALIZER; /* maps fxos */
+static unsigned int updates;   /* struct PMTgpsdr begin/end */
+static pthread_t thread;
+static volatile int stopping;
+static double period, blend;
+static int compass;
+
+/* last fix and the jump at it, shared with the thread */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct linxdata fix;
+static int havefix;
+static double jumplong, jumplat; /* prediction - fix when it came */
+
+/**
+ * gpsdrcompass() - pmtfxosd heading, opened the first time it is there
+ * @declination  degrees, magnetic => True
+ *
+ * called from the dead reckoning thread and from gpsnav.c in the main
+ * loop, so the first mapping is made under fxoslock.
+ * Return: degrees True, or -1.0 if no compass (or device not flat)
+ */
+double gpsdrcompass(double declination) {
+  struct PMTfxos *now;
+  void *base;
+  int fd;
+
+  pthread_mutex_lock(&fxoslock);
+  if (!fxos) {
+    fd = shm_open(FXOSNAME, O_RDONLY, 0600);
+    if (fd >= 0) {
+      base = mmap(0, sizeof(struct PMTfxos), PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+      if (base != MAP_FAILED)
+        fxos = base;
+    }
+  }
+  now = fxos;
+  pthread_mutex_unlock(&fxoslock);
+  if (!now || now->diefaceup != 1 || now->heading < 0)
+    return -1.0; /* heading only with dieface 1 up */
+  return fmod(now->heading + declination + 360.0, 360.0);
+}
+
+/**
+ * predict() - move a fix on along a heading
+ * @f        fix
+ * @t        gpsclock() to predict for
+ * @dr       output: position, heading, source, age and uncertainty
+ * Return: nothing
+ */
+static void predict(struct linxdata *f, double t, struct PMTgpsdr *dr) {
+  double age, distance, heading, north, east;
+
+  age = t - f->received;
+  dr->source = DRTRACK;
+  if (age > DRMAXAGE) {
+    age = DRMAXAGE;
+    dr->source = DRHOLD;
+  }
+  heading = f->track;
+  if (f->speed < GPSMINSPEED) {
+    distance = 0.0;
+    if (dr->source != DRHOLD)
+      dr->source = DRFIX;
+  } else {
+    distance = f->speed / 3.6 * (age > 0.0 ? age : 0.0);
+    if (compass && (heading = gpsdrcompass(f->declination)) >= 0.0) {
+      if (dr->source != DRHOLD)
+        dr->source = DRCOMPASS;
+    } else
+      heading = f->track;
+  }
+
+  north = distance * cos(DEG2RAD(heading));
+  east = distance * sin(DEG2RAD(heading));
+  dr->latitude = f->latitude + RAD2DEG(north / EARTHRADIUS);
+  dr->longitude = f->longitude + RAD2DEG(east / EARTHRADIUS) /
+                                     cos(DEG2RAD(f->latitude));
+  if (dr->longitude > 180.0)
+    dr->longitude -= 360.0;
+  else if (dr->longitude < -180.0)
+    dr->longitude += 360.0;
+  dr->heading = heading;
+  dr->age = t - f->received;
+  dr->uncertainty = sqrt(FIXERROR * FIXERROR +
+                         SPEEDERROR * SPEEDERROR * age * age +
+                         distance * distance * HEADINGERROR * HEADINGERROR);
+}
+
+/**
+ * publish() - write the prediction for now to /dev/shm/pmtgpsdr
+ * Return: nothing
+ */
+static void publish(void) {
+  struct PMTgpsdr dr;
+  double t, fade;
+
+  memset(&dr, 0, sizeof(dr));
+  pthread_mutex_lock(&lock);
+  if (havefix) {
+    t = gpsclock();
+    predict(&fix, t, &dr);
+    fade = blend > 0.0 ? exp(-(t - fix.received) / blend) : 0.0;
+    dr.longitude += jumplong * fade;
+    dr.latitude += jumplat * fade;
+    dr.altitude = fix.altitude;
+    dr.speed = fix.speed;
+    dr.date = fix.date;
+    dr.gmt = fix.gmt;
+  }
+  pthread_mutex_unlock(&lock);
+
+  dr.begin = ++updates;
+  dr.end = drnow->end; /* still the last update while copying */
+  drnow->begin = dr.begin;
+  __sync_synchronize();
+  *drnow = dr;
+  __sync_synchronize();
+  drnow->end = updates;
+}
+
+/**
+ * drloop() - the dead reckoning thread, publish() every period seconds
+ * Return: NULL when gpsdrclose() sets stopping
+ */
+static void *drloop(void *unused) {
+  struct timespec next;
+  long step;
+
+  step = (long)(period * 1e9);
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (!stopping) {
+    publish();
+    next.tv_nsec += step % 1000000000;
+    next.tv_sec += step / 1000000000 + next.tv_nsec / 1000000000;
+    next.tv_nsec %= 1000000000;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+  return NULL;
+}
+
+/**
+ * gpsdropen() - create /dev/shm/pmtgpsdr and start the thread, if
+ *  pmtgpsd.conf drrate > 0
+ * Return: TRUE if running
+ */
+int gpsdropen(void) {
+  struct gpsconfig *conf;
+  int fd;
+
+  conf = gpsconfig();
+  if (conf->drrate <= 0.0)
+    return FALSE;
+  period = 1.0 / (conf->drrate > 100.0 ? 100.0 : conf->drrate);
+  blend = conf->drblend;
+  compass = conf->drcompass > 0.0;
+
+  fd = shm_open(DRNAME, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    syslog(LOG_NOTICE, "shm_open %s error = %m", DRNAME);
+    return FALSE;
+  }
+  ftruncate(fd, sizeof(struct PMTgpsdr));
+  drnow = mmap(0, sizeof(struct PMTgpsdr), PROT_READ | PROT_WRITE,
+               MAP_SHARED, fd, 0);
+  close(fd);
+  if (drnow == MAP_FAILED) {
+    drnow = NULL;
+    shm_unlink(DRNAME);
+    return FALSE;
+  }
+  memset(drnow, 0, sizeof(struct PMTgpsdr));
+  stopping = FALSE;
+  if (pthread_create(&thread, NULL, drloop, NULL) != 0) {
+    syslog(LOG_NOTICE, "gpsdropen(): no dead reckoning thread");
+    munmap(drnow, sizeof(struct PMTgpsdr));
+    shm_unlink(DRNAME);
+    drnow = NULL;
+    return FALSE;
+  }
+  syslog(LOG_INFO, "dead reckoning %.1f times a second", 1.0 / period);
+  return TRUE;
+}
+
+/**
+ * gpsdrfix() - a new fix to predict from
+ * @linx  fix, received = gpsclock() it arrived
+ * Return: nothing
+ */
+void gpsdrfix(struct linxdata *linx) {
+  struct PMTgpsdr dr;
+  double north, east, fade;
+
+  if (!drnow)
+    return;
+  pthread_mutex_lock(&lock);
+  if (havefix) {
+    /* where we were shown as the fix came, blended into the new fix */
+    predict(&fix, linx->received, &dr);
+    fade = blend > 0.0 ? exp(-(linx->received - fix.received) / blend) : 0.0;
+    dr.longitude += jumplong * fade;
+    dr.latitude += jumplat * fade;
+    north = DEG2RAD(dr.latitude - linx->latitude) * EARTHRADIUS;
+    east = DEG2RAD(dr.longitude - linx->longitude) * EARTHRADIUS *
+           cos(DEG2RAD(linx->latitude));
+    jumplong = jumplat = 0.0;
+    if (sqrt(north * north + east * east) < DRMAXJUMP) {
+      jumplong = dr.longitude - linx->longitude;
+      jumplat = dr.latitude - linx->latitude;
+    }
+  }
+  fix = *linx;
+  havefix = TRUE;
+  pthread_mutex_unlock(&lock);
+}
+
+/**
+ * gpsdrclose() - stop the thread, remove /dev/shm/pmtgpsdr, unmap the
+ *  compass
+ * Return: nothing
+ */
+void gpsdrclose(void) {
+  if (drnow) {
+    stopping = TRUE;
+    pthread_join(thread, NULL);
+    munmap(drnow, sizeof(struct PMTgpsdr));
+    shm_unlink(DRNAME);
+    drnow = NULL;
+  }
+  if (fxos) /* mapped for gpsnav.c too, without drrate */
+    munmap(fxos, sizeof(struct PMTfxos));
+  fxos = NULL;
+}
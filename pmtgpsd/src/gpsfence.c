@@ -0,0 +1,559 @@
+/**
+ * DOC: -- gpsfence.c -- geofences: enter and exit events on every fix
+ * Peter Thompson -- Nov 2019
+ *
+ * with pmtgpsd.conf fencefile every fix is checked against the polygons
+ * in the file (campsites, hazard zones, map sheets ...) and each time
+ * the fix goes into or out of one an event goes to the ring on
+ * /dev/shm/pmtgpsfence (struct PMTgpsfence in pmtgps.h), see
+ * test/testgpsfence.c.
+ *
+ * fence file - # starts a comment, blanks or commas between values
+ *     fence name
+ *     longitude latitude
+ *     longitude latitude     3 or more points, decimal degrees
+ *     ...
+ *     fence next-name ...
+ *   the polygon closes itself, it must not cross longitude 180.
+ *
+ * a fix is not tested against every polygon: the fences' bounding boxes
+ * are put in a grid of about 1 cell per fence over the area they cover.
+ * A fix looks up its cell and tests only the fences whose box overlaps
+ * it, box first, then point in polygon (crossing count).  10000 fences
+ * cost ~100 ns a fix instead of ~50 us, see main() below.
+ *
+ * the file's modification time is checked every FENCECHECK seconds and
+ * a changed file is loaded into a new grid.  Fences with the same name
+ * keep their inside/outside state, so a reload only gives events for
+ * fences removed while inside (exit) or added around the fix (enter).
+ */
+/* #define MAINFORTESTING /* enable/disable testing with main() below */
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pmtgps.h"
+
+#define TRUE 1
+#define FALSE 0
+#define FENCECHECK 5.0 /* seconds between fence file checks */
+#define GRIDMAX 512    /* cells each way */
+
+/**
+ * struct fence -- one polygon
+ */
+struct fence {
+  char name[FENCELABEL];
+  int first, n;             /* its points in fenceset point[] */
+  double minlong, maxlong;  /* bounding box, decimal degrees */
+  double minlat, maxlat;
+};
+
+/**
+ * struct fencepoint -- one corner of a polygon
+ */
+struct fencepoint {
+  double longitude, latitude; /* decimal degrees */
+};
+
+/**
+ * struct fenceset -- every fence in the file and the grid over them
+ */
+struct fenceset {
+  struct fence *fence;
+  int nfence;
+  struct fencepoint *point;
+  int npoint;
+  char *inside;              /* per fence, TRUE if the last fix was in it */
+  unsigned int *stamp;       /* per fence, fixes when the fix was in it */
+  unsigned int fixes;        /* fixes checked */
+  int *insidelist;           /* the fences inside is TRUE for */
+  int ninside;
+  int nx, ny;                /* grid cells */
+  double minlong, minlat;    /* grid corner */
+  double cellwidth, cellheight; /* degrees */
+  int *cellstart;            /* nx*ny+1, fences of cell c are */
+  int *cellfence;            /*   cellfence[cellstart[c] ...] */
+};
+
+static struct fenceset *fences;   /* NULL if no fence file */
+static struct PMTgpsfence *fencenow; /* shared memory, NULL if not open */
+static char fencefile[GPSCONFNAME];
+static time_t fencetime;  /* fence file modification time loaded */
+static double lastcheck;  /* received of the last file check */
+
+/**
+ * fencefree() - free a fence set
+ * Return: nothing
+ */
+static void fencefree(struct fenceset *set) {
+  if (!set)
+    return;
+  free(set->fence);
+  free(set->point);
+  free(set->inside);
+  free(set->stamp);
+  free(set->insidelist);
+  free(set->cellstart);
+  free(set->cellfence);
+  free(set);
+}
+
+/**
+ * cellrange() - grid cells a bounding box covers
+ * Return: nothing, x0..x1 and y0..y1 are set
+ */
+static void cellrange(struct fenceset *set, struct fence *f, int *x0,
+                      int *x1, int *y0, int *y1) {
+  *x0 = (int)((f->minlong - set->minlong) / set->cellwidth);
+  *x1 = (int)((f->maxlong - set->minlong) / set->cellwidth);
+  *y0 = (int)((f->minlat - set->minlat) / set->cellheight);
+  *y1 = (int)((f->maxlat - set->minlat) / set->cellheight);
+  if (*x1 >= set->nx)
+    *x1 = set->nx - 1;
+  if (*y1 >= set->ny)
+    *y1 = set->ny - 1;
+}
+
+/**
+ * fencegrid() - put every fence's bounding box in the grid
+ * Return: TRUE if ok, FALSE if out of memory
+ */
+static int fencegrid(struct fenceset *set) {
+  double maxlong, maxlat;
+  int i, x, y, x0, x1, y0, y1, side, total;
+
+  set->minlong = set->minlat = 1000.0;
+  maxlong = maxlat = -1000.0;
+  for (i = 0; i < set->nfence; i++) {
+    set->minlong = fmin(set->minlong, set->fence[i].minlong);
+    set->minlat = fmin(set->minlat, set->fence[i].minlat);
+    maxlong = fmax(maxlong, set->fence[i].maxlong);
+    maxlat = fmax(maxlat, set->fence[i].maxlat);
+  }
+  side = (int)ceil(sqrt((double)set->nfence));
+  set->nx = set->ny = side < 1 ? 1 : side > GRIDMAX ? GRIDMAX : side;
+  set->cellwidth = (maxlong - set->minlong) / set->nx + 1e-9;
+  set->cellheight = (maxlat - set->minlat) / set->ny + 1e-9;
+
+  /* count the fences in each cell, then fill them in */
+  set->cellstart = calloc(set->nx * set->ny + 1, sizeof(int));
+  if (!set->cellstart)
+    return FALSE;
+  total = 0;
+  for (i = 0; i < set->nfence; i++) {
+    cellrange(set, &set->fence[i], &x0, &x1, &y0, &y1);
+    for (y = y0; y <= y1; y++)
+      for (x = x0; x <= x1; x++)
+        set->cellstart[y * set->nx + x + 1]++;
+    total += (x1 - x0 + 1) * (y1 - y0 + 1);
+  }
+  for (i = 1; i <= set->nx * set->ny; i++)
+    set->cellstart[i] += set->cellstart[i - 1];
+  set->cellfence = malloc((total + 1) * sizeof(int));
+  if (!set->cellfence)
+    return FALSE;
+  for (i = 0; i < set->nfence; i++) {
+    cellrange(set, &set->fence[i], &x0, &x1, &y0, &y1);
+    for (y = y0; y <= y1; y++)
+      for (x = x0; x <= x1; x++)
+        set->cellfence[set->cellstart[y * set->nx + x]++] = i;
+  }
+  for (i = set->nx * set->ny; i > 0; i--) /* filling moved starts on 1 */
+    set->cellstart[i] = set->cellstart[i - 1];
+  set->cellstart[0] = 0;
+  return TRUE;
+}
+
+/**
+ * fenceload() - read a fence file and build its grid
+ * @name  fence file
+ * Return: the fences, NULL if none could be loaded
+ */
+static struct fenceset *fenceload(char *name) {
+  struct fenceset *set;
+  struct fence *f;
+  struct fencepoint p;
+  char line[200], label[FENCELABEL], *c;
+  FILE *fp;
+  void *grown;
+  int maxfence, maxpoint;
+
+  fp = fopen(name, "r");
+  if (!fp) {
+    syslog(LOG_NOTICE, "fence file %s error = %m", name);
+    return NULL;
+  }
+  set = calloc(1, sizeof(struct fenceset));
+  maxfence = maxpoint = 0;
+  f = NULL;
+  while (set && fgets(line, sizeof(line), fp)) {
+    c = strchr(line, '#');
+    if (c)
+      *c = '\0';
+    for (c = line; *c; c++)
+      if (*c == ',')
+        *c = ' ';
+    if (sscanf(line, " fence %31s", label) == 1) {
+      if (f && f->n < 3) /* not a polygon, reuse it */
+        set->nfence--;
+      if (set->nfence == maxfence) {
+        maxfence = maxfence ? 2 * maxfence : 64;
+        grown = realloc(set->fence, maxfence * sizeof(struct fence));
+        if (!grown) {
+          fencefree(set); /* the old block is still set->fence */
+          set = NULL;
+          break;
+        }
+        set->fence = grown;
+      }
+      f = &set->fence[set->nfence++];
+      strcpy(f->name, label);
+      f->first = set->npoint;
+      f->n = 0;
+      f->minlong = f->minlat = 1000.0;
+      f->maxlong = f->maxlat = -1000.0;
+      continue;
+    }
+    if (!f || sscanf(line, "%lf %lf", &p.longitude, &p.latitude) != 2)
+      continue;
+    if (set->npoint == maxpoint) {
+      maxpoint = maxpoint ? 2 * maxpoint : 1024;
+      grown = realloc(set->point, maxpoint * sizeof(struct fencepoint));
+      if (!grown) {
+        fencefree(set);
+        set = NULL;
+        break;
+      }
+      set->point = grown;
+    }
+    set->point[set->npoint++] = p;
+    f->n++;
+    f->minlong = fmin(f->minlong, p.longitude);
+    f->maxlong = fmax(f->maxlong, p.longitude);
+    f->minlat = fmin(f->minlat, p.latitude);
+    f->maxlat = fmax(f->maxlat, p.latitude);
+  }
+  fclose(fp);
+  if (!set) {
+    syslog(LOG_NOTICE, "fence file %s: out of memory", name);
+    return NULL;
+  }
+  if (f && f->n < 3)
+    set->nfence--;
+
+  if (set->nfence == 0 || !set->fence || !set->point) {
+    syslog(LOG_NOTICE, "fence file %s has no fences", name);
+    fencefree(set);
+    return NULL;
+  }
+  set->inside = calloc(set->nfence, 1);
+  set->stamp = calloc(set->nfence, sizeof(unsigned int));
+  set->insidelist = malloc(set->nfence * sizeof(int));
+  if (!set->inside || !set->stamp || !set->insidelist || !fencegrid(set)) {
+    syslog(LOG_NOTICE, "fence file %s: out of memory", name);
+    fencefree(set);
+    return NULL;
+  }
+  return set;
+}
+
+/**
+ * insidefence() - point in polygon, counting edges crossed going East
+ * Return: TRUE if inside
+ */
+static int insidefence(struct fenceset *set, struct fence *f,
+                       double longitude, double latitude) {
+  struct fencepoint *p, *a, *b;
+  int i, in;
+
+  if (longitude < f->minlong || longitude > f->maxlong ||
+      latitude < f->minlat || latitude > f->maxlat)
+    return FALSE;
+  p = set->point + f->first;
+  in = FALSE;
+  for (i = 0; i < f->n; i++) {
+    a = &p[i];
+    b = &p[i ? i - 1 : f->n - 1];
+    if ((a->latitude > latitude) != (b->latitude > latitude) &&
+        longitude < a->longitude + (latitude - a->latitude) *
+                                       (b->longitude - a->longitude) /
+                                       (b->latitude - a->latitude))
+      in = !in;
+  }
+  return in;
+}
+
+/**
+ * fenceevent() - add an event to the ring on /dev/shm/pmtgpsfence
+ * Return: nothing
+ */
+static void fenceevent(int type, int n, struct fence *f,
+                       struct linxdata *linx) {
+  struct fenceevent *ev;
+  unsigned int number;
+
+  syslog(LOG_INFO, "fence %s %s", type == FENCEENTER ? "enter" : "exit",
+         f->name);
+  if (!fencenow)
+    return;
+  number = fencenow->events + 1;
+  ev = &fencenow->ring[(number - 1) % FENCERING];
+  ev->number = 0; /* readers skip it while it changes */
+  __sync_synchronize();
+  ev->type = type;
+  ev->fence = n;
+  memcpy(ev->name, f->name, FENCELABEL);
+  ev->date = linx ? linx->date : 0;
+  ev->gmt = linx ? linx->gmt : 0;
+  ev->longitude = linx ? linx->longitude : 0.0;
+  ev->latitude = linx ? linx->latitude : 0.0;
+  __sync_synchronize();
+  ev->number = number;
+  __sync_synchronize();
+  fencenow->events = number;
+}
+
+/**
+ * fencecheck() - evaluate a fix against a fence set, with events
+ * @set   fences
+ * @linx  fix
+ * Return: number of events
+ *
+ * only the fences listed in the fix's cell and the ones it was inside
+ * are looked at, not all of them
+ */
+static int fencecheck(struct fenceset *set, struct linxdata *linx) {
+  int i, x, y, c, n, events;
+
+  set->fixes++;
+  events = 0;
+  x = (int)floor((linx->longitude - set->minlong) / set->cellwidth);
+  y = (int)floor((linx->latitude - set->minlat) / set->cellheight);
+  if (x >= 0 && x < set->nx && y >= 0 && y < set->ny) {
+    c = y * set->nx + x;
+    for (i = set->cellstart[c]; i < set->cellstart[c + 1]; i++) {
+      n = set->cellfence[i];
+      if (!insidefence(set, &set->fence[n], linx->longitude, linx->latitude))
+        continue;
+      set->stamp[n] = set->fixes;
+      if (!set->inside[n]) {
+        set->inside[n] = TRUE;
+        set->insidelist[set->ninside++] = n;
+        fenceevent(FENCEENTER, n, &set->fence[n], linx);
+        events++;
+      }
+    }
+  }
+
+  /* inside last fix, not this one */
+  for (i = 0; i < set->ninside; i++) {
+    n = set->insidelist[i];
+    if (set->stamp[n] == set->fixes)
+      continue;
+    set->inside[n] = FALSE;
+    set->insidelist[i--] = set->insidelist[--set->ninside];
+    fenceevent(FENCEEXIT, n, &set->fence[n], linx);
+    events++;
+  }
+  return events;
+}
+
+/**
+ * fencecarry() - keep the inside state of fences still in a new set
+ * @old  fences before the reload
+ * @set  fences just loaded
+ * @linx last fix, for the exit events of fences removed
+ * Return: nothing
+ */
+static void fencecarry(struct fenceset *old, struct fenceset *set,
+                       struct linxdata *linx) {
+  int i, j, n;
+
+  for (i = 0; i < old->ninside; i++) {
+    n = old->insidelist[i];
+    for (j = 0; j < set->nfence; j++)
+      if (!set->inside[j] && strcmp(set->fence[j].name, old->fence[n].name) == 0)
+        break;
+    if (j < set->nfence) {
+      set->inside[j] = TRUE;
+      set->insidelist[set->ninside++] = j;
+    } else
+      fenceevent(FENCEEXIT, n, &old->fence[n], linx);
+  }
+}
+
+/**
+ * gpsfenceopen() - load the fence file, create /dev/shm/pmtgpsfence
+ * @name  pmtgpsd.conf fencefile, "" => no fences
+ * Return: number of fences, 0 if none
+ */
+int gpsfenceopen(char *name) {
+  struct stat st;
+  int fd;
+
+  if (name[0] == '\0')
+    return 0;
+  strncpy(fencefile, name, GPSCONFNAME - 1);
+  if (stat(fencefile, &st) == 0)
+    fencetime = st.st_mtime;
+  fences = fenceload(fencefile);
+
+  fd = shm_open(FENCENAME, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    syslog(LOG_NOTICE, "shm_open %s error = %m", FENCENAME);
+  } else {
+    ftruncate(fd, sizeof(struct PMTgpsfence));
+    fencenow = mmap(0, sizeof(struct PMTgpsfence), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+    close(fd);
+    if (fencenow == MAP_FAILED) {
+      fencenow = NULL;
+      shm_unlink(FENCENAME);
+    } else
+      memset(fencenow, 0, sizeof(struct PMTgpsfence));
+  }
+  if (fencenow)
+    fencenow->fences = fences ? fences->nfence : 0;
+  if (fences)
+    syslog(LOG_INFO, "%d fences from %s, %dx%d grid", fences->nfence,
+           fencefile, fences->nx, fences->ny);
+  return fences ? fences->nfence : 0;
+}
+
+/**
+ * gpsfencefix() - check a fix against the fences, reload a changed file
+ * @linx  fix, received = gpsclock() it arrived
+ * Return: number of enter and exit events
+ */
+int gpsfencefix(struct linxdata *linx) {
+  struct fenceset *set;
+  struct stat st;
+
+  if (fencefile[0] == '\0')
+    return 0;
+  if (linx->received - lastcheck >= FENCECHECK) {
+    lastcheck = linx->received;
+    if (stat(fencefile, &st) == 0 && st.st_mtime != fencetime) {
+      fencetime = st.st_mtime;
+      set = fenceload(fencefile);
+      if (set && fences)
+        fencecarry(fences, set, linx);
+      if (set || !fences) {
+        fencefree(fences);
+        fences = set;
+      }
+      if (fencenow) {
+        fencenow->fences = fences ? fences->nfence : 0;
+        fencenow->reloads++;
+      }
+      syslog(LOG_INFO, "%d fences reloaded from %s",
+             fences ? fences->nfence : 0, fencefile);
+    }
+  }
+  return fences ? fencecheck(fences, linx) : 0;
+}
+
+/**
+ * gpsfenceclose() - free the fences, remove /dev/shm/pmtgpsfence
+ * Return: nothing
+ */
+void gpsfenceclose(void) {
+  fencefree(fences);
+  fences = NULL;
+  fencefile[0] = '\0';
+  if (!fencenow)
+    return;
+  munmap(fencenow, sizeof(struct PMTgpsfence));
+  shm_unlink(FENCENAME);
+  fencenow = NULL;
+}
+
+#ifdef MAINFORTESTING
+/*
+ * benchmark: 10000 random fences (8-16 corners, 50-500 m) over 1 x 1
+ * degree near Percy Lake, 1000000 random fixes, grid vs testing every
+ * fence.  gcc -O2 gpsfence.c -I../../include -lm -lrt
+ */
+#define NFENCE 10000
+#define NFIX 1000000
+
+static double seconds(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int main() {
+  struct linxdata fix;
+  double t, x, y, r, a, grid, brute;
+  long events, hits, checks;
+  FILE *fp;
+  int i, j, n;
+
+  srand(1);
+  fp = fopen("/tmp/gpsfence.test", "w");
+  for (i = 0; i < NFENCE; i++) {
+    fprintf(fp, "fence f%d\n", i);
+    x = -78.9 + rand() / (double)RAND_MAX;
+    y = 44.7 + rand() / (double)RAND_MAX;
+    r = (50.0 + 450.0 * rand() / (double)RAND_MAX) / 111000.0;
+    n = 8 + rand() % 9;
+    for (j = 0; j < n; j++) {
+      a = 2.0 * M_PI * j / n;
+      fprintf(fp, "%.7f %.7f\n", x + r * (0.5 + rand() / (double)RAND_MAX) *
+                                          cos(a) / cos(y * M_PI / 180.0),
+              y + r * (0.5 + rand() / (double)RAND_MAX) * sin(a));
+    }
+  }
+  fclose(fp);
+
+  t = seconds();
+  fences = fenceload("/tmp/gpsfence.test");
+  printf("%d fences, %d points, %dx%d grid loaded in %.1f ms\n",
+         fences->nfence, fences->npoint, fences->nx, fences->ny,
+         (seconds() - t) * 1e3);
+
+  /* random walk so fixes go in and out of fences */
+  memset(&fix, 0, sizeof(fix));
+  fix.longitude = -78.4;
+  fix.latitude = 45.2;
+  events = 0;
+  t = seconds();
+  for (i = 0; i < NFIX; i++) {
+    fix.longitude += (rand() / (double)RAND_MAX - 0.5) * 1e-4;
+    fix.latitude += (rand() / (double)RAND_MAX - 0.5) * 1e-4;
+    events += fencecheck(fences, &fix);
+  }
+  grid = (seconds() - t) / NFIX;
+
+  /* every fence, and the grid has to agree with it */
+  hits = checks = 0;
+  t = seconds();
+  for (i = 0; i < NFIX / 100; i++) {
+    fix.longitude += (rand() / (double)RAND_MAX - 0.5) * 1e-4;
+    fix.latitude += (rand() / (double)RAND_MAX - 0.5) * 1e-4;
+    n = 0;
+    for (j = 0; j < fences->nfence; j++)
+      n += insidefence(fences, &fences->fence[j], fix.longitude,
+                       fix.latitude);
+    fencecheck(fences, &fix);
+    hits += n != fences->ninside;
+    checks++;
+  }
+  brute = (seconds() - t) / checks;
+  printf("grid %.0f ns/fix (%ld events), every fence %.0f ns/fix, %.0fx, "
+         "%ld disagree\n",
+         grid * 1e9, events, brute * 1e9, brute / grid, hits);
+  return 0;
+}
+#endif
@@ -0,0 +1,231 @@
+/**
+ * DOC: -- gpskalman.c -- Kalman filter for gps fixes
+ * Peter Thompson -- Nov 2019
+ *
+ * a fix from the Linx R4 wanders a few meters, and its altitude tens of
+ * meters, from one fix to the next.  With pmtgpsd.conf kalman = 1 each
+ * fix goes through a constant velocity Kalman filter before it is
+ * published (the raw fix is published too, see struct PMTgps).
+ *
+ * three independent axes in meters from an origin near the fix:
+ *   east, north  state position and velocity, measured position (GGA)
+ *                and velocity (RMC speed and track, Doppler - good)
+ *   up           state altitude and climb rate, measured altitude only
+ * every axis is 2 states, so all the matrices are 2x2 written out by
+ * hand: no allocation, ~100 multiplies per fix.
+ *
+ * measurement noise, 1 sigma:
+ *   position   UERE * HDOP, altitude 1.5 times that (VDOP ~ 1.5 HDOP)
+ *              fewer than 5 satellites doubles it, fewer than 4 (a 2D
+ *              fix, altitude made up) makes altitude 10 times worse
+ *   velocity   VELOCITYERROR
+ * process noise: acceleration of kalmanaccel m/s/s (1 sigma) between
+ * fixes, so the filter follows a walker quickly and a car lags.
+ *
+ * the filter restarts at the next fix after a gap of MAXGAP seconds or a
+ * jump of more than MAXJUMP meters (simulation, or the receiver's first
+ * real fix after a bad one).
+ */
+
+#include <math.h>
+
+#include "pmtgps.h"
+
+#define TRUE 1
+#define FALSE 0
+#define EARTHRADIUS 6371000.0 /* meters, mean */
+#define DEG2RAD(x) ((x) * M_PI / 180.0)
+#define RAD2DEG(x) ((x) * 180.0 / M_PI)
+#define UERE 4.0          /* meters, user equivalent range error */
+#define DEFAULTHDOP 2.0   /* when the fix has none */
+#define VELOCITYERROR 0.2 /* m/s, 1 sigma of RMC speed per axis */
+#define MAXGAP 10.0       /* seconds between fixes before a restart */
+#define MAXJUMP 500.0     /* meters from the prediction before a restart */
+#define MAXORIGIN 10000.0 /* meters from the origin before it moves */
+
+/**
+ * struct axis -- one axis of the filter
+ */
+struct axis {
+  double p;             /* position, meters from the origin */
+  double v;             /* velocity, m/s */
+  double p00, p01, p11; /* covariance, symmetric */
+};
+
+static struct axis east, north, up;
+static double originlong, originlat; /* decimal degrees */
+static double metersperlong;         /* at originlat */
+static double last;                  /* received of the last fix */
+static int running;
+static struct linxdata filtered;
+
+/**
+ * axisstart() - start an axis at a measurement
+ * Return: nothing
+ */
+static void axisstart(struct axis *a, double p, double rp, double v,
+                      double rv) {
+  a->p = p;
+  a->v = v;
+  a->p00 = rp;
+  a->p01 = 0.0;
+  a->p11 = rv;
+}
+
+/**
+ * axispredict() - move an axis on dt seconds at constant velocity
+ * @q  acceleration variance
+ * Return: nothing
+ */
+static void axispredict(struct axis *a, double dt, double q) {
+  double dt2 = dt * dt;
+
+  a->p += a->v * dt;
+  a->p00 += dt * (2.0 * a->p01 + dt * a->p11) + q * dt2 * dt2 / 4.0;
+  a->p01 += dt * a->p11 + q * dt2 * dt / 2.0;
+  a->p11 += q * dt2;
+}
+
+/**
+ * axisupdate() - correct an axis with a measured position and velocity
+ * @zp, rp  position and its variance
+ * @zv, rv  velocity and its variance, rv = 0 => no velocity measured
+ * Return: nothing
+ */
+static void axisupdate(struct axis *a, double zp, double rp, double zv,
+                       double rv) {
+  double s00, s01, s11, det, k00, k01, k10, k11, yp, yv, p00, p01, p11;
+
+  yp = zp - a->p;
+  if (rv <= 0.0) { /* position only, S is 1x1 */
+    k00 = a->p00 / (a->p00 + rp);
+    k10 = a->p01 / (a->p00 + rp);
+    a->p += k00 * yp;
+    a->v += k10 * yp;
+    a->p11 -= k10 * a->p01;
+    a->p01 *= 1.0 - k00;
+    a->p00 *= 1.0 - k00;
+    return;
+  }
+
+  /* K = P (P + R)^-1 */
+  yv = zv - a->v;
+  s00 = a->p00 + rp;
+  s01 = a->p01;
+  s11 = a->p11 + rv;
+  det = s00 * s11 - s01 * s01;
+  k00 = (a->p00 * s11 - a->p01 * s01) / det;
+  k01 = (a->p01 * s00 - a->p00 * s01) / det;
+  k10 = (a->p01 * s11 - a->p11 * s01) / det;
+  k11 = (a->p11 * s00 - a->p01 * s01) / det;
+  a->p += k00 * yp + k01 * yv;
+  a->v += k10 * yp + k11 * yv;
+
+  /* P = (I - K) P */
+  p00 = (1.0 - k00) * a->p00 - k01 * a->p01;
+  p01 = (1.0 - k00) * a->p01 - k01 * a->p11;
+  p11 = (1.0 - k11) * a->p11 - k10 * a->p01;
+  a->p00 = p00;
+  a->p01 = p01;
+  a->p11 = p11;
+}
+
+/**
+ * neworigin() - put the origin at a position, moving the state with it
+ * Return: nothing
+ */
+static void neworigin(double longitude, double latitude) {
+  double dlong;
+
+  if (running) {
+    dlong = longitude - originlong;
+    if (dlong > 180.0)
+      dlong -= 360.0;
+    else if (dlong < -180.0)
+      dlong += 360.0;
+    east.p -= dlong * metersperlong;
+    north.p -= DEG2RAD(latitude - originlat) * EARTHRADIUS;
+  }
+  originlong = longitude;
+  originlat = latitude;
+  metersperlong = DEG2RAD(1.0) * EARTHRADIUS * cos(DEG2RAD(latitude));
+}
+
+/**
+ * gpskalman() - filter one fix
+ * @raw       fix from linxread() or simroute()
+ * @accel     pmtgpsd.conf kalmanaccel, m/s/s
+ * @accuracy  output: meters, 1 sigma horizontal error of the result
+ * Return: filtered fix, date, gmt, declination and received as raw
+ */
+struct linxdata *gpskalman(struct linxdata *raw, double accel,
+                           double *accuracy) {
+  double hdop, rh, ra, rv, ze, zn, ve, vn, dlong, dt, q;
+
+  /* measurement noise from HDOP and satellites */
+  hdop = raw->hdop > 0.0 ? raw->hdop : DEFAULTHDOP;
+  rh = UERE * hdop;
+  ra = 1.5 * rh;
+  if (raw->satellites > 0 && raw->satellites < 5) {
+    rh *= 2.0;
+    ra *= raw->satellites < 4 ? 10.0 : 2.0;
+  }
+  rh *= rh;
+  ra *= ra;
+  rv = VELOCITYERROR * VELOCITYERROR;
+  q = accel > 0.0 ? accel * accel : 1.0;
+
+  /* measurement in meters from the origin */
+  dt = raw->received - last;
+  if (!running || dt <= 0.0 || dt > MAXGAP)
+    running = FALSE;
+  else if (fabs(east.p) > MAXORIGIN || fabs(north.p) > MAXORIGIN)
+    neworigin(raw->longitude, raw->latitude);
+  if (!running)
+    neworigin(raw->longitude, raw->latitude);
+  dlong = raw->longitude - originlong;
+  if (dlong > 180.0)
+    dlong -= 360.0;
+  else if (dlong < -180.0)
+    dlong += 360.0;
+  ze = dlong * metersperlong;
+  zn = DEG2RAD(raw->latitude - originlat) * EARTHRADIUS;
+  ve = raw->speed / 3.6 * sin(DEG2RAD(raw->track));
+  vn = raw->speed / 3.6 * cos(DEG2RAD(raw->track));
+
+  if (running) {
+    axispredict(&east, dt, q);
+    axispredict(&north, dt, q);
+    axispredict(&up, dt, q);
+    if (hypot(ze - east.p, zn - north.p) > MAXJUMP)
+      running = FALSE;
+  }
+  if (running) {
+    axisupdate(&east, ze, rh, ve, rv);
+    axisupdate(&north, zn, rh, vn, rv);
+    axisupdate(&up, raw->altitude, ra, 0.0, 0.0);
+  } else {
+    axisstart(&east, ze, rh, ve, rv);
+    axisstart(&north, zn, rh, vn, rv);
+    axisstart(&up, raw->altitude, ra, 0.0, q);
+    running = TRUE;
+  }
+  last = raw->received;
+
+  filtered = *raw;
+  filtered.longitude = originlong + east.p / metersperlong;
+  if (filtered.longitude > 180.0)
+    filtered.longitude -= 360.0;
+  else if (filtered.longitude < -180.0)
+    filtered.longitude += 360.0;
+  filtered.latitude = originlat + RAD2DEG(north.p / EARTHRADIUS);
+  filtered.altitude = up.p;
+  filtered.speed = hypot(east.v, north.v) * 3.6;
+  filtered.track = RAD2DEG(atan2(east.v, north.v));
+  if (filtered.track < 0.0)
+    filtered.track += 360.0;
+  if (filtered.speed < 1.0)
+    filtered.track = raw->track; /* standing still, direction is noise */
+  *accuracy = sqrt(east.p00 + north.p00);
+  return &filtered;
+}
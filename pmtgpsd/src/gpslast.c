@@ -0,0 +1,149 @@
+/**
+ * DOC: -- gpslast.c -- last known fix kept across restarts
+ * Peter Thompson -- Nov 2019
+ *
+ * after a power on the Linx R4 needs tens of seconds for its first fix
+ * and until then /dev/shm/pmtgps was Null Island.  pmtgpsd now saves
+ * the last fix from the gps device to pmtgpsd.conf lastfix every
+ * lastfixsave seconds and when it stops.  At start the saved fix is
+ * published at once with struct PMTgps status = GPSSTALE, so readers
+ * have a real position and declination in milliseconds, and know it
+ * is old.  With aiding = 1 it is also sent to the receiver as its
+ * starting position and time (linxaid() in linxdriver.c).
+ *
+ * only real fixes are kept: the Null Island record linxread() returns
+ * when it finds no fix does not replace the last one.
+ *
+ * file: one "name value" per line, written to lastfix.new and renamed
+ * so a power cut while saving leaves the previous file.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "pmtgps.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* Function Prototypes */
+struct gpsconfig *gpsconfig(void);
+double gpsclock(void);
+
+static struct linxdata last; /* last fix from the gps device */
+static int havelast;         /* TRUE once last is a real fix */
+static double lastsave;      /* gpsclock() of the last save */
+
+/**
+ * gpslastload() - read the saved fix
+ * @linx   output: the fix, received = 0 (not from the device)
+ * @saved  output: UTC seconds when it was saved
+ * Return: TRUE if there is a saved fix
+ */
+int gpslastload(struct linxdata *linx, time_t *saved) {
+  struct gpsconfig *conf;
+  char line[100], name[20];
+  double value;
+  int found;
+  FILE *fp;
+
+  conf = gpsconfig();
+  if (!conf->lastfix[0])
+    return FALSE;
+  fp = fopen(conf->lastfix, "r");
+  if (!fp)
+    return FALSE;
+  memset(linx, 0, sizeof(struct linxdata));
+  *saved = 0;
+  found = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    if (sscanf(line, "%19s %lf", name, &value) != 2)
+      continue;
+    found++;
+    if (strcmp(name, "date") == 0)
+      linx->date = (int)value;
+    else if (strcmp(name, "gmt") == 0) {
+      linx->gmt = (int)value;
+      linx->millisecond = (int)lround((value - (int)value) * 1000.0) % 1000;
+    }
+    else if (strcmp(name, "longitude") == 0)
+      linx->longitude = value;
+    else if (strcmp(name, "latitude") == 0)
+      linx->latitude = value;
+    else if (strcmp(name, "altitude") == 0)
+      linx->altitude = value;
+    else if (strcmp(name, "declination") == 0)
+      linx->declination = value;
+    else if (strcmp(name, "speed") == 0)
+      linx->speed = value;
+    else if (strcmp(name, "track") == 0)
+      linx->track = value;
+    else if (strcmp(name, "saved") == 0)
+      *saved = (time_t)value;
+    else
+      found--;
+  }
+  fclose(fp);
+  if (found < 9 || linx->date == 0) {
+    syslog(LOG_NOTICE, "gpslastload(): %s incomplete, ignored",
+           conf->lastfix);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+ * gpslastsave() - write the last fix from the gps device, if any
+ * Return: nothing
+ */
+void gpslastsave(void) {
+  struct gpsconfig *conf;
+  char temp[GPSCONFNAME + 4];
+  FILE *fp;
+
+  conf = gpsconfig();
+  if (!havelast || !conf->lastfix[0])
+    return;
+  snprintf(temp, sizeof(temp), "%s.new", conf->lastfix);
+  fp = fopen(temp, "w");
+  if (!fp) {
+    syslog(LOG_NOTICE, "gpslastsave(): Unable to open %s = %m", temp);
+    return;
+  }
+  fprintf(fp, "# pmtgpsd last fix, see pmtgpsd/src/gpslast.c\n");
+  fprintf(fp, "date %d\n", last.date);
+  fprintf(fp, "gmt %.3f\n", (int)last.gmt + last.millisecond / 1000.0);
+  fprintf(fp, "longitude %.9f\n", last.longitude);
+  fprintf(fp, "latitude %.9f\n", last.latitude);
+  fprintf(fp, "altitude %.1f\n", last.altitude);
+  fprintf(fp, "declination %.4f\n", last.declination);
+  fprintf(fp, "speed %.2f\n", last.speed);
+  fprintf(fp, "track %.2f\n", last.track);
+  fprintf(fp, "saved %ld\n", (long)time(NULL));
+  if (fclose(fp) != 0 || rename(temp, conf->lastfix) != 0)
+    syslog(LOG_NOTICE, "gpslastsave(): Unable to write %s = %m",
+           conf->lastfix);
+  lastsave = gpsclock();
+}
+
+/**
+ * gpslastfix() - remember a fix from the gps device, save it every
+ *  interval seconds (the first one at once)
+ * @linx      fix from linxread(), Null Island (no fix) is not kept,
+ *            the fix before it is saved instead
+ * @interval  pmtgpsd.conf lastfixsave, 0 => only when pmtgpsd stops
+ * Return: nothing
+ */
+void gpslastfix(struct linxdata *linx, double interval) {
+  if (linx->date == 0 || (linx->longitude == 0.0 && linx->latitude == 0.0) ||
+      fabs(linx->latitude) > 90.0 || fabs(linx->longitude) > 180.0)
+    return;
+  last = *linx;
+  if (!havelast || (interval > 0.0 && gpsclock() - lastsave >= interval)) {
+    havelast = TRUE;
+    gpslastsave();
+  }
+}
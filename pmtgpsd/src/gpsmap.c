@@ -0,0 +1,142 @@
+/**
+ * DOC: -- gpsmap.c -- map sheet and map tiles of the current position
+ * Peter Thompson -- Nov 2019
+ *
+ * a map renderer needs the map under the gps position on every redraw.
+ * gpsmap() puts it in struct PMTgps (version 3 fields) at every fix:
+ *   mapsheet    NTS (Canada's National Topographic System) 1:50000
+ *               sheet, e.g. Percy Lake is on "031E01":
+ *                 031  1:1M quadrangle, 8 degrees longitude West from
+ *                      48W (03 => 72-80W) by 4 degrees latitude North
+ *                      from 40N (1 => 44-48N)
+ *                 E    map area, 2 x 1 degrees, A-P snaking from the SE
+ *                 01   sheet, 30' x 15', 1-16 snaking from the SE
+ *               "" outside 40N-68N, 48W-144W (north of 68N quadrangles
+ *               are wider, not done)
+ *   tilex/tiley Web Mercator (OpenStreetMap "slippy map") tile at zoom
+ *               0 ... MAPMAXZOOM
+ *   mapchanges  + 1 every time any of them changes
+ *
+ * tiles nest (tile x, y at zoom z is x/2, y/2 at z-1) and every sheet
+ * edge is on a 30' x 15' grid, so all of them stay the same while the
+ * position is inside both the MAPMAXZOOM tile and the sheet.  That
+ * rectangle is kept in 1e-7 degrees: a fix inside it costs 4 integer
+ * compares, the trigonometry is only done when it is crossed (a
+ * MAPMAXZOOM tile is ~100 m, a minute or two walking).
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "pmtgps.h"
+
+#define TRUE 1
+#define FALSE 0
+#define SHEETLONG7 5000000LL /* 30' of longitude in 1e-7 degrees */
+#define SHEETLAT7 2500000LL  /* 15' of latitude */
+#define MAXMERCATOR 85.0511287798 /* degrees, Web Mercator edge */
+
+static int32_t west7, east7, south7, north7; /* cached, 1e-7 degrees */
+static int cached;
+
+/**
+ * floordiv() - integer division rounding down, also for negatives
+ * Return: floor(a / b)
+ */
+static int64_t floordiv(int64_t a, int64_t b) {
+  return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+/**
+ * ntssheet() - NTS 1:50000 sheet of a 30' x 15' cell
+ * @cellx  floor(longitude / 30')
+ * @celly  floor(latitude / 15')
+ * @sheet  output: "031E01", "" outside 40N-68N, 48W-144W
+ * Return: nothing
+ */
+static void ntssheet(int64_t cellx, int64_t celly, char *sheet) {
+  int k, j, col, row, letter, number;
+
+  k = (int)(-cellx - 1 - 96); /* 30' columns West of 48W */
+  j = (int)(celly - 160);     /* 15' rows North of 40N */
+  if (k < 0 || k >= 192 || j < 0 || j >= 112) {
+    sheet[0] = '\0';
+    return;
+  }
+  col = k % 16 / 4; /* map area, columns from the East */
+  row = j % 16 / 4;
+  letter = 'A' + row * 4 + (row % 2 ? 3 - col : col);
+  col = k % 4; /* sheet in the map area */
+  row = j % 4;
+  number = 1 + row * 4 + (row % 2 ? 3 - col : col);
+  snprintf(sheet, 8, "%02d%d%c%02d", k / 16, j / 16, letter, number);
+}
+
+/**
+ * gpsmap() - map sheet and tiles of the position in struct PMTgps
+ * @gps  shared memory, longitude7 and latitude7 set, pmtgpsd writing
+ * Return: TRUE if they changed
+ */
+int gpsmap(struct PMTgps *gps) {
+  int64_t cellx, celly, n, x, y, w7, e7;
+  double latitude, s, north, south;
+  char sheet[8] = "";
+  int z, changed;
+
+  if (cached && gps->longitude7 >= west7 && gps->longitude7 < east7 &&
+      gps->latitude7 > south7 && gps->latitude7 < north7)
+    return FALSE;
+
+  /* sheet: the 30' x 15' cell */
+  cellx = floordiv(gps->longitude7, SHEETLONG7);
+  celly = floordiv(gps->latitude7, SHEETLAT7);
+  ntssheet(cellx, celly, sheet);
+
+  /* tile at MAPMAXZOOM, x exact in integers, y on the Mercator curve */
+  n = 1LL << MAPMAXZOOM;
+  x = (gps->longitude7 + 1800000000LL) * n / 3600000000LL;
+  if (x >= n)
+    x = n - 1;
+  latitude = gps->latitude7 * 1e-7;
+  if (latitude > MAXMERCATOR)
+    latitude = MAXMERCATOR;
+  else if (latitude < -MAXMERCATOR)
+    latitude = -MAXMERCATOR;
+  s = (1.0 - asinh(tan(latitude * M_PI / 180.0)) / M_PI) / 2.0;
+  y = (int64_t)floor(s * n);
+  if (y < 0)
+    y = 0;
+  else if (y >= n)
+    y = n - 1;
+
+  /* rectangle inside both */
+  w7 = (x * 3600000000LL + n - 1) / n - 1800000000LL;
+  e7 = ((x + 1) * 3600000000LL + n - 1) / n - 1800000000LL;
+  north = atan(sinh(M_PI * (1.0 - 2.0 * y / n))) * 180.0 / M_PI;
+  south = atan(sinh(M_PI * (1.0 - 2.0 * (y + 1) / n))) * 180.0 / M_PI;
+  west7 = w7 > cellx * SHEETLONG7 ? w7 : cellx * SHEETLONG7;
+  east7 = e7 < (cellx + 1) * SHEETLONG7 ? e7 : (cellx + 1) * SHEETLONG7;
+  south7 = lround(south * 1e7);
+  if (south7 < celly * SHEETLAT7)
+    south7 = celly * SHEETLAT7;
+  north7 = lround(north * 1e7);
+  if (north7 > (celly + 1) * SHEETLAT7)
+    north7 = (celly + 1) * SHEETLAT7;
+  if (latitude != gps->latitude7 * 1e-7) /* beyond Mercator, no cache */
+    north7 = south7;
+  cached = TRUE;
+
+  changed = x != gps->tilex[MAPMAXZOOM] || y != gps->tiley[MAPMAXZOOM];
+  for (z = 0; z < 8 && !changed; z++)
+    changed = sheet[z] != gps->mapsheet[z];
+  if (!changed)
+    return FALSE;
+  for (z = MAPMAXZOOM; z >= 0; z--) {
+    gps->tilex[z] = (uint32_t)(x >> (MAPMAXZOOM - z));
+    gps->tiley[z] = (uint32_t)(y >> (MAPMAXZOOM - z));
+  }
+  for (z = 0; z < 8; z++)
+    gps->mapsheet[z] = sheet[z];
+  gps->mapchanges++;
+  return TRUE;
+}
@@ -0,0 +1,757 @@
+/**
+ * DOC: -- gpsmatch.c -- map matching fixes onto a trail network
+ * Peter Thompson -- Nov 2019
+ *
+ * under trees and in valleys fixes wander tens of meters off the trail
+ * being walked.  With pmtgpsd.conf trailfile every fix is snapped to the
+ * most likely trail and /dev/shm/pmtgpsmatch (struct PMTgpsmatch in
+ * pmtgps.h) gets the fix and the matched position.
+ *
+ * trailfile is made by test/trailbuild and mapped read only: start up
+ * reads nothing, the pages near the fixes are paged in as they are used.
+ *
+ * matching is a hidden Markov model (Newson and Krumm 2009) run one fix
+ * at a time:
+ *   candidates   the MATCHCAND nearest trail pieces within trailradius,
+ *                from the grid cells around the fix
+ *   emission     gps error, gaussian, sigma 5 m x hdop
+ *   transition   a walker goes along trails, so the path along the
+ *                network between 2 candidates should be about as long
+ *                as the straight line between the 2 fixes, exponential
+ *                in the difference.  Paths come from a Dijkstra search
+ *                capped at MATCHEXPAND nodes and MATCHSLACK meters more
+ *                than the straight line.
+ *   Viterbi      best score of each candidate and the candidate before
+ *                it, kept for the last MATCHWINDOW fixes
+ *   matched      the best candidate of the newest fix
+ *   settled      following the best path back MATCHWINDOW - 1 fixes:
+ *                where the walker was then, judged with the fixes since
+ * every step is bounded by the constants below and the trails near the
+ * fix, not by the size of the network (see main() below).  A fix no
+ * path reaches restarts the matching (breaks + 1); a fix with no trail
+ * within trailradius is published not matched.
+ */
+/* #define MAINFORTESTING /* enable/disable testing with main() below */
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pmtgps.h"
+
+#define TRUE 1
+#define FALSE 0
+#define EARTHRADIUS 6371000.0 /* meters, mean */
+#define DEG2RAD(x) ((x) * M_PI / 180.0)
+#define MATCHCAND 8       /* nearest trail pieces kept per fix */
+#define MATCHWINDOW 10    /* fixes kept, the settled one is the oldest */
+#define MATCHEXPAND 64    /* nodes a path search settles at most */
+#define MATCHSLACK 100.0  /* meters a path may be longer than the line */
+#define MATCHBETA 10.0    /* meters, path - line difference scale */
+#define MATCHSIGMA 10.0   /* meters, gps error when hdop is unknown */
+#define HASHSIZE 512      /* path search nodes, power of 2 */
+#define NOPATH 1e30
+
+/**
+ * struct candidate -- a trail piece near a fix
+ */
+struct candidate {
+  uint32_t edge;
+  double t;         /* 0 at edge from ... 1 at edge to */
+  double d;         /* meters from the fix */
+  double longitude; /* nearest point of the edge */
+  double latitude;
+  double score;     /* Viterbi log probability, best 0 */
+  int back;         /* candidate of the fix before, -1 = none */
+};
+
+/**
+ * struct column -- the candidates of one fix
+ */
+struct column {
+  int n;
+  int gmt;
+  double longitude; /* the fix */
+  double latitude;
+  struct candidate c[MATCHCAND];
+};
+
+/* the network, mapped */
+static struct trailfile *head;
+static struct trailnode *node;
+static struct trailedge *edge;
+static uint32_t *nodestart, *nodeedge, *cellstart, *celledge;
+static size_t mapsize;
+
+static struct column window[MATCHWINDOW];
+static int ncolumn; /* columns of the current chain, 0 ... MATCHWINDOW */
+static int newest;  /* window[newest] is the last fix */
+static double radius;
+
+/* path search */
+static struct {
+  uint32_t node;
+  uint32_t stamp; /* = search => in use */
+  float dist;
+  int done;
+} hash[HASHSIZE];
+static uint32_t search;
+static struct {
+  float dist;
+  uint32_t node;
+} heap[HASHSIZE];
+static int nheap;
+
+static struct PMTgpsmatch match;   /* copied to matchnow */
+static struct PMTgpsmatch *matchnow; /* shared memory, NULL if not open */
+static unsigned int updates;       /* struct PMTgpsmatch begin/end */
+
+/**
+ * trailattach() - point at the parts of a trail network file
+ * @base  the file, mapped
+ * @size  its bytes
+ * Return: TRUE if it is a whole trail network
+ */
+static int trailattach(void *base, size_t size) {
+  struct trailfile *h = base;
+  uint64_t need, ncell;
+  uint32_t *u;
+
+  if (size < sizeof(struct trailfile) || h->magic != TRAILMAGIC)
+    return FALSE;
+  ncell = (uint64_t)h->gridw * h->gridh;
+  need = sizeof(struct trailfile) +
+         (uint64_t)h->nnode * sizeof(struct trailnode) +
+         (uint64_t)h->nedge * sizeof(struct trailedge) +
+         ((uint64_t)h->nnode + 1 + 2 * (uint64_t)h->nedge + ncell + 1) * 4;
+  if (need > size)
+    return FALSE;
+  head = h;
+  node = (struct trailnode *)(h + 1);
+  edge = (struct trailedge *)(node + h->nnode);
+  nodestart = (uint32_t *)(edge + h->nedge);
+  nodeedge = nodestart + h->nnode + 1;
+  cellstart = nodeedge + 2 * h->nedge;
+  celledge = cellstart + ncell + 1;
+  u = celledge + cellstart[ncell];
+  if ((char *)u > (char *)base + size) /* celledge runs past the end */
+    return FALSE;
+  return TRUE;
+}
+
+/**
+ * fitedge() - place a fix on an edge, flat earth around the fix
+ * @kx, ky  meters per degree of longitude, latitude at the fix
+ * Return: nothing, c is set except score and back
+ */
+static void fitedge(uint32_t e, double longitude, double latitude,
+                    double kx, double ky, struct candidate *c) {
+  struct trailnode *a, *b;
+  double ax, ay, dx, dy, len2, px, py;
+
+  a = &node[edge[e].from];
+  b = &node[edge[e].to];
+  ax = (a->longitude7 * 1e-7 - longitude) * kx; /* fix at 0,0 */
+  ay = (a->latitude7 * 1e-7 - latitude) * ky;
+  dx = (b->longitude7 - a->longitude7) * 1e-7 * kx;
+  dy = (b->latitude7 - a->latitude7) * 1e-7 * ky;
+  len2 = dx * dx + dy * dy;
+  c->t = len2 > 0.0 ? -(ax * dx + ay * dy) / len2 : 0.0;
+  if (c->t < 0.0)
+    c->t = 0.0;
+  else if (c->t > 1.0)
+    c->t = 1.0;
+  px = ax + c->t * dx;
+  py = ay + c->t * dy;
+  c->d = sqrt(px * px + py * py);
+  c->longitude = longitude + px / kx;
+  c->latitude = latitude + py / ky;
+  c->edge = e;
+}
+
+/**
+ * findcandidates() - the nearest edges within radius of a fix
+ * @col  output: n and c[] set
+ * Return: number of candidates
+ */
+static int findcandidates(double longitude, double latitude,
+                          struct column *col) {
+  struct candidate c;
+  double kx, ky;
+  long x0, x1, y0, y1, x, y, lon7, lat7, rx7, ry7;
+  uint32_t k, e;
+  int i, j;
+
+  col->n = 0;
+  ky = DEG2RAD(1.0) * EARTHRADIUS;
+  kx = ky * cos(DEG2RAD(latitude));
+  lon7 = lround(longitude * 1e7);
+  lat7 = lround(latitude * 1e7);
+  rx7 = (long)(radius / kx * 1e7) + 1;
+  ry7 = (long)(radius / ky * 1e7) + 1;
+  x0 = (lon7 - rx7 - head->west7) / head->cellx7;
+  x1 = (lon7 + rx7 - head->west7) / head->cellx7;
+  y0 = (lat7 - ry7 - head->south7) / head->celly7;
+  y1 = (lat7 + ry7 - head->south7) / head->celly7;
+  if (lon7 + rx7 < head->west7 || lat7 + ry7 < head->south7 ||
+      x0 >= (long)head->gridw || y0 >= (long)head->gridh)
+    return 0; /* off the grid */
+  if (x0 < 0)
+    x0 = 0;
+  if (y0 < 0)
+    y0 = 0;
+  if (x1 >= (long)head->gridw)
+    x1 = head->gridw - 1;
+  if (y1 >= (long)head->gridh)
+    y1 = head->gridh - 1;
+
+  for (y = y0; y <= y1; y++)
+    for (x = x0; x <= x1; x++)
+      for (k = cellstart[x + y * head->gridw];
+           k < cellstart[x + y * head->gridw + 1]; k++) {
+        e = celledge[k];
+        for (i = 0; i < col->n && col->c[i].edge != e; i++)
+          ; /* an edge is in every cell it crosses */
+        if (i < col->n)
+          continue;
+        fitedge(e, longitude, latitude, kx, ky, &c);
+        if (c.d > radius ||
+            (col->n == MATCHCAND && c.d >= col->c[MATCHCAND - 1].d))
+          continue;
+        /* insert sorted by distance */
+        j = col->n < MATCHCAND ? col->n++ : MATCHCAND - 1;
+        for (; j > 0 && col->c[j - 1].d > c.d; j--)
+          col->c[j] = col->c[j - 1];
+        col->c[j] = c;
+      }
+  return col->n;
+}
+
+/**
+ * lookup() - a node's path search slot
+ * @add  TRUE => make one if it has none
+ * Return: slot, -1 if none (or the table is full)
+ */
+static int lookup(uint32_t n, int add) {
+  uint32_t h, i;
+
+  h = (n * 2654435761u) & (HASHSIZE - 1);
+  for (i = 0; i < HASHSIZE; i++, h = (h + 1) & (HASHSIZE - 1)) {
+    if (hash[h].stamp != search) {
+      if (!add)
+        return -1;
+      hash[h].stamp = search;
+      hash[h].node = n;
+      hash[h].dist = NOPATH;
+      hash[h].done = FALSE;
+      return h;
+    }
+    if (hash[h].node == n)
+      return h;
+  }
+  return -1;
+}
+
+/**
+ * reach() - offer a node a path length, queue it if shorter
+ * Return: nothing
+ */
+static void reach(uint32_t n, float dist) {
+  int s, i, parent;
+
+  s = lookup(n, TRUE);
+  if (s < 0 || hash[s].done || dist >= hash[s].dist || nheap == HASHSIZE)
+    return;
+  hash[s].dist = dist;
+  for (i = nheap++; i > 0; i = parent) { /* sift up */
+    parent = (i - 1) / 2;
+    if (heap[parent].dist <= dist)
+      break;
+    heap[i] = heap[parent];
+  }
+  heap[i].dist = dist;
+  heap[i].node = n;
+}
+
+/**
+ * pop() - the queued node with the shortest path
+ * Return: nothing, *n and *dist set
+ */
+static void pop(uint32_t *n, float *dist) {
+  int i, child;
+
+  *n = heap[0].node;
+  *dist = heap[0].dist;
+  nheap--;
+  for (i = 0; (child = 2 * i + 1) < nheap; i = child) { /* sift down */
+    if (child + 1 < nheap && heap[child + 1].dist < heap[child].dist)
+      child++;
+    if (heap[nheap].dist <= heap[child].dist)
+      break;
+    heap[i] = heap[child];
+  }
+  heap[i] = heap[nheap];
+}
+
+/**
+ * paths() - path lengths from one candidate to every candidate of a fix
+ * @a      candidate of the fix before
+ * @col    candidates of this fix
+ * @limit  meters, longer paths are not looked for
+ * @path   output: meters to col->c[j], NOPATH if not found
+ * Return: nothing
+ */
+static void paths(struct candidate *a, struct column *col, double limit,
+                  double *path) {
+  struct trailedge *ea, *eb;
+  uint32_t n, k, e, other;
+  float dist;
+  int settled, j, s;
+  double d;
+
+  ea = &edge[a->edge];
+  search++;
+  nheap = 0;
+  reach(ea->from, (float)(a->t * ea->length));
+  reach(ea->to, (float)((1.0 - a->t) * ea->length));
+  for (settled = 0; nheap > 0 && settled < MATCHEXPAND;) {
+    pop(&n, &dist);
+    s = lookup(n, FALSE);
+    if (hash[s].done || dist > hash[s].dist)
+      continue; /* queued again since with a shorter path */
+    if (dist > limit)
+      break;
+    hash[s].done = TRUE;
+    settled++;
+    for (k = nodestart[n]; k < nodestart[n + 1]; k++) {
+      e = nodeedge[k];
+      other = edge[e].from == n ? edge[e].to : edge[e].from;
+      reach(other, dist + edge[e].length);
+    }
+  }
+
+  for (j = 0; j < col->n; j++) {
+    eb = &edge[col->c[j].edge];
+    if (col->c[j].edge == a->edge) {
+      path[j] = fabs(col->c[j].t - a->t) * ea->length;
+      continue;
+    }
+    path[j] = NOPATH;
+    s = lookup(eb->from, FALSE);
+    if (s >= 0 && hash[s].dist < NOPATH) {
+      d = hash[s].dist + col->c[j].t * eb->length;
+      if (d < path[j])
+        path[j] = d;
+    }
+    s = lookup(eb->to, FALSE);
+    if (s >= 0 && hash[s].dist < NOPATH) {
+      d = hash[s].dist + (1.0 - col->c[j].t) * eb->length;
+      if (d < path[j])
+        path[j] = d;
+    }
+  }
+}
+
+/**
+ * viterbi() - scores of a new fix's candidates from the fix before
+ * @col    the new fix, candidates found
+ * @sigma  meters, gps error
+ * Return: TRUE if a path reached one, FALSE => start again
+ */
+static int viterbi(struct column *col, double sigma) {
+  struct column *prev;
+  double path[MATCHCAND], line, best, score;
+  int i, j, reached;
+
+  for (j = 0; j < col->n; j++) {
+    col->c[j].score = -HUGE_VAL;
+    col->c[j].back = -1;
+  }
+  prev = ncolumn > 0 ? &window[newest] : NULL;
+  reached = FALSE;
+  if (prev) {
+    line = hypot((col->longitude - prev->longitude) * DEG2RAD(1.0) *
+                     EARTHRADIUS * cos(DEG2RAD(col->latitude)),
+                 (col->latitude - prev->latitude) * DEG2RAD(1.0) *
+                     EARTHRADIUS);
+    for (i = 0; i < prev->n; i++) {
+      paths(&prev->c[i], col, line + MATCHSLACK, path);
+      for (j = 0; j < col->n; j++) {
+        if (path[j] >= NOPATH)
+          continue;
+        score = prev->c[i].score - fabs(path[j] - line) / MATCHBETA;
+        if (score > col->c[j].score) {
+          col->c[j].score = score;
+          col->c[j].back = i;
+          reached = TRUE;
+        }
+      }
+    }
+  }
+  best = -HUGE_VAL;
+  for (j = 0; j < col->n; j++) {
+    if (!reached)
+      col->c[j].score = 0.0; /* first fix of a chain */
+    col->c[j].score -= 0.5 * (col->c[j].d / sigma) * (col->c[j].d / sigma);
+    if (col->c[j].score > best)
+      best = col->c[j].score;
+  }
+  for (j = 0; j < col->n; j++) /* best 0, no drift */
+    col->c[j].score -= best;
+  return reached || !prev;
+}
+
+/**
+ * matchupdate() - match a fix, fill in match
+ * @linx  fix
+ * Return: nothing
+ */
+static void matchupdate(struct linxdata *linx) {
+  struct column col, *c;
+  double sigma;
+  int best, j, k, w;
+
+  match.date = linx->date;
+  match.gmt = (int)linx->gmt;
+  match.longitude = linx->longitude;
+  match.latitude = linx->latitude;
+  match.matched = FALSE;
+  match.trail = -1;
+  match.matchlongitude = linx->longitude;
+  match.matchlatitude = linx->latitude;
+  match.offtrail = 0.0;
+
+  col.gmt = match.gmt;
+  col.longitude = linx->longitude;
+  col.latitude = linx->latitude;
+  match.candidates = findcandidates(linx->longitude, linx->latitude, &col);
+  if (col.n == 0) {
+    ncolumn = 0; /* off the trails */
+    match.settledgmt = 0;
+    return;
+  }
+  sigma = linx->hdop > 0.0 ? 5.0 * linx->hdop : MATCHSIGMA;
+  if (!viterbi(&col, sigma)) {
+    match.breaks++;
+    ncolumn = 0;
+    viterbi(&col, sigma);
+  }
+  newest = (newest + 1) % MATCHWINDOW;
+  window[newest] = col;
+  if (ncolumn < MATCHWINDOW)
+    ncolumn++;
+
+  best = 0;
+  for (j = 1; j < col.n; j++)
+    if (col.c[j].score > col.c[best].score)
+      best = j;
+  match.matched = TRUE;
+  match.trail = edge[col.c[best].edge].trail;
+  match.matchlongitude = col.c[best].longitude;
+  match.matchlatitude = col.c[best].latitude;
+  match.offtrail = col.c[best].d;
+
+  /* back along the best path to the oldest fix kept */
+  match.settledgmt = 0;
+  if (ncolumn < MATCHWINDOW)
+    return;
+  k = best;
+  w = newest;
+  for (j = 1; j < MATCHWINDOW; j++) {
+    k = window[w].c[k].back;
+    w = (w + MATCHWINDOW - 1) % MATCHWINDOW;
+  }
+  c = &window[w];
+  match.settledgmt = c->gmt;
+  match.settledlongitude = c->c[k].longitude;
+  match.settledlatitude = c->c[k].latitude;
+}
+
+/**
+ * gpsmatchopen() - map the trail network, create /dev/shm/pmtgpsmatch
+ * @name    pmtgpsd.conf trailfile, "" => no map matching
+ * @meters  pmtgpsd.conf trailradius
+ * Return: number of trail pieces, 0 if none
+ */
+int gpsmatchopen(char *name, double meters) {
+  struct stat st;
+  void *base;
+  int fd;
+
+  if (name[0] == '\0')
+    return 0;
+  fd = open(name, O_RDONLY);
+  if (fd < 0) {
+    syslog(LOG_NOTICE, "trail network %s error = %m", name);
+    return 0;
+  }
+  fstat(fd, &st);
+  base = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    syslog(LOG_NOTICE, "trail network %s mmap error = %m", name);
+    return 0;
+  }
+  if (!trailattach(base, st.st_size)) {
+    syslog(LOG_NOTICE, "trail network %s is not from trailbuild", name);
+    munmap(base, st.st_size);
+    head = NULL;
+    return 0;
+  }
+  mapsize = st.st_size;
+  radius = meters > 0.0 ? meters : 50.0;
+  ncolumn = 0;
+  memset(&match, 0, sizeof(match));
+
+  fd = shm_open(MATCHNAME, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    syslog(LOG_NOTICE, "shm_open %s error = %m", MATCHNAME);
+    return head->nedge;
+  }
+  ftruncate(fd, sizeof(struct PMTgpsmatch));
+  matchnow = mmap(0, sizeof(struct PMTgpsmatch), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fd, 0);
+  close(fd);
+  if (matchnow == MAP_FAILED) {
+    matchnow = NULL;
+    shm_unlink(MATCHNAME);
+    return head->nedge;
+  }
+  memset(matchnow, 0, sizeof(struct PMTgpsmatch));
+  syslog(LOG_INFO, "map matching on %u trails, %u pieces, %s",
+         head->ntrail, head->nedge, name);
+  return head->nedge;
+}
+
+/**
+ * gpsmatchfix() - match a new fix, to /dev/shm/pmtgpsmatch
+ * @linx  fix
+ * Return: TRUE if it is on a trail
+ */
+int gpsmatchfix(struct linxdata *linx) {
+  if (!head)
+    return FALSE;
+  matchupdate(linx);
+  if (!matchnow)
+    return match.matched;
+  match.begin = ++updates;
+  match.end = matchnow->end; /* still the last update while copying */
+  matchnow->begin = match.begin;
+  __sync_synchronize();
+  *matchnow = match;
+  __sync_synchronize();
+  matchnow->end = updates;
+  return match.matched;
+}
+
+/**
+ * gpsmatchclose() - unmap the network, remove /dev/shm/pmtgpsmatch
+ * Return: nothing
+ */
+void gpsmatchclose(void) {
+  if (head)
+    munmap(head, mapsize);
+  head = NULL;
+  if (!matchnow)
+    return;
+  munmap(matchnow, sizeof(struct PMTgpsmatch));
+  shm_unlink(MATCHNAME);
+  matchnow = NULL;
+}
+
+#ifdef MAINFORTESTING
+/*
+ * benchmark: square lattice of trails 100 m apart, small (30 x 30
+ * nodes) and large (1000 x 1000 nodes, 2 million pieces), laid out as
+ * trailbuild writes it.  A walker goes 1.4 m a fix along lattice trails,
+ * turning at random junctions, with 15 m of gps wander.  Cost per fix
+ * should not grow with the network.
+ * gcc -O2 gpsmatch.c -I../../include -lm -lrt
+ */
+#define SPACING 100.0 /* meters between lattice trails */
+#define NFIX 200000
+
+static double now(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static double gauss(void) {
+  double u, v;
+
+  u = (rand() + 1.0) / (RAND_MAX + 2.0);
+  v = rand() / (double)RAND_MAX;
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/* lattice n x n, south west corner at 45.2N 78.4W */
+static void *lattice(uint32_t n, size_t *size) {
+  struct trailfile h;
+  double step7y, step7x;
+  uint32_t i, x, y, e, ncell, *ns, *ne, *cs, *ce, c;
+  char *base;
+
+  memset(&h, 0, sizeof(h));
+  h.magic = TRAILMAGIC;
+  h.nnode = n * n;
+  h.nedge = 2 * n * (n - 1);
+  h.ntrail = 2 * n;
+  h.west7 = -784000000;
+  h.south7 = 452000000;
+  step7y = SPACING / (DEG2RAD(1.0) * EARTHRADIUS) * 1e7;
+  step7x = step7y / cos(DEG2RAD(45.2 + n * SPACING / 222390.0));
+  h.cellx7 = (int32_t)ceil(step7x);
+  h.celly7 = (int32_t)ceil(step7y);
+  h.gridw = n;
+  h.gridh = n;
+  ncell = n * n;
+  *size = sizeof(h) + h.nnode * sizeof(struct trailnode) +
+          h.nedge * sizeof(struct trailedge) +
+          (h.nnode + 1 + 2 * h.nedge + ncell + 1 + 2 * h.nedge) * 4;
+  base = malloc(*size);
+  memcpy(base, &h, sizeof(h));
+  node = (struct trailnode *)((struct trailfile *)base + 1);
+  edge = (struct trailedge *)(node + h.nnode);
+  ns = (uint32_t *)(edge + h.nedge);
+  ne = ns + h.nnode + 1;
+  cs = ne + 2 * h.nedge;
+  ce = cs + ncell + 1;
+  for (y = 0; y < n; y++)
+    for (x = 0; x < n; x++) {
+      node[x + y * n].longitude7 = h.west7 + (int32_t)(x * step7x);
+      node[x + y * n].latitude7 = h.south7 + (int32_t)(y * step7y);
+    }
+  /* edges: east from node (x,y) is 2*(x+y*n), north is +1 */
+  e = 0;
+  for (i = 0; i < h.nnode; i++) {
+    x = i % n;
+    y = i / n;
+    ns[i] = 0;
+    if (x + 1 < n)
+      edge[e++] = (struct trailedge){i, i + 1, SPACING, n + y};
+    if (y + 1 < n)
+      edge[e++] = (struct trailedge){i, i + n, SPACING, x};
+  }
+  for (e = 0; e < h.nedge; e++) {
+    ns[edge[e].from]++;
+    ns[edge[e].to]++;
+  }
+  for (i = 0, c = 0; i <= h.nnode; i++) { /* counts => starts */
+    x = i < h.nnode ? ns[i] : 0;
+    ns[i] = c;
+    c += x;
+  }
+  for (e = 0; e < h.nedge; e++) { /* fill, moving starts on */
+    ne[ns[edge[e].from]++] = e;
+    ne[ns[edge[e].to]++] = e;
+  }
+  for (i = h.nnode; i > 0; i--) /* starts back */
+    ns[i] = ns[i - 1];
+  ns[0] = 0;
+  /* cells: the cell of a node holds its east and north edges */
+  for (c = 0, i = 0; i < ncell; i++) {
+    cs[i] = c;
+    for (x = ns[i]; x < ns[i + 1]; x++)
+      if (edge[ne[x]].from == i)
+        ce[c++] = ne[x];
+  }
+  cs[ncell] = c;
+  trailattach(base, *size);
+  return base;
+}
+
+static double meters(double long1, double lat1, double long2, double lat2) {
+  return hypot((long2 - long1) * DEG2RAD(1.0) * EARTHRADIUS *
+                   cos(DEG2RAD(lat1)),
+               (lat2 - lat1) * DEG2RAD(1.0) * EARTHRADIUS);
+}
+
+static void walk(uint32_t n) {
+  struct linxdata fix;
+  double t, along, cost, truelong[MATCHWINDOW], truelat[MATCHWINDOW];
+  double raw, matched, settled;
+  uint32_t at, next, x, y, choice[4];
+  int i, k, nsettled;
+  size_t size;
+  void *base;
+
+  base = lattice(n, &size);
+  radius = 50.0;
+  ncolumn = 0;
+  memset(&match, 0, sizeof(match));
+  memset(&fix, 0, sizeof(fix));
+  fix.hdop = 3.0;
+  at = n / 2 + n / 2 * n;
+  next = at + 1;
+  along = 0.0;
+  raw = matched = settled = cost = 0.0;
+  nsettled = 0;
+  for (i = 0; i < NFIX; i++) {
+    along += 1.4;
+    if (along >= SPACING) { /* junction, any way but back */
+      along -= SPACING;
+      x = next % n;
+      y = next / n;
+      k = 0;
+      if (x > 0 && next - 1 != at)
+        choice[k++] = next - 1;
+      if (x + 1 < n && next + 1 != at)
+        choice[k++] = next + 1;
+      if (y > 0 && next - n != at)
+        choice[k++] = next - n;
+      if (y + 1 < n && next + n != at)
+        choice[k++] = next + n;
+      at = next;
+      next = choice[rand() % k];
+    }
+    truelong[i % MATCHWINDOW] =
+        (node[at].longitude7 +
+         (node[next].longitude7 - node[at].longitude7) * along / SPACING) *
+        1e-7;
+    truelat[i % MATCHWINDOW] =
+        (node[at].latitude7 +
+         (node[next].latitude7 - node[at].latitude7) * along / SPACING) *
+        1e-7;
+    fix.longitude =
+        truelong[i % MATCHWINDOW] +
+        15.0 * gauss() / (DEG2RAD(1.0) * EARTHRADIUS * cos(DEG2RAD(45.2)));
+    fix.latitude = truelat[i % MATCHWINDOW] +
+                   15.0 * gauss() / (DEG2RAD(1.0) * EARTHRADIUS);
+    fix.gmt = i; /* not a time, tells the settled fix */
+    t = now();
+    matchupdate(&fix);
+    cost += now() - t;
+    raw += meters(truelong[i % MATCHWINDOW], truelat[i % MATCHWINDOW],
+                  fix.longitude, fix.latitude);
+    matched += meters(truelong[i % MATCHWINDOW], truelat[i % MATCHWINDOW],
+                      match.matchlongitude, match.matchlatitude);
+    if (match.settledgmt) {
+      k = match.settledgmt % MATCHWINDOW;
+      settled += meters(truelong[k], truelat[k], match.settledlongitude,
+                        match.settledlatitude);
+      nsettled++;
+    }
+  }
+  printf("%7u nodes %8u pieces: %5.0f ns/fix, mean error raw %.1f m "
+         "matched %.1f m settled %.1f m, %u breaks\n",
+         head->nnode, head->nedge, cost / NFIX * 1e9, raw / NFIX,
+         matched / NFIX, nsettled ? settled / nsettled : 0.0, match.breaks);
+  free(base);
+  head = NULL;
+}
+
+int main() {
+  walk(30);
+  walk(1000);
+  return 0;
+}
+#endif
@@ -0,0 +1,432 @@
+/**
+ * DOC: -- gpsnav.c -- navigation along a planned route
+ * Peter Thompson -- Nov 2019
+ *
+ * with pmtgpsd.conf navroute every fix is placed on the route and
+ * /dev/shm/pmtgpsnav (struct PMTgpsnav in pmtgps.h) gets
+ *   bearing, distance   to the next waypoint (end of the segment the
+ *                       fix is on), great circle
+ *   crosstrack          meters off the segment, + => right of it
+ *   remaining, eta      meters along the route to its end, and the time
+ *                       at the average moving speed (navspeed km/hr
+ *                       until the fixes give one)
+ *   heading, turn       the pmtfxosd compass (/dev/shm/pmtfxos, dieface
+ *                       1 up) or else the gps track, and how far to turn
+ *                       from it to the waypoint.  The compass is read at
+ *                       every fix, by gpsdrcompass() in gpsdr.c.
+ *
+ * route file - as simroute.c: one point per line, # starts a comment
+ *     longitude latitude [altitude [seconds]]   (only the first 2 used)
+ *
+ * finding the segment: the route can be thousands of points, but a
+ * hiker moves along it, so each fix only looks at the segments from
+ * NAVBACK behind to NAVAHEAD ahead of the last one (flat earth around
+ * the fix, nearest wins, ties to the later one so an out-and-back
+ * route goes on).  Only when the nearest of those is more than NAVLOST
+ * meters away is the whole route searched, at most once every
+ * NAVRESCAN fixes while off it.  See main() below for the cost.
+ */
+/* #define MAINFORTESTING /* enable/disable testing with main() below */
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pmtgps.h"
+
+#define TRUE 1
+#define FALSE 0
+#define EARTHRADIUS 6371000.0 /* meters, mean */
+#define DEG2RAD(x) ((x) * M_PI / 180.0)
+#define RAD2DEG(x) ((x) * 180.0 / M_PI)
+#define NAVBACK 2      /* segments behind the last one searched */
+#define NAVAHEAD 20    /* segments ahead */
+#define NAVLOST 250.0  /* meters, farther => search the whole route */
+#define NAVRESCAN 30   /* fixes between whole route searches */
+#define NAVSMOOTH 60.0 /* moving fixes averaged for the ETA speed */
+
+/* Function Prototypes */
+double gpsdrcompass(double declination);
+
+/**
+ * struct navpoint -- one point of the route
+ */
+struct navpoint {
+  double longitude; /* decimal degrees  + => East,  - => West */
+  double latitude;  /* decimal degrees  + => North, - => South */
+  double along;     /* meters along the route from the first point */
+};
+
+static struct navpoint *route;
+static int npoint;
+static int segment;   /* the fix is on route[segment] ... [segment + 1] */
+static int sincescan; /* fixes since the whole route was searched */
+static double speed;  /* km/hr, average moving */
+static struct PMTgpsnav nav;       /* copied to navnow */
+static struct PMTgpsnav *navnow;   /* shared memory, NULL if not open */
+static unsigned int updates;       /* struct PMTgpsnav begin/end */
+
+/**
+ * distance() - great circle distance between two points
+ * Return: meters
+ */
+static double distance(double long1, double lat1, double long2,
+                       double lat2) {
+  double dlat, dlong, h;
+
+  dlat = DEG2RAD(lat2 - lat1);
+  dlong = DEG2RAD(long2 - long1);
+  h = sin(dlat / 2) * sin(dlat / 2) + cos(DEG2RAD(lat1)) *
+                                          cos(DEG2RAD(lat2)) *
+                                          sin(dlong / 2) * sin(dlong / 2);
+  return 2.0 * EARTHRADIUS * asin(sqrt(h));
+}
+
+/**
+ * bearing() - initial great circle track from 1 to 2
+ * Return: degrees True, 0-360
+ */
+static double bearing(double long1, double lat1, double long2,
+                      double lat2) {
+  double dlong, t;
+
+  lat1 = DEG2RAD(lat1);
+  lat2 = DEG2RAD(lat2);
+  dlong = DEG2RAD(long2 - long1);
+  t = RAD2DEG(atan2(sin(dlong) * cos(lat2),
+                    cos(lat1) * sin(lat2) - sin(lat1) * cos(lat2) * cos(dlong)));
+  return t < 0.0 ? t + 360.0 : t;
+}
+
+/**
+ * struct navfit -- where a fix is on one segment
+ */
+struct navfit {
+  double d2;    /* meters squared from the segment */
+  double t;     /* 0 at its start ... 1 at its end */
+  double cross; /* meters, + => right of it */
+};
+
+/**
+ * fitsegment() - place a fix on segment i, flat earth around the fix
+ * @kx  meters per degree of longitude at the fix
+ * Return: nothing, f is set
+ */
+static void fitsegment(int i, double longitude, double latitude, double kx,
+                       struct navfit *f) {
+  double ax, ay, dx, dy, len2, px, py;
+  const double ky = DEG2RAD(1.0) * EARTHRADIUS;
+
+  ax = (route[i].longitude - longitude) * kx; /* fix at 0,0 */
+  ay = (route[i].latitude - latitude) * ky;
+  dx = (route[i + 1].longitude - route[i].longitude) * kx;
+  dy = (route[i + 1].latitude - route[i].latitude) * ky;
+  len2 = dx * dx + dy * dy;
+  f->t = len2 > 0.0 ? -(ax * dx + ay * dy) / len2 : 0.0;
+  if (f->t < 0.0)
+    f->t = 0.0;
+  else if (f->t > 1.0)
+    f->t = 1.0;
+  px = ax + f->t * dx; /* nearest point of the segment */
+  py = ay + f->t * dy;
+  f->d2 = px * px + py * py;
+  f->cross = len2 > 0.0 ? (dx * ay - dy * ax) / sqrt(len2) : 0.0;
+  f->cross = copysign(sqrt(f->d2), f->cross); /* + => fix right */
+}
+
+/**
+ * findsegment() - the segment nearest a fix, from first to last
+ * @best  output: the fit on it
+ * Return: segment number
+ */
+static int findsegment(int first, int last, double longitude,
+                       double latitude, struct navfit *best) {
+  struct navfit f;
+  double kx;
+  int i, found;
+
+  kx = DEG2RAD(1.0) * EARTHRADIUS * cos(DEG2RAD(latitude));
+  if (first < 0)
+    first = 0;
+  if (last > npoint - 2)
+    last = npoint - 2;
+  found = first;
+  best->d2 = HUGE_VAL;
+  for (i = first; i <= last; i++) {
+    fitsegment(i, longitude, latitude, kx, &f);
+    if (f.d2 <= best->d2 + 0.01) { /* ties go on along the route */
+      *best = f;
+      found = i;
+    }
+  }
+  return found;
+}
+
+/**
+ * navload() - read a route file
+ * Return: number of points
+ */
+static int navload(char *name) {
+  struct navpoint p, *grown;
+  char line[200], *c;
+  FILE *fp;
+  int max;
+
+  fp = fopen(name, "r");
+  if (!fp) {
+    syslog(LOG_NOTICE, "navigation route %s error = %m", name);
+    return 0;
+  }
+  free(route);
+  route = NULL;
+  npoint = max = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    c = strchr(line, '#');
+    if (c)
+      *c = '\0';
+    for (c = line; *c; c++)
+      if (*c == ',')
+        *c = ' ';
+    if (sscanf(line, "%lf %lf", &p.longitude, &p.latitude) != 2)
+      continue;
+    if (npoint == max) {
+      max = max ? 2 * max : 256;
+      grown = realloc(route, max * sizeof(struct navpoint));
+      if (!grown) {
+        syslog(LOG_NOTICE, "navigation route %s: out of memory", name);
+        fclose(fp);
+        free(route);
+        route = NULL;
+        npoint = 0;
+        return 0;
+      }
+      route = grown;
+    }
+    p.along = npoint == 0 ? 0.0
+                          : route[npoint - 1].along +
+                                distance(route[npoint - 1].longitude,
+                                         route[npoint - 1].latitude,
+                                         p.longitude, p.latitude);
+    route[npoint++] = p;
+  }
+  fclose(fp);
+  if (npoint < 2) {
+    syslog(LOG_NOTICE, "navigation route %s needs 2 points", name);
+    npoint = 0;
+  }
+  return npoint;
+}
+
+/**
+ * navupdate() - place a fix on the route, fill in nav
+ * @linx   fix
+ * Return: nothing
+ */
+static void navupdate(struct linxdata *linx) {
+  struct navpoint *w;
+  struct navfit fit;
+  int gmt, s;
+
+  segment = findsegment(segment - NAVBACK, segment + NAVAHEAD,
+                        linx->longitude, linx->latitude, &fit);
+  sincescan++;
+  if (fit.d2 > NAVLOST * NAVLOST && sincescan >= NAVRESCAN) {
+    segment = findsegment(0, npoint - 2, linx->longitude, linx->latitude,
+                          &fit);
+    sincescan = 0;
+    nav.scans++;
+  }
+
+  w = &route[segment + 1];
+  nav.waypoints = npoint;
+  nav.waypoint = segment + 1;
+  nav.bearing = bearing(linx->longitude, linx->latitude, w->longitude,
+                        w->latitude);
+  nav.distance = distance(linx->longitude, linx->latitude, w->longitude,
+                          w->latitude);
+  nav.crosstrack = fit.cross;
+  nav.remaining = route[npoint - 1].along - route[segment].along -
+                  fit.t * (w->along - route[segment].along);
+
+  /* ETA at the average moving speed */
+  if (linx->speed >= GPSMINSPEED)
+    speed += (linx->speed - speed) / NAVSMOOTH;
+  nav.eta = speed > 0.0 ? nav.remaining / (speed / 3.6) : 0.0;
+  gmt = (int)linx->gmt;
+  s = (gmt / 10000 * 3600 + gmt / 100 % 100 * 60 + gmt % 100 +
+       (int)nav.eta) % 86400;
+  nav.etagmt = s / 3600 * 10000 + s / 60 % 60 * 100 + s % 60;
+  nav.date = linx->date;
+  nav.gmt = gmt;
+}
+
+/**
+ * gpsnavopen() - load the route, create /dev/shm/pmtgpsnav
+ * @name   pmtgpsd.conf navroute, "" => no navigation
+ * @kmhr   pmtgpsd.conf navspeed, ETA speed until the fixes give one
+ * Return: number of route points, 0 if none
+ */
+int gpsnavopen(char *name, double kmhr) {
+  int fd;
+
+  if (name[0] == '\0' || navload(name) == 0)
+    return 0;
+  segment = 0;
+  sincescan = NAVRESCAN; /* the first fix can search everything */
+  speed = kmhr > 0.0 ? kmhr : 4.0;
+  memset(&nav, 0, sizeof(nav));
+  nav.waypoints = npoint;
+
+  fd = shm_open(NAVNAME, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    syslog(LOG_NOTICE, "shm_open %s error = %m", NAVNAME);
+    return npoint;
+  }
+  ftruncate(fd, sizeof(struct PMTgpsnav));
+  navnow = mmap(0, sizeof(struct PMTgpsnav), PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+  close(fd);
+  if (navnow == MAP_FAILED) {
+    navnow = NULL;
+    shm_unlink(NAVNAME);
+    return npoint;
+  }
+  memset(navnow, 0, sizeof(struct PMTgpsnav));
+  syslog(LOG_INFO, "navigating %d point route %s, %.1f km", npoint, name,
+         route[npoint - 1].along / 1000.0);
+  return npoint;
+}
+
+/**
+ * gpsnavfix() - navigation for a new fix, to /dev/shm/pmtgpsnav
+ * @linx  fix
+ * Return: nothing
+ */
+void gpsnavfix(struct linxdata *linx) {
+  double heading;
+
+  if (npoint == 0)
+    return;
+  navupdate(linx);
+  heading = gpsdrcompass(linx->declination);
+  if (heading < 0.0)
+    heading = linx->track;
+  nav.heading = heading;
+  nav.turn = fmod(nav.bearing - heading + 540.0, 360.0) - 180.0;
+  if (!navnow)
+    return;
+  nav.begin = ++updates;
+  nav.end = navnow->end; /* still the last update while copying */
+  navnow->begin = nav.begin;
+  __sync_synchronize();
+  *navnow = nav;
+  __sync_synchronize();
+  navnow->end = updates;
+}
+
+/**
+ * gpsnavclose() - remove /dev/shm/pmtgpsnav
+ * Return: nothing
+ */
+void gpsnavclose(void) {
+  free(route);
+  route = NULL;
+  npoint = 0;
+  if (!navnow)
+    return;
+  munmap(navnow, sizeof(struct PMTgpsnav));
+  shm_unlink(NAVNAME);
+  navnow = NULL;
+}
+
+#ifdef MAINFORTESTING
+/*
+ * benchmark: 100000 point route (10 m apart, winding), a hiker on it
+ * 1 m a fix with 5 m of gps noise, the segment search vs searching the
+ * whole route every fix.
+ * gcc -O2 gpsnav.c gpsdr.c gpsconfig.c gpsstats.c -I../../include -lm -lrt
+ *     -lpthread
+ */
+#define NROUTE 100000
+#define NFIX (10 * (NROUTE - 1))
+
+static double now(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static double noise(void) { return (rand() / (double)RAND_MAX - 0.5) * 10.0; }
+
+int main() {
+  struct linxdata fix;
+  struct navfit fit;
+  double heading, f, t, incremental, whole, worst;
+  int i, seg, wrong;
+
+  route = malloc(NROUTE * sizeof(struct navpoint));
+  for (i = 0; i < NROUTE; i++) {
+    if (i == 0) {
+      route[i].longitude = -78.4;
+      route[i].latitude = 45.2;
+      route[i].along = 0.0;
+      continue;
+    }
+    heading = 1.2 * sin(i / 40.0) + (rand() / (double)RAND_MAX - 0.5) * 0.4;
+    route[i].latitude = route[i - 1].latitude + 10.0 * cos(heading) / 111195.0;
+    route[i].longitude =
+        route[i - 1].longitude +
+        10.0 * sin(heading) / (111195.0 * cos(DEG2RAD(45.2)));
+    route[i].along = route[i - 1].along +
+                     distance(route[i - 1].longitude, route[i - 1].latitude,
+                              route[i].longitude, route[i].latitude);
+  }
+  npoint = NROUTE;
+  segment = 0;
+  sincescan = NAVRESCAN;
+  speed = 4.0;
+  memset(&fix, 0, sizeof(fix));
+  fix.speed = 3.6;
+
+  /* 1 m a fix along the route, 10 fixes a segment */
+  wrong = 0;
+  worst = 0.0;
+  t = now();
+  for (i = 0; i < NFIX; i++) {
+    seg = i / 10;
+    f = (i % 10) / 10.0;
+    fix.longitude = route[seg].longitude +
+                    f * (route[seg + 1].longitude - route[seg].longitude) +
+                    noise() / (111195.0 * cos(DEG2RAD(45.2)));
+    fix.latitude = route[seg].latitude +
+                   f * (route[seg + 1].latitude - route[seg].latitude) +
+                   noise() / 111195.0;
+    navupdate(&fix);
+    if (abs(segment - seg) > 3) /* noise can put it next door */
+      wrong++;
+    if (fabs(nav.crosstrack) > worst)
+      worst = fabs(nav.crosstrack);
+  }
+  incremental = (now() - t) / NFIX;
+
+  t = now();
+  for (i = 0; i < 1000; i++) {
+    seg = i * (NROUTE / 1000);
+    findsegment(0, npoint - 2, route[seg].longitude, route[seg].latitude,
+                &fit);
+  }
+  whole = (now() - t) / 1000;
+  printf("%d point route: %.0f ns/fix, whole route %.0f us/fix, %d "
+         "wrong segments, %u whole route searches, worst crosstrack "
+         "%.1f m\n",
+         npoint, incremental * 1e9, whole * 1e6, wrong, nav.scans, worst);
+  return 0;
+}
+#endif
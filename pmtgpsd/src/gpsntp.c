@@ -0,0 +1,215 @@
+/**
+ * DOC: -- gpsntp.c -- fix times to chronyd or ntpd, NTP SHM refclock
+ * Peter Thompson -- Nov 2019
+ *
+ * the boards have no RTC battery and in the backcountry no network, so
+ * the system clock is wrong until something sets it.  Every device fix
+ * has UTC; gpsntpfix() writes it, with the CLOCK_REALTIME its sentence
+ * arrived, to the shared memory segment of the NTP SHM reference clock
+ * (struct ntpshm in pmtgps.h), unit ntpunit of pmtgpsd.conf.  chronyd
+ * compares the two and steers the clock, in chrony.conf:
+ *     refclock SHM 0 refid GPS delay 0.2 offset 0.0
+ *     makestep 1 -1
+ *
+ * the receive time is stamped in linxdriver.c for the sentence's first
+ * byte, backdated from when read() returned, not after parsing, so the
+ * offset chronyd sees is mostly the receiver's own: the fixed delay
+ * from the second to its sentence (set chronyd offset to it) plus the
+ * sentence jitter, milliseconds at 9600 baud.  Bytes that waited in the
+ * tty while the loop was busy (a DEM tile mapped, a track chunk
+ * written) are stamped that much late, so NTPPRECISION claims ~8 ms,
+ * not the 1 ms of the stamp, and chronyd's filter drops the outliers.
+ * Only fixes from the device are written: simulated and saved fixes
+ * have no receive time.
+ *
+ * segment: System V key NTPSHMKEY + unit, created if chronyd has not
+ * already.  Units 0 and 1 are root only (0600), 2 and up 0666, as ntpd
+ * expects.  A write: valid = 0, count++, the fields, count++, valid = 1,
+ * with barriers, so a reader never takes half of one fix and half of
+ * the next (mode 1).
+ */
+/* #define MAINFORTESTING /* enable/disable testing with main() below */
+#define _DEFAULT_SOURCE /* timegm() */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "pmtgps.h"
+
+#define TRUE 1
+#define FALSE 0
+#define NTPPRECISION (-7) /* log2 seconds, ~8 ms: tty queueing, see above */
+#define NTPSAMPLES 3       /* ntpd median filter, chronyd ignores it */
+
+static struct ntpshm *shm; /* NULL => ntpunit -1 or no segment */
+static int ntpunit;
+
+/**
+ * gpsntpopen() - attach the NTP SHM segment
+ * @unit  pmtgpsd.conf ntpunit, -1 => none
+ * Return: TRUE if fix times will be written
+ */
+int gpsntpopen(int unit) {
+  void *base;
+  int id;
+
+  shm = NULL;
+  if (unit < 0)
+    return FALSE;
+  id = shmget(NTPSHMKEY + unit, sizeof(struct ntpshm),
+              IPC_CREAT | (unit <= 1 ? 0600 : 0666));
+  if (id < 0) {
+    syslog(LOG_NOTICE, "NTP SHM unit %d shmget error = %m", unit);
+    return FALSE;
+  }
+  base = shmat(id, NULL, 0);
+  if (base == (void *)-1) {
+    syslog(LOG_NOTICE, "NTP SHM unit %d shmat error = %m", unit);
+    return FALSE;
+  }
+  shm = base;
+  memset(shm, 0, sizeof(struct ntpshm));
+  shm->mode = 1;
+  shm->precision = NTPPRECISION;
+  shm->nsamples = NTPSAMPLES;
+  ntpunit = unit;
+  syslog(LOG_INFO, "fix times to NTP SHM unit %d", unit);
+  return TRUE;
+}
+
+/**
+ * gpsntpfix() - a device fix: its UTC and when it arrived
+ * @linx  fix, date gmt millisecond and realtime from linxdriver.c
+ * Return: nothing
+ */
+void gpsntpfix(struct linxdata *linx) {
+  struct ntpshm sample;
+  struct tm utc;
+  time_t seconds;
+  int hhmmss;
+
+  if (!shm || linx->realtime <= 0.0 || linx->date <= 0)
+    return; /* not from the device, or no fix */
+
+  memset(&utc, 0, sizeof(utc));
+  hhmmss = (int)linx->gmt;
+  utc.tm_year = linx->date / 10000 - 1900;
+  utc.tm_mon = linx->date / 100 % 100 - 1;
+  utc.tm_mday = linx->date % 100;
+  utc.tm_hour = hhmmss / 10000;
+  utc.tm_min = hhmmss / 100 % 100;
+  utc.tm_sec = hhmmss % 100;
+  sample.clockTimeStampSec = timegm(&utc);
+  sample.clockTimeStampNSec = (unsigned)linx->millisecond * 1000000;
+  sample.clockTimeStampUSec = linx->millisecond * 1000;
+
+  seconds = (time_t)floor(linx->realtime);
+  sample.receiveTimeStampSec = seconds;
+  sample.receiveTimeStampNSec =
+      (unsigned)lround((linx->realtime - seconds) * 1e9);
+  if (sample.receiveTimeStampNSec > 999999999)
+    sample.receiveTimeStampNSec = 999999999;
+  sample.receiveTimeStampUSec = sample.receiveTimeStampNSec / 1000;
+
+  shm->valid = 0;
+  shm->count++;
+  __sync_synchronize();
+  shm->clockTimeStampSec = sample.clockTimeStampSec;
+  shm->clockTimeStampUSec = sample.clockTimeStampUSec;
+  shm->clockTimeStampNSec = sample.clockTimeStampNSec;
+  shm->receiveTimeStampSec = sample.receiveTimeStampSec;
+  shm->receiveTimeStampUSec = sample.receiveTimeStampUSec;
+  shm->receiveTimeStampNSec = sample.receiveTimeStampNSec;
+  shm->leap = 0;
+  __sync_synchronize();
+  shm->count++;
+  shm->valid = 1;
+}
+
+/**
+ * gpsntpclose() - no more samples, the segment stays for chronyd
+ * Return: nothing
+ */
+void gpsntpclose(void) {
+  if (!shm)
+    return;
+  shm->valid = 0; /* the last fix must not be taken as new */
+  shmdt(shm);
+  shm = NULL;
+  syslog(LOG_INFO, "NTP SHM unit %d closed", ntpunit);
+}
+
+#ifdef MAINFORTESTING
+/*
+ * test: unit 9 (a key chronyd and ntpd leave alone), write fixes each
+ * with a receive time 0.1234567 s after the fix time, read them back as
+ * ntpd's refclock_shm.c does and check every field.  Then the segment
+ * is removed.
+ * gcc -O2 gpsntp.c -I../../include -lm
+ */
+#define NFIX 1000000
+#define UNIT 9
+
+static double now(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int main() {
+  struct linxdata fix;
+  struct ntpshm copy;
+  double t, offset, worst;
+  int i, count, bad;
+
+  if (!gpsntpopen(UNIT)) {
+    printf("no NTP SHM segment\n");
+    return 1;
+  }
+  memset(&fix, 0, sizeof(fix));
+  fix.date = 20191115;
+  worst = 0.0;
+  bad = 0;
+  t = now();
+  for (i = 0; i < NFIX; i++) {
+    fix.gmt = 120000 + i % 60;
+    fix.millisecond = i % 10 * 100; /* 10 Hz */
+    fix.realtime = 1573819200.0 + i % 60 + fix.millisecond / 1000.0 +
+                   0.1234567;
+    gpsntpfix(&fix);
+
+    /* ntpd: mode 1, take it only if count is the same after the copy */
+    count = shm->count;
+    __sync_synchronize();
+    copy = *shm;
+    __sync_synchronize();
+    if (!copy.valid || count != shm->count) {
+      bad++;
+      continue;
+    }
+    shm->valid = 0;
+    offset = (copy.receiveTimeStampSec - copy.clockTimeStampSec) +
+             ((double)copy.receiveTimeStampNSec -
+              copy.clockTimeStampNSec) * 1e-9;
+    if (fabs(offset - 0.1234567) > worst)
+      worst = fabs(offset - 0.1234567);
+    if (copy.clockTimeStampSec != 1573819200 + i % 60 ||
+        copy.clockTimeStampUSec != fix.millisecond * 1000 ||
+        copy.receiveTimeStampUSec != (int)copy.receiveTimeStampNSec / 1000)
+      bad++;
+  }
+  t = now() - t;
+  printf("%d fixes, %.0f ns each written and read back, %d bad, offset "
+         "error %.0f ns (double seconds since 1970)\n",
+         NFIX, t / NFIX * 1e9, bad, worst * 1e9);
+  gpsntpclose();
+  shmctl(shmget(NTPSHMKEY + UNIT, 0, 0), IPC_RMID, NULL);
+  return 0;
+}
+#endif
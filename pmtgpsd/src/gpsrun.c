@@ -12,8 +12,37 @@
  *      http://www.alexonlinux.com/signal-handling-in-linux
  *
  *  3- calls to linxdriver.c to obtain gps data from Linx R4 gps device
+ *     or, if it is not working, simroute.c (routefile in pmtgpsd.conf)
+ *     or simulate.c (Percy Lake)
+ *
+ *  while simulating, the loop waits in poll() on 2 timerfds:
+ *     simulated fix every 1/simrate seconds (a receiver is 1-10 Hz)
+ *     linxinit() retry every deviceretry seconds, so a receiver
+ *       plugged in late (or after a read error) is picked up
+ *
+ *  throughput and fix-to-shm latency are counted in gpsstats.c
+ *  satellites in view go to /dev/shm/pmtgpssat, see gpssat.c
+ *  the last fix is saved and published at the next start, flagged
+ *  status = GPSSTALE until the device has a fix, see gpslast.c
+ *  positions between fixes go to /dev/shm/pmtgpsdr, see gpsdr.c
+ *  struct PMTgps also has the fix in fixed point (version 2 fields),
+ *  written between 2 increments of sequence so readers can retry
+ *  device fixes are kept in a compact, time indexed log, see gpstrack.c
+ *  geofence enter/exit events go to /dev/shm/pmtgpsfence, see gpsfence.c
+ *  the NTS map sheet and map tiles under the fix are in struct PMTgps
+ *  (version 3 fields), see gpsmap.c
+ *  odometer, climb and moving time go to /dev/shm/pmtgpstrip, SIGUSR1
+ *  starts a new trip, see gpstrip.c
+ *  bearing, cross-track and ETA along navroute go to /dev/shm/pmtgpsnav,
+ *  see gpsnav.c
+ *  fixes snapped to the trails of trailfile go to /dev/shm/pmtgpsmatch,
+ *  see gpsmatch.c
+ *  ground height from SRTM tiles in demdir is in struct PMTgps (version 4
+ *  field) and blended into the published altitude, see gpsdem.c
+ *  device fix times go to chronyd or ntpd (NTP SHM refclock), see gpsntp.c
  */
 /* #define MAINFORTESTING /* enable/disable testing with main() below */
+#define _DEFAULT_SOURCE /* timegm() */
 
 #include <signal.h>
 #include <stdio.h>
@@ -22,7 +51,11 @@
 /* for mmap */
 #include <fcntl.h>
 #include <math.h>
+#include <poll.h>
+#include <stdint.h>
 #include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <errno.h>
@@ -40,7 +73,49 @@
 int linxinit(void);
 struct linxdata *linxread(void);
 void linxclose(void);
+void linxstop(void);
+int gpssatopen(void);
+void gpssatclose(void);
 void simulate(struct PMTgps *, int);
+struct gpsconfig *gpsconfig(void);
+void gpsstatsfix(double);
+void gpsstatslog(double);
+int simrouteopen(char *, double, double);
+struct linxdata *simroute(void);
+void linxaid(struct linxdata *);
+int gpslastload(struct linxdata *, time_t *);
+void gpslastsave(void);
+void gpslastfix(struct linxdata *, double);
+int gpsdropen(void);
+void gpsdrfix(struct linxdata *);
+void gpsdrclose(void);
+int gpstrackopen(void);
+void gpstrackfix(struct PMTgps *, double);
+void gpstrackclose(void);
+int gpsfenceopen(char *);
+int gpsfencefix(struct linxdata *);
+void gpsfenceclose(void);
+int gpsmap(struct PMTgps *);
+int gpstripopen(void);
+void gpstripreset(void);
+void gpstripfix(struct linxdata *, double, double);
+void gpstripclose(void);
+
+int gpsnavopen(char *, double);
+void gpsnavfix(struct linxdata *);
+void gpsnavclose(void);
+
+int gpsmatchopen(char *, double);
+int gpsmatchfix(struct linxdata *);
+void gpsmatchclose(void);
+
+int gpsdemopen(char *);
+double gpsdem(double, double);
+void gpsdemclose(void);
+int gpsntpopen(int);
+void gpsntpfix(struct linxdata *);
+void gpsntpclose(void);
+struct linxdata *gpskalman(struct linxdata *, double, double *);
 
 /**
  *DDtoDMS - convert decimal degree longitude/latitude to degree minute
@@ -75,6 +150,194 @@ struct dms *DDtoDMS(double dd, int longlat) {
   return &ddmmss;
 }
 
+/**
+ * timerfdnew() - periodic timer as a file descriptor for poll()
+ * @seconds  period,  0 => never expires
+ * Return: file descriptor, -1 on error
+ */
+static int timerfdnew(double seconds) {
+  struct itimerspec period;
+  int tfd;
+
+  tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (tfd < 0)
+    return -1;
+  memset(&period, 0, sizeof(period));
+  period.it_interval.tv_sec = (time_t)seconds;
+  period.it_interval.tv_nsec = (long)((seconds - (time_t)seconds) * 1e9);
+  period.it_value = period.it_interval; /* all 0 => disarmed */
+  timerfd_settime(tfd, 0, &period, NULL);
+  return tfd;
+}
+
+/**
+ * fixed7() - decimal degrees to struct PMTgps 1e-7 degrees
+ * Return: rounded, + => East or North
+ */
+static int32_t fixed7(double dd) { return (int32_t)lround(dd * 1e7); }
+
+/**
+ * dmsto7() - struct PMTgps ddmmss to 1e-7 degrees, for simulate.c fixes
+ * @dms   format = dddmmss
+ * @nsew  W or S => negative
+ * Return: 1e-7 degrees
+ */
+static int32_t dmsto7(int dms, char nsew) {
+  int64_t d;
+
+  d = (dms / 10000) * 10000000LL + (dms / 100 % 100) * 10000000LL / 60 +
+      (dms % 100) * 10000000LL / 3600;
+  return (int32_t)(nsew == 'W' || nsew == 'S' ? -d : d);
+}
+
+/**
+ * fixtime() - UTC of a fix in nanoseconds since 1970
+ * @date         yyyymmdd
+ * @gmt          hhmmss
+ * @millisecond  .sss of gmt
+ * Return: nanoseconds, 0 if no date
+ */
+static int64_t fixtime(int date, double gmt, int millisecond) {
+  struct tm utc;
+  int hhmmss;
+
+  if (date <= 0)
+    return 0;
+  memset(&utc, 0, sizeof(utc));
+  hhmmss = (int)gmt;
+  utc.tm_year = date / 10000 - 1900;
+  utc.tm_mon = date / 100 % 100 - 1;
+  utc.tm_mday = date % 100;
+  utc.tm_hour = hhmmss / 10000;
+  utc.tm_min = hhmmss / 100 % 100;
+  utc.tm_sec = hhmmss % 100;
+  return (int64_t)timegm(&utc) * 1000000000LL + millisecond * 1000000LL;
+}
+
+/**
+ * groundmm() - struct PMTgps groundmm at a position
+ * Return: millimeters, GPSNOGROUND if no elevation tile
+ */
+static int32_t groundmm(int32_t longitude7, int32_t latitude7) {
+  double ground;
+
+  ground = gpsdem(longitude7 * 1e-7, latitude7 * 1e-7);
+  return isnan(ground) ? GPSNOGROUND : (int32_t)lround(ground * 1000.0);
+}
+
+/**
+ * gpssimulate() - simulate.c fix on shared memory, with the version 2
+ *  to 4 fields made from it
+ * @sim  NULL_ISLAND, PERCY_LAKE ...
+ * Return: nothing
+ */
+static void gpssimulate(struct PMTgps *gpsnow, int sim) {
+  gpsnow->sequence++; /* odd, writing */
+  __sync_synchronize();
+  simulate(gpsnow, sim);
+  gpsnow->version = PMTGPSVERSION;
+  gpsnow->longitude7 = gpsnow->rawlongitude7 =
+      dmsto7(gpsnow->longitude, gpsnow->longitudeEW);
+  gpsnow->latitude7 = gpsnow->rawlatitude7 =
+      dmsto7(gpsnow->latitude, gpsnow->latitudeNS);
+  gpsnow->altitudemm = gpsnow->rawaltitudemm = gpsnow->altitude * 304.8;
+  gpsnow->fixtime = 0;
+  gpsmap(gpsnow);
+  gpsnow->groundmm = groundmm(gpsnow->longitude7, gpsnow->latitude7);
+  gpsnow->rawlongitude = gpsnow->longitude;
+  gpsnow->rawlongitudeEW = gpsnow->longitudeEW;
+  gpsnow->rawlatitude = gpsnow->latitude;
+  gpsnow->rawlatitudeNS = gpsnow->latitudeNS;
+  gpsnow->rawaltitude = gpsnow->altitude;
+  gpsnow->rawspeed = gpsnow->speed;
+  gpsnow->rawtrack = gpsnow->track;
+  __sync_synchronize();
+  gpsnow->sequence++;
+}
+
+/**
+ * gpspublish() - reformat linx data to gpsnow data on shared memory
+ * @linx      fix to publish, Kalman filtered or raw
+ * @raw       fix as received
+ * @accuracy  meters, 1 sigma of linx
+ * @stale     TRUE => saved fix from before this start
+ * Return: nothing
+ */
+static void gpspublish(struct PMTgps *gpsnow, struct linxdata *linx,
+                       struct linxdata *raw, double accuracy, int stale) {
+  struct dms *ddmmss; /* declared in DDtoDMS()  */
+  int longitude, latitude;
+
+  gpsnow->sequence++; /* odd, writing */
+  __sync_synchronize();
+  gpsnow->version = PMTGPSVERSION;
+  gpsnow->longitude7 = fixed7(linx->longitude);
+  gpsnow->latitude7 = fixed7(linx->latitude);
+  gpsnow->altitudemm = lround(linx->altitude * 1000.0);
+  gpsnow->rawlongitude7 = fixed7(raw->longitude);
+  gpsnow->rawlatitude7 = fixed7(raw->latitude);
+  gpsnow->rawaltitudemm = lround(raw->altitude * 1000.0);
+  gpsnow->fixtime = fixtime(raw->date, raw->gmt, raw->millisecond);
+  gpsmap(gpsnow);
+  gpsnow->groundmm = groundmm(gpsnow->longitude7, gpsnow->latitude7);
+
+  ddmmss = DDtoDMS(raw->longitude, LONG);
+  gpsnow->rawlongitude =
+      ddmmss->degrees * 10000 + ddmmss->minutes * 100 + ddmmss->seconds;
+  gpsnow->rawlongitudeEW = ddmmss->nsew;
+  ddmmss = DDtoDMS(raw->latitude, LAT);
+  gpsnow->rawlatitude =
+      ddmmss->degrees * 10000 + ddmmss->minutes * 100 + ddmmss->seconds;
+  gpsnow->rawlatitudeNS = ddmmss->nsew;
+  gpsnow->rawaltitude = raw->altitude * 3.28084;
+  gpsnow->rawspeed = raw->speed;
+  gpsnow->rawtrack = raw->track;
+  gpsnow->hdop = raw->hdop;
+  gpsnow->satellites = raw->satellites;
+  gpsnow->accuracy = accuracy;
+
+  ddmmss = DDtoDMS(linx->longitude, LONG);
+  longitude = ddmmss->degrees * 10000 + ddmmss->minutes * 100 + ddmmss->seconds;
+  gpsnow->longitudeEW = ddmmss->nsew;
+  ddmmss = DDtoDMS(linx->latitude, LAT);
+  latitude = ddmmss->degrees * 10000 + ddmmss->minutes * 100 + ddmmss->seconds;
+  gpsnow->latitudeNS = ddmmss->nsew;
+  if (stale)
+    gpsnow->status = GPSSTALE;
+  else if (longitude != gpsnow->longitude || latitude != gpsnow->latitude)
+    gpsnow->status = GPSMOVED;
+  else
+    gpsnow->status = GPSSTILL;
+  gpsnow->longitude = longitude;
+  gpsnow->latitude = latitude;
+  gpsnow->altitude = linx->altitude * 3.28084; /* convert meters to feet */
+  gpsnow->declination = linx->declination;
+  gpsnow->speed = linx->speed;
+  gpsnow->track = linx->track;
+  gpsnow->date = linx->date;
+  gpsnow->gmt = linx->gmt;
+  gpsnow->solartime = gpsnow->longitude / 150000 + gpsnow->gmt;
+  gpsnow->meridianlong = (int)linx->longitude;
+  gpsnow->meridiantime = gpsnow->meridianlong + gpsnow->gmt % 10000;
+  __sync_synchronize();
+  gpsnow->sequence++;
+}
+
+/**
+ * deviceinit() - linxinit(), then aid the receiver with the saved fix
+ *  when pmtgpsd.conf aiding = 1 and the system clock is not behind it
+ * @last   saved fix, NULL => none
+ * @saved  UTC when it was saved
+ * Return: TRUE if the gps device works
+ */
+static int deviceinit(struct linxdata *last, time_t saved) {
+  if (!linxinit())
+    return FALSE;
+  if (last && gpsconfig()->aiding > 0.0 && time(NULL) >= saved)
+    linxaid(last);
+  return TRUE;
+}
+
 volatile sig_atomic_t stopd = 0;
 
 /**
@@ -87,6 +350,12 @@ void terminate(int signum) {
   syslog(LOG_NOTICE, "SIGTERM received for pmtgpsd\n");
 }
 
+/**
+ * tripreset()   SIGUSR1 routine, new trip at the next fix
+ * Return: nothing
+ */
+void tripreset(int signum) { gpstripreset(); }
+
 /**
  * pmtgps() -- continuously posts gps data to shared memory
  * Return: nothing
@@ -94,11 +363,22 @@ void terminate(int signum) {
 void pmtgps(void) {
   struct PMTgps *gpsnow;   /* shared memory structure */
   struct linxdata *linx;   /* gps device Linx R4 data */
+  struct linxdata *fix;    /* linx, Kalman filtered if kalman = 1 */
+  struct linxdata blended; /* fix, altitude blended with the DEM */
   struct sigaction action; /*SIGTERM for daemon stop */
-  struct dms *ddmmss;      /* declared in DDtoDMS()  */
+  struct linxdata last;    /* fix saved before this start */
+  struct linxdata *warm;   /* &last, NULL if none saved */
+  struct gpsconfig *conf;
+  struct pollfd timers[2]; /* [0] simulated fix, [1] device retry */
+  uint64_t expired;
+  double accuracy; /* meters, 1 sigma of fix */
+  double ground;   /* meters, DEM height under fix */
   int fd;
+  time_t saved = 0;
   char err[100];
   int gpsworks; /* flag: simulation vs Linx R4 device */
+  int routing;  /* flag: simulation along routefile vs Percy Lake */
+  int stale;    /* flag: the saved fix is published, no fix since */
 
   /* setup for SIGTERM */
   memset(&action, 0, sizeof(struct sigaction));
@@ -107,6 +387,9 @@ void pmtgps(void) {
     sprintf(err, "sigaction error = %s\n", strerror(errno));
     syslog(LOG_NOTICE, "%s", err); /*to /var/log/syslog */
   }
+  action.sa_handler = tripreset;
+  action.sa_flags = SA_RESTART; /* the device read() carries on */
+  sigaction(SIGUSR1, &action, NULL);
 
   /* setup for shared memory /dev/shm/pmtgps */
   fd = shm_open(NAME, O_CREAT | O_EXCL | O_RDWR, 0600);
@@ -119,39 +402,124 @@ void pmtgps(void) {
   ftruncate(fd, SIZE);
   gpsnow = mmap(0, SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
 
-  /* initialize shared-memory to NULL ISLAND, Linx chip is slow */
-  simulate(gpsnow, NULL_ISLAND);
+  /* ground height, if demdir in pmtgpsd.conf, before anything is published */
+  gpsdemopen(gpsconfig()->demdir);
+
+  /*
+   * initialize shared-memory to the last fix saved, or NULL ISLAND,
+   * Linx chip is slow
+   */
+  gpssimulate(gpsnow, NULL_ISLAND);
+  warm = NULL;
+  stale = FALSE;
+  if (gpslastload(&last, &saved)) {
+    gpspublish(gpsnow, &last, &last, 0.0, TRUE);
+    warm = &last;
+    stale = TRUE;
+    syslog(LOG_INFO, "published last fix, saved %ld s ago",
+           (long)(time(NULL) - saved));
+  }
+  gpssatopen();   /* /dev/shm/pmtgpssat, empty until the first fix */
+  gpsdropen();    /* /dev/shm/pmtgpsdr, if drrate in pmtgpsd.conf */
+  gpstrackopen(); /* tracklog.dat and .idx, if tracklog in pmtgpsd.conf */
+  gpstripopen();  /* /dev/shm/pmtgpstrip */
+
+  /* geofences, if fencefile in pmtgpsd.conf, events on /dev/shm/pmtgpsfence */
+  gpsfenceopen(gpsconfig()->fencefile);
+
+  /* route navigation, if navroute in pmtgpsd.conf, on /dev/shm/pmtgpsnav */
+  gpsnavopen(gpsconfig()->navroute, gpsconfig()->navspeed);
+
+  /* map matching, if trailfile in pmtgpsd.conf, on /dev/shm/pmtgpsmatch */
+  gpsmatchopen(gpsconfig()->trailfile, gpsconfig()->trailradius);
+
+  /* fix times to chronyd, if ntpunit in pmtgpsd.conf is not -1 */
+  gpsntpopen((int)gpsconfig()->ntpunit);
 
   /* initialize Linx R4 device */
-  if (linxinit())
+  if (deviceinit(warm, saved))
     gpsworks = TRUE;
   else
     gpsworks = FALSE;
+  conf = gpsconfig();
+  routing = FALSE;
+  if (conf->routefile[0])
+    routing = simrouteopen(conf->routefile, conf->routespeed, conf->simscale);
+
+  /* timers for simulation, only read while the device is not working */
+  timers[0].fd = timerfdnew(1.0 / (conf->simrate > 0.0 ? conf->simrate : 1.0));
+  timers[1].fd = timerfdnew(conf->deviceretry > 0.0 ? conf->deviceretry : 0.0);
+  timers[0].events = timers[1].events = POLLIN;
+  if (timers[0].fd < 0 || timers[1].fd < 0) {
+    sprintf(err, "timerfd error = %s\n", strerror(errno));
+    syslog(LOG_NOTICE, "%s", err); /*to /var/log/syslog */
+  }
 
   /**** START THE BIG LOOP ****/
   while (!stopd) {
-    if (!gpsworks)
-      simulate(gpsnow, PERCY_LAKE);
-    else {
+    if (gpsworks) {
       linx = linxread(); /* gps device data */
-      /* reformat linx data to gpsnow data */
-      ddmmss = DDtoDMS(linx->longitude, LONG);
-      gpsnow->longitude =
-          ddmmss->degrees * 10000 + ddmmss->minutes * 100 + ddmmss->seconds;
-      gpsnow->longitudeEW = ddmmss->nsew;
-      ddmmss = DDtoDMS(linx->latitude, LAT);
-      gpsnow->latitude =
-          ddmmss->degrees * 10000 + ddmmss->minutes * 100 + ddmmss->seconds;
-      gpsnow->latitudeNS = ddmmss->nsew;
-      gpsnow->altitude = linx->altitude * 3.28084; /* convert meters to feet */
-      gpsnow->declination = linx->declination;
-      gpsnow->speed = linx->speed;
-      gpsnow->track = linx->track;
-      gpsnow->date = linx->date;
-      gpsnow->gmt = linx->gmt;
-      gpsnow->solartime = gpsnow->longitude / 150000 + gpsnow->gmt;
-      gpsnow->meridianlong = (int)linx->longitude;
-      gpsnow->meridiantime = gpsnow->meridianlong + gpsnow->gmt % 10000;
+      if (!linx) {
+        /* serial port error, keep the last fix and simulate until retry */
+        linxstop();
+        gpsworks = FALSE;
+        continue;
+      }
+    } else {
+      if (poll(timers, 2, -1) < 0)
+        continue; /* EINTR from SIGTERM */
+      if (timers[1].revents & POLLIN) {
+        read(timers[1].fd, &expired, sizeof(expired));
+        if (deviceinit(warm, saved)) {
+          gpsworks = TRUE;
+          continue;
+        }
+      }
+      if (!(timers[0].revents & POLLIN))
+        continue;
+      read(timers[0].fd, &expired, sizeof(expired));
+      linx = NULL;
+      if (routing)
+        linx = simroute(); /* simulated gps device data */
+      else if (!warm)
+        gpssimulate(gpsnow, PERCY_LAKE); /* the last fix beats Percy Lake */
+    }
+    if (linx) {
+      fix = linx;
+      accuracy = 4.0 * (linx->hdop > 0.0 ? linx->hdop : 2.0); /* UERE*HDOP */
+      if (linx->date == 0) {
+        /* no fix, linxread() gave up after MAXCHAR with the record zeroed:
+         * published unless the saved fix still is, kept from the per-fix
+         * stages */
+        if (!stale)
+          gpspublish(gpsnow, linx, linx, accuracy, FALSE);
+      } else {
+        stale = FALSE;
+        if (conf->kalman > 0.0)
+          fix = gpskalman(linx, conf->kalmanaccel, &accuracy);
+        if (conf->demblend > 0.0) {
+          ground = gpsdem(fix->longitude, fix->latitude);
+          if (!isnan(ground)) {
+            blended = *fix;
+            blended.altitude = conf->demblend * ground +
+                               (1.0 - conf->demblend) * fix->altitude;
+            fix = &blended;
+          }
+        }
+        gpspublish(gpsnow, fix, linx, accuracy, FALSE);
+        gpsdrfix(fix);
+        gpsfencefix(fix);
+        gpstripfix(fix, conf->tripstill, conf->tripclimb);
+        gpsnavfix(fix);
+        gpsmatchfix(fix);
+        if (gpsworks) {
+          gpsntpfix(linx); /* the device's time, not filtered */
+          gpslastfix(fix, conf->lastfixsave);
+          gpstrackfix(gpsnow, conf->tracksync);
+        }
+      }
+      gpsstatsfix(linx->received);
+      gpsstatslog(conf->statsinterval);
     }
 #ifdef MAINFORTESTING
     printf(" hello world \n");
@@ -167,9 +535,22 @@ void pmtgps(void) {
   }
   /**** END THE BIG LOOP ****/
 
+  gpslastsave();
+  gpstrackclose();
+
+  close(timers[0].fd);
+  close(timers[1].fd);
   munmap(gpsnow, SIZE);
   close(fd);
   shm_unlink(NAME);
+  gpssatclose();
+  gpsdrclose();
+  gpsfenceclose();
+  gpstripclose();
+  gpsnavclose();
+  gpsmatchclose();
+  gpsdemclose();
+  gpsntpclose();
   syslog(LOG_NOTICE, "stopping pmtgpsd %d ", getpid());
   return;
 }
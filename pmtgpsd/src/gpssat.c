@@ -0,0 +1,265 @@
+/**
+ * DOC: -- gpssat.c -- satellite table on shared memory /dev/shm/pmtgpssat
+ * Peter Thompson -- Nov 2019
+ *
+ * linxdriver.c passes every GSV and GSA sentence (any talker) here.
+ *   GSV  satellites in view: PRN, elevation, azimuth, SNR.  One cycle
+ *        of sentences per constellation, sentence 1 starts a new list.
+ *   GSA  PRNs used in the fix and the dilutions of precision.  A GN
+ *        receiver sends one GSA per constellation, NMEA 4.1 adds a
+ *        system id at the end, older ones need the PRN range.
+ * At the end of every GSV cycle, and at every fix, the table is copied
+ * to the view readers are not reading and struct PMTgpssat current is
+ * switched to it (double buffering, see pmtgps.h), so field
+ * diagnostics read satellite health without a second process on the
+ * gps port - also with no fix (cold start, indoors), when it matters
+ * most.  date and gmt are of the last fix, 0 before the first.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "pmtgps.h"
+
+#define TRUE 1
+#define FALSE 0
+#define MAXSENTENCE 100 /* as linxdriver.c */
+#define MAXFIELD 24   /* fields in one GSV or GSA sentence */
+#define MAXUSED 16    /* PRNs used per constellation */
+#define NSYSTEM 6     /* SATOTHER ... SATQZSS */
+
+static struct PMTgpssat *satnow; /* shared memory, NULL if not open */
+static unsigned int updates;     /* gpssatview begin/end */
+
+/* table being collected from sentences */
+static struct gpssat work[MAXSAT];
+static int nwork;
+static short used[NSYSTEM][MAXUSED]; /* PRNs in the last GSA */
+static int nused[NSYSTEM];
+static float pdop, hdop, vdop;
+static int satdate, satgmt; /* last fix, 0 = none yet */
+
+static void satpublish(void);
+
+/**
+ * gpssatopen() - create /dev/shm/pmtgpssat
+ * Return: TRUE if ok, FALSE if not (sentences are still parsed)
+ */
+int gpssatopen(void) {
+  int fd;
+
+  fd = shm_open(SATNAME, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    syslog(LOG_NOTICE, "shm_open %s error = %m", SATNAME);
+    return FALSE;
+  }
+  ftruncate(fd, sizeof(struct PMTgpssat));
+  satnow = mmap(0, sizeof(struct PMTgpssat), PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+  close(fd);
+  if (satnow == MAP_FAILED) {
+    satnow = NULL;
+    shm_unlink(SATNAME);
+    return FALSE;
+  }
+  memset(satnow, 0, sizeof(struct PMTgpssat));
+  return TRUE;
+}
+
+/**
+ * gpssatclose() - remove /dev/shm/pmtgpssat
+ * Return: nothing
+ */
+void gpssatclose(void) {
+  if (!satnow)
+    return;
+  munmap(satnow, sizeof(struct PMTgpssat));
+  shm_unlink(SATNAME);
+  satnow = NULL;
+}
+
+/**
+ * talkersystem() - constellation from the NMEA talker id
+ * @s  sentence starting "$tt"
+ * Return: SATGPS ... SATQZSS, SATOTHER for GN (mixed) and unknown
+ */
+static int talkersystem(char *s) {
+  if (strncmp(s + 1, "GP", 2) == 0)
+    return SATGPS;
+  if (strncmp(s + 1, "GL", 2) == 0)
+    return SATGLONASS;
+  if (strncmp(s + 1, "GA", 2) == 0)
+    return SATGALILEO;
+  if (strncmp(s + 1, "GB", 2) == 0 || strncmp(s + 1, "BD", 2) == 0)
+    return SATBEIDOU;
+  if (strncmp(s + 1, "GQ", 2) == 0)
+    return SATQZSS;
+  return SATOTHER;
+}
+
+/**
+ * prnsystem() - constellation of a GN sentence from the NMEA PRN range
+ * Return: SATGLONASS for 65-96, SATGPS otherwise
+ */
+static int prnsystem(int prn) {
+  return (prn >= 65 && prn <= 96) ? SATGLONASS : SATGPS;
+}
+
+/**
+ * split() - break a sentence into its comma separated fields
+ * @s  copy of the sentence, changed in place, ends at '*'
+ * @f  output: fields, f[0] = "$ttGSV" ..., empty fields are ""
+ * Return: number of fields
+ */
+static int split(char *s, char **f) {
+  int n;
+
+  n = 0;
+  f[n++] = s;
+  for (; *s && *s != '*'; s++)
+    if (*s == ',' && n < MAXFIELD) {
+      *s = '\0';
+      f[n++] = s + 1;
+    }
+  *s = '\0';
+  return n;
+}
+
+/**
+ * number() - integer field
+ * Return: value, or missing if the field is empty
+ */
+static int number(char *f, int missing) { return *f ? atoi(f) : missing; }
+
+/**
+ * gpssatgsv() - satellites in view
+ * @sentence  $ttGSV,total,index,inview,{prn,elevation,azimuth,snr}x1-4
+ * Return: nothing
+ */
+void gpssatgsv(char *sentence) {
+  char copy[MAXSENTENCE], *f[MAXFIELD];
+  int n, i, j, system, prn;
+
+  strncpy(copy, sentence, MAXSENTENCE - 1);
+  copy[MAXSENTENCE - 1] = '\0';
+  n = split(copy, f);
+  if (n < 4)
+    return;
+  system = talkersystem(sentence);
+
+  /*
+   * sentence 1 of a cycle replaces this constellation's satellites,
+   * a GN cycle replaces them all
+   */
+  if (atoi(f[2]) == 1) {
+    for (i = j = 0; i < nwork; i++)
+      if (system != SATOTHER && work[i].system != system)
+        work[j++] = work[i];
+    nwork = j;
+  }
+
+  /* whole groups of 4 only - NMEA 4.1 adds a signal id after them */
+  for (i = 4; i + 3 < n && nwork < MAXSAT; i += 4) {
+    prn = number(f[i], 0);
+    if (prn <= 0)
+      continue;
+    work[nwork].system = system != SATOTHER ? system : prnsystem(prn);
+    work[nwork].prn = prn;
+    work[nwork].elevation = number(f[i + 1], -1);
+    work[nwork].azimuth = number(f[i + 2], -1);
+    work[nwork].snr = number(f[i + 3], -1);
+    work[nwork].used = 0;
+    nwork++;
+  }
+
+  /* last sentence of the cycle: publish, fix or not */
+  if (atoi(f[1]) == atoi(f[2]))
+    satpublish();
+}
+
+/**
+ * gpssatgsa() - satellites used in the fix
+ * @sentence  $ttGSA,mode,fix,prn x12,pdop,hdop,vdop[,systemid]
+ * Return: nothing
+ */
+void gpssatgsa(char *sentence) {
+  char copy[MAXSENTENCE], *f[MAXFIELD];
+  int n, i, system, prn;
+
+  strncpy(copy, sentence, MAXSENTENCE - 1);
+  copy[MAXSENTENCE - 1] = '\0';
+  n = split(copy, f);
+  if (n < 18)
+    return;
+  system = talkersystem(sentence);
+  if (n >= 19 && *f[18]) /* NMEA 4.1 system id 1-5 = SATGPS ... */
+    system = atoi(f[18]) >= 1 && atoi(f[18]) <= 5 ? atoi(f[18]) : SATOTHER;
+  if (system == SATOTHER) /* GN without system id */
+    system = prnsystem(number(f[3], 0));
+
+  nused[system] = 0;
+  for (i = 3; i < 15; i++) {
+    prn = number(f[i], 0);
+    if (prn > 0 && nused[system] < MAXUSED)
+      used[system][nused[system]++] = prn;
+  }
+  pdop = atof(f[15]);
+  hdop = atof(f[16]);
+  vdop = atof(f[17]);
+}
+
+/**
+ * gpssatpublish() - copy the table to shared memory for this fix
+ * @date  yyyymmdd
+ * @gmt   hhmmss
+ * Return: nothing
+ */
+void gpssatpublish(int date, int gmt) {
+  satdate = date;
+  satgmt = gmt;
+  satpublish();
+}
+
+/**
+ * satpublish() - copy the table to the view readers are not reading
+ * Return: nothing
+ */
+static void satpublish(void) {
+  struct gpssatview *view;
+  int i, j, next, count;
+
+  if (!satnow)
+    return;
+  next = 1 - satnow->current;
+  view = &satnow->view[next];
+  view->begin = ++updates;
+  __sync_synchronize();
+
+  count = 0;
+  for (i = 0; i < nwork; i++) {
+    view->sat[i] = work[i];
+    view->sat[i].used = 0;
+    for (j = 0; j < nused[work[i].system]; j++)
+      if (used[work[i].system][j] == work[i].prn) {
+        view->sat[i].used = 1;
+        count++;
+        break;
+      }
+  }
+  view->nsat = nwork;
+  view->nused = count;
+  view->date = satdate;
+  view->gmt = satgmt;
+  view->pdop = pdop;
+  view->hdop = hdop;
+  view->vdop = vdop;
+
+  __sync_synchronize();
+  view->end = updates;
+  __sync_synchronize();
+  satnow->current = next;
+}
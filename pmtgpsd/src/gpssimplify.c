@@ -0,0 +1,250 @@
+/**
+ * DOC: -- gpssimplify.c -- track simplification as fixes arrive
+ * Peter Thompson -- Nov 2019
+ *
+ * a week of fixes at 1-10 a second is millions of points, more than a
+ * viewer or an exporter wants.  gpssimplifyfix() takes the fixes as
+ * they come and hands back the few that are kept (vertices), such that
+ * no fix is more than tolerance meters from the line through the
+ * vertices before and after it.  gpstrack.c writes the vertices to
+ * tracklog-simple beside the full track log.
+ *
+ * opening window: from the last vertex (the anchor) the fixes since are
+ * kept while a straight line from the anchor to the newest fix passes
+ * within tolerance of all of them.  When it does not, the fix before
+ * the newest becomes a vertex (its line did pass) and the anchor.
+ * Positions are kept in meters east/north of the anchor, so each check
+ * is a few multiplies.  At most SIMPLEWINDOW fixes are kept: a straight
+ * walk longer than that gets a vertex anyway, memory stays the same
+ * however long the trip, and a fix never costs more than SIMPLEWINDOW
+ * checks (see main() below).
+ */
+/* #define MAINFORTESTING /* enable/disable testing with main() below */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pmtgps.h"
+
+#define TRUE 1
+#define FALSE 0
+#define EARTHRADIUS 6371000.0 /* meters, mean */
+#define DEG2RAD(x) ((x) * M_PI / 180.0)
+#define SIMPLEWINDOW 256 /* fixes kept since the last vertex */
+
+/**
+ * struct simplepoint -- a fix since the anchor
+ */
+struct simplepoint {
+  struct trackpoint fix;
+  double x, y; /* meters east, north of the anchor */
+};
+
+static struct trackpoint anchor;
+static int anchored; /* FALSE => the next fix is the first vertex */
+static struct simplepoint window[SIMPLEWINDOW];
+static int nwindow;
+static double kx, ky; /* meters per 1e-7 degree at the anchor */
+static double tolerance2; /* meters squared */
+
+/**
+ * offline2() - distance from the anchor ... b segment, squared
+ * Return: meters squared
+ */
+static double offline2(struct simplepoint *p, double bx, double by) {
+  double len2, t, dx, dy;
+
+  len2 = bx * bx + by * by;
+  t = len2 > 0.0 ? (p->x * bx + p->y * by) / len2 : 0.0;
+  if (t < 0.0)
+    t = 0.0;
+  else if (t > 1.0)
+    t = 1.0;
+  dx = p->x - t * bx;
+  dy = p->y - t * by;
+  return dx * dx + dy * dy;
+}
+
+/**
+ * setanchor() - a new vertex, fixes are measured from it
+ * Return: nothing
+ */
+static void setanchor(struct trackpoint *fix) {
+  anchor = *fix;
+  anchored = TRUE;
+  ky = DEG2RAD(1e-7) * EARTHRADIUS;
+  kx = ky * cos(DEG2RAD(fix->latitude7 * 1e-7));
+}
+
+/**
+ * gpssimplifyopen() - start a simplified track
+ * @meters  pmtgpsd.conf tracksimplify, largest distance off it
+ * Return: nothing
+ */
+void gpssimplifyopen(double meters) {
+  anchored = FALSE;
+  nwindow = 0;
+  tolerance2 = meters * meters;
+}
+
+/**
+ * gpssimplifyfix() - the next fix of the track
+ * @fix     the fix, later than the one before
+ * @vertex  output: a fix that is kept, if there is one
+ * Return: TRUE if vertex is set
+ */
+int gpssimplifyfix(struct trackpoint *fix, struct trackpoint *vertex) {
+  struct simplepoint *p;
+  double bx, by;
+  int i;
+
+  if (!anchored) {
+    setanchor(fix);
+    *vertex = *fix;
+    return TRUE;
+  }
+  bx = (fix->longitude7 - anchor.longitude7) * kx;
+  by = (fix->latitude7 - anchor.latitude7) * ky;
+  for (i = 0; i < nwindow; i++)
+    if (offline2(&window[i], bx, by) > tolerance2)
+      break;
+
+  if (i == nwindow && nwindow < SIMPLEWINDOW) { /* the line still fits */
+    p = &window[nwindow++];
+    p->fix = *fix;
+    p->x = bx;
+    p->y = by;
+    return FALSE;
+  }
+
+  /* the fix before is a vertex, this fix is the first after it */
+  *vertex = window[nwindow - 1].fix;
+  setanchor(vertex);
+  window[0].fix = *fix;
+  window[0].x = (fix->longitude7 - anchor.longitude7) * kx;
+  window[0].y = (fix->latitude7 - anchor.latitude7) * ky;
+  nwindow = 1;
+  return TRUE;
+}
+
+/**
+ * gpssimplifyflush() - the track ends, the last fix is a vertex
+ * @vertex  output: the last fix, if not a vertex already
+ * Return: TRUE if vertex is set
+ */
+int gpssimplifyflush(struct trackpoint *vertex) {
+  if (nwindow == 0)
+    return FALSE;
+  *vertex = window[nwindow - 1].fix;
+  setanchor(vertex);
+  nwindow = 0;
+  return TRUE;
+}
+
+#ifdef MAINFORTESTING
+/*
+ * benchmark: 10 million fixes of a made up hike, 1 a second at ~1.3 m/s
+ * wandering along a winding trail, with 3 m of gps error (drifting, as
+ * real fixes do, not new every fix) and stops where the fixes wander
+ * about one spot.  Every fix is checked again against the segment of
+ * vertices it falls in, flat earth at the segment rather than at the
+ * anchor.
+ * gcc -O2 gpssimplify.c -I../../include -lm
+ */
+#define NFIX 10000000
+#define TOLERANCE 5.0
+
+static double now(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static double gauss(void) {
+  double u, v;
+
+  u = (rand() + 1.0) / (RAND_MAX + 2.0);
+  v = rand() / (double)RAND_MAX;
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/* meters from p to segment a b, on the sphere near them */
+static double segment(struct trackpoint *p, struct trackpoint *a,
+                      struct trackpoint *b) {
+  double cy, cx, px, py, bx, by, len2, t;
+
+  cy = DEG2RAD(1e-7) * EARTHRADIUS;
+  cx = cy * cos(DEG2RAD((a->latitude7 + (double)b->latitude7) * 0.5e-7));
+  px = (p->longitude7 - a->longitude7) * cx;
+  py = (p->latitude7 - a->latitude7) * cy;
+  bx = (b->longitude7 - a->longitude7) * cx;
+  by = (b->latitude7 - a->latitude7) * cy;
+  len2 = bx * bx + by * by;
+  t = len2 > 0.0 ? (px * bx + py * by) / len2 : 0.0;
+  t = t < 0.0 ? 0.0 : t > 1.0 ? 1.0 : t;
+  return hypot(px - t * bx, py - t * by);
+}
+
+int main() {
+  static struct trackpoint pending[SIMPLEWINDOW + 2];
+  struct trackpoint fix, vertex, last;
+  double t, cost, heading, x, y, ex, ey, worst, d;
+  long vertices;
+  int i, k, npending, still, havelast;
+
+  gpssimplifyopen(TOLERANCE);
+  x = y = ex = ey = heading = 0.0;
+  still = 0;
+  vertices = 0;
+  npending = 0;
+  havelast = FALSE;
+  worst = cost = 0.0;
+  for (i = 0; i < NFIX; i++) {
+    if (still > 0)
+      still--; /* stopped, noise only */
+    else {
+      if (rand() % 3000 == 0)
+        still = 300;
+      heading += 0.02 * gauss() + 0.01 * sin(i / 500.0);
+      x += 1.3 * sin(heading);
+      y += 1.3 * cos(heading);
+    }
+    ex = 0.98 * ex + 0.6 * gauss(); /* 3 m, ~1 minute to change */
+    ey = 0.98 * ey + 0.6 * gauss();
+    fix.ms = 1573800000000LL + i * 1000LL;
+    fix.latitude7 = (int32_t)lround(
+        (45.2 + (y + ey) / (DEG2RAD(1.0) * EARTHRADIUS)) * 1e7);
+    fix.longitude7 = (int32_t)lround(
+        (-78.4 + (x + ex) /
+                     (DEG2RAD(1.0) * EARTHRADIUS * cos(DEG2RAD(45.2)))) *
+        1e7);
+    fix.altitudemm = 440000;
+
+    t = now();
+    k = gpssimplifyfix(&fix, &vertex);
+    cost += now() - t;
+
+    /* check: every fix since the last vertex against the new segment */
+    if (k) {
+      vertices++;
+      for (k = 0; k < npending && pending[k].ms < vertex.ms; k++)
+        if (havelast && (d = segment(&pending[k], &last, &vertex)) > worst)
+          worst = d;
+      last = vertex;
+      havelast = TRUE;
+      npending = 0;
+      if (vertex.ms != fix.ms)
+        pending[npending++] = fix;
+    } else
+      pending[npending++] = fix;
+  }
+  printf("%d fixes => %ld vertices (1 in %.1f), %.0f ns/fix, farthest fix "
+         "%.2f m off (tolerance %.1f), %ld bytes kept\n",
+         NFIX, vertices, (double)NFIX / vertices, cost / NFIX * 1e9, worst,
+         TOLERANCE, (long)sizeof(window));
+  return 0;
+}
+#endif
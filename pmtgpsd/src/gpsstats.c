@@ -0,0 +1,124 @@
+/**
+ * DOC: -- gpsstats.c -- throughput and latency counters for pmtgpsd
+ * Peter Thompson -- Nov 2019
+ *
+ * linxdriver.c counts every NMEA sentence, gpsrun.c counts every fix
+ * it posts to shared memory.  Every statsinterval seconds
+ * (pmtgpsd.conf, 0 => never) one line goes to syslog:
+ *   sentences/sec, bad sentences (checksum), fixes/sec,
+ *   cpu (user+system) per fix,
+ *   fix-to-shm latency = from the first byte of the sentence that
+ *     completed the fix arriving on the serial port to the fix being
+ *     in /dev/shm/pmtgps,  mean and max.
+ *
+ * use with test/nmeareplay.c to measure pmtgpsd without a gps receiver.
+ */
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include <syslog.h>
+#include <time.h>
+
+static struct {
+  double start;      /* gpsclock() at start of interval */
+  double cpu;        /* user+system seconds at start of interval */
+  long sentences;    /* good NMEA sentences */
+  long bad;          /* sentences with bad checksum or too long */
+  long fixes;        /* fixes posted to shared memory */
+  double latency;    /* sum of fix-to-shm latency, seconds */
+  double maxlatency; /* seconds */
+} stats;
+
+/**
+ * gpsclock() - monotonic clock for timestamps inside pmtgpsd
+ * Return: seconds since boot, nanosecond resolution
+ */
+double gpsclock(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/**
+ * cputime() - user + system time used by pmtgpsd
+ * Return: seconds
+ */
+static double cputime(void) {
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+/**
+ * gpsstatsreset() - start a new interval
+ * Return: nothing
+ */
+static void gpsstatsreset(void) {
+  stats.start = gpsclock();
+  stats.cpu = cputime();
+  stats.sentences = stats.bad = stats.fixes = 0;
+  stats.latency = stats.maxlatency = 0.0;
+}
+
+/**
+ * gpsstatsentence() - count one NMEA sentence
+ * @good  TRUE if the checksum was right
+ * Return: nothing
+ */
+void gpsstatsentence(int good) {
+  if (stats.start == 0.0)
+    gpsstatsreset();
+  if (good)
+    stats.sentences++;
+  else
+    stats.bad++;
+}
+
+/**
+ * gpsstatsfix() - count one fix just written to shared memory
+ * @received  gpsclock() when the fix's last sentence started arriving
+ * Return: nothing
+ */
+void gpsstatsfix(double received) {
+  double latency;
+
+  if (stats.start == 0.0)
+    gpsstatsreset();
+  if (received <= 0.0)
+    return; /* no fix, Null Island */
+  latency = gpsclock() - received;
+  stats.fixes++;
+  stats.latency += latency;
+  if (latency > stats.maxlatency)
+    stats.maxlatency = latency;
+}
+
+/**
+ * gpsstatslog() - syslog the counters if interval seconds have passed
+ * @interval  seconds,  0 => never
+ * Return: nothing
+ */
+void gpsstatslog(double interval) {
+  double elapsed, cpu;
+
+  if (interval <= 0.0)
+    return;
+  if (stats.start == 0.0)
+    gpsstatsreset();
+  elapsed = gpsclock() - stats.start;
+  if (elapsed < interval)
+    return;
+
+  cpu = cputime() - stats.cpu;
+  syslog(LOG_INFO,
+         "pmtgpsd stats: %.1f sentences/s (%ld bad), %.2f fixes/s, "
+         "%.1f us cpu/fix, latency mean %.1f us max %.1f us",
+         stats.sentences / elapsed, stats.bad, stats.fixes / elapsed,
+         stats.fixes ? cpu / stats.fixes * 1e6 : 0.0,
+         stats.fixes ? stats.latency / stats.fixes * 1e6 : 0.0,
+         stats.maxlatency * 1e6);
+  gpsstatsreset();
+}
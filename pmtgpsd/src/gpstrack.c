@@ -0,0 +1,350 @@
+/**
+ * DOC: -- gpstrack.c -- binary track log with a time index
+ * Peter Thompson -- Nov 2019
+ *
+ * the NMEA log is ~500 bytes a fix and has to be read from the start to
+ * find where the unit was at a given time.  With pmtgpsd.conf tracklog
+ * every fix from the device is also kept in 2 files (see pmtgps.h):
+ *   tracklog.dat  TRACKCHUNK byte chunks.  A chunk starts with the first
+ *                 fix in full (struct trackchunk), then each fix is the
+ *                 difference from the one before, zig-zag varint coded:
+ *                 ~1 byte milliseconds + 2-3 bytes each coordinate, so
+ *                 a fix is ~8 bytes, 500 fixes a chunk
+ *   tracklog.idx  first and last time of every chunk (struct trackindex)
+ * a reader mmaps the index, binary searches it for a time and decodes
+ * one chunk, see test/trackquery.c.
+ *
+ * the open chunk is kept here and rewritten in place every tracksync
+ * seconds, when it is full, and at stop, so an SD card sees one 4k
+ * write a minute.  A restart begins a new chunk after the last one.
+ * A fix not later than the last one logged is skipped, so the index
+ * stays in time order for the binary search.
+ *
+ * with tracksimplify the fixes also go through gpssimplify.c and the
+ * ones it keeps are written the same way to tracklog-simple.dat and
+ * tracklog-simple.idx, so test/trackquery reads either.
+ */
+/* #define MAINFORTESTING /* enable/disable testing with main() below */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "pmtgps.h"
+
+#define TRUE 1
+#define FALSE 0
+#define MAXFIX 40 /* bytes, worst case of 4 varints */
+
+/* Function Prototypes */
+struct gpsconfig *gpsconfig(void);
+double gpsclock(void);
+void gpssimplifyopen(double);
+int gpssimplifyfix(struct trackpoint *, struct trackpoint *);
+int gpssimplifyflush(struct trackpoint *);
+
+/**
+ * struct tracklog -- one open track log, .dat and .idx
+ */
+struct tracklog {
+  int datfd, idxfd; /* -1 => not logging */
+  unsigned char chunk[TRACKCHUNK];
+  long chunkno;           /* of the open chunk in .dat */
+  int used;               /* bytes of chunk[] used */
+  struct trackpoint last; /* last fix added */
+  double lastsync;        /* gpsclock() of the last write */
+};
+
+static struct tracklog full = {-1, -1};   /* every fix */
+static struct tracklog simple = {-1, -1}; /* tracksimplify vertices */
+
+/**
+ * putvarint() - zig-zag varint: small + and - numbers in few bytes
+ * @p  output, up to 10 bytes
+ * Return: bytes used
+ */
+static int putvarint(unsigned char *p, int64_t v) {
+  uint64_t z;
+  int n;
+
+  z = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); /* 0,-1,1,-2 => 0,1,2,3 */
+  for (n = 0; z >= 0x80; z >>= 7)
+    p[n++] = (unsigned char)(z | 0x80);
+  p[n++] = (unsigned char)z;
+  return n;
+}
+
+/**
+ * tracksync() - write the open chunk and its index entry
+ * Return: nothing
+ */
+static void tracksync(struct tracklog *log) {
+  struct trackchunk *head = (struct trackchunk *)log->chunk;
+  struct trackindex index;
+
+  if (log->datfd < 0 || head->nfix == 0)
+    return;
+  index.first = head->first;
+  index.last = head->last;
+  if (pwrite(log->datfd, log->chunk, TRACKCHUNK,
+             log->chunkno * TRACKCHUNK) != TRACKCHUNK ||
+      pwrite(log->idxfd, &index, sizeof(index),
+             log->chunkno * sizeof(index)) != sizeof(index))
+    syslog(LOG_NOTICE, "track log write error = %m");
+  log->lastsync = gpsclock();
+}
+
+/**
+ * trackstart() - begin the next chunk with a fix
+ * Return: nothing
+ */
+static void trackstart(struct tracklog *log, struct trackpoint *fix) {
+  struct trackchunk *head = (struct trackchunk *)log->chunk;
+
+  memset(log->chunk, 0, TRACKCHUNK);
+  head->magic = TRACKMAGIC;
+  head->nfix = 1;
+  head->first = head->last = fix->ms * 1000000;
+  head->longitude7 = fix->longitude7;
+  head->latitude7 = fix->latitude7;
+  head->altitudemm = fix->altitudemm;
+  log->used = sizeof(struct trackchunk);
+}
+
+/**
+ * trackopen() - open name.dat and name.idx to add to them
+ * Return: TRUE if logging
+ */
+static int trackopen(struct tracklog *log, char *name) {
+  char file[GPSCONFNAME + 16];
+  struct trackindex index;
+  struct stat st;
+
+  snprintf(file, sizeof(file), "%s.dat", name);
+  log->datfd = open(file, O_RDWR | O_CREAT, 0644);
+  if (log->datfd < 0) {
+    syslog(LOG_NOTICE, "track log %s error = %m", file);
+    return FALSE;
+  }
+  snprintf(file, sizeof(file), "%s.idx", name);
+  log->idxfd = open(file, O_RDWR | O_CREAT, 0644);
+  if (log->idxfd < 0) {
+    syslog(LOG_NOTICE, "track log %s error = %m", file);
+    close(log->datfd);
+    log->datfd = -1;
+    return FALSE;
+  }
+
+  /* the index says how many chunks there are, a torn chunk is reused */
+  fstat(log->idxfd, &st);
+  log->chunkno = st.st_size / sizeof(struct trackindex);
+  ((struct trackchunk *)log->chunk)->nfix = 0;
+  log->last.ms = 0;
+  if (log->chunkno > 0 &&
+      pread(log->idxfd, &index, sizeof(index),
+            (log->chunkno - 1) * sizeof(index)) == sizeof(index))
+    log->last.ms = index.last / 1000000;
+  syslog(LOG_INFO, "track log %s chunk %ld", name, log->chunkno);
+  return TRUE;
+}
+
+/**
+ * trackadd() - add a fix to a track log
+ * @interval  seconds between writes
+ * Return: TRUE if added, FALSE if not later than the last
+ */
+static int trackadd(struct tracklog *log, struct trackpoint *fix,
+                    double interval) {
+  struct trackchunk *head = (struct trackchunk *)log->chunk;
+  unsigned char delta[MAXFIX];
+  int n;
+
+  if (fix->ms <= log->last.ms)
+    return FALSE; /* replayed log or receiver clock reset */
+  if (head->nfix == 0) {
+    trackstart(log, fix);
+  } else {
+    n = putvarint(delta, fix->ms - log->last.ms);
+    n += putvarint(delta + n,
+                   (int64_t)fix->longitude7 - log->last.longitude7);
+    n += putvarint(delta + n, (int64_t)fix->latitude7 - log->last.latitude7);
+    n += putvarint(delta + n,
+                   (int64_t)fix->altitudemm - log->last.altitudemm);
+    if (log->used + n > TRACKCHUNK || head->nfix == 0xffff) {
+      tracksync(log);
+      log->chunkno++;
+      trackstart(log, fix);
+    } else {
+      memcpy(log->chunk + log->used, delta, n);
+      log->used += n;
+      head->nfix++;
+      head->bytes = log->used - sizeof(struct trackchunk);
+      head->last = fix->ms * 1000000;
+    }
+  }
+  log->last = *fix;
+  if (gpsclock() - log->lastsync >= interval)
+    tracksync(log);
+  return TRUE;
+}
+
+/**
+ * trackclose() - write the open chunk, close the track log
+ * Return: nothing
+ */
+static void trackclose(struct tracklog *log) {
+  if (log->datfd < 0)
+    return;
+  tracksync(log);
+  close(log->datfd);
+  close(log->idxfd);
+  log->datfd = log->idxfd = -1;
+}
+
+/**
+ * gpstrackopen() - open the track log, if pmtgpsd.conf tracklog is set,
+ *  and the simplified one, if tracksimplify is too
+ * Return: TRUE if logging
+ */
+int gpstrackopen(void) {
+  struct gpsconfig *conf;
+  char name[GPSCONFNAME + 8];
+
+  conf = gpsconfig();
+  if (conf->tracklog[0] == '\0' || !trackopen(&full, conf->tracklog))
+    return FALSE;
+  if (conf->tracksimplify > 0.0) {
+    snprintf(name, sizeof(name), "%s-simple", conf->tracklog);
+    if (trackopen(&simple, name))
+      gpssimplifyopen(conf->tracksimplify);
+  }
+  return TRUE;
+}
+
+/**
+ * gpstrackfix() - add the fix just published to the track log
+ * @gps       /dev/shm/pmtgps with the version 2 fields set
+ * @interval  pmtgpsd.conf tracksync, seconds between writes
+ * Return: nothing
+ */
+void gpstrackfix(struct PMTgps *gps, double interval) {
+  struct trackpoint fix, vertex;
+
+  if (full.datfd < 0 || gps->fixtime == 0)
+    return;
+  fix.ms = gps->fixtime / 1000000;
+  fix.longitude7 = gps->longitude7;
+  fix.latitude7 = gps->latitude7;
+  fix.altitudemm = gps->altitudemm;
+  if (!trackadd(&full, &fix, interval))
+    return;
+  if (simple.datfd >= 0 && gpssimplifyfix(&fix, &vertex))
+    trackadd(&simple, &vertex, interval);
+}
+
+/**
+ * gpstrackclose() - write the open chunks, close the track logs
+ * Return: nothing
+ */
+void gpstrackclose(void) {
+  struct trackpoint vertex;
+
+  if (simple.datfd >= 0 && gpssimplifyflush(&vertex))
+    trackadd(&simple, &vertex, 0.0);
+  trackclose(&simple);
+  trackclose(&full);
+}
+
+#ifdef MAINFORTESTING
+/*
+ * test: a walk logged at 1 fix a second, then at 10 and at 5 (as
+ * pmtgpsd.conf fixrate can set), with a repeated fix now and then (as
+ * a replayed log has), to /tmp/tracktest.  Every chunk is read back and
+ * decoded as test/trackquery.c does: each fix must be there, once, in
+ * time order, at its millisecond.
+ * gcc -O2 gpstrack.c gpssimplify.c gpsstats.c gpsconfig.c -I../../include -lm
+ */
+#define NFIX 3000 /* at each rate */
+
+/* varint as putvarint() wrote it */
+static int64_t getvarint(unsigned char **p) {
+  uint64_t z;
+  int shift;
+
+  z = 0;
+  for (shift = 0; **p & 0x80; shift += 7)
+    z |= (uint64_t)(*(*p)++ & 0x7f) << shift;
+  z |= (uint64_t)*(*p)++ << shift;
+  return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+}
+
+int main() {
+  static int64_t want[3 * NFIX];
+  unsigned char chunk[TRACKCHUNK], *p;
+  struct trackchunk *head = (struct trackchunk *)chunk;
+  struct trackindex index;
+  struct PMTgps gps;
+  int64_t ms, t;
+  int rates[] = {1, 10, 5};
+  int r, i, k, nwant, nread, bad, chunks, fd, idx;
+
+  unlink("/tmp/tracktest.dat");
+  unlink("/tmp/tracktest.idx");
+  unlink("/tmp/tracktest-simple.dat");
+  unlink("/tmp/tracktest-simple.idx");
+  if (!trackopen(&full, "/tmp/tracktest") ||
+      !trackopen(&simple, "/tmp/tracktest-simple"))
+    return 1;
+  gpssimplifyopen(5.0);
+
+  memset(&gps, 0, sizeof(gps));
+  t = 1573819200000LL; /* 2019-11-15 12:00:00 UTC, ms */
+  nwant = 0;
+  for (r = 0; r < 3; r++)
+    for (i = 0; i < NFIX; i++) {
+      t += 1000 / rates[r];
+      gps.fixtime = t * 1000000;
+      gps.longitude7 = -783697184 + (int32_t)(t / 100 % 100000);
+      gps.latitude7 = 452191650 + (int32_t)(t / 77 % 100000);
+      gps.altitudemm = 440000 + i;
+      gpstrackfix(&gps, 60.0);
+      want[nwant++] = t;
+      if (i % 100 == 0)
+        gpstrackfix(&gps, 60.0); /* the same fix again, skipped */
+    }
+  gpstrackclose();
+
+  fd = open("/tmp/tracktest.dat", O_RDONLY);
+  idx = open("/tmp/tracktest.idx", O_RDONLY);
+  nread = bad = chunks = 0;
+  while (read(idx, &index, sizeof(index)) == sizeof(index) &&
+         read(fd, chunk, TRACKCHUNK) == TRACKCHUNK) {
+    chunks++;
+    if (head->magic != TRACKMAGIC || head->first != index.first ||
+        head->last != index.last)
+      bad++;
+    ms = head->first / 1000000;
+    p = chunk + sizeof(struct trackchunk);
+    for (k = 0; k < head->nfix; k++) {
+      if (k > 0) {
+        ms += getvarint(&p);
+        getvarint(&p);
+        getvarint(&p);
+        getvarint(&p);
+      }
+      if (nread >= nwant || ms != want[nread])
+        bad++;
+      nread++;
+    }
+  }
+  close(fd);
+  close(idx);
+  printf("%d fixes at 1, 10 and 5 a second (and %d repeats): %d read back "
+         "from %d chunks, %d wrong\n",
+         nwant, 3 * NFIX / 100, nread, chunks, bad);
+  return bad != 0 || nread != nwant;
+}
+#endif
@@ -0,0 +1,447 @@
+/**
+ * DOC: -- gpstrip.c -- trip computer: distance, climb, moving time
+ * Peter Thompson -- Nov 2019
+ *
+ * every fix pmtgpsd publishes (device or routefile) is added to the
+ * trip on /dev/shm/pmtgpstrip (struct PMTgpstrip in pmtgps.h), so a
+ * display shows odometer, ascent/descent and moving time without
+ * integrating ddmmss positions itself.  kill -USR1 starts a new trip.
+ * The record linxread() returns when it finds no fix (date 0, Null
+ * Island) is skipped, the jump to 0,0 and back is not a trip.
+ *
+ *   distance  only while moving (fix speed >= tripstill km/hr) so the
+ *             few meters a standing fix wanders are not counted.
+ *             Each step is flat earth (equirectangular) with the WGS84
+ *             radii of curvature at its latitude: 2 multiplies and a
+ *             sqrt.  Every TRIPWINDOW moving fixes the straight line
+ *             since the window started is measured again on the
+ *             ellipsoid (Vincenty) and the window's steps are scaled
+ *             by the difference; a step over TRIPLONGSTEP (a gap in
+ *             the fixes) is measured with Vincenty directly.
+ *   ascent    altitude has to move tripclimb meters from the last
+ *   descent   counted altitude before it counts (hysteresis), the
+ *             fix-to-fix altitude noise would otherwise add up to
+ *             hundreds of meters a day
+ *   moving    seconds between fixes (gmt, so simscale is simulated
+ *   stopped   time), by the speed of the later one
+ *
+ * accuracy and speed, see main() below: within 1e-11 of summing every
+ * step with Vincenty, ~60 ns a fix (Vincenty is ~1 us).
+ */
+/* #define MAINFORTESTING /* enable/disable testing with main() below */
+
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pmtgps.h"
+
+#define TRUE 1
+#define FALSE 0
+#define DEG2RAD(x) ((x) * M_PI / 180.0)
+#define WGS84A 6378137.0               /* meters, equatorial radius */
+#define WGS84F (1.0 / 298.257223563)   /* flattening */
+#define WGS84E2 (WGS84F * (2.0 - WGS84F)) /* eccentricity squared */
+#define TRIPWINDOW 60      /* moving fixes between ellipsoid checks */
+#define TRIPLONGSTEP 1000.0 /* meters, longer steps use Vincenty */
+#define TRIPMAXGAP 10.0    /* seconds, longer => moving from distance */
+
+static struct PMTgpstrip *tripnow; /* shared memory, NULL if not open */
+static struct PMTgpstrip trip;     /* the trip, copied to tripnow */
+static unsigned int updates;       /* struct PMTgpstrip begin/end */
+static volatile sig_atomic_t resetting;
+
+/* last fix, and the window checked against the ellipsoid */
+static double lastlong, lastlat, lastreceived, lastgmt;
+static double windowlong, windowlat; /* where the window started */
+static double windowsum;             /* its flat earth steps, meters */
+static int windowfixes;
+
+/**
+ * flatdistance() - short distance, flat earth at the mean latitude
+ * Return: meters
+ */
+static double flatdistance(double long1, double lat1, double long2,
+                           double lat2) {
+  double lat, s, w, n, m, dlong;
+
+  lat = DEG2RAD((lat1 + lat2) / 2.0);
+  s = sin(lat);
+  w = 1.0 - WGS84E2 * s * s;
+  n = WGS84A / sqrt(w);              /* prime vertical radius */
+  m = WGS84A * (1.0 - WGS84E2) / (w * sqrt(w)); /* meridian radius */
+  dlong = long2 - long1;
+  if (dlong > 180.0)
+    dlong -= 360.0;
+  else if (dlong < -180.0)
+    dlong += 360.0;
+  return hypot(m * DEG2RAD(lat2 - lat1), n * cos(lat) * DEG2RAD(dlong));
+}
+
+/**
+ * vincenty() - distance on the WGS84 ellipsoid, Vincenty's inverse
+ * Return: meters, flatdistance() if it does not converge (antipodes)
+ */
+static double vincenty(double long1, double lat1, double long2,
+                       double lat2) {
+  double b, l, u1, u2, su1, cu1, su2, cu2, lambda, lambdap, sl, cl, ss, cs,
+      sigma, sa, c2a, c2sm, c, u, k1, k2, ds;
+  int i;
+
+  b = WGS84A * (1.0 - WGS84F);
+  l = DEG2RAD(long2 - long1);
+  u1 = atan((1.0 - WGS84F) * tan(DEG2RAD(lat1)));
+  u2 = atan((1.0 - WGS84F) * tan(DEG2RAD(lat2)));
+  su1 = sin(u1);
+  cu1 = cos(u1);
+  su2 = sin(u2);
+  cu2 = cos(u2);
+  lambda = l;
+  for (i = 0; i < 100; i++) {
+    sl = sin(lambda);
+    cl = cos(lambda);
+    ss = hypot(cu2 * sl, cu1 * su2 - su1 * cu2 * cl);
+    if (ss == 0.0)
+      return 0.0; /* same point */
+    cs = su1 * su2 + cu1 * cu2 * cl;
+    sigma = atan2(ss, cs);
+    sa = cu1 * cu2 * sl / ss;
+    c2a = 1.0 - sa * sa;
+    c2sm = c2a != 0.0 ? cs - 2.0 * su1 * su2 / c2a : 0.0; /* equator */
+    c = WGS84F / 16.0 * c2a * (4.0 + WGS84F * (4.0 - 3.0 * c2a));
+    lambdap = lambda;
+    lambda = l + (1.0 - c) * WGS84F * sa *
+                     (sigma + c * ss * (c2sm + c * cs *
+                                                   (-1.0 + 2.0 * c2sm * c2sm)));
+    if (fabs(lambda - lambdap) <= 1e-12 * fabs(lambda)) /* short too */
+      break;
+  }
+  if (i == 100)
+    return flatdistance(long1, lat1, long2, lat2);
+  u = c2a * (WGS84A * WGS84A - b * b) / (b * b);
+  k1 = 1.0 + u / 16384.0 * (4096.0 + u * (-768.0 + u * (320.0 - 175.0 * u)));
+  k2 = u / 1024.0 * (256.0 + u * (-128.0 + u * (74.0 - 47.0 * u)));
+  ds = k2 * ss *
+       (c2sm + k2 / 4.0 *
+                   (cs * (-1.0 + 2.0 * c2sm * c2sm) -
+                    k2 / 6.0 * c2sm * (-3.0 + 4.0 * ss * ss) *
+                        (-3.0 + 4.0 * c2sm * c2sm)));
+  return b * k1 * (sigma - ds);
+}
+
+/**
+ * seconds() - fix time, gmt hhmmss and millisecond, as seconds of the day
+ * Return: seconds
+ */
+static double seconds(struct linxdata *linx) {
+  int hhmmss;
+
+  hhmmss = (int)linx->gmt;
+  return hhmmss / 10000 * 3600 + hhmmss / 100 % 100 * 60 + hhmmss % 100 +
+         linx->millisecond / 1000.0;
+}
+
+/**
+ * tripstart() - a new trip from this fix
+ * Return: nothing
+ */
+static void tripstart(struct linxdata *linx) {
+  unsigned int resets;
+
+  resets = trip.resets;
+  memset(&trip, 0, sizeof(trip));
+  trip.resets = resets;
+  trip.startdate = linx->date;
+  trip.startgmt = (int)linx->gmt;
+  trip.altitude = linx->altitude;
+  windowlong = linx->longitude;
+  windowlat = linx->latitude;
+  windowsum = 0.0;
+  windowfixes = 0;
+}
+
+/**
+ * tripstep() - distance from the last fix, with the window correction
+ * Return: meters
+ */
+static double tripstep(struct linxdata *linx) {
+  double step, flat, exact;
+
+  step = flatdistance(lastlong, lastlat, linx->longitude, linx->latitude);
+  if (step > TRIPLONGSTEP)
+    step = vincenty(lastlong, lastlat, linx->longitude, linx->latitude);
+  windowsum += step;
+  if (++windowfixes < TRIPWINDOW)
+    return step;
+
+  /* the window's straight line, flat earth vs ellipsoid */
+  flat = flatdistance(windowlong, windowlat, linx->longitude, linx->latitude);
+  exact = vincenty(windowlong, windowlat, linx->longitude, linx->latitude);
+  if (flat > TRIPLONGSTEP / 10.0 && fabs(exact / flat - 1.0) < 0.01)
+    step += windowsum * (exact / flat - 1.0);
+  windowlong = linx->longitude;
+  windowlat = linx->latitude;
+  windowsum = 0.0;
+  windowfixes = 0;
+  return step;
+}
+
+/**
+ * gpstripopen() - create /dev/shm/pmtgpstrip
+ * Return: TRUE if ok
+ */
+int gpstripopen(void) {
+  int fd;
+
+  fd = shm_open(TRIPNAME, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    syslog(LOG_NOTICE, "shm_open %s error = %m", TRIPNAME);
+    return FALSE;
+  }
+  ftruncate(fd, sizeof(struct PMTgpstrip));
+  tripnow = mmap(0, sizeof(struct PMTgpstrip), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+  close(fd);
+  if (tripnow == MAP_FAILED) {
+    tripnow = NULL;
+    shm_unlink(TRIPNAME);
+    return FALSE;
+  }
+  memset(tripnow, 0, sizeof(struct PMTgpstrip));
+  return TRUE;
+}
+
+/**
+ * gpstripreset() - start a new trip at the next fix, from a signal
+ * Return: nothing
+ */
+void gpstripreset(void) { resetting = TRUE; }
+
+/**
+ * gpstripfix() - add a fix to the trip
+ * @linx   fix, received = gpsclock() it arrived, date 0 => no fix,
+ *         ignored
+ * @still  pmtgpsd.conf tripstill, km/hr
+ * @climb  pmtgpsd.conf tripclimb, meters
+ * Return: nothing
+ */
+void gpstripfix(struct linxdata *linx, double still, double climb) {
+  double dt, step;
+  int moving;
+
+  if (linx->date == 0)
+    return;
+  if (resetting || trip.fixes == 0) {
+    if (resetting)
+      trip.resets++;
+    resetting = FALSE;
+    tripstart(linx);
+  } else {
+    /* fix times, simulated fixes (simscale) are not real time */
+    dt = seconds(linx) - lastgmt;
+    if (dt < 0.0)
+      dt += 86400.0; /* midnight */
+    if (dt > 3600.0)
+      dt = linx->received - lastreceived;
+    moving = linx->speed >= still;
+    step = 0.0;
+    if (moving || dt > TRIPMAXGAP)
+      step = tripstep(linx);
+    if (dt > TRIPMAXGAP) { /* no speed over a gap, use the distance */
+      moving = dt > 0.0 && step / dt * 3.6 >= still;
+      if (!moving)
+        step = 0.0;
+    }
+    if (moving) {
+      trip.distance += step;
+      trip.movingtime += dt;
+    } else {
+      trip.stoppedtime += dt;
+      windowlong = linx->longitude; /* start the window again */
+      windowlat = linx->latitude;
+      windowsum = 0.0;
+      windowfixes = 0;
+    }
+    if (linx->altitude > trip.altitude + climb) {
+      trip.ascent += linx->altitude - trip.altitude;
+      trip.altitude = linx->altitude;
+    } else if (linx->altitude < trip.altitude - climb) {
+      trip.descent += trip.altitude - linx->altitude;
+      trip.altitude = linx->altitude;
+    }
+  }
+  if (linx->speed > trip.maxspeed)
+    trip.maxspeed = linx->speed;
+  trip.fixes++;
+  trip.date = linx->date;
+  trip.gmt = (int)linx->gmt;
+  lastlong = linx->longitude;
+  lastlat = linx->latitude;
+  lastreceived = linx->received;
+  lastgmt = seconds(linx);
+
+  if (!tripnow)
+    return;
+  trip.begin = ++updates;
+  trip.end = tripnow->end; /* still the last update while copying */
+  tripnow->begin = trip.begin;
+  __sync_synchronize();
+  *tripnow = trip;
+  __sync_synchronize();
+  tripnow->end = updates;
+}
+
+/**
+ * gpstripclose() - remove /dev/shm/pmtgpstrip
+ * Return: nothing
+ */
+void gpstripclose(void) {
+  if (!tripnow)
+    return;
+  munmap(tripnow, sizeof(struct PMTgpstrip));
+  shm_unlink(TRIPNAME);
+  tripnow = NULL;
+}
+
+#ifdef MAINFORTESTING
+/*
+ * benchmark: synthetic 100 km hike, a wandering walk at 0.1, 1 and 10 fixes
+ * a second, at 45N and 65N, trip distance vs Vincenty on every step
+ * (in long double, double loses ~1e-9 of a 1 m step to rounding).
+ * gcc -O2 gpstrip.c -I../../include -lm -lrt
+ */
+/* vincenty() in long double, the reference */
+static long double vincentyl(long double long1, long double lat1,
+                              long double long2, long double lat2) {
+  long double b, l, u1, u2, su1, cu1, su2, cu2, lambda, lambdap, sl, cl, ss, cs,
+      sigma, sa, c2a, c2sm, c, u, k1, k2, ds;
+  int i;
+
+  b = WGS84A * (1.0 - WGS84F);
+  l = DEG2RAD(long2 - long1);
+  u1 = atanl((1.0 - WGS84F) * tanl(DEG2RAD(lat1)));
+  u2 = atanl((1.0 - WGS84F) * tanl(DEG2RAD(lat2)));
+  su1 = sinl(u1);
+  cu1 = cosl(u1);
+  su2 = sinl(u2);
+  cu2 = cosl(u2);
+  lambda = l;
+  for (i = 0; i < 100; i++) {
+    sl = sinl(lambda);
+    cl = cosl(lambda);
+    ss = hypotl(cu2 * sl, cu1 * su2 - su1 * cu2 * cl);
+    if (ss == 0.0)
+      return 0.0; /* same point */
+    cs = su1 * su2 + cu1 * cu2 * cl;
+    sigma = atan2l(ss, cs);
+    sa = cu1 * cu2 * sl / ss;
+    c2a = 1.0 - sa * sa;
+    c2sm = c2a != 0.0 ? cs - 2.0 * su1 * su2 / c2a : 0.0; /* equator */
+    c = WGS84F / 16.0 * c2a * (4.0 + WGS84F * (4.0 - 3.0 * c2a));
+    lambdap = lambda;
+    lambda = l + (1.0 - c) * WGS84F * sa *
+                     (sigma + c * ss * (c2sm + c * cs *
+                                                   (-1.0 + 2.0 * c2sm * c2sm)));
+    if (fabsl(lambda - lambdap) <= 1e-16 * fabsl(lambda))
+      break;
+  }
+  if (i == 100)
+    return -1.0;
+  u = c2a * (WGS84A * WGS84A - b * b) / (b * b);
+  k1 = 1.0 + u / 16384.0 * (4096.0 + u * (-768.0 + u * (320.0 - 175.0 * u)));
+  k2 = u / 1024.0 * (256.0 + u * (-128.0 + u * (74.0 - 47.0 * u)));
+  ds = k2 * ss *
+       (c2sm + k2 / 4.0 *
+                   (cs * (-1.0 + 2.0 * c2sm * c2sm) -
+                    k2 / 6.0 * c2sm * (-3.0 + 4.0 * ss * ss) *
+                        (-3.0 + 4.0 * c2sm * c2sm)));
+  return b * k1 * (sigma - ds);
+}
+
+static double now(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int main() {
+  static struct linxdata fixes[1000000];
+  double rates[] = {0.1, 1.0, 10.0}, lats[] = {45.0, 65.0};
+  double heading, exact, t, ns;
+  int r, l, i, n;
+
+  for (r = 0; r < 3; r++)
+    for (l = 0; l < 2; l++) {
+      /* 4 km/hr, heading wanders, speed above tripstill */
+      n = (int)(100000.0 / (4.0 / 3.6) * rates[r]);
+      if (n > 1000000)
+        n = 1000000;
+      memset(fixes, 0, sizeof(fixes));
+      heading = 0.0;
+      fixes[0].longitude = -78.0;
+      fixes[0].latitude = lats[l];
+      for (i = 0; i < n; i++) {
+        fixes[i].date = 20191115;
+        t = i / rates[r];
+        fixes[i].gmt = (int)t / 3600 % 24 * 10000 + (int)t / 60 % 60 * 100 +
+                       (int)t % 60;
+        fixes[i].millisecond = (int)lround((t - floor(t)) * 1000.0) % 1000;
+        fixes[i].speed = 4.0;
+        fixes[i].altitude = 400.0 + 50.0 * sin(i / (600.0 * rates[r]));
+        fixes[i].received = i / rates[r];
+        if (i == 0)
+          continue;
+        heading += 0.05 * sin(i * 0.01 / rates[r]) / rates[r];
+        fixes[i].latitude = fixes[i - 1].latitude +
+                            4.0 / 3.6 / rates[r] * cos(heading) / 111132.0;
+        fixes[i].longitude =
+            fixes[i - 1].longitude +
+            4.0 / 3.6 / rates[r] * sin(heading) /
+                (111320.0 * cos(DEG2RAD(fixes[i - 1].latitude)));
+      }
+      exact = 0.0;
+      for (i = 1; i < n; i++)
+        exact += vincentyl(fixes[i - 1].longitude, fixes[i - 1].latitude,
+                           fixes[i].longitude, fixes[i].latitude);
+      trip.fixes = 0;
+      t = now();
+      for (i = 0; i < n; i++)
+        gpstripfix(&fixes[i], 1.0, 5.0);
+      ns = (now() - t) / n * 1e9;
+      printf("%4.1f Hz %2.0fN %7d fixes: %.3f m, Vincenty %.3f m, "
+             "error %.1e, %.0f ns/fix, ascent %.0f m\n",
+             rates[r], lats[l], n, trip.distance, exact,
+             (trip.distance - exact) / exact, ns, trip.ascent);
+    }
+
+  /* walking at 45N 78W, then a no fix record (Null Island), then on */
+  memset(fixes, 0, 7 * sizeof(struct linxdata));
+  for (i = 0; i < 7; i++) {
+    if (i == 5)
+      continue; /* zeroed, as linxread() after MAXCHAR without a fix */
+    fixes[i].date = 20191115;
+    fixes[i].gmt = 120000 + i;
+    fixes[i].longitude = -78.0;
+    fixes[i].latitude = 45.0 + i * 1.2 / 111132.0;
+    fixes[i].altitude = 440.0;
+    fixes[i].speed = 4.3;
+    fixes[i].received = i;
+  }
+  trip.fixes = 0;
+  for (i = 0; i < 7; i++)
+    gpstripfix(&fixes[i], 1.0, 5.0);
+  printf("fixes 1.2 m apart and a no fix record: %.1f m (7.2), "
+         "ascent %.0f m, descent %.0f m, %u fixes%s\n",
+         trip.distance, trip.ascent, trip.descent, trip.fixes,
+         fabs(trip.distance - 7.2) < 0.01 && trip.ascent == 0.0 ? ""
+                                                               : "  WRONG");
+  return 0;
+}
+#endif
@@ -3,7 +3,8 @@
  *
  * for unit testing,  cross-compile with
 arm-linux-gnueabihf-gcc -o testlinxdriver linxdriver.c peterpoint.c
-GeomagnetismLibrary.c  -I ../../include/ -L
+wmmfast.c GeomagnetismLibrary.c gpsconfig.c gpsstats.c ubxdriver.c gpssat.c
+-I ../../include/ -L
 /home/peter/bbb2018/buildroot/output/target/usr/lib  -lm -lrt
  *
  * Linx R4 gps device broadcasts NMEA sentences
@@ -13,6 +14,34 @@ GeomagnetismLibrary.c  -I ../../include/ -L
  *   no parity,
  *   no hardware flow control,
  *   character buffering.
+ *
+ * serial port is pmtgpsd.conf "device", default /dev/ttyS1,
+ * or a pty from test/nmeareplay.c for testing without the Linx R4.
+ * Bytes are read READSIZE at a time and split into sentences at the
+ * end of line, each stamped with the time its '$' arrived: gpsclock()
+ * after the read(), and CLOCK_REALTIME less the time the bytes after
+ * the '$' in that read took at the baud rate (for gpsntp.c, so parsing
+ * and the sentences before it in the same read do not move it).  That
+ * takes the last byte to have arrived as read() returned: bytes left
+ * queued in the tty while the loop was busy still make it late.
+ * A u-blox receiver sending UBX binary frames (ubxdriver.c) on the same
+ * port is recognised by the frame's first byte, 0xB5, which is never
+ * in NMEA text - NAV-PVT frames give fixes without any NMEA.
+ *
+ * receiver configuration (pmtgpsd.conf baud, fixrate, nmeaset):
+ * out of the box the Linx R4 sends 8 sentence types once a second at
+ * 9600 baud and pmtgpsd uses 2 of them.  When any of the three is set
+ * linxinit() finds the receiver's baud rate (autobaud: listen at each
+ * rate for a sentence with a good checksum), then sends MediaTek PMTK
+ * commands - the Linx R4 is a MediaTek MT3339:
+ *   $PMTK251,baud     new baud rate, no reply, we listen at the new rate
+ *   $PMTK314,...      how often each sentence type is sent, 0 = never
+ *   $PMTK220,ms       milliseconds between fixes, 100 = 10 Hz
+ * 314 and 220 are answered $PMTK001,cmd,3 (done).  Finally the output
+ * stream is watched for a few seconds and the fixes/s, sentence types
+ * and baud rate actually seen are logged, with a warning if they are
+ * not what was asked for.  Settings are lost when the receiver loses
+ * power, so they are sent every time the device is opened.
  */
 
 /*  #define MAINFORTESTING */
@@ -20,52 +49,137 @@ GeomagnetismLibrary.c  -I ../../include/ -L
 #include <errno.h>   /* for error messages via errno */
 #include <fcntl.h>   /* File control definitions */
 #include <math.h>    /* fabs() */
+#include <poll.h>    /* poll() with a timeout while configuring */
 #include <stdio.h>   /* Standard input/output definitions */
 #include <stdlib.h>  /* for exit() */
 #include <string.h>  /* String function definitions */
 #include <syslog.h>  /* for syslog */
 #include <termios.h> /* POSIX terminal control definitions */
+#include <time.h>    /* UTC for linxaid() */
 #include <unistd.h>  /* UNIX standard function definitions */
 
+#include "pmtwmm.h" /* declination, also TRUE FALSE - keep after <termios.h> */
+
 #define SUCCESS 1
-#define TRUE 1
 #define FAILURE 0
-#define FALSE 0
 #define MAXCHAR 10000 /* max char to read looking for right NMEA sentence */
+#define READSIZE 512  /* max char per read() of the serial port */
+#define MAXSENTENCE 100 /* NMEA max is 82 char including $ and CR LF */
 #define MOTIONLESS 0.0002778 /* 0.0002778 degrees = 1 second = 101 feet */
+#define MSGNMEA 1 /* linxmessage() found a NMEA sentence */
+#define MSGUBX 2  /* linxmessage() found a UBX frame */
+#define LISTEN 1.2 /* seconds to wait for a sentence at one baud rate */
+#define ACKWAIT 1.0 /* seconds to wait for $PMTK001 */
+#define VERIFY 3.0 /* seconds of output watched after configuring */
+#define MAXTYPE 16 /* sentence types counted while verifying */
 
 /* Function Prototypes */
-void wmminit(void);
-void wmmclose(void);
 int ddmmyytoyyyymmdd(int);
 double dmtodd(double);
-double wmmdeclination(double, double, double, int, int, int);
+struct gpsconfig *gpsconfig(void);
+double gpsclock(void);
+void gpsstatsentence(int);
+int ubxbyte(unsigned char);
+unsigned char *ubxframe(int *);
+int ubxpvt(struct linxdata *);
+void gpssatgsv(char *);
+void gpssatgsa(char *);
+void gpssatpublish(int, int);
 
 static char err[100];
 static struct linxdata gpslinx;
+static struct wmmmodel *wmm;    /* world or enhanced magnetic model */
+static struct wmmstate *wmmnow; /* declination workspace for this thread */
 static int fser; /* File descriptor for serial port */
-FILE *fpgps;     /* File pointer for /var/log/pmtgpsd-nmea.log */
+FILE *fpgps;     /* File pointer for /var/log/pmtgpsd-nmea.log, or NULL */
+
+/* serial port read buffer, and the sentence being assembled from it */
+static char rbuf[READSIZE];
+static int rnext, rlast;          /* next unused char, end of data */
+static double rrealtime;          /* CLOCK_REALTIME when it was read */
+static char sentence[MAXSENTENCE]; /* '$' ... up to '*hh' */
+static int slen;                   /* 0 => waiting for '$' */
+static int inubx;                  /* TRUE => reading a UBX frame */
+static double sreceived;           /* gpsclock() when its '$' was read */
+static double srealtime;           /* CLOCK_REALTIME its '$' arrived */
+static double deadline; /* linxmessage() gives up at this gpsclock(), 0 never */
+static int baudnow;     /* serial port baud rate */
+
+static void linxsetup(struct gpsconfig *conf);
+
+/**
+ * declinit() -- load the magnetic model once, for linxread() and
+ *  simroute.c (which runs when the Linx R4 is not there)
+ * EMM if configured (pmtgpsd.conf), WMM if not or if it fails
+ * Return: nothing, declination is 0.0 if no model loads
+ */
+static void declinit(void) {
+  static int loaded = FALSE;
+  struct gpsconfig *conf;
+
+  if (loaded)
+    return;
+  loaded = TRUE;
+  conf = gpsconfig();
+  wmm = NULL;
+  if (conf->emmfile[0])
+    wmm = emmopen(conf->emmfile, conf->emmsvfile, conf->emmbudget);
+  if (!wmm)
+    wmm = wmmopen(conf->wmmfile);
+  wmmnow = wmmstatenew(wmm); /* NULL => declination = 0.0 */
+  if (strcmp(conf->precision, "float") == 0)
+    wmmprecision(wmmnow, WMMSINGLE);
+  else if (strcmp(conf->precision, "double") == 0)
+    wmmprecision(wmmnow, WMMDOUBLE);
+}
+
+/**
+ * linxdeclination() -- declination at a gps position
+ * @longitude  decimal degrees  + => East,  - => West
+ * @latitude   decimal degrees  + => North, - => South
+ * @altitude   meters above mean sea level
+ * @date       yyyymmdd
+ * Return: degrees, to West = negative, to East = positive
+ */
+double linxdeclination(double longitude, double latitude, double altitude,
+                       int date) {
+  declinit();
+  return wmmdeclination(wmmnow, longitude, latitude, altitude / 1000.0,
+                        date / 10000, (date % 10000) / 100, date % 100);
+}
 
 /**
  * linxinit() -- initialize UART, Null Island for linx R4 gps device --
+ * called again by gpsrun.c every deviceretry seconds until it works,
+ * each different open() error is logged once
  * Return: SUCCESS if initialize ok,  or FAILURE otherwise
  */
 int linxinit(void) {
+  static int lasterrno = 0; /* last open() error logged */
+  static int opened = FALSE; /* nmealog written before */
   struct termios options;
+  struct gpsconfig *conf;
 
-  /*   open serial port 1  */
-  fser = open("/dev/ttyS1", O_RDWR | O_NOCTTY | O_NDELAY);
+  /*   open serial port 1  (or the device in pmtgpsd.conf) */
+  conf = gpsconfig();
+  fser = open(conf->device, O_RDWR | O_NOCTTY | O_NDELAY);
   if (fser == -1) {
-    sprintf(err, "linxinit(): Unable to open /dev/ttyS1 = %s\n",
-            strerror(errno));
-    syslog(LOG_NOTICE, "%s", err); /*to /var/log/syslog */
+    if (errno != lasterrno)
+      syslog(LOG_NOTICE, "linxinit(): Unable to open %s = %s\n", conf->device,
+             strerror(errno)); /*to /var/log/syslog */
+    lasterrno = errno;
     return (FAILURE);
   }
+  lasterrno = 0;
+  /* O_NDELAY only so open() does not wait for carrier, read() blocks */
+  fcntl(fser, F_SETFL, 0);
+  rnext = rlast = slen = inubx = 0;
 
   /* get/set the  options for the port */
   tcgetattr(fser, &options);
-  cfsetispeed(&options, B9600); /* baud rate 9600 */
+  cfsetispeed(&options, B9600); /* baud rate 9600, Linx R4 power on */
   cfsetospeed(&options, B9600);
+  baudnow = 9600;
   options.c_cflag |= (CLOCAL | CREAD);
   options.c_cflag &= ~PARENB; /* Mask the character size to 8 bits, no parity */
   options.c_cflag &= ~CSTOPB;
@@ -76,25 +190,489 @@ int linxinit(void) {
   /* Set the new options for the port */
   tcsetattr(fser, TCSANOW, &options);
 
-  /* log file for NMEA statements */
-  fpgps = fopen("/var/log/pmtgpsd-nmea.log", "w");
-  if (!fpgps) {
-    sprintf(err, " %s\n", strerror(errno));
-    syslog(LOG_NOTICE, "Unable to open /var/log/pmtgpsd-nmea.log = %s", err);
-    return (FAILURE);
+  /* log file for NMEA statements, pmtgpsd.conf nmealog = "" => none */
+  fpgps = NULL;
+  if (conf->nmealog[0]) {
+    fpgps = fopen(conf->nmealog, opened ? "a" : "w"); /* keep on reopen */
+    if (!fpgps) {
+      sprintf(err, " %s\n", strerror(errno));
+      syslog(LOG_NOTICE, "Unable to open %s = %s", conf->nmealog, err);
+      close(fser);
+      return (FAILURE);
+    }
+    opened = TRUE;
   }
 
+  /* optional: faster baud rate, fewer sentences, more fixes per second */
+  if (conf->baud > 0 || conf->fixrate > 0 || conf->nmeaset[0])
+    linxsetup(conf);
+
   /* initialize world magnetic model for declination calculation */
-  wmminit();
+  declinit();
 
   /* success */
-  syslog(LOG_INFO, "Serial port /dev/ttyS1 successfully opened");
+  syslog(LOG_INFO, "Serial port %s successfully opened", conf->device);
   return (SUCCESS);
 }
 
+/**
+ * milliseconds() - .sss of a NMEA time, "123519.200" => 200
+ * @s  the time field
+ * Return: 0 ... 999
+ */
+static int milliseconds(char *s) {
+  int ms, scale;
+
+  while (*s >= '0' && *s <= '9')
+    s++;
+  if (*s++ != '.')
+    return 0;
+  for (ms = 0, scale = 100; scale > 0 && *s >= '0' && *s <= '9'; s++) {
+    ms += (*s - '0') * scale;
+    scale /= 10;
+  }
+  return ms;
+}
+
+/**
+ * nmeachecksum() - check the *hh at the end of a NMEA sentence
+ * @s  sentence from '$', no CR LF
+ * Return: TRUE if hh = XOR of every char between '$' and '*'
+ */
+static int nmeachecksum(char *s) {
+  unsigned int sum, hh;
+  char *c;
+
+  sum = 0;
+  for (c = s + 1; *c && *c != '*'; c++)
+    sum ^= (unsigned char)*c;
+  if (*c != '*' || strlen(c) != 3 || sscanf(c + 1, "%2x", &hh) != 1)
+    return FALSE; /* Linx R4 always sends a checksum */
+  return sum == hh;
+}
+
+/**
+ * linxmessage() - next NMEA sentence or UBX frame from the serial port
+ * @type      output: MSGNMEA or MSGUBX
+ * @received  output: gpsclock() when its '$' or 0xB5 was read
+ * @realtime  output: CLOCK_REALTIME when the same arrived, seconds
+ * @count     output: characters used from the serial port
+ *
+ * algorithm: read() up to READSIZE char, stamp them with the time.
+ *  The last char arrived as read() returned (late if the loop was
+ *  busy and it waited in the tty), one before it 10 bits
+ *  (1 start, 8 data, 1 stop) earlier at baudnow, and so on back.
+ *  '$' starts a sentence (dropping any unfinished one),
+ *  CR or LF ends it.  Sentences longer than MAXSENTENCE or with a bad
+ *  checksum are dropped and counted in gpsstats.c
+ *  0xB5 outside a UBX frame starts one, ubxbyte() says when it ends.
+ *
+ * Return: sentence without CR LF (MSGNMEA), the UBX frame is kept in
+ *  ubxdriver.c (MSGUBX), or NULL on read error or EOF, or with
+ *  errno = ETIMEDOUT if nothing came before deadline (linxsetup() only)
+ */
+static char *linxmessage(int *type, double *received, double *realtime,
+                         int *count) {
+  unsigned char *frame;
+  struct pollfd wait;
+  struct timespec now;
+  double stamp, bytetime;
+  int num, len;
+  char c;
+
+  *count = 0;
+  stamp = sreceived;
+  bytetime = baudnow > 0 ? 10.0 / baudnow : 0.0;
+  while (1) {
+    if (rnext == rlast) {
+      if (deadline > 0.0) {
+        wait.fd = fser;
+        wait.events = POLLIN;
+        num = (deadline - gpsclock()) * 1000.0;
+        if (num <= 0 || poll(&wait, 1, num) <= 0) {
+          errno = ETIMEDOUT;
+          return NULL;
+        }
+      }
+      num = read(fser, rbuf, READSIZE);
+      if (num <= 0) {
+        if (num == 0)
+          errno = 0; /* EOF */
+        return NULL;
+      }
+      stamp = gpsclock();
+      clock_gettime(CLOCK_REALTIME, &now);
+      rrealtime = now.tv_sec + now.tv_nsec * 1e-9;
+      rnext = 0;
+      rlast = num;
+    }
+    c = rbuf[rnext++];
+    (*count)++;
+
+    if (inubx) {
+      num = ubxbyte(c);
+      if (num == UBXMORE)
+        continue;
+      inubx = FALSE;
+      frame = ubxframe(&len);
+      if (fpgps)
+        fwrite(frame, 1, len, fpgps); /* raw, test/nmeareplay.c replays it */
+      gpsstatsentence(num == UBXGOOD);
+      if (num != UBXGOOD)
+        continue;
+      *type = MSGUBX;
+      *received = sreceived;
+      *realtime = srealtime;
+      return (char *)frame;
+    } else if ((unsigned char)c == UBXSYNC1) {
+      if (slen > 0)
+        gpsstatsentence(FALSE); /* unfinished, CR LF lost */
+      slen = 0;
+      inubx = TRUE;
+      ubxbyte(c);
+      sreceived = stamp;
+      srealtime = rrealtime - (rlast - rnext) * bytetime;
+    } else if (c == '$') {
+      if (slen > 0)
+        gpsstatsentence(FALSE); /* unfinished, CR LF lost */
+      sentence[0] = c;
+      slen = 1;
+      sreceived = stamp;
+      srealtime = rrealtime - (rlast - rnext) * bytetime;
+    } else if (c == '\r' || c == '\n') {
+      if (slen == 0)
+        continue; /* LF after CR, or noise */
+      sentence[slen] = '\0';
+      slen = 0;
+      if (fpgps)
+        fprintf(fpgps, "%s\r\n", sentence);
+      if (!nmeachecksum(sentence)) {
+        gpsstatsentence(FALSE);
+        continue;
+      }
+      gpsstatsentence(TRUE);
+      *type = MSGNMEA;
+      *received = sreceived;
+      *realtime = srealtime;
+      return sentence;
+    } else if (slen > 0) {
+      if (slen < MAXSENTENCE - 1)
+        sentence[slen++] = c;
+      else {
+        gpsstatsentence(FALSE); /* too long - lost the end of line */
+        slen = 0;
+      }
+    }
+  }
+}
+
+/* baud rates tried by linxautobaud(), Linx R4 power on rate first */
+static int bauds[] = {9600, 115200, 57600, 38400, 19200, 4800};
+#define NBAUD (sizeof(bauds) / sizeof(bauds[0]))
+
+/* PMTK314 fields: GLL RMC VTG GGA GSA GSV, 11 reserved, ZDA, MCHN */
+#define MTKFIELDS 19
+static struct {
+  char *name;
+  int field;
+} mtknames[] = {{"GLL", 0}, {"RMC", 1}, {"VTG", 2}, {"GGA", 3},
+                {"GSA", 4}, {"GSV", 5}, {"ZDA", 17}};
+#define NMTKNAME (sizeof(mtknames) / sizeof(mtknames[0]))
+
+/**
+ * baudspeed() - termios speed for a baud rate
+ * Return: B4800 ... B115200, or B0 if not one the receiver can use
+ */
+static speed_t baudspeed(int baud) {
+  switch (baud) {
+  case 4800:
+    return B4800;
+  case 9600:
+    return B9600;
+  case 19200:
+    return B19200;
+  case 38400:
+    return B38400;
+  case 57600:
+    return B57600;
+  case 115200:
+    return B115200;
+  }
+  return B0;
+}
+
+/**
+ * linxbaud() - change the serial port baud rate, after sending what
+ *  was written at the old rate, and drop anything read at the old rate
+ * Return: TRUE if ok, FALSE if not a baud rate in baudspeed()
+ */
+static int linxbaud(int baud) {
+  struct termios options;
+  speed_t speed;
+
+  speed = baudspeed(baud);
+  if (speed == B0)
+    return FALSE;
+  tcdrain(fser);
+  tcgetattr(fser, &options);
+  cfsetispeed(&options, speed);
+  cfsetospeed(&options, speed);
+  tcsetattr(fser, TCSANOW, &options);
+  tcflush(fser, TCIFLUSH);
+  rnext = rlast = slen = inubx = 0;
+  baudnow = baud;
+  return TRUE;
+}
+
+/**
+ * linxlisten() - wait for a sentence from the receiver
+ * @want     start of the sentence wanted, "" => any sentence or UBX frame
+ * @seconds  how long to wait
+ * Return: the sentence, or NULL if it did not come
+ */
+static char *linxlisten(char *want, double seconds) {
+  double received, realtime;
+  int type, count;
+  char *s;
+
+  deadline = gpsclock() + seconds;
+  while ((s = linxmessage(&type, &received, &realtime, &count)))
+    if (type == MSGUBX ? !*want : strncmp(s, want, strlen(want)) == 0)
+      break;
+  deadline = 0.0;
+  return s;
+}
+
+/**
+ * linxautobaud() - find the receiver's baud rate: at each rate listen
+ *  for a sentence with a good checksum, at the wrong rate there is none
+ * @first  rate to try before bauds[], 0 => none
+ * Return: baud rate, serial port left at it, or 0 if nothing heard
+ */
+static int linxautobaud(int first) {
+  unsigned int i;
+
+  if (first > 0 && linxbaud(first) && linxlisten("", LISTEN))
+    return first;
+  for (i = 0; i < NBAUD; i++)
+    if (bauds[i] != first && linxbaud(bauds[i]) && linxlisten("", LISTEN))
+      return bauds[i];
+  return 0;
+}
+
+/**
+ * mtksend() - send a PMTK command
+ * @body  command between '$' and '*', "PMTK220,100"
+ * Return: nothing
+ */
+static void mtksend(char *body) {
+  char command[MAXSENTENCE];
+  unsigned int sum;
+  char *c;
+  int len;
+
+  sum = 0;
+  for (c = body; *c; c++)
+    sum ^= (unsigned char)*c;
+  len = snprintf(command, MAXSENTENCE, "$%s*%02X\r\n", body, sum);
+  if (write(fser, command, len) != len)
+    syslog(LOG_NOTICE, "gps receiver: unable to send %s = %m", body);
+}
+
+/**
+ * mtkcommand() - send a PMTK command until the receiver answers
+ *  $PMTK001,cmd,flag  flag 3 = done, 1 = unknown command, 2 = failed
+ * @body  as mtksend()
+ * Return: TRUE if done, FALSE if refused or no answer after 3 tries
+ */
+static int mtkcommand(char *body) {
+  char want[20], *ack;
+  int tries;
+
+  snprintf(want, sizeof(want), "$PMTK001,%.3s,", body + 4);
+  for (tries = 0; tries < 3; tries++) {
+    mtksend(body);
+    ack = linxlisten(want, ACKWAIT);
+    if (ack && ack[strlen(want)] == '3')
+      return TRUE;
+    if (ack) {
+      syslog(LOG_NOTICE, "gps receiver: %s refused, %s", body, ack);
+      return FALSE;
+    }
+  }
+  syslog(LOG_NOTICE, "gps receiver: no answer to %s", body);
+  return FALSE;
+}
+
+/**
+ * mtk314() - PMTK314 command for pmtgpsd.conf nmeaset
+ * @set    sentence types, each sent every fix or every N fixes (1-5)
+ *         "RMC GGA GSA:5 GSV:5", types not named are turned off
+ * @body   output: "PMTK314,0,1,0,1,5,5,0,...,0"
+ * @every  output: fixes between each PMTK314 field, 0 => off
+ * Return: nothing
+ */
+static void mtk314(char *set, char *body, int size, int *every) {
+  char copy[GPSCONFNAME], *name, *colon;
+  unsigned int i;
+  int n, len;
+
+  memset(every, 0, MTKFIELDS * sizeof(int));
+  strncpy(copy, set, GPSCONFNAME - 1);
+  copy[GPSCONFNAME - 1] = '\0';
+  for (name = strtok(copy, " ,\t"); name; name = strtok(NULL, " ,\t")) {
+    n = 1;
+    colon = strchr(name, ':');
+    if (colon) {
+      *colon = '\0';
+      n = atoi(colon + 1);
+      n = n < 1 ? 1 : n > 5 ? 5 : n;
+    }
+    for (i = 0; i < NMTKNAME && strcmp(mtknames[i].name, name); i++)
+      ;
+    if (i < NMTKNAME)
+      every[mtknames[i].field] = n;
+    else
+      syslog(LOG_NOTICE, "gps receiver: nmeaset %s unknown, ignored", name);
+  }
+  if (!every[1] || !every[3])
+    syslog(LOG_NOTICE, "gps receiver: nmeaset without RMC and GGA, no fixes");
+
+  len = snprintf(body, size, "PMTK314");
+  for (i = 0; i < MTKFIELDS; i++)
+    len += snprintf(body + len, size - len, ",%d", every[i]);
+}
+
+/**
+ * linxverify() - watch the output stream for VERIFY seconds and log
+ *  what the receiver is really doing: baud rate, fixes/s (GGA per
+ *  second), each sentence type per second and how full the port is
+ * @conf   fixrate to check against
+ * @every  from mtk314(), to check turned off sentences are gone,
+ *         NULL => not changed
+ * Return: nothing
+ */
+static void linxverify(struct gpsconfig *conf, int *every) {
+  char types[MAXTYPE][4], list[MAXTYPE * 12], *s;
+  int counts[MAXTYPE], ntype, nfix, type, count, i, len;
+  unsigned int j;
+  double received, realtime;
+  long bytes;
+
+  ntype = nfix = 0;
+  bytes = 0;
+  deadline = gpsclock() + VERIFY;
+  while ((s = linxmessage(&type, &received, &realtime, &count))) {
+    bytes += count;
+    if (type == MSGUBX)
+      continue;
+    if (strncmp(s + 3, "GGA,", 4) == 0)
+      nfix++;
+    for (i = 0; i < ntype && strncmp(types[i], s + 3, 3); i++)
+      ;
+    if (i == ntype && ntype < MAXTYPE) {
+      memcpy(types[i], s + 3, 3);
+      types[i][3] = '\0';
+      counts[ntype++] = 0;
+    }
+    if (i < ntype)
+      counts[i]++;
+  }
+  deadline = 0.0;
+
+  len = 0;
+  list[0] = '\0';
+  for (i = 0; i < ntype; i++)
+    len += snprintf(list + len, sizeof(list) - len, " %s %.1f", types[i],
+                    counts[i] / VERIFY);
+  syslog(LOG_INFO,
+         "gps receiver: %d baud %.0f%% used, %.1f fixes/s, sentences/s:%s",
+         baudnow, bytes * 1000.0 / VERIFY / baudnow, nfix / VERIFY, list);
+
+  if (conf->fixrate > 0.0 && nfix < 0.8 * VERIFY * conf->fixrate)
+    syslog(LOG_NOTICE, "gps receiver: %.1f fixes/s asked for, %.1f seen",
+           conf->fixrate, nfix / VERIFY);
+  for (i = 0; i < ntype && every; i++)
+    for (j = 0; j < NMTKNAME; j++)
+      if (strcmp(types[i], mtknames[j].name) == 0 && !every[mtknames[j].field])
+        syslog(LOG_NOTICE, "gps receiver: %s still sent, not in nmeaset",
+               types[i]);
+}
+
+/**
+ * linxsetup() - configure the receiver from pmtgpsd.conf baud, fixrate
+ *  and nmeaset: find its baud rate, change the rate, the sentences sent
+ *  and the fix rate, then check the output stream (see DOC above)
+ * Return: nothing, the serial port is left at the receiver's baud rate
+ */
+static void linxsetup(struct gpsconfig *conf) {
+  char body[MAXSENTENCE];
+  int every[MTKFIELDS], was, baud;
+
+  was = linxautobaud((int)conf->baud);
+  if (!was) {
+    syslog(LOG_NOTICE, "gps receiver: nothing heard at any baud rate");
+    linxbaud(9600);
+    return;
+  }
+
+  /* baud rate first, so the port has room for a higher fix rate */
+  baud = (int)conf->baud;
+  if (baud > 0 && baud != was) {
+    if (baudspeed(baud) == B0)
+      syslog(LOG_NOTICE, "gps receiver: %d baud not supported", baud);
+    else {
+      snprintf(body, sizeof(body), "PMTK251,%d", baud);
+      mtksend(body);
+      linxbaud(baud);
+      if (!linxlisten("", 2 * LISTEN)) {
+        syslog(LOG_NOTICE, "gps receiver: did not change to %d baud", baud);
+        if (!linxautobaud(was))
+          return;
+      }
+    }
+  }
+
+  if (conf->nmeaset[0]) {
+    mtk314(conf->nmeaset, body, sizeof(body), every);
+    mtkcommand(body);
+  }
+  if (conf->fixrate > 0.0) {
+    snprintf(body, sizeof(body), "PMTK220,%d",
+             (int)(1000.0 / (conf->fixrate > 10.0 ? 10.0 : conf->fixrate)));
+    mtkcommand(body);
+  }
+  linxverify(conf, conf->nmeaset[0] ? every : NULL);
+}
+
+/**
+ * linxaid() - give the receiver a starting position and the time, so
+ *  its first fix after power on comes sooner (pmtgpsd.conf aiding = 1)
+ *  $PMTK741,lat,long,alt,yyyy,mm,dd,hh,mm,ss - MediaTek only
+ * @last  fix saved by gpslast.c, time from the system clock
+ * Return: nothing
+ */
+void linxaid(struct linxdata *last) {
+  char body[MAXSENTENCE];
+  struct tm utc;
+  time_t now;
+
+  now = time(NULL);
+  gmtime_r(&now, &utc);
+  snprintf(body, sizeof(body),
+           "PMTK741,%.6f,%.6f,%.0f,%04d,%02d,%02d,%02d,%02d,%02d",
+           last->latitude, last->longitude, last->altitude,
+           utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour,
+           utc.tm_min, utc.tm_sec);
+  if (mtkcommand(body))
+    syslog(LOG_INFO, "gps receiver: aided with %.4f %.4f", last->longitude,
+           last->latitude);
+}
+
 /**
  * linxread() -- read data from linx R4 gps device --
- * Return: linxdata record or Null Island if MAXCHAR read with no success
+ * Return: linxdata record or Null Island if MAXCHAR read with no success,
+ *  NULL if the serial port failed - call linxstop(), then linxinit()
  */
 struct linxdata *linxread(void) {
 
@@ -102,11 +680,10 @@ struct linxdata *linxread(void) {
   struct GPRMC gprmc;
   /* Flags showing new gps records received TRUE=1,FALSE=0 */
   int gpggaF, gprmcF;
-  char chout;
-  char buf[100];
-  int i, j, num;
+  char *buf;
+  double received, realtime;
+  int j, num, type;
 
-  i = 0;
   gpggaF = gprmcF = FALSE;
 
   /* initiate gpslinx to Null Island */
@@ -119,100 +696,110 @@ struct linxdata *linxread(void) {
       0.0;             /* to West = negative (Toronto), to East = positive */
   gpslinx.speed = 0.0; /* 999.99 = knots per hour */
   gpslinx.track = 0.0; /* 999.99 = track angle in degrees True */
+  gpslinx.received = 0.0;
+  gpslinx.realtime = 0.0;
+  gpslinx.millisecond = 0;
+  gpslinx.hdop = 0.0;
+  gpslinx.satellites = 0;
 
   /*
-   *    Read characters until NMEA sentence found or MAXCHAR char read
-   *    algorithm: look for $ (beginning of new NMEA sentence)
-   *    then examine previous sentence (all char back to last $)
-   *    for $GPGGA or $GPRMC
-   *    if MAXCHAR read without finding NMEA sentence, return NULL pointer
+   *    Read sentences until $--GGA and $--RMC (or a UBX NAV-PVT) found
+   *    or MAXCHAR char read.  Any talker -- (GP, GN, GL ...)
+   *    if MAXCHAR read without finding them, return Null Island
    */
-  for (j = 0; j < MAXCHAR; j++) {
-    /* Read char off serial port */
-    num = read(fser, &chout, sizeof(chout));
-    if (num < 0) {
-      sprintf(err, " %s\n", strerror(errno));
+  for (j = 0; j < MAXCHAR; j += num) {
+    buf = linxmessage(&type, &received, &realtime, &num);
+    if (!buf) {
+      sprintf(err, " %s\n", errno ? strerror(errno) : "EOF");
       syslog(LOG_NOTICE, " error reading serial port = %s", err);
-      sleep(30); /*Linx chip slow to start - wait 30 sec */
-      continue;
-    }
-    if (num == 0) {
-      sprintf(err, " %s\n", strerror(errno));
-      syslog(LOG_NOTICE, "EOF on serial port = %s", err);
-      continue;
+      return NULL;
     }
 
-    /* character found on serial port */
-    if (chout == '$') {
-      /* found NMEA sentence - print it to file*/
-      buf[i] = '\0';
-      fprintf(fpgps, "%s", buf);
-      /* check if NMEA sentence is something we want */
-      if (strncmp(buf, "$GPGGA", 6) == 0) {
-        sscanf(buf + 7, "%f,%f,%c,%f,%c,%d,%d,%f,%f,%c,%f,%c", &gpgga.time,
-               &gpgga.latitude, &gpgga.north, &gpgga.longitude, &gpgga.west,
-               &gpgga.quality, &gpgga.satellites, &gpgga.dilution,
-               &gpgga.altitude, &gpgga.meters, &gpgga.geoid, &gpgga.metric);
-        gpggaF = TRUE;
-      } else if (strncmp(buf, "$GPRMC", 6) == 0) {
-        sscanf(buf + 7, "%f,%c,%f,%c,%f,%c,%f,%f,%d,%f,%c", &gprmc.time,
-               &gprmc.status, &gprmc.latitude, &gprmc.north, &gprmc.longitude,
-               &gprmc.west, &gprmc.speed, &gprmc.track, &gprmc.date,
-               &gprmc.declination, &gprmc.east);
-        gprmcF = TRUE;
-      }
+    /* UBX binary - a NAV-PVT with a fix is a whole gpslinx record */
+    if (type == MSGUBX) {
+      if (!ubxpvt(&gpslinx))
+        continue;
+      gpslinx.declination = linxdeclination(
+          gpslinx.longitude, gpslinx.latitude, gpslinx.altitude, gpslinx.date);
+      gpslinx.received = received;
+      gpslinx.realtime = realtime;
+      return &gpslinx;
+    }
 
-      /* if both NMEA records received, and both are valid... */
-      if (gpggaF && gprmcF && gpgga.quality >= 1 && gpgga.quality <= 5 &&
-          gprmc.status == 'A') {
-        /* create a new gpslinx record */
-        gpslinx.date = ddmmyytoyyyymmdd(gprmc.date);
-        gpslinx.gmt = (int)gpgga.time;
-        gpslinx.latitude = dmtodd(gpgga.latitude);
-        if (gpgga.north == 'S')
-          gpslinx.latitude = -gpslinx.latitude;
-        gpslinx.longitude = dmtodd(gpgga.longitude);
-        if (gpgga.west == 'W')
-          gpslinx.longitude = -gpslinx.longitude;
-        gpslinx.altitude = gpgga.altitude;
-        gpslinx.speed = gprmc.speed * 1.852; /* convert knots/hr to km/hr */
-        gpslinx.track = gprmc.track;
-        gpslinx.declination =
-            wmmdeclination(gpslinx.longitude, gpslinx.latitude,
-                           gpslinx.altitude / 1000.0, gpslinx.date / 10000,
-                           (gpslinx.date % 10000) / 100, gpslinx.date % 100);
-        /*return a new gpslinx record */
-        return &gpslinx;
-      }
-      /*
-       * ...a NMEA sentence found (chout = $), but it is
-       * not the 2 sentences we want, so
-       * look for next NMEA by starting a new NMEA sentence
-       */
-      buf[0] = chout;
-      i = 1;
+    /* check if NMEA sentence is something we want, from any talker */
+    if (strncmp(buf + 3, "GGA,", 4) == 0) {
+      sscanf(buf + 7, "%f,%f,%c,%f,%c,%d,%d,%f,%f,%c,%f,%c", &gpgga.time,
+             &gpgga.latitude, &gpgga.north, &gpgga.longitude, &gpgga.west,
+             &gpgga.quality, &gpgga.satellites, &gpgga.dilution,
+             &gpgga.altitude, &gpgga.meters, &gpgga.geoid, &gpgga.metric);
+      gpslinx.millisecond = milliseconds(buf + 7);
+      gpggaF = TRUE;
+    } else if (strncmp(buf + 3, "RMC,", 4) == 0) {
+      sscanf(buf + 7, "%f,%c,%f,%c,%f,%c,%f,%f,%d,%f,%c", &gprmc.time,
+             &gprmc.status, &gprmc.latitude, &gprmc.north, &gprmc.longitude,
+             &gprmc.west, &gprmc.speed, &gprmc.track, &gprmc.date,
+             &gprmc.declination, &gprmc.east);
+      gprmcF = TRUE;
+    } else if (strncmp(buf + 3, "GSV,", 4) == 0) {
+      gpssatgsv(buf);
+      continue;
+    } else if (strncmp(buf + 3, "GSA,", 4) == 0) {
+      gpssatgsa(buf);
+      continue;
+    } else
       continue;
+
+    /* if both NMEA records received, and both are valid... */
+    if (gpggaF && gprmcF && gpgga.quality >= 1 && gpgga.quality <= 5 &&
+        gprmc.status == 'A') {
+      /* create a new gpslinx record */
+      gpslinx.date = ddmmyytoyyyymmdd(gprmc.date);
+      gpslinx.gmt = (int)gpgga.time;
+      gpslinx.latitude = dmtodd(gpgga.latitude);
+      if (gpgga.north == 'S')
+        gpslinx.latitude = -gpslinx.latitude;
+      gpslinx.longitude = dmtodd(gpgga.longitude);
+      if (gpgga.west == 'W')
+        gpslinx.longitude = -gpslinx.longitude;
+      gpslinx.altitude = gpgga.altitude;
+      gpslinx.speed = gprmc.speed * 1.852; /* convert knots/hr to km/hr */
+      gpslinx.track = gprmc.track;
+      gpslinx.hdop = gpgga.dilution;
+      gpslinx.satellites = gpgga.satellites;
+      gpslinx.declination = linxdeclination(
+          gpslinx.longitude, gpslinx.latitude, gpslinx.altitude, gpslinx.date);
+      gpslinx.received = received;
+      gpslinx.realtime = realtime;
+      gpssatpublish(gpslinx.date, gpslinx.gmt);
+      /*return a new gpslinx record */
+      return &gpslinx;
     }
-    /*
-     * chout != $
-     * continue building NMEA sentence 1 character at atime
-     */
-    buf[i] = chout;
-    i++;
   }
-  syslog(LOG_INFO, "GPGGA, GPRMC sentences not found in %d characters", j);
+  syslog(LOG_INFO, "GGA, RMC or NAV-PVT not found in %d characters", j);
   return &gpslinx;
 }
 
+/**
+ * linxstop() -- close the serial port and NMEA log after a read error,
+ *  linxinit() opens them again
+ * Return: nothing
+ */
+void linxstop(void) {
+  close(fser);   /* Close the serial port */
+  if (fpgps)
+    fclose(fpgps); /* Close the log file */
+  fpgps = NULL;
+}
+
 /**
  * linxclose() -- initialize UART, Null Island for linx R4 gps device --
  * Return: nothing
  */
 void linxclose(void) {
   syslog(LOG_INFO, "Exiting pmtgpsd  \n");
-  close(fser);   /* Close the serial port */
-  fclose(fpgps); /* Close the log file */
-  wmmclose();    /* close world magetic model */
+  linxstop();
+  wmmstatefree(wmmnow); /* close world magetic model */
+  wmmclose(wmm);
   return;
 }
 
@@ -259,6 +846,8 @@ int main() {
   printf(" start linx read\n");
   while (1) {
     linx = linxread();
+    if (!linx)
+      break; /* serial port error */
     printf("date/time %d %f long/lat %f %f altitude %f  declination %f "
            "speed/track  %f %f\n",
            linx->date, linx->gmt, linx->longitude, linx->latitude,
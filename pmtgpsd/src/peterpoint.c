@@ -15,6 +15,22 @@
  *              - remove MAG_PrintUserDataWithUncertainty()
  *      - wmmclose() + create by extracting end of main()
  *
+ * Nov 2019 - static variables replaced by 2 handles so declination
+ *  can be computed from many threads, see pmtwmm.h
+ *      - wmmopen() replaces wmminit(): loads model, ellipsoid, geoid
+ *      - wmmstatenew() per thread time adjusted model and workspace
+ *      - wmmdeclination() takes a wmmstate
+ *      - wmmclose() frees the model
+ *
+ * Nov 2019 - emmopen() loads the Enhanced Magnetic Model (degree 720).
+ *  Legendre functions and sums are done by wmmfast.c for every model,
+ *  GeomagnetismLibrary.c still reads the files and does the coordinate
+ *  conversions and rotations.
+ *
+ * Nov 2019 - wmmprecision() selects float for wmmdeclination(), for the
+ *  BBB whose NEON unit has no double.  Build with -DWMMFLOAT to make
+ *  float the default.  All other functions stay double.
+ *
  * Other downloads from World Magnetic Model required
  *  - GeomagnetismLibrary.c (unchanged) is linked into pmtgpsd
  *  - WMM.COF datafile (unchanged) is expected in pmtgpsd/data/WMM.COF
@@ -69,68 +85,421 @@
 #include <syslog.h>
 
 #include "EGM9615.h"
-#include "GeomagnetismHeader.h"
-
-/* Memory allocation */
-static MAGtype_MagneticModel *MagneticModels[1], *TimedMagneticModel;
-static MAGtype_Ellipsoid Ellip;
-static MAGtype_CoordSpherical CoordSpherical;
-static MAGtype_CoordGeodetic CoordGeodetic;
-static MAGtype_Date UserDate;
-static MAGtype_GeoMagneticElements GeoMagneticElements, Errors;
-static MAGtype_Geoid Geoid;
-static char filename[] = "/usr/share/pmt/WMM.COF";
-//	static char filename[] = "WMM.COF";
-static char VersionDate_Large[] =
-    "$Date: 2014-11-21 10:40:43 -0700 (Fri, 21 Nov 2014) $";
-static char VersionDate[12];
-static int NumTerms, nMax = 0;
-static int epochs = 1;
-
-static int wmmstop = 0; /* TRUE = 1, FALSE = 0 */
-
-/**
- * wmminit() - initialize WMM variables
- * Return: nothing
+#include "pmtwmm.h"
+
+/* Function Prototypes - wmmfast.c */
+int wmmfastdegree(MAGtype_MagneticModel *magneticmodel, double budget,
+                  double relativeradius);
+struct wmmfast *wmmfastnew(MAGtype_MagneticModel *magneticmodel, int nmax);
+void wmmfastfree(struct wmmfast *fast);
+struct wmmfastwork *wmmfastworknew(struct wmmfast *fast);
+void wmmfastworkfree(struct wmmfastwork *work);
+void wmmfasttime(struct wmmfastwork *work, double decimalyear);
+void wmmfastcolumns(struct wmmfastwork *work, double relativeradius,
+                    double phig);
+void wmmfastlambda(struct wmmfastwork *work, double lambda,
+                   MAGtype_MagneticResults *field,
+                   MAGtype_MagneticResults *secvar);
+void wmmfastcolumnsf(struct wmmfastwork *work, double relativeradius,
+                     double phig);
+void wmmfastlambdaf(struct wmmfastwork *work, double lambda,
+                    MAGtype_MagneticResults *field);
+
+/* wmmdeclination() precision of a new wmmstate */
+#ifdef WMMFLOAT
+#define WMMDEFAULT WMMSINGLE
+#else
+#define WMMDEFAULT WMMDOUBLE
+#endif
+
+/**
+ * struct wmmmodel -- everything loaded from the model file
+ * read only after wmmopen() or emmopen() returns
+ */
+struct wmmmodel {
+  struct wmmfast *fast;    /* coefficients in wmmfast.c column order */
+  MAGtype_Ellipsoid ellip; /* WGS84 */
+  MAGtype_Geoid geoid;     /* EGM96 for sea level altitudes */
+  int nmax;                /* degree used, may be truncated */
+};
+
+/**
+ * struct wmmstate -- evaluation state owned by one thread
+ */
+struct wmmstate {
+  struct wmmmodel *model;
+  struct wmmfastwork *work; /* time adjusted coefficients, column sums */
+  int precision;            /* of wmmdeclination(), WMMDOUBLE or WMMSINGLE */
+};
+
+/**
+ * wmmmodelnew() - wrap coefficients read by GeomagnetismLibrary.c
+ * @magneticmodel  freed here, whatever happens
+ * @nmax  degree to use
+ *
+ * Return: model handle, or NULL if out of memory
+ */
+static struct wmmmodel *wmmmodelnew(MAGtype_MagneticModel *magneticmodel,
+                                    int nmax) {
+  struct wmmmodel *model;
+
+  model = calloc(1, sizeof(struct wmmmodel));
+  if (model)
+    model->fast = wmmfastnew(magneticmodel, nmax);
+  MAG_FreeMagneticModelMemory(magneticmodel);
+  if (!model || !model->fast) {
+    free(model);
+    return NULL;
+  }
+  model->nmax = nmax;
+
+  MAG_SetDefaults(&model->ellip, &model->geoid); /* Set default values */
+
+  /* Set EGM96 Geoid parameters */
+  model->geoid.GeoidHeightBuffer = GeoidHeightBuffer;
+  model->geoid.Geoid_Initialized = 1;
+  model->geoid.UseGeoid = 1;
+
+  return model;
+}
+
+/**
+ * wmmopen() - load World Magnetic Model
+ * @cofname  WMM.COF file name, normally WMMFILE
+ *
+ * Return: model handle, or NULL if the file cannot be read
  */
-void wmminit(void) {
+struct wmmmodel *wmmopen(char *cofname) {
+  MAGtype_MagneticModel *magneticmodels[1];
   char err[100];
 
-  strncpy(VersionDate, VersionDate_Large + 39, 11);
-  VersionDate[11] = '\0';
-  if (!MAG_robustReadMagModels(filename, &MagneticModels, epochs)) {
-    sprintf(
-        err,
-        "/usr/share/pmt/WMM.COF not found.  declination = 0.0 \n ");
+  if (!MAG_robustReadMagModels(cofname, &magneticmodels, 1)) {
+    sprintf(err, "%s not found.  declination = 0.0 \n ", cofname);
+    syslog(LOG_NOTICE, "%s", err); /*to /var/log/syslog */
+    return NULL;
+  }
+  if (magneticmodels[0] == NULL)
+    return NULL;
+  return wmmmodelnew(magneticmodels[0], magneticmodels[0]->nMax);
+}
+
+/**
+ * emmopen() - load Enhanced Magnetic Model (or any high degree model)
+ * @cofname  main field coefficients e.g. EMM2015.COF
+ * @svname   secular variation coefficients e.g. EMM2015SV.COF
+ * @budget   nT rms error allowed by truncating the degree, 0 = none
+ *
+ * EMM2015 is degree 720.  The high degrees are crustal anomalies of
+ * a fraction of a nT each, so a budget of a few nT drops many of
+ * them - the work goes as degree squared.  See wmmfastdegree().
+ *
+ * Return: model handle, or NULL if either file cannot be read
+ */
+struct wmmmodel *emmopen(char *cofname, char *svname, double budget) {
+  MAGtype_MagneticModel *magneticmodel;
+  MAGtype_Ellipsoid ellip;
+  MAGtype_Geoid geoid;
+  char err[300];
+  int nmax;
+
+  if (!MAG_robustReadMagneticModel_Large(cofname, svname, &magneticmodel)) {
+    sprintf(err, "%s or %s not found\n", cofname, svname);
     syslog(LOG_NOTICE, "%s", err); /*to /var/log/syslog */
-    wmmstop = 1;                   /* TRUE */
+    return NULL;
+  }
+  /* budget holds down to sea level at the poles, the lowest radius */
+  MAG_SetDefaults(&ellip, &geoid);
+  nmax = wmmfastdegree(magneticmodel, budget, ellip.re / ellip.b);
+  sprintf(err, "%s degree %d of %d, truncation budget %.1f nT\n", cofname,
+          nmax, magneticmodel->nMax, budget);
+  syslog(LOG_NOTICE, "%s", err);
+  return wmmmodelnew(magneticmodel, nmax);
+}
+
+/**
+ * wmmclose() - free magnetic model
+ * @model  from wmmopen() or emmopen().  All its wmmstates must be freed
+ *   first.
+ * Return: nothing
+ */
+void wmmclose(struct wmmmodel *model) {
+  if (!model)
+    return;
+  wmmfastfree(model->fast);
+  free(model);
+}
+
+/**
+ * wmmdegree() - spherical harmonic degree in use
+ * Return: degree after any truncation, 0 if no model
+ */
+int wmmdegree(struct wmmmodel *model) { return model ? model->nmax : 0; }
+
+/**
+ * wmmstatenew() - create evaluation state for one thread
+ * @model  from wmmopen() or emmopen()
+ *
+ * workspace is allocated once here - MAG_Geomag() would malloc it on
+ * every call.
+ *
+ * Return: state handle, or NULL if out of memory
+ */
+struct wmmstate *wmmstatenew(struct wmmmodel *model) {
+  struct wmmstate *state;
+
+  if (!model)
+    return NULL;
+  state = calloc(1, sizeof(struct wmmstate));
+  if (!state)
+    return NULL;
+  state->model = model;
+  state->precision = WMMDEFAULT;
+  state->work = wmmfastworknew(model->fast);
+  if (!state->work) {
+    wmmstatefree(state);
+    return NULL;
+  }
+  return state;
+}
+
+/**
+ * wmmprecision() - choose double or float for wmmdeclination()
+ * @precision  WMMDOUBLE or WMMSINGLE
+ * Return: nothing
+ */
+void wmmprecision(struct wmmstate *state, int precision) {
+  if (state)
+    state->precision = precision;
+}
+
+/**
+ * wmmstatefree() - free evaluation state
+ * Return: nothing
+ */
+void wmmstatefree(struct wmmstate *state) {
+  if (!state)
     return;
+  wmmfastworkfree(state->work);
+  free(state);
+}
+
+/**
+ * wmmcolumns() - latitude part of the field at a geodetic point
+ * @geodetic   point, height above the ellipsoid
+ * @spherical  output, spherical coordinates of the point
+ *
+ * everything that depends on latitude and height only, see wmmfast.c
+ */
+static void wmmcolumns(struct wmmstate *state, MAGtype_CoordGeodetic *geodetic,
+                       MAGtype_CoordSpherical *spherical) {
+  MAG_GeodeticToSpherical(state->model->ellip, *geodetic,
+                          spherical); /*Convert from geodetic to Spherical
+                                        Equations: 17-18, WMM Tech report*/
+  wmmfastcolumns(state->work, state->model->ellip.re / spherical->r,
+                 spherical->phig);
+}
+
+/**
+ * wmmsum() - field elements at a point whose columns are ready
+ * @coordspherical  spherical coordinates of the point
+ * @coordgeodetic   geodetic coordinates of the same point
+ * @elements        output
+ *
+ * same sequence as MAG_Geomag() after the Legendre functions.
+ * wmmcolumns() must already have been called for this latitude.
+ */
+static void wmmsum(struct wmmstate *state,
+                   MAGtype_CoordSpherical *coordspherical,
+                   MAGtype_CoordGeodetic *coordgeodetic,
+                   MAGtype_GeoMagneticElements *elements) {
+  MAGtype_MagneticResults sph, geo, sphvar, geovar;
+
+  wmmfastlambda(state->work, coordspherical->lambda, &sph, &sphvar);
+  MAG_RotateMagneticVector(*coordspherical, *coordgeodetic, sph, &geo);
+  MAG_RotateMagneticVector(*coordspherical, *coordgeodetic, sphvar, &geovar);
+  MAG_CalculateGeoMagneticElements(&geo, elements);
+  MAG_CalculateSecularVariationElements(geovar, elements);
+  MAG_CalculateGridVariation(*coordgeodetic, elements);
+}
+
+/**
+ * wmmgeodetic() - evaluate at a geodetic point, height already ellipsoidal
+ */
+static void wmmgeodetic(struct wmmstate *state, MAGtype_CoordGeodetic *geodetic,
+                        double decimalyear,
+                        MAGtype_GeoMagneticElements *elements) {
+  MAGtype_CoordSpherical spherical;
+
+  wmmfasttime(state->work, decimalyear);
+  wmmcolumns(state, geodetic, &spherical);
+  wmmsum(state, &spherical, geodetic, elements);
+}
+
+/**
+ * wmmpoint() - all magnetic field elements at one point
+ * @state  from wmmstatenew()
+ * @longitude 999.99999999 degrees + => East, - => West
+ * @latitude 99.99999999 degrees + => North, - => South
+ * @heightkm  height above the WGS84 ellipsoid in km (NOT above sea level)
+ * @decimalyear  2017.5 = July 2 2017
+ * @elements output X, Y, Z, Decl, Incl ... see GeomagnetismHeader.h
+ *
+ * heights are ellipsoidal so results compare directly with the NOAA
+ * WMM test values.
+ *
+ * Return: 1 if computed, 0 if no state
+ */
+int wmmpoint(struct wmmstate *state, double longitude, double latitude,
+             double heightkm, double decimalyear,
+             MAGtype_GeoMagneticElements *elements) {
+  MAGtype_CoordGeodetic geodetic;
+
+  if (!state)
+    return 0;
+
+  geodetic.lambda = longitude;
+  geodetic.phi = latitude;
+  geodetic.HeightAboveEllipsoid = heightkm;
+  geodetic.HeightAboveGeoid = heightkm;
+  geodetic.UseGeoid = 0;
+  wmmgeodetic(state, &geodetic, decimalyear, elements);
+  return 1;
+}
+
+/**
+ * wmmbatch() - magnetic field elements at many points on one date
+ * @state  from wmmstatenew()
+ * @npoints  number of points
+ * @longitude, @latitude, @heightkm  arrays of npoints, as in wmmpoint()
+ * @decimalyear  one date for all points
+ * @elements  array of npoints results
+ *
+ * Return: number of points computed
+ */
+int wmmbatch(struct wmmstate *state, int npoints, double *longitude,
+             double *latitude, double *heightkm, double decimalyear,
+             MAGtype_GeoMagneticElements *elements) {
+  int i;
+
+  for (i = 0; i < npoints; i++)
+    if (!wmmpoint(state, longitude[i], latitude[i], heightkm[i], decimalyear,
+                  &elements[i]))
+      break;
+  return i;
+}
+
+/**
+ * wmmgrid() - magnetic field elements on a regular longitude/latitude grid
+ * @state  from wmmstatenew()
+ * @minlong  western edge of grid in degrees
+ * @minlat   southern edge of grid in degrees
+ * @step     grid spacing in degrees
+ * @ncols    number of longitudes
+ * @nrows    number of latitudes
+ * @heightkm  height above the WGS84 ellipsoid
+ * @decimalyear  date
+ * @elements  ncols * nrows results, row by row from minlat northwards
+ *
+ * Legendre functions and the sums over degree depend only on latitude,
+ * so they are computed once per row.  Each point then costs one pass
+ * over the orders m.
+ *
+ * Return: number of points computed
+ */
+int wmmgrid(struct wmmstate *state, double minlong, double minlat,
+            double step, int ncols, int nrows, double heightkm,
+            double decimalyear, MAGtype_GeoMagneticElements *elements) {
+  MAGtype_CoordGeodetic geodetic;
+  MAGtype_CoordSpherical spherical;
+  int row, col;
+
+  if (!state)
+    return 0;
+
+  wmmfasttime(state->work, decimalyear);
+  geodetic.HeightAboveEllipsoid = heightkm;
+  geodetic.HeightAboveGeoid = heightkm;
+  geodetic.UseGeoid = 0;
+  for (row = 0; row < nrows; row++) {
+    geodetic.phi = minlat + row * step;
+    geodetic.lambda = minlong;
+    wmmcolumns(state, &geodetic, &spherical);
+    for (col = 0; col < ncols; col++) {
+      geodetic.lambda = minlong + col * step;
+      spherical.lambda = geodetic.lambda;
+      wmmsum(state, &spherical, &geodetic, &elements[row * ncols + col]);
+    }
   }
-  if (nMax < MagneticModels[0]->nMax)
-    nMax = MagneticModels[0]->nMax;
-  NumTerms = ((nMax + 1) * (nMax + 2) / 2);
-  TimedMagneticModel = MAG_AllocateModelMemory(
-      NumTerms); /* For storing the time modified WMM Model parameters */
-  if (MagneticModels[0] == NULL || TimedMagneticModel == NULL) {
-    MAG_Error(2);
+  return nrows * ncols;
+}
+
+/**
+ * wmmgps() - gps position and date to ellipsoidal height and decimal year
+ * @geodetic  output
+ * @decimalyear  output
+ *
+ * Return: 1 if converted, 0 if no state or invalid date
+ */
+static int wmmgps(struct wmmstate *state, double longitude, double latitude,
+                  double altitudekm, int year, int month, int day,
+                  MAGtype_CoordGeodetic *geodetic, double *decimalyear) {
+  MAGtype_Date date;
+  char err[255];
+
+  if (!state)
+    return 0;
+
+  /*Get User Input - peter's hack  */
+  geodetic->phi = latitude;
+  geodetic->lambda = longitude;
+  geodetic->HeightAboveGeoid = altitudekm;
+  geodetic->UseGeoid = 1;
+  MAG_ConvertGeoidToEllipsoidHeight(geodetic, &state->model->geoid);
+  date.Month = month;
+  date.Day = day;
+  date.Year = year;
+  if (!MAG_DateToYear(&date, err)) {
+    syslog(LOG_NOTICE, "%s", err); /*to /var/log/syslog */
+    return 0;
   }
-  MAG_SetDefaults(&Ellip, &Geoid); /* Set default values and constants */
-  /* Check for Geographic Poles */
+  *decimalyear = date.DecimalYear;
+  return 1;
+}
 
-  /* Set EGM96 Geoid parameters */
-  Geoid.GeoidHeightBuffer = GeoidHeightBuffer;
-  Geoid.Geoid_Initialized = 1;
-  /* Set EGM96 Geoid parameters END */
-  /* WMM initialize END */
+/**
+ * wmmelements() - all magnetic field elements at a gps position
+ * @state  from wmmstatenew()
+ * @longitude 999.99999999 degrees + => East, - => West
+ * @latitude 99.99999999 degrees + => North, - => South
+ * @altitudekm 99.99999 km above sea level ( accurate to 10 cm )
+ * @year YYYY current year
+ * @month MM  current month
+ * @day DD    current day
+ * @elements output X, Y, Z, Decl, Incl, F ... see GeomagnetismHeader.h
+ *
+ * Return: 1 if computed, 0 if no state or invalid date
+ */
+int wmmelements(struct wmmstate *state, double longitude, double latitude,
+                double altitudekm, int year, int month, int day,
+                MAGtype_GeoMagneticElements *elements) {
+  MAGtype_CoordGeodetic geodetic;
+  double decimalyear;
 
-  return;
+  if (!wmmgps(state, longitude, latitude, altitudekm, year, month, day,
+              &geodetic, &decimalyear))
+    return 0;
+
+  /* do wmm magic  - copied from wmm_point.c */
+  wmmgeodetic(state, &geodetic, decimalyear, elements);
+  return 1;
 }
 
 /**
  * wmmdeclination() - calculate declination
+ * @state  from wmmstatenew()
  * @longitude 999.99999999 degrees + => East, - => West
  * @latitude 99.99999999 degrees + => North, - => South
- * @altitudekm 99.99999 km ( accurate to 10 cm )
+ * @altitudekm 99.99999 km above sea level ( accurate to 10 cm )
  * @year YYYY current year
  * @month MM  current month
  * @day DD    current day
@@ -140,58 +509,36 @@ void wmminit(void) {
  * For understanding of the declination calculation
  * consult the NOAA website https://ngdc.noaa.gov/geomag
  *
- * Return: double declination 99.99999999 (guessing)
+ * with wmmprecision(state, WMMSINGLE) the sums are done in float and
+ * only the main field is computed (no secular variation elements)
+ *
+ * Return: double declination 99.99999999 (guessing), 0.0 if no state
  */
-/* declination calculation */
-double wmmdeclination(double longitude, double latitude, double altitudekm,
-                      int year, int month, int day) {
-  char err[100];
-
-  if (wmmstop)
-    return (0.0);
+double wmmdeclination(struct wmmstate *state, double longitude,
+                      double latitude, double altitudekm, int year, int month,
+                      int day) {
+  MAGtype_GeoMagneticElements elements;
+  MAGtype_CoordGeodetic geodetic;
+  MAGtype_CoordSpherical spherical;
+  MAGtype_MagneticResults sph, geo;
+  double decimalyear;
 
-  /*Get User Input - peter's hack  */
-  CoordGeodetic.phi = latitude;
-  CoordGeodetic.lambda = longitude;
-  CoordGeodetic.HeightAboveGeoid = altitudekm;
-  Geoid.UseGeoid = 1;
-  MAG_ConvertGeoidToEllipsoidHeight(&CoordGeodetic, &Geoid);
-  UserDate.Month = month;
-  UserDate.Day = day;
-  UserDate.Year = year;
-  if (!MAG_DateToYear(&UserDate, err)) {
-    syslog(LOG_NOTICE, "%s", err); /*to /var/log/syslog */
-    return (0.0);
+  if (!state || state->precision != WMMSINGLE) {
+    if (!wmmelements(state, longitude, latitude, altitudekm, year, month, day,
+                     &elements))
+      return (0.0);
+    return (elements.Decl);
   }
 
-  /* do wmm magic  - copied from wmm_point.c */
-  MAG_GeodeticToSpherical(
-      Ellip, CoordGeodetic,
-      &CoordSpherical); /*Convert from geodetic to Spherical Equations: 17-18,
-                           WMM Technical report*/
-  MAG_TimelyModifyMagneticModel(
-      UserDate, MagneticModels[0],
-      TimedMagneticModel); /* Time adjust the coefficients, Equation 19, WMM
-                              Technical report */
-  MAG_Geomag(Ellip, CoordSpherical, CoordGeodetic, TimedMagneticModel,
-             &GeoMagneticElements); /* Computes the geoMagnetic field elements
-                                       and their time change*/
-  MAG_CalculateGridVariation(CoordGeodetic, &GeoMagneticElements);
-  MAG_WMMErrorCalc(GeoMagneticElements.H,
-                   &Errors); /* I dont think I use this  */
-
-  return (GeoMagneticElements.Decl);
-}
-
-/**
- * wmmclose() - close WMM
- * Return: nothing
- */
-void wmmclose() {
-  /* WMM close  */
-  MAG_FreeMagneticModelMemory(TimedMagneticModel);
-  MAG_FreeMagneticModelMemory(MagneticModels[0]);
-  /* WMM close END */
-
-  return;
+  /* float: same steps as wmmgeodetic(), declination only */
+  if (!wmmgps(state, longitude, latitude, altitudekm, year, month, day,
+              &geodetic, &decimalyear))
+    return (0.0);
+  wmmfasttime(state->work, decimalyear);
+  MAG_GeodeticToSpherical(state->model->ellip, geodetic, &spherical);
+  wmmfastcolumnsf(state->work, state->model->ellip.re / spherical.r,
+                  spherical.phig);
+  wmmfastlambdaf(state->work, spherical.lambda, &sph);
+  MAG_RotateMagneticVector(spherical, geodetic, sph, &geo);
+  return (RAD2DEG(atan2(geo.By, geo.Bx)));
 }
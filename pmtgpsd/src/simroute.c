@@ -0,0 +1,217 @@
+/**
+ * DOC: -- simroute.c -- simulated gps moving along a route
+ * Peter Thompson -- Nov 2019
+ *
+ * when the Linx R4 is not working and pmtgpsd.conf has a routefile,
+ * pmtgpsd plays the route back instead of sitting at Percy Lake
+ * (simulate.c), so everything reading /dev/shm/pmtgps sees motion.
+ *
+ * route file - one point per line, # starts a comment
+ *     longitude latitude altitude [seconds]
+ *   decimal degrees (+ => East, North), meters above sea level,
+ *   seconds after the first point (blanks or commas between values).
+ *   Without seconds (a waypoint route) points are routespeed km/hr apart.
+ *   At the last point the route starts again from the first.
+ *
+ * simroute() returns a struct linxdata like linxread(), interpolated
+ * between points at the simulated time = simscale * real time since
+ * simrouteopen().  gmt and date advance from the real UTC at start,
+ * speed and track come from the segment being travelled and
+ * declination from the magnetic model in linxdriver.c
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "pmtgps.h"
+
+#define EARTHRADIUS 6371.0 /* km, mean */
+#define DEG2RAD(x) ((x) * M_PI / 180.0)
+#define RAD2DEG(x) ((x) * 180.0 / M_PI)
+
+/* Function Prototypes */
+double gpsclock(void);
+double linxdeclination(double, double, double, int);
+
+/**
+ * struct waypoint -- one point of the route
+ */
+struct waypoint {
+  double longitude; /* decimal degrees  + => East,  - => West */
+  double latitude;  /* decimal degrees  + => North, - => South */
+  double altitude;  /* meters */
+  double time;      /* seconds after the first point */
+};
+
+static struct waypoint *route;
+static int npoint;
+static double scale;   /* simulated seconds per real second */
+static double start;   /* gpsclock() at simrouteopen() */
+static time_t startutc; /* UTC at simrouteopen() */
+static struct linxdata gpsroute;
+
+/**
+ * distance() - great circle distance between two points
+ * Return: km
+ */
+static double distance(struct waypoint *a, struct waypoint *b) {
+  double dlat, dlong, h;
+
+  dlat = DEG2RAD(b->latitude - a->latitude);
+  dlong = DEG2RAD(b->longitude - a->longitude);
+  h = sin(dlat / 2) * sin(dlat / 2) + cos(DEG2RAD(a->latitude)) *
+                                          cos(DEG2RAD(b->latitude)) *
+                                          sin(dlong / 2) * sin(dlong / 2);
+  return 2.0 * EARTHRADIUS * asin(sqrt(h));
+}
+
+/**
+ * bearing() - initial great circle track from a to b
+ * Return: degrees True, 0-360
+ */
+static double bearing(struct waypoint *a, struct waypoint *b) {
+  double lat1, lat2, dlong, t;
+
+  lat1 = DEG2RAD(a->latitude);
+  lat2 = DEG2RAD(b->latitude);
+  dlong = DEG2RAD(b->longitude - a->longitude);
+  t = RAD2DEG(atan2(sin(dlong) * cos(lat2),
+                    cos(lat1) * sin(lat2) - sin(lat1) * cos(lat2) * cos(dlong)));
+  return t < 0.0 ? t + 360.0 : t;
+}
+
+/**
+ * simrouteopen() - load a route for simroute()
+ * @name      route file
+ * @speed     km/hr between points without times
+ * @timescale simulated seconds per real second
+ * Return: number of points, 0 if the route cannot be used
+ */
+int simrouteopen(char *name, double speed, double timescale) {
+  struct waypoint p, *grown;
+  char line[200], *c;
+  FILE *fp;
+  int n, max, timed;
+
+  fp = fopen(name, "r");
+  if (!fp) {
+    syslog(LOG_NOTICE, "simrouteopen(): Unable to open %s", name);
+    return 0;
+  }
+  free(route);
+  route = NULL;
+  npoint = max = 0;
+  timed = 1;
+  while (fgets(line, sizeof(line), fp)) {
+    c = strchr(line, '#');
+    if (c)
+      *c = '\0';
+    for (c = line; *c; c++)
+      if (*c == ',')
+        *c = ' ';
+    n = sscanf(line, "%lf %lf %lf %lf", &p.longitude, &p.latitude,
+               &p.altitude, &p.time);
+    if (n < 3)
+      continue;
+    if (n == 3)
+      timed = 0;
+    if (npoint == max) {
+      max = max ? 2 * max : 64;
+      grown = realloc(route, max * sizeof(struct waypoint));
+      if (!grown) {
+        syslog(LOG_NOTICE, "simrouteopen(): %s out of memory", name);
+        fclose(fp);
+        free(route);
+        route = NULL;
+        npoint = 0;
+        return 0;
+      }
+      route = grown;
+    }
+    route[npoint++] = p;
+  }
+  fclose(fp);
+
+  /* waypoint route, or times out of order - time from distance */
+  if (speed <= 0.0)
+    speed = 4.0;
+  for (n = 1; n < npoint && timed; n++)
+    if (route[n].time <= route[n - 1].time)
+      timed = 0;
+  if (npoint > 0)
+    route[0].time = 0.0;
+  for (n = 1; n < npoint && !timed; n++)
+    route[n].time = route[n - 1].time +
+                    distance(&route[n - 1], &route[n]) / speed * 3600.0;
+
+  if (npoint < 2 || route[npoint - 1].time <= 0.0) {
+    syslog(LOG_NOTICE, "simrouteopen(): %s needs 2 different points", name);
+    npoint = 0;
+    return 0;
+  }
+  scale = timescale > 0.0 ? timescale : 1.0;
+  start = gpsclock();
+  startutc = time(NULL);
+  syslog(LOG_INFO, "simulating %d point route %s, %.0f s at %.1fx", npoint,
+         name, route[npoint - 1].time, scale);
+  return npoint;
+}
+
+/**
+ * simroute() - simulated gps data at the current time along the route
+ * Return: linxdata record, as linxread()
+ */
+struct linxdata *simroute(void) {
+  struct waypoint *a, *b;
+  struct tm utc;
+  double elapsed, t, f, dlong;
+  time_t now;
+  int lo, hi, mid;
+
+  elapsed = (gpsclock() - start) * scale;
+  t = fmod(elapsed, route[npoint - 1].time);
+
+  /* segment a->b containing t */
+  lo = 0;
+  hi = npoint - 1;
+  while (hi - lo > 1) {
+    mid = (lo + hi) / 2;
+    if (route[mid].time <= t)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  a = &route[lo];
+  b = &route[hi];
+  f = (t - a->time) / (b->time - a->time);
+
+  dlong = b->longitude - a->longitude;
+  if (dlong > 180.0) /* across the date line */
+    dlong -= 360.0;
+  else if (dlong < -180.0)
+    dlong += 360.0;
+  gpsroute.longitude = a->longitude + f * dlong;
+  if (gpsroute.longitude > 180.0)
+    gpsroute.longitude -= 360.0;
+  else if (gpsroute.longitude < -180.0)
+    gpsroute.longitude += 360.0;
+  gpsroute.latitude = a->latitude + f * (b->latitude - a->latitude);
+  gpsroute.altitude = a->altitude + f * (b->altitude - a->altitude);
+  gpsroute.speed = distance(a, b) / (b->time - a->time) * 3600.0;
+  gpsroute.track = bearing(a, b);
+
+  now = startutc + (time_t)elapsed;
+  gmtime_r(&now, &utc);
+  gpsroute.date =
+      (utc.tm_year + 1900) * 10000 + (utc.tm_mon + 1) * 100 + utc.tm_mday;
+  gpsroute.gmt = utc.tm_hour * 10000 + utc.tm_min * 100 + utc.tm_sec;
+  gpsroute.millisecond = (int)((elapsed - floor(elapsed)) * 1000.0);
+  gpsroute.declination = linxdeclination(
+      gpsroute.longitude, gpsroute.latitude, gpsroute.altitude, gpsroute.date);
+  gpsroute.received = gpsclock();
+  return &gpsroute;
+}
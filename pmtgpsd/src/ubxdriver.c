@@ -0,0 +1,121 @@
+/**
+ * DOC: -- ubxdriver.c -- u-blox UBX binary protocol for pmtgpsd
+ * Peter Thompson -- Nov 2019
+ *
+ * a u-blox receiver on the gps serial port may send UBX binary frames
+ * instead of (or mixed with) NMEA text.  linxdriver.c reads the port
+ * and hands every byte from a 0xB5 sync char to ubxbyte() until the
+ * frame is complete, so no configuration is needed to choose.
+ *
+ * UBX frame, little endian:
+ *   0xB5 0x62 class id length(2) payload(length) CK_A CK_B
+ *   CK_A, CK_B = 8 bit Fletcher checksum over class, id, length, payload
+ *
+ * only NAV-PVT (class 0x01 id 0x07, 92 bytes) is decoded, it has
+ * everything in struct linxdata in one message and in fixed point
+ * (1e-7 degrees, mm, mm/s) so it is much cheaper than NMEA at 10-25 Hz.
+ * Reference: u-blox 8 / M8 Receiver Description, UBX-13003221
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pmtgps.h"
+
+#define TRUE 1
+#define FALSE 0
+#define UBXSYNC2 0x62
+#define UBXNAV 0x01      /* class */
+#define UBXNAVPVT 0x07   /* id */
+#define UBXPVTLEN 92     /* NAV-PVT payload bytes */
+#define UBXMAX 1024      /* longest payload kept, longer frames dropped */
+#define UBXHEAD 6        /* sync, sync, class, id, length */
+
+static unsigned char frame[UBXHEAD + UBXMAX + 2]; /* frame being read */
+static int flen;  /* bytes in frame[] */
+static int fneed; /* bytes in the whole frame, 0 = length not read yet */
+
+/* little endian fields, any alignment */
+static uint16_t u2(unsigned char *p) { return p[0] | p[1] << 8; }
+static uint32_t u4(unsigned char *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+static int32_t i4(unsigned char *p) { return (int32_t)u4(p); }
+
+/**
+ * ubxbyte() - add one byte to the UBX frame being read
+ * @c  byte from the serial port, the first is always UBXSYNC1
+ * Return: UBXMORE until the frame ends, then UBXGOOD or UBXBAD
+ *  (second sync char wrong, too long or checksum wrong)
+ */
+int ubxbyte(unsigned char c) {
+  unsigned char cka, ckb;
+  int i;
+
+  if (flen == 0)
+    fneed = 0;
+  frame[flen++] = c;
+  if (flen == 2 && c != UBXSYNC2)
+    fneed = flen; /* not UBX after all */
+  else if (flen == UBXHEAD) {
+    fneed = UBXHEAD + u2(frame + 4) + 2;
+    if (fneed > (int)sizeof(frame))
+      fneed = flen; /* too long for us */
+  }
+  if (fneed == 0 || flen < fneed)
+    return UBXMORE;
+  flen = 0;
+  if (fneed < UBXHEAD + 2)
+    return UBXBAD;
+
+  /* complete frame */
+  cka = ckb = 0;
+  for (i = 2; i < fneed - 2; i++) {
+    cka += frame[i];
+    ckb += cka;
+  }
+  return (cka == frame[fneed - 2] && ckb == frame[fneed - 1]) ? UBXGOOD
+                                                              : UBXBAD;
+}
+
+/**
+ * ubxframe() - the frame ubxbyte() just finished, for the log file
+ * @len  output: bytes
+ * Return: raw frame from the sync char to the checksum
+ */
+unsigned char *ubxframe(int *len) {
+  *len = fneed;
+  return frame;
+}
+
+/**
+ * ubxpvt() - decode the last good frame if it is a NAV-PVT with a fix
+ * @linx  output: position, altitude, speed, track, date, gmt, millisecond
+ *        (declination, received and realtime are left to the caller)
+ * Return: TRUE if linx was filled, FALSE if not NAV-PVT or no fix yet
+ */
+int ubxpvt(struct linxdata *linx) {
+  unsigned char *p = frame + UBXHEAD;
+  int fixtype;
+
+  if (frame[2] != UBXNAV || frame[3] != UBXNAVPVT ||
+      u2(frame + 4) < UBXPVTLEN)
+    return FALSE;
+  fixtype = p[20];
+  if (!(p[21] & 0x01) || fixtype < 2 || fixtype > 4 || (p[11] & 0x03) != 0x03)
+    return FALSE; /* gnssFixOK, 2D/3D/GNSS+DR, validDate and validTime */
+
+  linx->date = u2(p + 4) * 10000 + p[6] * 100 + p[7]; /* yyyymmdd */
+  linx->gmt = p[8] * 10000 + p[9] * 100 + p[10];      /* hhmmss */
+  linx->millisecond = 0;
+  if (i4(p + 16) > 0)
+    linx->millisecond = i4(p + 16) / 1000000; /* .sss from nano */
+  linx->longitude = i4(p + 24) * 1e-7;
+  linx->latitude = i4(p + 28) * 1e-7;
+  linx->altitude = i4(p + 36) / 1000.0; /* hMSL mm => meters */
+  linx->speed = i4(p + 60) * 0.0036;    /* gSpeed mm/s => km/hr */
+  linx->track = i4(p + 64) * 1e-5;      /* headMot */
+  linx->hdop = u2(p + 76) * 0.01;        /* pDOP, NAV-PVT has no hDOP */
+  linx->satellites = p[23];              /* numSV */
+  return TRUE;
+}
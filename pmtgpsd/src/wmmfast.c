@@ -0,0 +1,644 @@
+/**
+ * DOC: -- wmmfast.c -- spherical harmonic sums for WMM and EMM models
+ * Peter Thompson -- Nov 2019
+ *
+ * MAG_PcupHigh() + MAG_Summation() + MAG_SecVarSummation() from
+ * GeomagnetismLibrary.c rearranged so the Enhanced Magnetic Model
+ * (EMM2015 = degree 720, 260,000 coefficient pairs) runs on the BBB.
+ * Same recurrence as MAG_PcupHigh(): Holmes and Featherstone 2002,
+ * scaled by 10^280 sin^m against underflow near the poles.
+ *
+ *  1- recurrence factors f1, f2, f3 depend only on n and m.  They are
+ *     computed once in wmmfastnew().  MAG_PcupHigh() mallocs and
+ *     recomputes them, 3 sqrt() per term, on every call.
+ *  2- coefficients are stored column by column (order m, then degree n)
+ *     which is the order the recurrence produces Pcup(n,m).  Each Pcup
+ *     is summed the moment it is made, so recurrence and summation are
+ *     one pass streaming forwards through memory.  The Pcup and dPcup
+ *     arrays (2 MB each at degree 720) are never stored.
+ *  3- sums over n are kept per column, separately for g and h.  They
+ *     depend only on latitude and radius, so cos(m lambda) and
+ *     sin(m lambda) are applied once per column in wmmfastlambda(), and
+ *     a grid row computes its columns once for all its longitudes.
+ *  4- only coefficients with secular variation (n <= nmaxsv, 15 for
+ *     EMM2015) change with the date.  They are time adjusted into the
+ *     workspace, the rest are read straight from the model.
+ *  5- wmmfastdegree() truncates a model to the lowest degree whose
+ *     dropped terms stay within an accuracy budget in nT.
+ *  6- wmmfastcolumnsf() and wmmfastlambdaf() repeat 2 and 3 in float,
+ *     main field only, for declination on the BBB.  The Cortex-A8 NEON
+ *     unit does float but not double, and declination only needs 0.01
+ *     degree.  Float cannot hold the 10^-280 scaling, so the float
+ *     recurrence is rescaled by 2^-64 whenever it grows past 2^64 and
+ *     sin^m is applied with the count of rescalings as exp2f().
+ *
+ * struct wmmfast is read only after wmmfastnew() and shared by threads.
+ * struct wmmfastwork is the per thread workspace, allocated once.
+ * used by peterpoint.c only - see pmtwmm.h for the public interface.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "pmtwmm.h"
+
+#define SCALEF 1.0e-280          /* Pcup(m,m) scaling, as MAG_PcupHigh() */
+#define NSUM 6                   /* per column: Bz g, h  By g, h  Bx g, h */
+#define FLOATBIG 1.8446744e19f   /* 2^64, float recurrence rescaled above */
+#define FLOATSMALL 5.421011e-20f /* 2^-64 */
+#define FLOATSHIFT 64
+
+/**
+ * struct wmmterm -- recurrence factors for one Pcup(n,m)
+ *   Pcup(n,m)  = x * f1 * Pcup(n-1,m) - f2 * Pcup(n-2,m)
+ *   dPcup(n,m) = (f3 * Pcup(n-1,m) - n * x * Pcup(n,m)) / z
+ *   x = sin(latitude), z = cos(latitude), dPcup is d/dlatitude
+ */
+struct wmmterm {
+  double f1, f2, f3;
+};
+
+/**
+ * struct wmmtermf -- struct wmmterm in float
+ */
+struct wmmtermf {
+  float f1, f2, f3;
+};
+
+/**
+ * struct wmmfast -- model rearranged in column order
+ *   column m holds degrees n = max(m,1) .. nmax
+ */
+struct wmmfast {
+  int nmax;             /* degree used, may be truncated */
+  int nmaxsv;           /* degree of secular variation, <= nmax */
+  double epoch;         /* decimal year of the coefficients */
+  int *column;          /* column[m] = index of first term of order m */
+  int *svcolumn;        /* the same for terms with n <= nmaxsv */
+  struct wmmterm *term; /* recurrence factors */
+  double *gh;           /* g, h pairs at epoch (nT) */
+  double *svgh;         /* secular variation g, h pairs (nT/year) */
+  struct wmmtermf *termf; /* term in float */
+  float *ghf;             /* gh in float */
+};
+
+/**
+ * struct wmmfastwork -- per thread workspace
+ */
+struct wmmfastwork {
+  struct wmmfast *fast;
+  double timedyear; /* -1 = not yet time adjusted */
+  double *timedgh;  /* g, h at timedyear for n <= nmaxsv */
+  double *rrp;      /* (re/r)^(n+2) */
+  double *rrp1;     /* (n+1) * (re/r)^(n+2) */
+  double *sum;      /* NSUM per column, main field */
+  double *svsum;    /* NSUM per column, secular variation */
+  double z;         /* cos(geocentric latitude) of the column sums */
+  float *timedghf;  /* timedgh in float */
+  float *rrpf;      /* rrp in float */
+  float *rrp1f;     /* rrp1 in float */
+  float *sumf;      /* NSUM per column, main field, from wmmfastcolumnsf */
+  float zf;         /* z of sumf */
+};
+
+/**
+ * columns() - start index of each column for degree nmax
+ * @column  nmax+2 entries, column[nmax+1] = number of terms
+ */
+static void columns(int *column, int nmax) {
+  int m;
+
+  column[0] = 0;
+  column[1] = nmax; /* n = 1 .. nmax, Pcup(0,0) is not summed */
+  for (m = 1; m <= nmax; m++)
+    column[m + 1] = column[m] + nmax - m + 1;
+}
+
+/**
+ * factors() - recurrence factors for Pcup(n,m), as MAG_PcupHigh()
+ *
+ * Pcup(m,m) is started as x * 0 * 0 - (-1) * Pcup(m,m), so every term
+ * of a column runs through the same loop.
+ */
+static void factors(struct wmmterm *t, int n, int m) {
+  double root;
+
+  if (m == 0) {
+    t->f1 = (double)(2 * n - 1) / n;
+    t->f2 = (double)(n - 1) / n;
+    t->f3 = n;
+  } else if (n == m) {
+    t->f1 = 0.0;
+    t->f2 = -1.0;
+    t->f3 = 0.0;
+  } else {
+    root = sqrt((double)(n + m)) * sqrt((double)(n - m));
+    t->f1 = (2 * n - 1) / root;
+    t->f2 = sqrt((double)(n - m - 1)) * sqrt((double)(n + m - 1)) / root;
+    t->f3 = root;
+  }
+}
+
+/**
+ * wmmfastdegree() - lowest degree within an accuracy budget
+ * @magneticmodel  coefficients as read by GeomagnetismLibrary.c
+ * @budget  nT, rms of the dropped degrees
+ * @relativeradius  re / lowest radius evaluated
+ *
+ * Lowes-Mauersberger spectrum: degree n adds
+ *   (n+1) * (re/r)^(2n+4) * sum over m of (g*g + h*h)  nT^2
+ * to the mean square field on a sphere of radius r.  Degrees are
+ * dropped from the top while their total stays within budget^2.
+ * At degree 720 (re/r)^(2n+4) is 25 times larger at the polar radius
+ * than at re, so pass the smallest radius the model will be used at.
+ *
+ * Return: degree to use, nMax if budget <= 0
+ */
+int wmmfastdegree(MAGtype_MagneticModel *magneticmodel, double budget,
+                  double relativeradius) {
+  double power, rr, tail = 0.0;
+  int n, m, index;
+
+  if (budget <= 0.0)
+    return magneticmodel->nMax;
+  for (n = magneticmodel->nMax; n > 1; n--) {
+    power = 0.0;
+    for (m = 0; m <= n; m++) {
+      index = n * (n + 1) / 2 + m;
+      power += magneticmodel->Main_Field_Coeff_G[index] *
+                   magneticmodel->Main_Field_Coeff_G[index] +
+               magneticmodel->Main_Field_Coeff_H[index] *
+                   magneticmodel->Main_Field_Coeff_H[index];
+    }
+    rr = pow(relativeradius, n + 2);
+    power *= (n + 1) * rr * rr;
+    if (tail + power > budget * budget)
+      break;
+    tail += power;
+  }
+  return n;
+}
+
+/**
+ * wmmfastfree() - free rearranged model
+ * Return: nothing
+ */
+void wmmfastfree(struct wmmfast *fast) {
+  if (!fast)
+    return;
+  free(fast->column);
+  free(fast->svcolumn);
+  free(fast->term);
+  free(fast->gh);
+  free(fast->svgh);
+  free(fast->termf);
+  free(fast->ghf);
+  free(fast);
+}
+
+/**
+ * wmmfastnew() - rearrange a model into column order
+ * @magneticmodel  coefficients as read by GeomagnetismLibrary.c.
+ *   Not referenced after return.
+ * @nmax  degree to use, <= magneticmodel->nMax
+ *
+ * Return: rearranged model, or NULL if out of memory
+ */
+struct wmmfast *wmmfastnew(MAGtype_MagneticModel *magneticmodel, int nmax) {
+  struct wmmfast *fast;
+  int n, m, n0, k, j, index, nterm, nsvterm;
+
+  fast = calloc(1, sizeof(struct wmmfast));
+  if (!fast)
+    return NULL;
+  fast->nmax = nmax;
+  fast->nmaxsv = magneticmodel->nMaxSecVar < nmax ? magneticmodel->nMaxSecVar
+                                                  : nmax;
+  fast->epoch = magneticmodel->epoch;
+  fast->column = malloc((nmax + 2) * sizeof(int));
+  fast->svcolumn = malloc((fast->nmaxsv + 2) * sizeof(int));
+  if (!fast->column || !fast->svcolumn) {
+    wmmfastfree(fast);
+    return NULL;
+  }
+  columns(fast->column, nmax);
+  columns(fast->svcolumn, fast->nmaxsv);
+  nterm = fast->column[nmax + 1];
+  nsvterm = fast->svcolumn[fast->nmaxsv + 1];
+
+  fast->term = malloc(nterm * sizeof(struct wmmterm));
+  fast->gh = malloc(2 * nterm * sizeof(double));
+  fast->svgh = malloc((2 * nsvterm + 1) * sizeof(double));
+  fast->termf = malloc(nterm * sizeof(struct wmmtermf));
+  fast->ghf = malloc(2 * nterm * sizeof(float));
+  if (!fast->term || !fast->gh || !fast->svgh || !fast->termf ||
+      !fast->ghf) {
+    wmmfastfree(fast);
+    return NULL;
+  }
+
+  for (m = 0; m <= nmax; m++) {
+    n0 = m ? m : 1;
+    for (n = n0; n <= nmax; n++) {
+      k = fast->column[m] + n - n0;
+      index = n * (n + 1) / 2 + m;
+      factors(&fast->term[k], n, m);
+      fast->gh[2 * k] = magneticmodel->Main_Field_Coeff_G[index];
+      fast->gh[2 * k + 1] = magneticmodel->Main_Field_Coeff_H[index];
+      fast->termf[k].f1 = fast->term[k].f1;
+      fast->termf[k].f2 = fast->term[k].f2;
+      fast->termf[k].f3 = fast->term[k].f3;
+      fast->ghf[2 * k] = fast->gh[2 * k];
+      fast->ghf[2 * k + 1] = fast->gh[2 * k + 1];
+      if (n > fast->nmaxsv)
+        continue;
+      j = fast->svcolumn[m] + n - n0;
+      fast->svgh[2 * j] = magneticmodel->Secular_Var_Coeff_G[index];
+      fast->svgh[2 * j + 1] = magneticmodel->Secular_Var_Coeff_H[index];
+    }
+  }
+  return fast;
+}
+
+/**
+ * wmmfastworkfree() - free workspace
+ * Return: nothing
+ */
+void wmmfastworkfree(struct wmmfastwork *work) {
+  if (!work)
+    return;
+  free(work->timedgh);
+  free(work->rrp);
+  free(work->rrp1);
+  free(work->sum);
+  free(work->svsum);
+  free(work->timedghf);
+  free(work->rrpf);
+  free(work->rrp1f);
+  free(work->sumf);
+  free(work);
+}
+
+/**
+ * wmmfastworknew() - workspace for one thread
+ * Return: workspace, or NULL if out of memory
+ */
+struct wmmfastwork *wmmfastworknew(struct wmmfast *fast) {
+  struct wmmfastwork *work;
+  int nsvterm;
+
+  work = calloc(1, sizeof(struct wmmfastwork));
+  if (!work)
+    return NULL;
+  work->fast = fast;
+  work->timedyear = -1.0;
+  nsvterm = fast->svcolumn[fast->nmaxsv + 1];
+  work->timedgh = malloc((2 * nsvterm + 1) * sizeof(double));
+  work->rrp = malloc((fast->nmax + 1) * sizeof(double));
+  work->rrp1 = malloc((fast->nmax + 1) * sizeof(double));
+  work->sum = malloc(NSUM * (fast->nmax + 1) * sizeof(double));
+  work->svsum = malloc(NSUM * (fast->nmaxsv + 1) * sizeof(double));
+  work->timedghf = malloc((2 * nsvterm + 1) * sizeof(float));
+  work->rrpf = malloc((fast->nmax + 1) * sizeof(float));
+  work->rrp1f = malloc((fast->nmax + 1) * sizeof(float));
+  work->sumf = malloc(NSUM * (fast->nmax + 1) * sizeof(float));
+  if (!work->timedgh || !work->rrp || !work->rrp1 || !work->sum ||
+      !work->svsum || !work->timedghf || !work->rrpf || !work->rrp1f ||
+      !work->sumf) {
+    wmmfastworkfree(work);
+    return NULL;
+  }
+  return work;
+}
+
+/**
+ * wmmfasttime() - time adjust coefficients, Equation 19 WMM Tech report
+ * @decimalyear  2017.5 = July 2 2017
+ *
+ * only the n <= nmaxsv coefficients, and only when the date changes.
+ */
+void wmmfasttime(struct wmmfastwork *work, double decimalyear) {
+  struct wmmfast *fast = work->fast;
+  double dt;
+  int n, m, n0, k, j;
+
+  if (decimalyear == work->timedyear)
+    return;
+  dt = decimalyear - fast->epoch;
+  for (m = 0; m <= fast->nmaxsv; m++) {
+    n0 = m ? m : 1;
+    for (n = n0; n <= fast->nmaxsv; n++) {
+      k = fast->column[m] + n - n0;
+      j = fast->svcolumn[m] + n - n0;
+      work->timedgh[2 * j] = fast->gh[2 * k] + dt * fast->svgh[2 * j];
+      work->timedgh[2 * j + 1] =
+          fast->gh[2 * k + 1] + dt * fast->svgh[2 * j + 1];
+      work->timedghf[2 * j] = work->timedgh[2 * j];
+      work->timedghf[2 * j + 1] = work->timedgh[2 * j + 1];
+    }
+  }
+  work->timedyear = decimalyear;
+}
+
+/**
+ * wmmfastcolumns() - Legendre recurrence and sums over n for one latitude
+ * @relativeradius  earth reference radius / spherical radius (re / r)
+ * @phig  geocentric latitude in degrees
+ *
+ * call wmmfasttime() first.  Within MAG_GEO_POLE_TOLERANCE of a pole
+ * the latitude is moved off the pole, where MAG_PcupHigh() fails.
+ */
+void wmmfastcolumns(struct wmmfastwork *work, double relativeradius,
+                    double phig) {
+  struct wmmfast *fast = work->fast;
+  struct wmmterm *t;
+  double *gh, *sv, *sum;
+  double x, z, q, rescale, scale, pm1, pm2, p, dp, a, b, d;
+  double zg, zh, yg, yh, xg, xh;
+  double svzg, svzh, svyg, svyh, svxg, svxh;
+  int n, m, n0, j, nsv;
+
+  if (phig > 90.0 - MAG_GEO_POLE_TOLERANCE)
+    phig = 90.0 - MAG_GEO_POLE_TOLERANCE;
+  if (phig < -90.0 + MAG_GEO_POLE_TOLERANCE)
+    phig = -90.0 + MAG_GEO_POLE_TOLERANCE;
+  x = sin(DEG2RAD(phig));
+  z = sqrt((1.0 - x) * (1.0 + x));
+  work->z = z;
+
+  a = relativeradius * relativeradius;
+  for (n = 1; n <= fast->nmax; n++) {
+    a *= relativeradius;
+    work->rrp[n] = a;
+    work->rrp1[n] = (n + 1) * a;
+  }
+
+  q = SCALEF;             /* scaled Pcup(m,m) / z^m */
+  rescale = 1.0 / SCALEF; /* z^m / SCALEF */
+  for (m = 0; m <= fast->nmax; m++) {
+    if (m == 0) {
+      n0 = 1;
+      pm2 = 0.0;
+      pm1 = 1.0; /* Pcup(0,0) */
+      scale = 1.0;
+    } else {
+      n0 = m;
+      pm2 = q;
+      pm1 = 0.0;
+      rescale *= z;
+      scale = rescale;
+      q *= sqrt((2.0 * m + 1.0) / (2.0 * m + 2.0));
+    }
+    t = &fast->term[fast->column[m]];
+    n = n0;
+
+    /* degrees with secular variation, time adjusted coefficients */
+    svzg = svzh = svyg = svyh = svxg = svxh = 0.0;
+    zg = zh = yg = yh = xg = xh = 0.0;
+    nsv = fast->nmaxsv;
+    j = m <= nsv ? 2 * fast->svcolumn[m] : 0;
+    gh = &work->timedgh[j];
+    sv = &fast->svgh[j];
+    for (; n <= nsv; n++, t++, gh += 2, sv += 2) {
+      p = x * t->f1 * pm1 - t->f2 * pm2;
+      dp = t->f3 * pm1 - n * x * p;
+      pm2 = pm1;
+      pm1 = p;
+      a = work->rrp[n] * p;
+      b = work->rrp1[n] * p;
+      d = work->rrp[n] * dp;
+      zg += gh[0] * b;
+      zh += gh[1] * b;
+      yg += gh[0] * a;
+      yh += gh[1] * a;
+      xg += gh[0] * d;
+      xh += gh[1] * d;
+      svzg += sv[0] * b;
+      svzh += sv[1] * b;
+      svyg += sv[0] * a;
+      svyh += sv[1] * a;
+      svxg += sv[0] * d;
+      svxh += sv[1] * d;
+    }
+
+    /* remaining degrees, coefficients straight from the model */
+    gh = &fast->gh[2 * (t - fast->term)];
+    for (; n <= fast->nmax; n++, t++, gh += 2) {
+      p = x * t->f1 * pm1 - t->f2 * pm2;
+      dp = t->f3 * pm1 - n * x * p;
+      pm2 = pm1;
+      pm1 = p;
+      a = work->rrp[n] * p;
+      b = work->rrp1[n] * p;
+      d = work->rrp[n] * dp;
+      zg += gh[0] * b;
+      zh += gh[1] * b;
+      yg += gh[0] * a;
+      yh += gh[1] * a;
+      xg += gh[0] * d;
+      xh += gh[1] * d;
+    }
+
+    sum = &work->sum[NSUM * m];
+    sum[0] = zg * scale;
+    sum[1] = zh * scale;
+    sum[2] = yg * scale;
+    sum[3] = yh * scale;
+    sum[4] = xg * scale / z;
+    sum[5] = xh * scale / z;
+    if (m > nsv)
+      continue;
+    sum = &work->svsum[NSUM * m];
+    sum[0] = svzg * scale;
+    sum[1] = svzh * scale;
+    sum[2] = svyg * scale;
+    sum[3] = svyh * scale;
+    sum[4] = svxg * scale / z;
+    sum[5] = svxh * scale / z;
+  }
+}
+
+/**
+ * wmmfastlambda() - field at one longitude of the latitude in the columns
+ * @lambda  longitude in degrees
+ * @field   output, spherical components as MAG_Summation()
+ * @secvar  output, spherical components as MAG_SecVarSummation()
+ */
+void wmmfastlambda(struct wmmfastwork *work, double lambda,
+                   MAGtype_MagneticResults *field,
+                   MAGtype_MagneticResults *secvar) {
+  struct wmmfast *fast = work->fast;
+  double cl, sl, cm, sm, c, *s;
+  int m;
+
+  cl = cos(DEG2RAD(lambda));
+  sl = sin(DEG2RAD(lambda));
+  cm = 1.0;
+  sm = 0.0;
+  field->Bx = field->By = field->Bz = 0.0;
+  secvar->Bx = secvar->By = secvar->Bz = 0.0;
+  for (m = 0; m <= fast->nmax; m++) {
+    s = &work->sum[NSUM * m];
+    field->Bz -= cm * s[0] + sm * s[1];
+    field->By += m * (sm * s[2] - cm * s[3]);
+    field->Bx -= cm * s[4] + sm * s[5];
+    if (m <= fast->nmaxsv) {
+      s = &work->svsum[NSUM * m];
+      secvar->Bz -= cm * s[0] + sm * s[1];
+      secvar->By += m * (sm * s[2] - cm * s[3]);
+      secvar->Bx -= cm * s[4] + sm * s[5];
+    }
+    /* cos((m+1) lambda), sin((m+1) lambda) */
+    c = cm * cl - sm * sl;
+    sm = cm * sl + sm * cl;
+    cm = c;
+  }
+  field->By /= work->z;
+  secvar->By /= work->z;
+}
+
+/**
+ * runf() - float recurrence and sums for degrees n .. nend of one column
+ * @t, @gh  factors and coefficients of degree n
+ * @pm  recurrence, pm[0] = Pcup(n-2,m) and pm[1] = Pcup(n-1,m), updated
+ * @s   NSUM sums, updated
+ * @e   binary exponent of the recurrence scale, updated
+ */
+static void runf(struct wmmfastwork *work, struct wmmtermf *t, float *gh,
+                 int n, int nend, float x, float *pm, float *s, int *e) {
+  float pm2 = pm[0], pm1 = pm[1], p, dp, a, b, d;
+  float zg = s[0], zh = s[1], yg = s[2], yh = s[3], xg = s[4], xh = s[5];
+
+  for (; n <= nend; n++, t++, gh += 2) {
+    p = x * t->f1 * pm1 - t->f2 * pm2;
+    dp = t->f3 * pm1 - n * x * p;
+    pm2 = pm1;
+    pm1 = p;
+    a = work->rrpf[n] * p;
+    b = work->rrp1f[n] * p;
+    d = work->rrpf[n] * dp;
+    zg += gh[0] * b;
+    zh += gh[1] * b;
+    yg += gh[0] * a;
+    yh += gh[1] * a;
+    xg += gh[0] * d;
+    xh += gh[1] * d;
+    if (fabsf(p) > FLOATBIG) { /* near the poles Pcup/z^m overflows float */
+      pm1 *= FLOATSMALL;
+      pm2 *= FLOATSMALL;
+      zg *= FLOATSMALL;
+      zh *= FLOATSMALL;
+      yg *= FLOATSMALL;
+      yh *= FLOATSMALL;
+      xg *= FLOATSMALL;
+      xh *= FLOATSMALL;
+      *e += FLOATSHIFT;
+    }
+  }
+  pm[0] = pm2;
+  pm[1] = pm1;
+  s[0] = zg;
+  s[1] = zh;
+  s[2] = yg;
+  s[3] = yh;
+  s[4] = xg;
+  s[5] = xh;
+}
+
+/**
+ * wmmfastcolumnsf() - wmmfastcolumns() in float, main field only
+ * @relativeradius  earth reference radius / spherical radius (re / r)
+ * @phig  geocentric latitude in degrees
+ *
+ * call wmmfasttime() first.  Results go to work->sumf, for
+ * wmmfastlambdaf().  The double column sums are not touched.
+ */
+void wmmfastcolumnsf(struct wmmfastwork *work, double relativeradius,
+                     double phig) {
+  struct wmmfast *fast = work->fast;
+  float x, z, lz, q, a, factor, pm[2], *sum;
+  int n, m, n0, e, nsv;
+
+  if (phig > 90.0 - MAG_GEO_POLE_TOLERANCE)
+    phig = 90.0 - MAG_GEO_POLE_TOLERANCE;
+  if (phig < -90.0 + MAG_GEO_POLE_TOLERANCE)
+    phig = -90.0 + MAG_GEO_POLE_TOLERANCE;
+  x = sin(DEG2RAD(phig));
+  z = cos(DEG2RAD(phig)); /* not sqrt(1 - x*x), that loses z at the poles */
+  lz = log2f(z);
+  work->zf = z;
+
+  a = relativeradius * relativeradius;
+  for (n = 1; n <= fast->nmax; n++) {
+    a *= (float)relativeradius;
+    work->rrpf[n] = a;
+    work->rrp1f[n] = (n + 1) * a;
+  }
+
+  nsv = fast->nmaxsv;
+  q = 1.0f; /* Pcup(m,m) / z^m */
+  for (m = 0; m <= fast->nmax; m++) {
+    if (m == 0) {
+      n0 = 1;
+      pm[0] = 0.0f;
+      pm[1] = 1.0f; /* Pcup(0,0) */
+    } else {
+      n0 = m;
+      pm[0] = q;
+      pm[1] = 0.0f;
+      q *= sqrtf((2.0f * m + 1.0f) / (2.0f * m + 2.0f));
+    }
+    sum = &work->sumf[NSUM * m];
+    sum[0] = sum[1] = sum[2] = sum[3] = sum[4] = sum[5] = 0.0f;
+    e = 0;
+    n = n0;
+    if (n <= nsv)
+      runf(work, &fast->termf[fast->column[m]],
+           &work->timedghf[2 * fast->svcolumn[m]], n, nsv, x, pm, sum, &e);
+    if (n < nsv + 1)
+      n = nsv + 1;
+    if (n <= fast->nmax)
+      runf(work, &fast->termf[fast->column[m] + n - n0],
+           &fast->ghf[2 * (fast->column[m] + n - n0)], n, fast->nmax, x, pm,
+           sum, &e);
+
+    /* z^m * 2^e, underflows to 0 where the column does not matter */
+    factor = exp2f(m * lz + e);
+    sum[0] *= factor;
+    sum[1] *= factor;
+    sum[2] *= factor;
+    sum[3] *= factor;
+    sum[4] *= factor / z;
+    sum[5] *= factor / z;
+  }
+}
+
+/**
+ * wmmfastlambdaf() - wmmfastlambda() in float, main field only
+ * @lambda  longitude in degrees
+ * @field   output, spherical components as MAG_Summation()
+ */
+void wmmfastlambdaf(struct wmmfastwork *work, double lambda,
+                    MAGtype_MagneticResults *field) {
+  struct wmmfast *fast = work->fast;
+  float cl, sl, cm, sm, c, bx, by, bz, *s;
+  int m;
+
+  cl = cos(DEG2RAD(lambda));
+  sl = sin(DEG2RAD(lambda));
+  cm = 1.0f;
+  sm = 0.0f;
+  bx = by = bz = 0.0f;
+  for (m = 0; m <= fast->nmax; m++) {
+    s = &work->sumf[NSUM * m];
+    bz -= cm * s[0] + sm * s[1];
+    by += m * (sm * s[2] - cm * s[3]);
+    bx -= cm * s[4] + sm * s[5];
+    c = cm * cl - sm * sl;
+    sm = cm * sl + sm * cl;
+    cm = c;
+  }
+  field->Bx = bx;
+  field->By = by / work->zf;
+  field->Bz = bz;
+}
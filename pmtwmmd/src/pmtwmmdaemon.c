@@ -0,0 +1,98 @@
+/**
+ * DOC: -- pmtwmmdaemon.c  -- initialize daemon for declination queries --
+ * Peter Thompson Nov 2019  (copy of pmtgpsdaemon.c)
+ *
+ *      daemon code copied from ...
+ *      http://www.netzmafia.de/skripten/unix/linux-daemon-howto.html
+ *
+ * daemon name = pmtwmmd =  defined in S55pmtwmmd script
+ * sudo service S55pmtwmmd start  <==> sudo /etc/init.d/S55pmtwmmd
+ * sudo service S55pmtwmmd stop
+ * cat /var/log/syslog | tail  ## has all daemon messages
+ *
+ * X86 compile with
+ * gcc -o ../bin/pmtwmmd pmtwmmdaemon.c wmmserver.c wmmcache.c
+ *      ../../pmtgpsd/src/peterpoint.c ../../pmtgpsd/src/wmmfast.c
+ *      ../../pmtgpsd/src/GeomagnetismLibrary.c
+ *       -I../../include -I../../pmtgpsd/src/include -lrt -lm   OR
+ * ARM compile with
+ *    export PATH=$PATH:$HOME/bbb2018/buildroot/output/host/bin ## for compiler
+ *    arm-linux-gnueabihf-gcc -o ../bin/pmtwmmd  pmtwmmdaemon.c
+ *    wmmserver.c wmmcache.c ../../pmtgpsd/src/peterpoint.c
+ *    ../../pmtgpsd/src/wmmfast.c ../../pmtgpsd/src/GeomagnetismLibrary.c -I../../include
+ *    -I../../pmtgpsd/src/include -lrt -lm
+ */
+
+void pmtwmm(void); /* the big loop process */
+
+/* for daemon setup */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <syslog.h>
+#include <unistd.h>
+
+/**
+ * main()   daemon
+ * @argc    not used in this daemon
+ * @argv    not used in this daemon
+ *
+ * daemon started by S55pmtwmmd script
+ */
+int main(int argc, char *argv[]) {
+
+  char pmtsetpid[100]; /* for pid correction */
+
+  /* process id and session id */
+  pid_t pid, sid;
+
+  /* Fork the Parent Process */
+  pid = fork();
+
+  if (pid < 0) {
+    exit(EXIT_FAILURE);
+  }
+
+  /* We got a good pid, Close the Parent Process */
+  if (pid > 0) {
+    exit(EXIT_SUCCESS);
+  }
+
+  /* Change File Mask (permissions) to enable daemon access */
+  umask(0);
+
+  /* Create a new Signature Id for our child */
+  sid = setsid();
+  if (sid < 0) {
+    exit(EXIT_FAILURE);
+  }
+
+  /* Change working directory to / = pmtroot */
+  if ((chdir("/")) < 0) {
+    exit(EXIT_FAILURE);
+  }
+
+  /* Close Standard File Descriptors */
+  close(STDIN_FILENO);
+  close(STDOUT_FILENO);
+  close(STDERR_FILENO);
+
+  /**
+   * pmt: update daemon pid which was incorrectly created by
+   *      S55pmtwmmd script.
+   * see
+   * http://unix.stackexchange.com/questions/78056/start-stop-daemon-makes-cron-pidfile-with-wrong-pid*/
+  sprintf(pmtsetpid, "echo %d > /run/pmtwmmd.pid", getpid());
+  system(pmtsetpid);
+
+  /* update /var/log/syslog */
+  syslog(LOG_NOTICE, "Peter Thompson pmtwmmd serving declination");
+  syslog(LOG_NOTICE, "%s", pmtsetpid);
+
+  /* the big loop */
+  pmtwmm();
+}
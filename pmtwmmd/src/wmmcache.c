@@ -0,0 +1,176 @@
+/**
+ * DOC: -- wmmcache.c -- LRU cache of declination answers for pmtwmmd
+ * Peter Thompson -- Nov 2019
+ *
+ * WMMCACHESIZE answers kept in a fixed array - nothing is malloc'ed.
+ *   - hash table of chains finds an answer from its quantized key
+ *   - doubly linked list in use order, most recent at head.
+ *     when the cache is full the tail (least recently used) is reused.
+ *
+ * map tiles and routes ask for the same few cells over and over, so
+ * nearly every query is a hash lookup instead of a spherical harmonic
+ * summation.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pmtwmmd.h"
+
+#define WMMCACHESIZE 8192 /* answers, about 320 KB */
+#define WMMHASHSIZE 16381 /* prime, about 2 buckets per answer */
+#define NONE (-1)
+
+/**
+ * struct wmmentry -- one cached answer
+ */
+struct wmmentry {
+  struct wmmkey key;
+  struct wmmanswer answer;
+  int hnext; /* next entry in same hash chain */
+  int prev;  /* LRU list - more recently used */
+  int next;  /* LRU list - less recently used */
+};
+
+static struct wmmentry cache[WMMCACHESIZE];
+static int hashtab[WMMHASHSIZE]; /* first entry of each chain */
+static int head, tail;           /* most, least recently used */
+static int used;                 /* entries filled so far */
+static long hits, misses;
+
+/**
+ * hashkey() - bucket for a key
+ */
+static unsigned int hashkey(struct wmmkey *key) {
+  uint32_t h;
+
+  h = (uint32_t)key->latitude * 73856093u;
+  h ^= (uint32_t)key->longitude * 19349663u;
+  h ^= (uint32_t)key->altitude * 83492791u;
+  h ^= (uint32_t)key->date * 2654435761u;
+  return h % WMMHASHSIZE;
+}
+
+/**
+ * samekey() - Return: 1 if keys are equal
+ */
+static int samekey(struct wmmkey *a, struct wmmkey *b) {
+  return a->latitude == b->latitude && a->longitude == b->longitude &&
+         a->altitude == b->altitude && a->date == b->date;
+}
+
+/**
+ * lruremove() - remove entry from the LRU list
+ */
+static void lruremove(int i) {
+  if (cache[i].prev != NONE)
+    cache[cache[i].prev].next = cache[i].next;
+  else
+    head = cache[i].next;
+  if (cache[i].next != NONE)
+    cache[cache[i].next].prev = cache[i].prev;
+  else
+    tail = cache[i].prev;
+}
+
+/**
+ * lrufront() - put entry at head of the LRU list
+ */
+static void lrufront(int i) {
+  cache[i].prev = NONE;
+  cache[i].next = head;
+  if (head != NONE)
+    cache[head].prev = i;
+  head = i;
+  if (tail == NONE)
+    tail = i;
+}
+
+/**
+ * hashremove() - remove entry from its hash chain
+ */
+static void hashremove(int i) {
+  int *link;
+
+  link = &hashtab[hashkey(&cache[i].key)];
+  while (*link != NONE && *link != i)
+    link = &cache[*link].hnext;
+  if (*link == i)
+    *link = cache[i].hnext;
+}
+
+/**
+ * wmmcacheinit() - empty the cache
+ * Return: nothing
+ */
+void wmmcacheinit(void) {
+  int i;
+
+  for (i = 0; i < WMMHASHSIZE; i++)
+    hashtab[i] = NONE;
+  head = tail = NONE;
+  used = 0;
+  hits = misses = 0;
+}
+
+/**
+ * wmmcachefind() - look up an answer
+ * @key  quantized position and date
+ *
+ * a found entry becomes the most recently used.
+ *
+ * Return: cached answer, or NULL if not in cache
+ */
+struct wmmanswer *wmmcachefind(struct wmmkey *key) {
+  int i;
+
+  for (i = hashtab[hashkey(key)]; i != NONE; i = cache[i].hnext)
+    if (samekey(&cache[i].key, key)) {
+      if (i != head) {
+        lruremove(i);
+        lrufront(i);
+      }
+      hits++;
+      return &cache[i].answer;
+    }
+  misses++;
+  return NULL;
+}
+
+/**
+ * wmmcacheadd() - make room for a new answer
+ * @key  quantized position and date, must not already be cached
+ *
+ * reuses the least recently used entry once the cache is full.
+ *
+ * Return: answer slot for the caller to fill in
+ */
+struct wmmanswer *wmmcacheadd(struct wmmkey *key) {
+  unsigned int h;
+  int i;
+
+  if (used < WMMCACHESIZE)
+    i = used++;
+  else {
+    i = tail;
+    lruremove(i);
+    hashremove(i);
+  }
+  cache[i].key = *key;
+  h = hashkey(key);
+  cache[i].hnext = hashtab[h];
+  hashtab[h] = i;
+  lrufront(i);
+  memset(&cache[i].answer, 0, sizeof(struct wmmanswer));
+  return &cache[i].answer;
+}
+
+/**
+ * wmmcachestats() - hits and misses since wmmcacheinit()
+ * Return: nothing
+ */
+void wmmcachestats(long *nhits, long *nmisses, int *nused) {
+  *nhits = hits;
+  *nmisses = misses;
+  *nused = used;
+}
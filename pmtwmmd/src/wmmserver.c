@@ -0,0 +1,257 @@
+/**
+ * DOC: -- wmmserver.c -- answers declination queries on a UNIX socket
+ * Peter Thompson -- Nov 2019
+ *
+ * There are 3 parts to this program
+ *  1- SIGTERM code as in gpsrun.c
+ *
+ *  2- UNIX domain socket /run/pmtwmmd.sock (SOCK_SEQPACKET) shared by
+ *     up to MAXCLIENT processes, served by one poll() loop.  Replies
+ *     never block it: a client whose socket is full (not reading its
+ *     replies) is dropped.
+ *     protocol defined in pmtwmmd.h
+ *
+ *  3- each query is rounded to a cache cell and looked up in the LRU
+ *     cache (wmmcache.c).  Only cache misses run the World Magnetic
+ *     Model (peterpoint.c), which is loaded once for every client.
+ */
+/* #define MAINFORTESTING /* enable/disable testing with main() below */
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "pmtwmmd.h"
+#include "pmtwmm.h" /* keep after system headers */
+
+#define MAXCLIENT 32 /* simultaneous client connections */
+
+/* function prototypes - wmmcache.c */
+void wmmcacheinit(void);
+struct wmmanswer *wmmcachefind(struct wmmkey *key);
+struct wmmanswer *wmmcacheadd(struct wmmkey *key);
+void wmmcachestats(long *nhits, long *nmisses, int *nused);
+
+static volatile sig_atomic_t stopd = 0;
+static struct wmmstate *wmmnow; /* NULL => no WMM.COF, answers 0.0 */
+
+/**
+ * terminate()   SIGTERM routine to stop daemon
+ * stops pmtwmm() infinite loop by setting stopd=1
+ * Return: nothing
+ */
+static void terminate(int signum) {
+  stopd = 1;
+  syslog(LOG_NOTICE, "SIGTERM received for pmtwmmd\n");
+}
+
+/**
+ * answer() - compute or look up one query
+ * @q  query from client
+ * @a  answer to client
+ */
+static void answer(struct wmmquery *q, struct wmmanswer *a) {
+  MAGtype_GeoMagneticElements elements;
+  struct wmmanswer *cached;
+  struct wmmkey key;
+  double longitude;
+  int year, month, day;
+
+  year = q->date / 10000;
+  month = (q->date % 10000) / 100;
+  day = q->date % 100;
+  if (year < 1900 || month < 1 || month > 12 || day < 1 || day > 31) {
+    memset(a, 0, sizeof(struct wmmanswer));
+    a->status = WMMBADDATE;
+    return;
+  }
+  if (!(fabs(q->latitude) <= 90.0) || !(fabs(q->longitude) <= 360.0)) {
+    memset(a, 0, sizeof(struct wmmanswer)); /* NaN too */
+    a->status = WMMBADPOSITION;
+    return;
+  }
+  if (!wmmnow) {
+    memset(a, 0, sizeof(struct wmmanswer));
+    a->status = WMMNOMODEL;
+    return;
+  }
+
+  /* round to cache cell, -180 and +180 are the same cell */
+  longitude = fmod(q->longitude + 540.0, 360.0) - 180.0;
+  key.latitude = lround(q->latitude / WMMQLATLONG);
+  key.longitude = lround(longitude / WMMQLATLONG);
+  if (key.longitude == lround(180.0 / WMMQLATLONG))
+    key.longitude = -key.longitude;
+  key.altitude = lround(q->altitude / WMMQALT);
+  key.date = q->date;
+
+  cached = wmmcachefind(&key);
+  if (!cached) {
+    /* compute at the cell centre, so every query in the cell agrees */
+    cached = wmmcacheadd(&key);
+    if (wmmelements(wmmnow, key.longitude * WMMQLATLONG,
+                    key.latitude * WMMQLATLONG,
+                    key.altitude * WMMQALT / 1000.0, year, month, day,
+                    &elements)) {
+      cached->declination = elements.Decl;
+      cached->inclination = elements.Incl;
+      cached->totalfield = elements.F;
+      cached->status = WMMOK;
+    } else
+      cached->status = WMMBADDATE;
+  }
+  *a = *cached;
+}
+
+/**
+ * serve() - read one request from a client and send the reply
+ * @fd  client socket
+ * Return: 1 if client still connected, 0 if it closed or failed, or
+ *  its socket had no room for the reply (EAGAIN)
+ */
+static int serve(int fd) {
+  static char in[WMMREQUESTMAX], out[WMMREPLYMAX];
+  struct wmmrequest *request = (struct wmmrequest *)in;
+  struct wmmquery *query = (struct wmmquery *)(request + 1);
+  struct wmmreply *reply = (struct wmmreply *)out;
+  struct wmmanswer *ans = (struct wmmanswer *)(reply + 1);
+  ssize_t num;
+  size_t len;
+  int i;
+
+  num = recv(fd, in, sizeof(in), 0);
+  if (num <= 0)
+    return 0;
+  len = (size_t)num;
+
+  reply->magic = WMMMAGIC;
+  reply->version = WMMVERSION;
+  reply->count = 0;
+  reply->status = WMMOK;
+  if (len < sizeof(struct wmmrequest) || request->magic != WMMMAGIC ||
+      request->version != WMMVERSION || request->count < 1 ||
+      request->count > WMMMAXQUERY ||
+      len != sizeof(struct wmmrequest) +
+                 request->count * sizeof(struct wmmquery))
+    reply->status = WMMBADREQUEST;
+  else {
+    reply->count = request->count;
+    for (i = 0; i < request->count; i++)
+      answer(&query[i], &ans[i]);
+  }
+
+  len = sizeof(struct wmmreply) + reply->count * sizeof(struct wmmanswer);
+  num = send(fd, out, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+  if (num < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    syslog(LOG_NOTICE, "pmtwmmd: client not reading replies, dropped");
+  return num == (ssize_t)len;
+}
+
+/**
+ * pmtwmm() -- answers declination queries until SIGTERM
+ * Return: nothing
+ */
+void pmtwmm(void) {
+  struct sigaction action; /*SIGTERM for daemon stop */
+  struct sockaddr_un addr;
+  struct pollfd fds[MAXCLIENT + 1]; /* [0] = listening socket */
+  struct wmmmodel *wmm;
+  char err[100];
+  long hits, misses;
+  int i, nfds, fd, used;
+
+  /* setup for SIGTERM */
+  memset(&action, 0, sizeof(struct sigaction));
+  action.sa_handler = terminate;
+  if (sigaction(SIGTERM, &action, NULL) < 0) {
+    sprintf(err, "sigaction error = %s\n", strerror(errno));
+    syslog(LOG_NOTICE, "%s", err); /*to /var/log/syslog */
+  }
+
+  /* one resident model for every client */
+  wmm = wmmopen(WMMFILE);
+  wmmnow = wmmstatenew(wmm);
+  wmmcacheinit();
+
+  /* setup for socket /run/pmtwmmd.sock */
+  fds[0].fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (fds[0].fd < 0) {
+    sprintf(err, "socket error = %s\n", strerror(errno));
+    syslog(LOG_NOTICE, "%s", err); /*to /var/log/syslog */
+    return;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, WMMSOCKET, sizeof(addr.sun_path) - 1);
+  unlink(WMMSOCKET);
+  if (bind(fds[0].fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(fds[0].fd, MAXCLIENT) < 0) {
+    sprintf(err, "%s bind error = %s\n", WMMSOCKET, strerror(errno));
+    syslog(LOG_NOTICE, "%s", err); /*to /var/log/syslog */
+    close(fds[0].fd);
+    return;
+  }
+  chmod(WMMSOCKET, 0666); /* any process may ask */
+  fds[0].events = POLLIN;
+  nfds = 1;
+
+  /**** START THE BIG LOOP ****/
+  while (!stopd) {
+    if (poll(fds, nfds, -1) < 0)
+      continue; /* EINTR from SIGTERM */
+
+    /* new client */
+    if (fds[0].revents & POLLIN) {
+      fd = accept(fds[0].fd, NULL, NULL);
+      if (fd >= 0 && nfds <= MAXCLIENT) {
+        fds[nfds].fd = fd;
+        fds[nfds].events = POLLIN;
+        fds[nfds].revents = 0;
+        nfds++;
+      } else if (fd >= 0) {
+        syslog(LOG_NOTICE, "pmtwmmd: more than %d clients", MAXCLIENT);
+        close(fd);
+      }
+    }
+
+    /* requests from clients, closed clients replaced by the last one */
+    for (i = 1; i < nfds; i++) {
+      if (!fds[i].revents)
+        continue;
+      if ((fds[i].revents & POLLIN) && serve(fds[i].fd))
+        continue;
+      close(fds[i].fd);
+      fds[i--] = fds[--nfds];
+    }
+  }
+  /**** END THE BIG LOOP ****/
+
+  for (i = 0; i < nfds; i++)
+    close(fds[i].fd);
+  unlink(WMMSOCKET);
+  wmmcachestats(&hits, &misses, &used);
+  syslog(LOG_NOTICE, "pmtwmmd cache: %ld hits, %ld misses, %d cells", hits,
+         misses, used);
+  wmmstatefree(wmmnow);
+  wmmclose(wmm);
+  syslog(LOG_NOTICE, "stopping pmtwmmd %d ", getpid());
+  return;
+}
+
+#ifdef MAINFORTESTING
+int main() {
+  printf("calling pmtwmm\n");
+  pmtwmm();
+  printf("exiting pmtwmm\n");
+  return 0;
+}
+#endif
@@ -0,0 +1,519 @@
+/**
+ * DOC: --  benchwmm.c  -- accuracy and speed of the WMM declination wrapper
+ *  Peter Thompson   -- Nov 2019
+ *
+ *  evaluates the NOAA WMM2015 test values (WMM2015 technical report)
+ *  through peterpoint.c and checks every element against its tolerance,
+ *  then again from NTHREAD threads sharing one model (reentrancy).
+ *  Then times the wrapper in 4 modes and prints nanoseconds per point:
+ *    single - every call changes date, so coefficients are re-timed
+ *    cached - same date on every call, time adjusted coefficients reused
+ *    batch  - wmmbatch() over a list of points on one date
+ *    grid   - wmmgrid() over a 1 degree global grid on one date
+ *
+ *  Float declination (wmmprecision WMMSINGLE) is compared with double
+ *  over a global grid, and both are timed.  It must agree to FLOATTOL
+ *  wherever the horizontal field is over FLOATMINH (near the magnetic
+ *  poles declination is meaningless in any precision).
+ *
+ *  With -e and -s a high degree model (EMM2015) is also loaded through
+ *  emmopen() and compared at EMMPOINTS random points with MAG_Geomag()
+ *  from GeomagnetismLibrary.c, then timed at full degree and truncated
+ *  to the -t budget in nT, and its float declination checked on an
+ *  EMMSTEP grid.  EMM times are printed, not limited.
+ *
+ *  exit status 0 = pass, 1 = accuracy failure, 2 = speed failure
+ *  A speed failure is any mode slower than its limit.  Limits come from
+ *  the baseline file (-b) plus SLACK percent, or MAXNS if no baseline:
+ *  5 us on X86, where every mode is 0.3-1.1 us, so a wrapper several
+ *  times slower fails.  The ARM MAXNS only catches gross slowdowns, on the BBB
+ *  write a baseline once and check against it.
+ *  Run with -w to write a new baseline after a deliberate change.
+ *
+ *  usage: benchwmm [-f WMM.COF] [-b baselinefile] [-w]
+ *                  [-e EMM2015.COF -s EMM2015SV.COF] [-t budget]
+ *
+ * X86 compile with:
+ *  gcc -O2 -o benchwmm benchwmm.c ../pmtgpsd/src/peterpoint.c
+ *      ../pmtgpsd/src/wmmfast.c ../pmtgpsd/src/GeomagnetismLibrary.c
+ *      -I../include
+ *      -I../pmtgpsd/src/include -lm -lrt -lpthread
+ * cross-compile with:
+ *  arm-linux-gnueabihf-gcc -O2 -o benchwmm benchwmm.c
+ *      ../pmtgpsd/src/peterpoint.c ../pmtgpsd/src/wmmfast.c
+ *      ../pmtgpsd/src/GeomagnetismLibrary.c
+ *      -I../include -I../pmtgpsd/src/include -lm -lrt -lpthread
+ *  for the BBB add -mcpu=cortex-a8 -mfpu=neon -mfloat-abi=hard so
+ *  float runs on NEON - compare the double and float times.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pmtwmm.h"
+
+#define COFFILE "../pmtgpsd/data/WMM.COF"
+#define NTEST 12
+#define NMODE 4
+#define XYZTOL 0.15   /* nT - test values are published to 0.1 nT */
+#define ANGLETOL 0.01 /* degrees - test values are published to 0.01 */
+#define SLACK 25      /* percent slower than baseline before failing */
+#ifdef __arm__
+#define MAXNS 100000 /* ns/point with no baseline, Cortex-A8: use -b there */
+#else
+#define MAXNS 5000 /* ns/point with no baseline, ~5x X86 (300-1100 ns) */
+#endif
+#define MINTIME 0.2   /* seconds to run each speed mode */
+#define GRIDSTEP 1.0  /* degrees */
+#define GRIDCOLS 360
+#define GRIDROWS 179 /* -89 .. 89, poles excluded */
+#define NTHREAD 4    /* concurrent wmmstates sharing one wmmmodel */
+#define NLOOP 2000   /* passes over the test table per thread */
+#define EMMPOINTS 50 /* random points compared with MAG_Geomag() */
+#define EMMTOL 0.01  /* nT - same model and recurrence, rounding only */
+#define EMMYEAR 2017.5
+#define EMMSTEP 10.0   /* degrees, float check grid for EMM */
+#define FLOATTOL 0.01  /* degrees, float against double declination */
+#define FLOATMINH 1000 /* nT, horizontal field needed for FLOATTOL */
+
+static struct wmmmodel *wmm; /* shared by all threads */
+
+/**
+ * struct wmmtest -- one row of the NOAA WMM2015 test value table
+ *   height is km above the WGS84 ellipsoid
+ */
+struct wmmtest {
+  double year;
+  double height;
+  double latitude;
+  double longitude;
+  double x, y, z; /* nT */
+  double incl;    /* degrees */
+  double decl;    /* degrees */
+};
+
+static struct wmmtest wmmtests[NTEST] = {
+    {2015.0, 0, 80, 0, 6627.1, -445.9, 54432.3, 83.04, -3.85},
+    {2015.0, 0, 0, 120, 39518.2, 392.9, -11252.4, -15.89, 0.57},
+    {2015.0, 0, -80, 240, 5797.3, 15761.1, -52919.1, -72.39, 69.81},
+    {2015.0, 100, 80, 0, 6314.3, -471.6, 52269.8, 83.09, -4.27},
+    {2015.0, 100, 0, 120, 37535.6, 364.4, -10773.4, -16.01, 0.56},
+    {2015.0, 100, -80, 240, 5613.1, 14791.5, -50378.6, -72.57, 69.22},
+    {2017.5, 0, 80, 0, 6599.4, -317.1, 54459.2, 83.08, -2.75},
+    {2017.5, 0, 0, 120, 39571.4, 222.5, -11030.1, -15.57, 0.32},
+    {2017.5, 0, -80, 240, 5873.8, 15781.4, -52687.9, -72.28, 69.58},
+    {2017.5, 100, 80, 0, 6290.5, -348.5, 52292.7, 83.13, -3.17},
+    {2017.5, 100, 0, 120, 37585.5, 209.5, -10564.2, -15.70, 0.32},
+    {2017.5, 100, -80, 240, 5683.5, 14808.8, -50163.0, -72.45, 69.00},
+};
+
+static MAGtype_GeoMagneticElements reference[NTEST]; /* from accuracy() */
+
+static char *modename[NMODE] = {"single", "cached", "batch", "grid"};
+
+/**
+ * now() - monotonic clock in seconds
+ */
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * check() - compare one computed value against the test table
+ * Return: 1 if within tolerance, 0 otherwise (and print it)
+ */
+static int check(int row, char *what, double got, double want, double tol) {
+  if (fabs(got - want) <= tol)
+    return 1;
+  printf("FAIL row %d %s: got %.3f want %.3f (tol %.3f)\n", row, what, got,
+         want, tol);
+  return 0;
+}
+
+/**
+ * accuracy() - evaluate every test point, singly and as a batch
+ * Return: number of failures
+ */
+static int accuracy(struct wmmstate *state) {
+  MAGtype_GeoMagneticElements e, batch[NTEST];
+  double lon[NTEST], lat[NTEST], hgt[NTEST];
+  struct wmmtest *t;
+  int i, j, n, ok, fails = 0;
+
+  for (i = 0; i < NTEST; i++) {
+    t = &wmmtests[i];
+    wmmpoint(state, t->longitude, t->latitude, t->height, t->year, &e);
+    ok = check(i, "X", e.X, t->x, XYZTOL);
+    ok &= check(i, "Y", e.Y, t->y, XYZTOL);
+    ok &= check(i, "Z", e.Z, t->z, XYZTOL);
+    ok &= check(i, "Decl", e.Decl, t->decl, ANGLETOL);
+    ok &= check(i, "Incl", e.Incl, t->incl, ANGLETOL);
+    fails += !ok;
+    reference[i] = e;
+  }
+
+  /* batch must give bit-identical answers to single points */
+  for (i = 0; i < NTEST; i += n) {
+    for (n = 0; i + n < NTEST && wmmtests[i + n].year == wmmtests[i].year;
+         n++) {
+      lon[n] = wmmtests[i + n].longitude;
+      lat[n] = wmmtests[i + n].latitude;
+      hgt[n] = wmmtests[i + n].height;
+    }
+    wmmbatch(state, n, lon, lat, hgt, wmmtests[i].year, batch);
+    for (j = 0; j < n; j++) {
+      wmmpoint(state, lon[j], lat[j], hgt[j], wmmtests[i].year, &e);
+      if (e.Decl != batch[j].Decl || e.X != batch[j].X) {
+        printf("FAIL batch row %d differs from single point\n", i + j);
+        fails++;
+      }
+    }
+  }
+  return fails;
+}
+
+/**
+ * speed() - time one mode
+ * @mode 0-3 see modename[]
+ * @grid workspace of GRIDCOLS * GRIDROWS elements
+ * Return: nanoseconds per point
+ */
+static double speed(struct wmmstate *state, int mode,
+                    MAGtype_GeoMagneticElements *grid) {
+  MAGtype_GeoMagneticElements e;
+  double lon[NTEST], lat[NTEST], hgt[NTEST];
+  double start, elapsed;
+  long points = 0;
+  int i;
+
+  for (i = 0; i < NTEST; i++) {
+    lon[i] = wmmtests[i].longitude;
+    lat[i] = wmmtests[i].latitude;
+    hgt[i] = wmmtests[i].height;
+  }
+
+  start = now();
+  do {
+    switch (mode) {
+    case 0: /* alternate dates so every call re-times the coefficients */
+      for (i = 0; i < NTEST; i++)
+        wmmpoint(state, lon[i], lat[i], hgt[i], (i & 1) ? 2015.0 : 2017.5,
+                 &e);
+      points += NTEST;
+      break;
+    case 1:
+      for (i = 0; i < NTEST; i++)
+        wmmpoint(state, lon[i], lat[i], hgt[i], 2017.5, &e);
+      points += NTEST;
+      break;
+    case 2:
+      points += wmmbatch(state, NTEST, lon, lat, hgt, 2017.5, grid);
+      break;
+    case 3:
+      points += wmmgrid(state, -180.0, -89.0, GRIDSTEP, GRIDCOLS, GRIDROWS,
+                        0.0, 2017.5, grid);
+      break;
+    }
+    elapsed = now() - start;
+  } while (elapsed < MINTIME);
+
+  return elapsed * 1e9 / points;
+}
+
+/**
+ * worker() - one thread evaluating the test table with its own wmmstate
+ * @arg  unused
+ * Return: (void *)number of results that differ from reference[]
+ */
+static void *worker(void *arg) {
+  MAGtype_GeoMagneticElements e;
+  struct wmmstate *state;
+  struct wmmtest *t;
+  long bad = 0;
+  int i, j, loop;
+
+  state = wmmstatenew(wmm);
+  for (loop = 0; loop < NLOOP; loop++)
+    for (i = 0; i < NTEST; i++) {
+      j = (i + loop) % NTEST; /* keep threads out of step */
+      t = &wmmtests[j];
+      wmmpoint(state, t->longitude, t->latitude, t->height, t->year, &e);
+      bad += (e.X != reference[j].X || e.Y != reference[j].Y ||
+              e.Z != reference[j].Z);
+    }
+  wmmstatefree(state);
+  return (void *)bad;
+}
+
+/**
+ * threads() - NTHREAD threads share one model, each with its own state
+ * Return: number of failures
+ */
+static int threads(void) {
+  pthread_t tid[NTHREAD];
+  void *bad;
+  int i, fails = 0;
+
+  for (i = 0; i < NTHREAD; i++)
+    pthread_create(&tid[i], NULL, worker, NULL);
+  for (i = 0; i < NTHREAD; i++) {
+    pthread_join(tid[i], &bad);
+    if (bad) {
+      printf("FAIL thread %d: %ld results differ\n", i, (long)bad);
+      fails++;
+    }
+  }
+  return fails;
+}
+
+/**
+ * floatcheck() - float declination against double on a global grid
+ * @name  printed with the results
+ * @step  grid spacing in degrees, poles excluded
+ * Return: number of failures
+ */
+static int floatcheck(struct wmmstate *state, char *name, double step) {
+  MAGtype_GeoMagneticElements e;
+  double lat, lon, f, diff, maxdiff = 0.0, sumsq = 0.0;
+  double start, dns = 0.0, fns = 0.0;
+  int n = 0, fails = 0;
+
+  for (lat = -90.0 + step; lat < 90.0; lat += step)
+    for (lon = -180.0; lon < 180.0; lon += step) {
+      start = now();
+      wmmelements(state, lon, lat, 0.0, 2017, 7, 2, &e);
+      dns += now() - start;
+      wmmprecision(state, WMMSINGLE);
+      start = now();
+      f = wmmdeclination(state, lon, lat, 0.0, 2017, 7, 2);
+      fns += now() - start;
+      wmmprecision(state, WMMDOUBLE);
+      n++;
+      if (e.H < FLOATMINH)
+        continue;
+      diff = fabs(f - e.Decl);
+      sumsq += diff * diff;
+      maxdiff = fmax(maxdiff, diff);
+      if (diff > FLOATTOL) {
+        printf("FAIL %s float declination at %.1f %.1f: %.4f double %.4f\n",
+               name, lat, lon, f, e.Decl);
+        fails++;
+      }
+    }
+  printf("%-7s float decl max diff %.5f deg rms %.5f deg  double %.0f "
+         "float %.0f ns/point\n",
+         name, maxdiff, sqrt(sumsq / n), dns * 1e9 / n, fns * 1e9 / n);
+  return fails;
+}
+
+/**
+ * emmtime() - time wmmpoint() over the EMM test points
+ * @e  output, one result per point
+ * Return: microseconds per point
+ */
+static double emmtime(struct wmmstate *state, double *lon, double *lat,
+                      double *hgt, MAGtype_GeoMagneticElements *e) {
+  double start;
+  int i;
+
+  start = now();
+  for (i = 0; i < EMMPOINTS; i++)
+    wmmpoint(state, lon[i], lat[i], hgt[i], EMMYEAR, &e[i]);
+  return (now() - start) * 1e6 / EMMPOINTS;
+}
+
+/**
+ * emm() - high degree model against MAG_Geomag(), then timed
+ * @cofname, @svname  EMM coefficient files
+ * @budget  nT for the truncated run, see emmopen()
+ * Return: number of failures
+ */
+static int emm(char *cofname, char *svname, double budget) {
+  MAGtype_MagneticModel *magneticmodel, *timedmodel;
+  MAGtype_Ellipsoid ellip;
+  MAGtype_Geoid geoid;
+  MAGtype_CoordGeodetic geodetic;
+  MAGtype_CoordSpherical spherical;
+  MAGtype_Date date;
+  MAGtype_GeoMagneticElements ref[EMMPOINTS], e[EMMPOINTS];
+  double lon[EMMPOINTS], lat[EMMPOINTS], hgt[EMMPOINTS];
+  double start, us, diff, maxdiff = 0.0, maxdecl = 0.0;
+  struct wmmmodel *model;
+  struct wmmstate *state;
+  int i, fails = 0;
+
+  /* reference: GeomagnetismLibrary.c as NOAA ships it */
+  if (!MAG_robustReadMagneticModel_Large(cofname, svname, &magneticmodel)) {
+    fprintf(stderr, "cannot load %s %s\n", cofname, svname);
+    return 1;
+  }
+  timedmodel = MAG_AllocateModelMemory(CALCULATE_NUMTERMS(magneticmodel->nMax));
+  MAG_SetDefaults(&ellip, &geoid);
+  date.DecimalYear = EMMYEAR;
+  MAG_TimelyModifyMagneticModel(date, magneticmodel, timedmodel);
+
+  srand(1);
+  start = now();
+  for (i = 0; i < EMMPOINTS; i++) {
+    lat[i] = geodetic.phi = -89.0 + 178.0 * rand() / RAND_MAX;
+    lon[i] = geodetic.lambda = -180.0 + 360.0 * rand() / RAND_MAX;
+    hgt[i] = geodetic.HeightAboveEllipsoid = 10.0 * rand() / RAND_MAX;
+    MAG_GeodeticToSpherical(ellip, geodetic, &spherical);
+    MAG_Geomag(ellip, spherical, geodetic, timedmodel, &ref[i]);
+  }
+  us = (now() - start) * 1e6 / EMMPOINTS;
+  printf("emm     degree %d MAG_Geomag %10.0f us/point\n", magneticmodel->nMax,
+         us);
+  MAG_FreeMagneticModelMemory(timedmodel);
+  MAG_FreeMagneticModelMemory(magneticmodel);
+
+  /* full degree must agree with the library */
+  model = emmopen(cofname, svname, 0.0);
+  state = wmmstatenew(model);
+  if (!state) {
+    fprintf(stderr, "emmopen %s failed\n", cofname);
+    return 1;
+  }
+  us = emmtime(state, lon, lat, hgt, e);
+  for (i = 0; i < EMMPOINTS; i++) {
+    diff = fmax(fabs(e[i].X - ref[i].X), fabs(e[i].Y - ref[i].Y));
+    diff = fmax(diff, fabs(e[i].Z - ref[i].Z));
+    maxdiff = fmax(maxdiff, diff);
+    if (diff > EMMTOL) {
+      printf("FAIL emm point %d differs from MAG_Geomag by %.4f nT\n", i,
+             diff);
+      fails++;
+    }
+  }
+  printf("emm     degree %d wmmpoint   %10.0f us/point  max diff %.5f nT\n",
+         wmmdegree(model), us, maxdiff);
+  fails += floatcheck(state, "emm", EMMSTEP);
+  wmmstatefree(state);
+  wmmclose(model);
+
+  /* truncated to the budget: error against the library, in nT and degrees */
+  model = emmopen(cofname, svname, budget);
+  state = wmmstatenew(model);
+  if (!state)
+    return fails + 1;
+  us = emmtime(state, lon, lat, hgt, e);
+  maxdiff = 0.0;
+  for (i = 0; i < EMMPOINTS; i++) {
+    maxdiff = fmax(maxdiff, fabs(e[i].F - ref[i].F));
+    maxdecl = fmax(maxdecl, fabs(e[i].Decl - ref[i].Decl));
+  }
+  printf("emm     degree %d wmmpoint   %10.0f us/point  max diff %.2f nT "
+         "%.4f deg (budget %.1f nT)\n",
+         wmmdegree(model), us, maxdiff, maxdecl, budget);
+  wmmstatefree(state);
+  wmmclose(model);
+  return fails;
+}
+
+/**
+ * readbaseline() - read "mode ns" lines written by -w
+ */
+static void readbaseline(char *name, double *limit) {
+  FILE *fp;
+  char mode[20];
+  double ns;
+  int i;
+
+  fp = fopen(name, "r");
+  if (!fp) {
+    perror(name);
+    return;
+  }
+  while (fscanf(fp, "%19s %lf", mode, &ns) == 2)
+    for (i = 0; i < NMODE; i++)
+      if (strcmp(mode, modename[i]) == 0)
+        limit[i] = ns * (100 + SLACK) / 100.0;
+  fclose(fp);
+}
+
+int main(int argc, char *argv[]) {
+  MAGtype_GeoMagneticElements *grid;
+  struct wmmstate *state;
+  char *cofname = COFFILE;
+  char *baseline = NULL;
+  char *emmname = NULL, *emmsvname = NULL;
+  double limit[NMODE], ns[NMODE], budget = 10.0;
+  int i, opt, writebase = 0, fails, slow = 0;
+  FILE *fp;
+
+  while ((opt = getopt(argc, argv, "f:b:we:s:t:")) != -1) {
+    if (opt == 'f')
+      cofname = optarg;
+    else if (opt == 'b')
+      baseline = optarg;
+    else if (opt == 'w')
+      writebase = 1;
+    else if (opt == 'e')
+      emmname = optarg;
+    else if (opt == 's')
+      emmsvname = optarg;
+    else if (opt == 't')
+      budget = atof(optarg);
+    else {
+      fprintf(stderr,
+              "usage: %s [-f WMM.COF] [-b baselinefile] [-w]\n"
+              "          [-e EMM2015.COF -s EMM2015SV.COF] [-t budget]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  wmm = wmmopen(cofname);
+  state = wmmstatenew(wmm);
+  if (!state) {
+    fprintf(stderr, "cannot load %s\n", cofname);
+    return 1;
+  }
+
+  fails = accuracy(state);
+  printf("accuracy: %d of %d test points failed\n", fails, NTEST);
+  fails += threads();
+  printf("threads: %d threads x %d points\n", NTHREAD, NLOOP * NTEST);
+  fails += floatcheck(state, "wmm", GRIDSTEP);
+  if (emmname && emmsvname)
+    fails += emm(emmname, emmsvname, budget);
+  if (fails)
+    return 1;
+
+  for (i = 0; i < NMODE; i++)
+    limit[i] = MAXNS;
+  if (baseline && !writebase)
+    readbaseline(baseline, limit);
+
+  grid = malloc(GRIDCOLS * GRIDROWS * sizeof(*grid));
+  for (i = 0; i < NMODE; i++) {
+    ns[i] = speed(state, i, grid);
+    printf("%-7s %10.0f ns/point  (limit %.0f)%s\n", modename[i], ns[i],
+           limit[i], ns[i] > limit[i] ? "  TOO SLOW" : "");
+    slow += ns[i] > limit[i];
+  }
+  free(grid);
+  wmmstatefree(state);
+  wmmclose(wmm);
+
+  if (writebase && baseline) {
+    fp = fopen(baseline, "w");
+    if (!fp) {
+      perror(baseline);
+      return 1;
+    }
+    for (i = 0; i < NMODE; i++)
+      fprintf(fp, "%s %.0f\n", modename[i], ns[i]);
+    fclose(fp);
+    printf("baseline written to %s\n", baseline);
+    return 0;
+  }
+  return slow ? 2 : 0;
+}
@@ -0,0 +1,511 @@
+/**
+ * DOC: --  nmeareplay.c  -- replay a NMEA log into pmtgpsd through a pty
+ *  Peter Thompson   -- Nov 2019
+ *
+ *  pretends to be the Linx R4 so pmtgpsd can be tested and measured on
+ *  a desk machine with no gps hardware.
+ *
+ *  creates a pseudo terminal, prints the name of its slave side
+ *  (/dev/pts/N) and optionally links it to a fixed name (-s), then
+ *  writes the NMEA log to it:
+ *    real time       - paced by the UTC time in each GGA sentence
+ *    -r N            - N times real time
+ *    -u              - unthrottled, as fast as pmtgpsd reads
+ *  -c P corrupts P percent of sentences, one of: a flipped bit,
+ *  a dropped char, a sentence cut short (CR LF lost) or a noise char.
+ *  pmtgpsd must drop all of these (bad checksum) and count them.
+ *  -n sends the log as a receiver with no fix: every GGA with quality 0
+ *  and every RMC with status V, both without a position, the times
+ *  kept.  The cold start check: with a saved lastfix, test/testgpsfix
+ *  must show it, status stale, all through the replay.
+ *
+ *  the log may also hold u-blox UBX binary frames (a capture from a
+ *  u-blox receiver, or pmtgpsd's own log of one), alone or mixed with
+ *  NMEA.  Frames are sent whole and corrupted the same way.  The
+ *  stream is paced by whichever comes first, GGA time or the NAV-PVT
+ *  iTOW (gps time of week).
+ *
+ *  -m answers the MediaTek PMTK commands pmtgpsd sends when pmtgpsd.conf
+ *  has baud, fixrate, nmeaset or aiding (linxdriver.c): $PMTK001,cmd,3 for
+ *  each, and sentence types turned off by PMTK314 are no longer sent.
+ *  A pty has no baud rate and the log sets the fix rate, so PMTK251 and
+ *  PMTK220 change nothing - this tests the commands, not the receiver.
+ *
+ *  the whole log is read before the pty is opened, so it is safe to
+ *  replay /var/log/pmtgpsd-nmea.log while pmtgpsd rewrites it.
+ *
+ *  usage: nmeareplay [-r rate | -u] [-c percent] [-l loops] [-s link]
+ *                    [-d delay] [-m] [-n] nmealogfile
+ *   -l 0 = loop forever, -d = seconds to wait before the first sentence
+ *
+ *  measuring pmtgpsd:
+ *    nmeareplay -u -l 0 -s /tmp/ttygps /var/log/pmtgpsd-nmea.log
+ *    /usr/share/pmt/pmtgpsd.conf:   device = /tmp/ttygps
+ *                                   statsinterval = 10
+ *    start pmtgpsd, then  grep "pmtgpsd stats" /var/log/syslog
+ *    for sentences/s, cpu per fix and fix-to-shm latency (gpsstats.c)
+ *
+ * X86 compile with:
+ *  gcc -O2 -o nmeareplay nmeareplay.c
+ * cross-compile with:
+ *  arm-linux-gnueabihf-gcc -O2 -o nmeareplay nmeareplay.c
+ */
+
+#define _DEFAULT_SOURCE /* cfmakeraw(), usleep() */
+#define _XOPEN_SOURCE 600 /* posix_openpt(), ptsname() */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAXFRAME 1100   /* UBX frames longer than this are sent as is */
+#define MAXGAP 10.0     /* seconds, longer gaps replay as 1 second */
+#define UBXSYNC1 0xB5
+#define UBXSYNC2 0x62
+#define GGACLOCK 1 /* pace by GGA UTC time, wraps at midnight */
+#define PVTCLOCK 2 /* pace by NAV-PVT iTOW, wraps every week */
+
+static volatile sig_atomic_t stop = 0;
+static long nsentence, nbyte, ncorrupt;
+
+/* -m receiver emulation, PMTK314 field of each sentence type */
+static int mtk;
+static int nofix; /* -n, no fix sentences */
+static char *mtknames[] = {"GLL", "RMC", "VTG", "GGA", "GSA", "GSV"};
+#define NMTKNAME 6
+static int mtkoff[NMTKNAME]; /* TRUE => turned off by PMTK314 */
+static char command[100];    /* PMTK command being read from pmtgpsd */
+static int clen;
+
+/**
+ * terminate() - SIGINT or SIGTERM, finish the current sentence and stop
+ */
+static void terminate(int signum) {
+  (void)signum;
+  stop = 1;
+}
+
+/**
+ * loadlog() - read a whole NMEA log into memory
+ * @name  log file
+ * @size  output: bytes read
+ * Return: malloc'd text ending in '\n', or NULL
+ */
+static char *loadlog(char *name, long *size) {
+  FILE *fp;
+  char *text;
+  long n;
+
+  fp = fopen(name, "r");
+  if (!fp) {
+    perror(name);
+    return NULL;
+  }
+  fseek(fp, 0, SEEK_END);
+  n = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  text = n < 0 ? NULL : malloc(n + 1); /* ftell() -1, not a plain file */
+  if (!text || fread(text, 1, n, fp) != (size_t)n) {
+    fprintf(stderr, "%s: read error\n", name);
+    fclose(fp);
+    free(text);
+    return NULL;
+  }
+  fclose(fp);
+  if (n == 0 || text[n - 1] != '\n')
+    text[n++] = '\n';
+  *size = n;
+  return text;
+}
+
+/**
+ * ggatime() - UTC time of a GGA sentence
+ * @s  sentence
+ * Return: seconds after midnight, or -1.0 if not a GGA or no time
+ */
+static double ggatime(char *s) {
+  int hh, mm;
+  double ss;
+
+  if (s[0] != '$' || strncmp(s + 3, "GGA,", 4) != 0)
+    return -1.0;
+  if (sscanf(s + 7, "%2d%2d%lf", &hh, &mm, &ss) != 3)
+    return -1.0;
+  return hh * 3600.0 + mm * 60.0 + ss;
+}
+
+/**
+ * pvttime() - gps time of week of a UBX NAV-PVT frame
+ * @s    frame
+ * @len  its length
+ * Return: seconds, or -1.0 if not a NAV-PVT
+ */
+static double pvttime(unsigned char *s, int len) {
+  if (len < 10 || s[0] != UBXSYNC1 || s[2] != 0x01 || s[3] != 0x07)
+    return -1.0;
+  return (s[6] | s[7] << 8 | s[8] << 16 | (unsigned)s[9] << 24) / 1000.0;
+}
+
+/**
+ * nextmessage() - length of the NMEA sentence or UBX frame at p
+ * Return: bytes, a sentence ends after its LF (or before a UBX frame)
+ */
+static long nextmessage(unsigned char *p, unsigned char *end) {
+  unsigned char *q;
+
+  if (end - p >= 6 && p[0] == UBXSYNC1 && p[1] == UBXSYNC2 &&
+      end - p >= 8 + (p[4] | p[5] << 8))
+    return 8 + (p[4] | p[5] << 8);
+  for (q = p + 1; q < end && q[-1] != '\n'; q++)
+    if (q[0] == UBXSYNC1 && q + 1 < end && q[1] == UBXSYNC2)
+      break;
+  return q - p;
+}
+
+/**
+ * corrupt() - damage one sentence the way a noisy UART would
+ * @s    sentence including CR LF, room for one more char
+ * @len  its length
+ * Return: new length
+ */
+static int corrupt(char *s, int len) {
+  int k;
+
+  if (len < 6)
+    return len;
+  k = 1 + rand() % (len - 3); /* never the first char or the last 2 */
+  switch (rand() % 4) {
+  case 0: /* flipped bit */
+    s[k] ^= 1 << (rand() % 7);
+    break;
+  case 1: /* dropped char */
+    memmove(s + k, s + k + 1, len - k - 1);
+    len--;
+    break;
+  case 2: /* cut short, CR LF lost, runs into the next sentence */
+    len = k;
+    break;
+  case 3: /* noise char */
+    memmove(s + k + 1, s + k, len - k);
+    s[k] = ' ' + rand() % 95;
+    len++;
+    break;
+  }
+  ncorrupt++;
+  return len;
+}
+
+/**
+ * voidfix() - the GGA or RMC of a receiver without a fix, same time
+ * @s    sentence including CR LF, room for MAXFRAME chars
+ * @len  its length
+ * Return: new length, or len if not a GGA or RMC
+ */
+static int voidfix(char *s, int len) {
+  char talker[3], time[16], date[8], *f;
+  unsigned int sum;
+  int i, n;
+
+  if (len < 8 || s[0] != '$' || sscanf(s + 7, "%15[^,*]", time) != 1)
+    return len;
+  memcpy(talker, s + 1, 2);
+  talker[2] = '\0';
+  if (strncmp(s + 3, "GGA,", 4) == 0) {
+    n = snprintf(s + 1, MAXFRAME, "%sGGA,%s,,,,,0,00,99.99,,,,,,", talker,
+                 time);
+  } else if (strncmp(s + 3, "RMC,", 4) == 0) {
+    for (f = s, i = 0; i < 9 && f; i++) /* field 9, ddmmyy */
+      f = memchr(f + 1, ',', len - (f + 1 - s));
+    if (!f || sscanf(f + 1, "%7[0-9]", date) != 1)
+      date[0] = '\0';
+    n = snprintf(s + 1, MAXFRAME, "%sRMC,%s,V,,,,,,,%s,,,N", talker, time,
+                 date);
+  } else
+    return len;
+  for (sum = 0, i = 1; i <= n; i++)
+    sum ^= (unsigned char)s[i];
+  return 1 + n + sprintf(s + 1 + n, "*%02X\r\n", sum);
+}
+
+/**
+ * writeall() - write to the pty, blocks while pmtgpsd is behind
+ * Return: 0 if ok, -1 if the pty failed
+ */
+static int writeall(int fd, char *s, int len) {
+  int num;
+
+  while (len > 0) {
+    num = write(fd, s, len);
+    if (num < 0 && errno == EINTR && !stop)
+      continue;
+    if (num <= 0)
+      return -1;
+    s += num;
+    len -= num;
+  }
+  return 0;
+}
+
+/**
+ * mtkreply() - answer one PMTK command as the Linx R4 would
+ * @fd       pty master
+ * @command  "$PMTKnnn,...*hh"
+ * Return: nothing
+ */
+static void mtkreply(int fd, char *command) {
+  char reply[40], out[48], *c;
+  unsigned int sum;
+  int cmd, i, len;
+
+  cmd = atoi(command + 5);
+  if (cmd == 251)
+    return; /* new baud rate, the receiver just changes */
+  if (cmd == 314)
+    for (c = command, i = 0; (c = strchr(c + 1, ',')) && i < NMTKNAME; i++)
+      mtkoff[i] = atoi(c + 1) == 0;
+  len = snprintf(reply, sizeof(reply), "PMTK001,%d,3", cmd);
+  for (sum = 0, i = 0; i < len; i++)
+    sum ^= (unsigned char)reply[i];
+  len = snprintf(out, sizeof(out), "$%s*%02X\r\n", reply, sum);
+  if (write(fd, out, len) == len)
+    fprintf(stderr, "answered %s", out);
+}
+
+/**
+ * mtkread() - read what pmtgpsd wrote to the pty, answer PMTK commands
+ * @fd  pty master
+ * Return: nothing
+ */
+static void mtkread(int fd) {
+  struct pollfd wait;
+  char c;
+
+  wait.fd = fd;
+  wait.events = POLLIN;
+  while (poll(&wait, 1, 0) > 0 && read(fd, &c, 1) == 1) {
+    if (c == '$')
+      clen = 0;
+    if (c == '\r' || c == '\n') {
+      command[clen] = '\0';
+      if (strncmp(command, "$PMTK", 5) == 0)
+        mtkreply(fd, command);
+      clen = 0;
+    } else if (clen < (int)sizeof(command) - 1)
+      command[clen++] = c;
+  }
+}
+
+/**
+ * mtksent() - is this sentence type still sent after PMTK314
+ * Return: 1 if sent, 0 if turned off
+ */
+static int mtksent(char *s) {
+  int i;
+
+  if (s[0] != '$')
+    return 1;
+  for (i = 0; i < NMTKNAME; i++)
+    if (strncmp(s + 3, mtknames[i], 3) == 0)
+      return !mtkoff[i];
+  return 1;
+}
+
+/**
+ * replay() - write the log to the pty once
+ * @rate     times real time, 0 => unthrottled
+ * @percent  sentences to corrupt
+ * Return: 0 if ok, -1 if the pty failed
+ */
+static int replay(int fd, char *text, long size, double rate,
+                  double percent) {
+  char s[MAXFRAME + 2];
+  unsigned char *line, *end;
+  struct timespec next;
+  double t, last, dt, wrap;
+  int len, out, clock;
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  last = -1.0;
+  clock = 0;
+  end = (unsigned char *)text + size;
+  for (line = (unsigned char *)text; line < end && !stop; line += len) {
+    len = nextmessage(line, end);
+
+    /* pace by the first sentence (GGA) or frame (NAV-PVT) of each fix */
+    t = -1.0;
+    if (clock != PVTCLOCK && (t = ggatime((char *)line)) >= 0.0)
+      clock = GGACLOCK;
+    else if (clock != GGACLOCK && (t = pvttime(line, len)) >= 0.0)
+      clock = PVTCLOCK;
+    if (t >= 0.0 && rate > 0.0) {
+      if (last >= 0.0) {
+        wrap = clock == GGACLOCK ? 86400.0 : 604800.0;
+        dt = t - last;
+        if (dt < 0.0)
+          dt += wrap; /* midnight UTC or end of the gps week */
+        if (dt > MAXGAP)
+          dt = 1.0;
+        dt /= rate;
+        next.tv_sec += (time_t)dt;
+        next.tv_nsec += (long)((dt - (time_t)dt) * 1e9);
+        if (next.tv_nsec >= 1000000000) {
+          next.tv_sec++;
+          next.tv_nsec -= 1000000000;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) &&
+               !stop)
+          ;
+      }
+      last = t;
+    }
+
+    if (mtk) {
+      mtkread(fd);
+      if (!mtksent((char *)line))
+        continue;
+    }
+
+    if (len > MAXFRAME) { /* not NMEA or UBX we know, send as is */
+      if (writeall(fd, (char *)line, len) < 0)
+        return -1;
+      nbyte += len;
+      continue;
+    }
+    memcpy(s, line, len);
+    out = len;
+    if (nofix)
+      out = voidfix(s, len);
+    if (rand() % 10000 < percent * 100.0)
+      out = corrupt(s, out);
+    if (writeall(fd, s, out) < 0)
+      return -1;
+    nsentence++;
+    nbyte += out;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  struct sigaction action;
+  struct termios options;
+  struct timespec t0, t1;
+  char *text, *slave, *link;
+  double rate, percent, delay, seconds;
+  long size;
+  int opt, loops, loop, master, fd;
+
+  rate = 1.0;
+  percent = 0.0;
+  loops = 1;
+  delay = 0.0;
+  link = NULL;
+  while ((opt = getopt(argc, argv, "r:uc:l:s:d:mn")) != -1) {
+    switch (opt) {
+    case 'r':
+      rate = atof(optarg);
+      break;
+    case 'u':
+      rate = 0.0;
+      break;
+    case 'c':
+      percent = atof(optarg);
+      break;
+    case 'l':
+      loops = atoi(optarg);
+      break;
+    case 's':
+      link = optarg;
+      break;
+    case 'd':
+      delay = atof(optarg);
+      break;
+    case 'm':
+      mtk = 1;
+      break;
+    case 'n':
+      nofix = 1;
+      break;
+    default:
+      optind = argc; /* usage */
+    }
+  }
+  if (optind != argc - 1 || rate < 0.0) {
+    fprintf(stderr,
+            "usage: %s [-r rate | -u] [-c percent] [-l loops] [-s link]\n"
+            "          [-d delay] [-m] [-n] nmealogfile\n",
+            argv[0]);
+    return 1;
+  }
+  text = loadlog(argv[optind], &size);
+  if (!text)
+    return 1;
+
+  /* pseudo terminal, pmtgpsd opens the slave side as its serial port */
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0 ||
+      !(slave = ptsname(master))) {
+    perror("pty");
+    return 1;
+  }
+  /*
+   * hold the slave open: the pty survives pmtgpsd restarts, and it is
+   * raw from the start so nothing is echoed back before pmtgpsd sets it
+   */
+  fd = open(slave, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    perror(slave);
+    return 1;
+  }
+  tcgetattr(fd, &options);
+  cfmakeraw(&options);
+  tcsetattr(fd, TCSANOW, &options);
+  printf("replaying %s on %s", argv[optind], slave);
+  if (link) {
+    unlink(link);
+    if (symlink(slave, link) < 0)
+      perror(link);
+    else
+      printf(" (%s)", link);
+  }
+  printf("\n");
+  fflush(stdout);
+
+  memset(&action, 0, sizeof(struct sigaction));
+  action.sa_handler = terminate;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  srand(time(NULL));
+  if (delay > 0.0)
+    usleep(delay * 1e6);
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (loop = 0; (loops == 0 || loop < loops) && !stop; loop++)
+    if (replay(master, text, size, rate, percent) < 0) {
+      perror("write pty");
+      break;
+    }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+  printf("%ld sentences (%ld corrupted), %ld bytes in %.2f s = "
+         "%.1f sentences/s\n",
+         nsentence, ncorrupt, nbyte, seconds,
+         seconds > 0.0 ? nsentence / seconds : 0.0);
+
+  /* let pmtgpsd read what is still in the pty, up to 5 s */
+  for (loop = 0; loop < 500 && ioctl(fd, FIONREAD, &opt) == 0 && opt > 0;
+       loop++)
+    usleep(10000);
+  if (link)
+    unlink(link);
+  close(fd);
+  close(master);
+  free(text);
+  return 0;
+}
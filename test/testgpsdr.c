@@ -0,0 +1,76 @@
+/**
+ * DOC: --  testgpsdr.c  -- print the pmtgpsd dead reckoned position
+ *  Peter Thompson   -- Nov 2019
+ *
+ *  reads /dev/shm/pmtgpsdr (struct PMTgpsdr in pmtgps.h) every 50 ms
+ *  and prints the predicted position, how far it moved since the last
+ *  line and its uncertainty.  pmtgpsd.conf needs drrate > 0.
+ *  usage: testgpsdr [count]      count lines, default forever
+ *
+ * cross-compile with:
+ *  arm-linux-gnueabihf-gcc -o testgpsdr  testgpsdr.c -I../include -L
+ * /home/peter/bbb2018/buildroot/output/target/usr/lib  -lm -lrt
+ * X86 compile with:
+ *  gcc -o testgpsdr  testgpsdr.c -I../include -lm -lrt
+ */
+
+#include <fcntl.h> /* for shared memory access */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h> /* for shared memory access */
+#include <unistd.h>   /* for shared memory access */
+
+#include "pmtgps.h" // struct PMTgpsdr
+
+static char *sourcename[] = {"none", "fix", "track", "compass", "hold"};
+
+/**
+ * readdr() - consistent copy of the predicted position
+ * Return: number of retries (0 almost always)
+ */
+static int readdr(struct PMTgpsdr *dr, struct PMTgpsdr *copy) {
+  unsigned int end;
+  int retry;
+
+  retry = -1;
+  do {
+    retry++;
+    end = dr->end;
+    __sync_synchronize();
+    *copy = *dr;
+    __sync_synchronize();
+  } while (dr->begin != end);
+  return retry;
+}
+
+int main(int argc, char **argv) {
+  struct PMTgpsdr *dr, now, last;
+  double north, east;
+  int fd, n, count, retry;
+
+  count = argc > 1 ? atoi(argv[1]) : 0;
+  fd = shm_open(DRNAME, O_RDONLY, 0644);
+  if (fd < 0) {
+    perror("/dev/shm/pmtgpsdr");
+    return 1;
+  }
+  dr = mmap(0, sizeof(struct PMTgpsdr), PROT_READ, MAP_SHARED, fd, 0);
+
+  readdr(dr, &last);
+  for (n = 0; count == 0 || n < count; n++) {
+    usleep(50000);
+    retry = readdr(dr, &now);
+    north = (now.latitude - last.latitude) * M_PI / 180.0 * 6371000.0;
+    east = (now.longitude - last.longitude) * M_PI / 180.0 * 6371000.0 *
+           cos(now.latitude * M_PI / 180.0);
+    printf("%u %-7s %11.7f %11.7f  moved %5.2fm  age %5.2fs  +-%5.1fm "
+           "hdg %5.1f%s\n",
+           now.end, sourcename[now.source % 5], now.longitude, now.latitude,
+           sqrt(north * north + east * east), now.age, now.uncertainty,
+           now.heading, retry ? "  (retried)" : "");
+    fflush(stdout);
+    last = now;
+  }
+  return 0;
+}
@@ -0,0 +1,76 @@
+/**
+ * DOC: --  testgpsfence.c  -- print pmtgpsd geofence events
+ *  Peter Thompson   -- Nov 2019
+ *
+ *  reads the event ring on /dev/shm/pmtgpsfence (struct PMTgpsfence in
+ *  pmtgps.h) 10 times a second and prints every new enter/exit event.
+ *  Shows how to read the ring: keep the number of the last event read,
+ *  copy the next one and use it only if its number is right before and
+ *  after the copy (pmtgpsd may be rewriting that slot).
+ *
+ * cross-compile with:
+ *  arm-linux-gnueabihf-gcc -o testgpsfence  testgpsfence.c -I../include -L
+ * /home/peter/bbb2018/buildroot/output/target/usr/lib  -lrt
+ * X86 compile with:
+ *  gcc -o testgpsfence  testgpsfence.c -I../include -lrt
+ */
+
+#include <fcntl.h> /* for shared memory access */
+#include <stdio.h>
+#include <sys/mman.h> /* for shared memory access */
+#include <unistd.h>   /* for shared memory access */
+
+#include "pmtgps.h" // geofence event ring
+
+/**
+ * readevent() - copy event number n + 1
+ * Return: 1 if copied, 0 if pmtgpsd has overwritten it
+ */
+static int readevent(struct PMTgpsfence *fence, unsigned int n,
+                     struct fenceevent *copy) {
+  struct fenceevent *ev;
+
+  ev = &fence->ring[n % FENCERING];
+  if (ev->number != n + 1)
+    return 0;
+  __sync_synchronize();
+  *copy = *ev;
+  __sync_synchronize();
+  return ev->number == n + 1;
+}
+
+int main() {
+  struct PMTgpsfence *fence;
+  struct fenceevent ev;
+  unsigned int n, events;
+  int fd;
+
+  fd = shm_open(FENCENAME, O_RDONLY, 0644);
+  if (fd < 0) {
+    perror("/dev/shm/pmtgpsfence");
+    return 1;
+  }
+  fence = mmap(0, sizeof(struct PMTgpsfence), PROT_READ, MAP_SHARED, fd, 0);
+  printf("%d fences, %u events so far, %u reloads\n", fence->fences,
+         fence->events, fence->reloads);
+
+  n = fence->events > FENCERING ? fence->events - FENCERING : 0;
+  for (;;) {
+    events = fence->events;
+    __sync_synchronize();
+    if (events - n > FENCERING) {
+      printf("  %u events lost\n", events - n - FENCERING);
+      n = events - FENCERING;
+    }
+    for (; n < events; n++)
+      if (readevent(fence, n, &ev))
+        printf("%6u %s %-31s date=%d gmt=%06d %.6f %.6f\n", ev.number,
+               ev.type == FENCEENTER ? "enter" : "exit ", ev.name, ev.date,
+               ev.gmt, ev.longitude, ev.latitude);
+      else
+        printf("  event %u lost\n", n + 1);
+    fflush(stdout);
+    usleep(100000);
+  }
+  return 0;
+}
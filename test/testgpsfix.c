@@ -0,0 +1,92 @@
+/**
+ * DOC: --  testgpsfix.c  -- print the pmtgpsd fix in fixed point
+ *  Peter Thompson   -- Nov 2019
+ *
+ *  reads the version 2 fields of /dev/shm/pmtgps (struct PMTgps in
+ *  pmtgps.h) once a second: 1e-7 degrees, millimeters and the fix
+ *  time in nanoseconds, filtered and raw, the version 3 map sheet and
+ *  zoom 14 map tile and the version 4 ground height, and the status
+ *  (stale while the saved fix is published).  Shows how to check the
+ *  version and read the record consistently with sequence.
+ *
+ * cross-compile with:
+ *  arm-linux-gnueabihf-gcc -o testgpsfix  testgpsfix.c -I../include -L
+ * /home/peter/bbb2018/buildroot/output/target/usr/lib  -lrt
+ * X86 compile with:
+ *  gcc -o testgpsfix  testgpsfix.c -I../include -lrt
+ */
+
+#include <fcntl.h> /* for shared memory access */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h> /* for shared memory access */
+#include <sys/stat.h>
+#include <unistd.h> /* for shared memory access */
+
+#include "pmtgps.h" // struct PMTgps
+
+/**
+ * readgps() - consistent copy of struct PMTgps
+ * Return: number of retries (0 almost always)
+ */
+static int readgps(struct PMTgps *gps, struct PMTgps *copy) {
+  unsigned int seq;
+  int retry;
+
+  retry = -1;
+  do {
+    retry++;
+    seq = gps->sequence;
+    __sync_synchronize();
+    *copy = *gps;
+    __sync_synchronize();
+  } while ((seq & 1) || gps->sequence != seq);
+  return retry;
+}
+
+int main() {
+  struct PMTgps *gps, now;
+  struct stat size;
+  int fd, retry;
+
+  fd = shm_open("/pmtgps", O_RDONLY, 0666);
+  if (fd < 0) {
+    perror("/dev/shm/pmtgps");
+    return 1;
+  }
+  if (fstat(fd, &size) < 0 || size.st_size < (off_t)sizeof(struct PMTgps)) {
+    fprintf(stderr, "pmtgpsd older than version %d\n", PMTGPSVERSION);
+    return 1;
+  }
+  gps = mmap(0, sizeof(struct PMTgps), PROT_READ, MAP_SHARED, fd, 0);
+
+  for (;;) {
+    retry = readgps(gps, &now);
+    if (now.version != PMTGPSVERSION) {
+      fprintf(stderr, "version %d, not %d\n", now.version, PMTGPSVERSION);
+      return 1;
+    }
+    printf("seq %u %s  %.7f %.7f %.3fm  raw %.7f %.7f %.3fm  "
+           "fix %" PRId64 ".%09" PRId64 "%s\n",
+           now.sequence,
+           now.status == GPSSTALE   ? "stale"
+           : now.status == GPSMOVED ? "moved"
+           : now.status == GPSLOST  ? "lost"
+                                    : "still",
+           now.longitude7 * 1e-7, now.latitude7 * 1e-7,
+           now.altitudemm / 1000.0, now.rawlongitude7 * 1e-7,
+           now.rawlatitude7 * 1e-7, now.rawaltitudemm / 1000.0,
+           now.fixtime / 1000000000, now.fixtime % 1000000000,
+           retry ? "  (retried)" : "");
+    printf("  map %u  sheet %s  tile 14/%u/%u", now.mapchanges,
+           now.mapsheet[0] ? now.mapsheet : "none", now.tilex[14],
+           now.tiley[14]);
+    if (now.groundmm != GPSNOGROUND)
+      printf("  ground %.3fm", now.groundmm / 1000.0);
+    printf("\n");
+    fflush(stdout);
+    sleep(1);
+  }
+  return 0;
+}
@@ -0,0 +1,71 @@
+/**
+ * DOC: --  testgpsmatch.c  -- print pmtgpsd map matching
+ *  Peter Thompson   -- Nov 2019
+ *
+ *  reads /dev/shm/pmtgpsmatch (struct PMTgpsmatch in pmtgps.h) once a
+ *  second: the fix, where it is on the trails and how far off it was,
+ *  and the settled position of an older fix.  Needs trailfile in
+ *  pmtgpsd.conf.
+ *
+ * cross-compile with:
+ *  arm-linux-gnueabihf-gcc -o testgpsmatch  testgpsmatch.c -I../include -L
+ * /home/peter/bbb2018/buildroot/output/target/usr/lib  -lrt
+ * X86 compile with:
+ *  gcc -o testgpsmatch  testgpsmatch.c -I../include -lrt
+ */
+
+#include <fcntl.h> /* for shared memory access */
+#include <stdio.h>
+#include <sys/mman.h> /* for shared memory access */
+#include <unistd.h>   /* for shared memory access */
+
+#include "pmtgps.h" // struct PMTgpsmatch
+
+/**
+ * readmatch() - consistent copy of the matching
+ * Return: number of retries (0 almost always)
+ */
+static int readmatch(struct PMTgpsmatch *match, struct PMTgpsmatch *copy) {
+  unsigned int end;
+  int retry;
+
+  retry = -1;
+  do {
+    retry++;
+    end = match->end;
+    __sync_synchronize();
+    *copy = *match;
+    __sync_synchronize();
+  } while (match->begin != end);
+  return retry;
+}
+
+int main() {
+  struct PMTgpsmatch *match, now;
+  int fd, retry;
+
+  fd = shm_open(MATCHNAME, O_RDONLY, 0644);
+  if (fd < 0) {
+    perror("/dev/shm/pmtgpsmatch");
+    return 1;
+  }
+  match = mmap(0, sizeof(struct PMTgpsmatch), PROT_READ, MAP_SHARED, fd, 0);
+
+  for (;;) {
+    retry = readmatch(match, &now);
+    printf("%06d fix %.6f %.6f  ", now.gmt, now.longitude, now.latitude);
+    if (now.matched)
+      printf("trail %d %.6f %.6f  %.1f m off, %d near", now.trail,
+             now.matchlongitude, now.matchlatitude, now.offtrail,
+             now.candidates);
+    else
+      printf("not on a trail");
+    if (now.settledgmt)
+      printf("  settled %06d %.6f %.6f", now.settledgmt,
+             now.settledlongitude, now.settledlatitude);
+    printf("  breaks %u%s\n", now.breaks, retry ? "  (retried)" : "");
+    fflush(stdout);
+    sleep(1);
+  }
+  return 0;
+}
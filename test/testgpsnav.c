@@ -0,0 +1,68 @@
+/**
+ * DOC: --  testgpsnav.c  -- print pmtgpsd route navigation
+ *  Peter Thompson   -- Nov 2019
+ *
+ *  reads /dev/shm/pmtgpsnav (struct PMTgpsnav in pmtgps.h) once a
+ *  second: next waypoint, bearing and distance to it, cross-track
+ *  error, how far to turn, remaining distance and ETA.  Needs navroute
+ *  in pmtgpsd.conf.
+ *
+ * cross-compile with:
+ *  arm-linux-gnueabihf-gcc -o testgpsnav  testgpsnav.c -I../include -L
+ * /home/peter/bbb2018/buildroot/output/target/usr/lib  -lrt
+ * X86 compile with:
+ *  gcc -o testgpsnav  testgpsnav.c -I../include -lrt
+ */
+
+#include <fcntl.h> /* for shared memory access */
+#include <stdio.h>
+#include <sys/mman.h> /* for shared memory access */
+#include <unistd.h>   /* for shared memory access */
+
+#include "pmtgps.h" // struct PMTgpsnav
+
+/**
+ * readnav() - consistent copy of the navigation
+ * Return: number of retries (0 almost always)
+ */
+static int readnav(struct PMTgpsnav *nav, struct PMTgpsnav *copy) {
+  unsigned int end;
+  int retry;
+
+  retry = -1;
+  do {
+    retry++;
+    end = nav->end;
+    __sync_synchronize();
+    *copy = *nav;
+    __sync_synchronize();
+  } while (nav->begin != end);
+  return retry;
+}
+
+int main() {
+  struct PMTgpsnav *nav, now;
+  int fd, retry;
+
+  fd = shm_open(NAVNAME, O_RDONLY, 0644);
+  if (fd < 0) {
+    perror("/dev/shm/pmtgpsnav");
+    return 1;
+  }
+  nav = mmap(0, sizeof(struct PMTgpsnav), PROT_READ, MAP_SHARED, fd, 0);
+
+  for (;;) {
+    retry = readnav(nav, &now);
+    printf("%06d waypoint %d/%d: %5.1f deg %6.0f m  off %+6.1f m  turn "
+           "%+6.1f (heading %5.1f)  %.2f km to go, eta %d:%02d:%02d at "
+           "%06d  scans %u%s\n",
+           now.gmt, now.waypoint, now.waypoints - 1, now.bearing,
+           now.distance, now.crosstrack, now.turn, now.heading,
+           now.remaining / 1000.0, (int)now.eta / 3600,
+           (int)now.eta / 60 % 60, (int)now.eta % 60, now.etagmt, now.scans,
+           retry ? "  (retried)" : "");
+    fflush(stdout);
+    sleep(1);
+  }
+  return 0;
+}
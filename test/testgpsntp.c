@@ -0,0 +1,87 @@
+/**
+ * DOC: --  testgpsntp.c  -- print pmtgpsd fix times on NTP SHM
+ *  Peter Thompson   -- Nov 2019
+ *
+ *  testgpsntp [unit]
+ *  reads the NTP SHM reference clock segment (struct ntpshm in
+ *  pmtgps.h, default unit 0) once a second, as chronyd does: fix time,
+ *  the CLOCK_REALTIME it arrived and their difference (what chronyd
+ *  corrects less its offset).  It does not clear valid, so chronyd
+ *  still gets every sample.  Needs ntpunit in pmtgpsd.conf and root
+ *  for units 0 and 1.
+ *
+ * cross-compile with:
+ *  arm-linux-gnueabihf-gcc -o testgpsntp  testgpsntp.c -I../include
+ * X86 compile with:
+ *  gcc -o testgpsntp  testgpsntp.c -I../include
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <unistd.h>
+
+#include "pmtgps.h" // struct ntpshm
+
+/**
+ * readntp() - consistent copy of the segment, mode 1
+ * Return: number of retries (0 almost always)
+ */
+static int readntp(struct ntpshm *shm, struct ntpshm *copy) {
+  int count, retry;
+
+  retry = -1;
+  do {
+    retry++;
+    count = shm->count;
+    __sync_synchronize();
+    *copy = *shm;
+    __sync_synchronize();
+  } while (shm->count != count || (count & 1));
+  return retry;
+}
+
+int main(int argc, char *argv[]) {
+  struct ntpshm *shm, now;
+  struct tm utc;
+  double offset;
+  int unit, id, retry;
+  int lastcount;
+
+  unit = argc > 1 ? atoi(argv[1]) : 0;
+  id = shmget(NTPSHMKEY + unit, sizeof(struct ntpshm), 0);
+  if (id < 0) {
+    perror("NTP SHM segment");
+    return 1;
+  }
+  shm = shmat(id, NULL, SHM_RDONLY);
+  if (shm == (void *)-1) {
+    perror("NTP SHM shmat");
+    return 1;
+  }
+
+  lastcount = -1;
+  for (;;) {
+    retry = readntp(shm, &now);
+    if (now.count == lastcount || now.clockTimeStampSec == 0) {
+      printf("unit %d: no new fix time (count %d)\n", unit, now.count);
+    } else {
+      gmtime_r(&now.clockTimeStampSec, &utc);
+      offset = (now.receiveTimeStampSec - now.clockTimeStampSec) +
+               ((double)now.receiveTimeStampNSec -
+                now.clockTimeStampNSec) * 1e-9;
+      printf("unit %d: fix %04d-%02d-%02d %02d:%02d:%02d.%03u  received "
+             "%ld.%09u  %+.6f s  mode %d precision %d valid %d count %d%s\n",
+             unit, utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+             utc.tm_hour, utc.tm_min, utc.tm_sec,
+             now.clockTimeStampNSec / 1000000,
+             (long)now.receiveTimeStampSec, now.receiveTimeStampNSec, offset,
+             now.mode, now.precision, now.valid, now.count,
+             retry ? "  (retried)" : "");
+    }
+    lastcount = now.count;
+    sleep(1);
+  }
+  return 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * DOC: --  testgpssat.c  -- print the pmtgpsd satellite table
+ *  Peter Thompson   -- Nov 2019
+ *
+ *  reads /dev/shm/pmtgpssat (struct PMTgpssat in pmtgps.h) once a
+ *  second and prints every satellite in view, * = used in the fix.
+ *  Shows how to read the double buffered table: copy the current view,
+ *  retry if pmtgpsd rewrote it while we copied.
+ *
+ * cross-compile with:
+ *  arm-linux-gnueabihf-gcc -o testgpssat  testgpssat.c -I../include -L
+ * /home/peter/bbb2018/buildroot/output/target/usr/lib  -lrt
+ * X86 compile with:
+ *  gcc -o testgpssat  testgpssat.c -I../include -lrt
+ */
+
+#include <fcntl.h> /* for shared memory access */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h> /* for shared memory access */
+#include <unistd.h>   /* for shared memory access */
+
+#include "pmtgps.h" // satellite table
+
+static char *systemname[] = {"--", "GP", "GL", "GA", "BD", "QZ"};
+
+/**
+ * readview() - consistent copy of the current satellite view
+ * Return: number of retries (0 almost always)
+ */
+static int readview(struct PMTgpssat *sat, struct gpssatview *copy) {
+  unsigned int end;
+  int v, retry;
+
+  retry = -1;
+  do {
+    retry++;
+    v = sat->current;
+    end = sat->view[v].end;
+    __sync_synchronize();
+    *copy = sat->view[v];
+    __sync_synchronize();
+  } while (sat->view[v].begin != end);
+  return retry;
+}
+
+int main() {
+  struct PMTgpssat *sat;
+  struct gpssatview view;
+  int fd, i, retry;
+
+  fd = shm_open(SATNAME, O_RDONLY, 0644);
+  if (fd < 0) {
+    perror("/dev/shm/pmtgpssat");
+    return 1;
+  }
+  sat = mmap(0, sizeof(struct PMTgpssat), PROT_READ, MAP_SHARED, fd, 0);
+
+  for (;;) {
+    retry = readview(sat, &view);
+    printf("update %u date=%d gmt=%06d  %d in view, %d used  "
+           "pdop=%.1f hdop=%.1f vdop=%.1f%s\n",
+           view.end, view.date, view.gmt, view.nsat, view.nused, view.pdop,
+           view.hdop, view.vdop, retry ? "  (retried)" : "");
+    for (i = 0; i < view.nsat && i < MAXSAT; i++)
+      printf("  %s%3d%c elev=%3d az=%3d snr=%3d\n",
+             systemname[view.sat[i].system % 6], view.sat[i].prn,
+             view.sat[i].used ? '*' : ' ', view.sat[i].elevation,
+             view.sat[i].azimuth, view.sat[i].snr);
+    fflush(stdout);
+    sleep(1);
+  }
+  return 0;
+}
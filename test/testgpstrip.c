@@ -0,0 +1,97 @@
+/**
+ * DOC: --  testgpstrip.c  -- print the pmtgpsd trip computer
+ *  Peter Thompson   -- Nov 2019
+ *
+ *  reads /dev/shm/pmtgpstrip (struct PMTgpstrip in pmtgps.h) once a
+ *  second: distance, ascent/descent, moving and stopped time.  A new
+ *  trip starts with  kill -USR1 `pidof pmtgpsd`
+ *
+ *  JUMP marks a second in which the distance grew more than the trip's
+ *  max speed (twice, plus 100 m) allows for the time it added: a fix
+ *  that is not one, like the Null Island record of linxread() with no
+ *  fix, reaching the trip.
+ *
+ * cross-compile with:
+ *  arm-linux-gnueabihf-gcc -o testgpstrip  testgpstrip.c -I../include -L
+ * /home/peter/bbb2018/buildroot/output/target/usr/lib  -lrt
+ * X86 compile with:
+ *  gcc -o testgpstrip  testgpstrip.c -I../include -lrt
+ */
+
+#include <fcntl.h> /* for shared memory access */
+#include <stdio.h>
+#include <sys/mman.h> /* for shared memory access */
+#include <unistd.h>   /* for shared memory access */
+
+#include "pmtgps.h" // struct PMTgpstrip
+
+/**
+ * readtrip() - consistent copy of the trip
+ * Return: number of retries (0 almost always)
+ */
+static int readtrip(struct PMTgpstrip *trip, struct PMTgpstrip *copy) {
+  unsigned int end;
+  int retry;
+
+  retry = -1;
+  do {
+    retry++;
+    end = trip->end;
+    __sync_synchronize();
+    *copy = *trip;
+    __sync_synchronize();
+  } while (trip->begin != end);
+  return retry;
+}
+
+/**
+ * hhmmss() - seconds as h:mm:ss
+ * Return: the text, in a static buffer of 2
+ */
+static char *hhmmss(double seconds) {
+  static char text[2][16];
+  static int n;
+  int s;
+
+  n = 1 - n;
+  s = (int)seconds;
+  snprintf(text[n], sizeof(text[n]), "%d:%02d:%02d", s / 3600, s / 60 % 60,
+           s % 60);
+  return text[n];
+}
+
+int main() {
+  struct PMTgpstrip *trip, now, last;
+  double seconds, allowed;
+  int fd, retry, jump;
+
+  fd = shm_open(TRIPNAME, O_RDONLY, 0644);
+  if (fd < 0) {
+    perror("/dev/shm/pmtgpstrip");
+    return 1;
+  }
+  trip = mmap(0, sizeof(struct PMTgpstrip), PROT_READ, MAP_SHARED, fd, 0);
+
+  readtrip(trip, &last);
+  for (;;) {
+    retry = readtrip(trip, &now);
+    jump = 0;
+    if (now.resets == last.resets) {
+      seconds = (now.movingtime + now.stoppedtime) -
+                (last.movingtime + last.stoppedtime);
+      allowed = 2.0 * now.maxspeed / 3.6 * seconds + 100.0;
+      jump = now.distance - last.distance > allowed;
+    }
+    last = now;
+    printf("trip %d since %d %06d: %.3f km  up %.0f m down %.0f m  "
+           "moving %s (%.1f km/hr) stopped %s  max %.1f km/hr%s%s\n",
+           now.resets, now.startdate, now.startgmt, now.distance / 1000.0,
+           now.ascent, now.descent, hhmmss(now.movingtime),
+           now.movingtime > 0.0 ? now.distance / now.movingtime * 3.6 : 0.0,
+           hhmmss(now.stoppedtime), now.maxspeed, retry ? "  (retried)" : "",
+           jump ? "  JUMP" : "");
+    fflush(stdout);
+    sleep(1);
+  }
+  return 0;
+}
@@ -0,0 +1,113 @@
+/**
+ * DOC: --  testwmmdaemon.c  -- test pmtwmmd declination query daemon
+ *  Peter Thompson   -- Nov 2019
+ *
+ *  sends the pmt favourite locations (see simulate.c) as one batch,
+ *  prints the answers, then repeats a full WMMMAXQUERY batch of one
+ *  map tile and prints the round trip time per message and per point.
+ *  The first pass fills the cache, the rest are cache hits.
+ *
+ * cross-compile with:
+ *  arm-linux-gnueabihf-gcc -o testwmmdaemon  testwmmdaemon.c -I../include
+ * X86 compile with:
+ *  gcc -o testwmmdaemon  testwmmdaemon.c -I../include
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pmtwmmd.h"
+
+#define NPLACE 4
+#define REPEAT 1000
+
+static char *placename[NPLACE] = {"Percy Lake", "Panorama", "Solsona",
+                                  "Nahanni"};
+static struct wmmquery place[NPLACE] = {
+    {-78.36972, 45.21917, 440.0, 20191115},
+    {-116.2406, 50.45944, 1150.0, 20191115},
+    {1.5155, 41.9933, 670.0, 20191115},
+    {-123.8319, 61.1153, 300.0, 20191115},
+};
+
+/**
+ * ask() - send count queries, wait for the answers
+ * Return: 1 if a good reply came back
+ */
+static int ask(int fd, struct wmmquery *query, int count,
+               struct wmmanswer *answer) {
+  static char in[WMMREPLYMAX], out[WMMREQUESTMAX];
+  struct wmmrequest *request = (struct wmmrequest *)out;
+  struct wmmreply *reply = (struct wmmreply *)in;
+  ssize_t num;
+
+  request->magic = WMMMAGIC;
+  request->version = WMMVERSION;
+  request->count = count;
+  memcpy(request + 1, query, count * sizeof(struct wmmquery));
+  num = sizeof(struct wmmrequest) + count * sizeof(struct wmmquery);
+  if (send(fd, out, num, 0) != num)
+    return 0;
+  num = recv(fd, in, sizeof(in), 0);
+  if (num < (ssize_t)sizeof(struct wmmreply) || reply->status != WMMOK ||
+      reply->count != count)
+    return 0;
+  memcpy(answer, reply + 1, count * sizeof(struct wmmanswer));
+  return 1;
+}
+
+int main() {
+  struct wmmquery tile[WMMMAXQUERY];
+  struct wmmanswer answer[WMMMAXQUERY];
+  struct sockaddr_un addr;
+  struct timespec t0, t1;
+  double us;
+  int fd, i;
+
+  fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, WMMSOCKET, sizeof(addr.sun_path) - 1);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror(WMMSOCKET);
+    return 1;
+  }
+
+  if (!ask(fd, place, NPLACE, answer)) {
+    printf("bad reply from pmtwmmd\n");
+    return 1;
+  }
+  for (i = 0; i < NPLACE; i++)
+    printf("%-12s decl=%8.3f incl=%7.3f field=%8.1fnT status=%d\n",
+           placename[i], answer[i].declination, answer[i].inclination,
+           answer[i].totalfield, answer[i].status);
+
+  /* 16 x 16 points 0.005 degrees apart around Percy Lake = one map tile */
+  for (i = 0; i < WMMMAXQUERY; i++) {
+    tile[i] = place[0];
+    tile[i].longitude += (i % 16) * 0.005;
+    tile[i].latitude += (i / 16) * 0.005;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  ask(fd, tile, WMMMAXQUERY, answer);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  us = (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+  printf("first tile  %8.1f us/message %6.2f us/point\n", us,
+         us / WMMMAXQUERY);
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (i = 0; i < REPEAT; i++)
+    ask(fd, tile, WMMMAXQUERY, answer);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  us = (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+  printf("cached tile %8.1f us/message %6.2f us/point\n", us / REPEAT,
+         us / REPEAT / WMMMAXQUERY);
+
+  close(fd);
+  return 0;
+}
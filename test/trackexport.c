@@ -0,0 +1,648 @@
+/**
+ * DOC: --  trackexport.c  -- recorded fixes to GPX or GeoJSON
+ *  Peter Thompson   -- Nov 2019
+ *
+ *  trackexport [-j] [-b from] [-e to] log > out.gpx
+ *    log   the NMEA log (pmtgpsd.conf nmealog, /var/log/pmtgpsd-nmea.log)
+ *          or a binary track log (tracklog, /var/log/pmtgpsd-track, or
+ *          tracklog-simple) given without .dat/.idx
+ *    -j    GeoJSON FeatureCollection, one Point a fix, instead of GPX
+ *    -b -e only fixes from/to this UTC time, yyyymmddhhmmss[.sss]
+ *
+ *  every fix: time, longitude, latitude, altitude.  From the NMEA log
+ *  also (when the sentences have them) satellites and hdop (GGA),
+ *  speed, course and magnetic variation (RMC), in GPX 1.1 <sat> <hdop>
+ *  <magvar> and <extensions> course and speed.  GGA and RMC with the
+ *  same time are one fix; bad checksums, no fix and the binary UBX
+ *  frames the log also holds are skipped.  A gap of more than GAP
+ *  seconds, or time going back (a restart), starts a new GPX <trkseg>.
+ *
+ *  memory stays the same for any size of log: the log is read in
+ *  BUFSIZE blocks, a fix is written as soon as its last sentence is
+ *  read, and output is formatted by hand into a BUFSIZE buffer (no
+ *  printf per number), so a log of gigabytes goes at about disk speed.
+ *  A binary track log with -b starts at the chunk its index points to.
+ *
+ * X86 compile with:
+ *  gcc -O2 -o trackexport  trackexport.c -I../include
+ */
+#define _DEFAULT_SOURCE /* timegm() */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pmtgps.h" // struct trackchunk, struct trackindex
+
+#define TRUE 1
+#define FALSE 0
+#define BUFSIZE (1 << 20) /* bytes read, and written, at a time */
+#define MAXLINE 512       /* longer lines are not NMEA */
+#define GAP 300           /* seconds, longer starts a new segment */
+#define NONE (-1000000)   /* field not in the sentences */
+
+/**
+ * struct exportfix -- one fix, from a sentence pair or the track log
+ */
+struct exportfix {
+  int64_t ms;          /* UTC, milliseconds since 1970 */
+  int32_t longitude7;  /* 1e-7 degrees */
+  int32_t latitude7;
+  int32_t altitudemm;  /* NONE if not known */
+  int satellites;      /* NONE ... */
+  int hdop10;          /* hdop x 10 */
+  int speed100;        /* km/hr x 100 */
+  int course10;        /* degrees True x 10 */
+  int magvar10;        /* degrees x 10, + => East */
+};
+
+static int64_t from = INT64_MIN, to = INT64_MAX; /* ms, -b -e */
+static int geojson;
+static long nfix;
+static int64_t lastms; /* fix written before, 0 = none */
+
+/* output, hand formatted */
+static char out[BUFSIZE];
+static int nout;
+
+/**
+ * flush() - write the output buffer
+ * Return: nothing
+ */
+static void flush(void) {
+  if (nout > 0 && fwrite(out, 1, nout, stdout) != (size_t)nout) {
+    perror("trackexport write");
+    exit(1);
+  }
+  nout = 0;
+}
+
+/**
+ * put() - text to the output
+ * Return: nothing
+ */
+static void put(const char *s) {
+  while (*s)
+    out[nout++] = *s++;
+}
+
+/**
+ * putint() - a whole number, at least digits long (leading 0s)
+ * Return: nothing
+ */
+static void putint(int64_t v, int digits) {
+  char d[24];
+  int n;
+
+  if (v < 0) {
+    out[nout++] = '-';
+    v = -v;
+  }
+  for (n = 0; v > 0 || n < digits || n == 0; v /= 10)
+    d[n++] = (char)('0' + v % 10);
+  while (n > 0)
+    out[nout++] = d[--n];
+}
+
+/**
+ * putfixed() - v / 10^decimals, exactly, "-78.3697184"
+ * Return: nothing
+ */
+static void putfixed(int64_t v, int decimals) {
+  int64_t scale;
+  int i;
+
+  for (scale = 1, i = 0; i < decimals; i++)
+    scale *= 10;
+  if (v < 0) {
+    out[nout++] = '-';
+    v = -v;
+  }
+  putint(v / scale, 1);
+  out[nout++] = '.';
+  putint(v % scale, decimals);
+}
+
+/**
+ * puttime() - ISO 8601 UTC, "2019-11-15T12:00:00.000Z"
+ * Return: nothing
+ */
+static void puttime(int64_t ms) {
+  static int64_t day = -1;
+  static char date[16];
+  struct tm tm;
+  time_t t;
+  int s;
+
+  if (ms / 86400000 != day) { /* gmtime once a day */
+    day = ms / 86400000;
+    t = (time_t)(day * 86400);
+    gmtime_r(&t, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%dT", &tm);
+  }
+  put(date);
+  s = (int)(ms % 86400000 / 1000);
+  putint(s / 3600, 2);
+  out[nout++] = ':';
+  putint(s / 60 % 60, 2);
+  out[nout++] = ':';
+  putint(s % 60, 2);
+  out[nout++] = '.';
+  putint(ms % 1000, 3);
+  out[nout++] = 'Z';
+}
+
+/**
+ * start() - GPX or GeoJSON header
+ * Return: nothing
+ */
+static void start(char *name) {
+  if (geojson) {
+    put("{\"type\":\"FeatureCollection\",\"features\":[");
+    return;
+  }
+  put("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      "<gpx version=\"1.1\" creator=\"pmtgpsd trackexport\" "
+      "xmlns=\"http://www.topografix.com/GPX/1/1\">\n<trk><name>");
+  for (; *name; name++) /* XML escapes */
+    if (*name == '<')
+      put("&lt;");
+    else if (*name == '&')
+      put("&amp;");
+    else
+      out[nout++] = *name;
+  put("</name>\n<trkseg>\n");
+}
+
+/**
+ * finish() - GPX or GeoJSON end
+ * Return: nothing
+ */
+static void finish(void) {
+  put(geojson ? "\n]}\n" : "</trkseg>\n</trk>\n</gpx>\n");
+  flush();
+}
+
+/**
+ * writefix() - one fix, if in the time range
+ * Return: nothing
+ */
+static void writefix(struct exportfix *f) {
+  if (f->ms < from || f->ms > to)
+    return;
+  if (nout > BUFSIZE - 1024)
+    flush();
+
+  if (geojson) {
+    put(nfix ? ",\n" : "\n");
+    put("{\"type\":\"Feature\",\"geometry\":{\"type\":\"Point\","
+        "\"coordinates\":[");
+    putfixed(f->longitude7, 7);
+    out[nout++] = ',';
+    putfixed(f->latitude7, 7);
+    if (f->altitudemm != NONE) {
+      out[nout++] = ',';
+      putfixed(f->altitudemm, 3);
+    }
+    put("]},\"properties\":{\"time\":\"");
+    puttime(f->ms);
+    out[nout++] = '"';
+    if (f->satellites != NONE) {
+      put(",\"sat\":");
+      putint(f->satellites, 1);
+    }
+    if (f->hdop10 != NONE) {
+      put(",\"hdop\":");
+      putfixed(f->hdop10, 1);
+    }
+    if (f->speed100 != NONE) {
+      put(",\"speed\":");
+      putfixed(f->speed100, 2);
+    }
+    if (f->course10 != NONE) {
+      put(",\"course\":");
+      putfixed(f->course10, 1);
+    }
+    if (f->magvar10 != NONE) {
+      put(",\"declination\":");
+      putfixed(f->magvar10, 1);
+    }
+    put("}}");
+  } else {
+    if (lastms && (f->ms < lastms || f->ms - lastms > GAP * 1000))
+      put("</trkseg>\n<trkseg>\n");
+    put("<trkpt lat=\"");
+    putfixed(f->latitude7, 7);
+    put("\" lon=\"");
+    putfixed(f->longitude7, 7);
+    put("\">");
+    if (f->altitudemm != NONE) {
+      put("<ele>");
+      putfixed(f->altitudemm, 3);
+      put("</ele>");
+    }
+    put("<time>");
+    puttime(f->ms);
+    put("</time>");
+    if (f->magvar10 != NONE) { /* GPX magvar is 0 ... 360 */
+      put("<magvar>");
+      putfixed((f->magvar10 + 3600) % 3600, 1);
+      put("</magvar>");
+    }
+    if (f->satellites != NONE) {
+      put("<sat>");
+      putint(f->satellites, 1);
+      put("</sat>");
+    }
+    if (f->hdop10 != NONE) {
+      put("<hdop>");
+      putfixed(f->hdop10, 1);
+      put("</hdop>");
+    }
+    if (f->speed100 != NONE || f->course10 != NONE) {
+      put("<extensions>");
+      if (f->course10 != NONE) {
+        put("<course>");
+        putfixed(f->course10, 1);
+        put("</course>");
+      }
+      if (f->speed100 != NONE) {
+        put("<speed>"); /* m/s as GPX 1.0 */
+        putfixed(f->speed100 * 25 / 9, 3);
+        put("</speed>");
+      }
+      put("</extensions>");
+    }
+    put("</trkpt>\n");
+  }
+  lastms = f->ms;
+  nfix++;
+}
+
+/**
+ * parsetime() - yyyymmddhhmmss[.sss] UTC, as trackquery.c
+ * Return: milliseconds since 1970
+ */
+static int64_t parsetime(char *s) {
+  struct tm tm;
+  double seconds;
+
+  memset(&tm, 0, sizeof(tm));
+  if (sscanf(s, "%4d%2d%2d%2d%2d%lf", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+             &tm.tm_hour, &tm.tm_min, &seconds) != 6) {
+    fprintf(stderr, "time %s is not yyyymmddhhmmss\n", s);
+    exit(1);
+  }
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  return (int64_t)timegm(&tm) * 1000 + (int64_t)(seconds * 1000.0 + 0.5);
+}
+
+/*
+ * NMEA log
+ */
+
+/**
+ * decimal() - "123.45" => 12345 with decimals = 2, digits past ignored
+ * Return: the number scaled, NONE if the field is empty
+ */
+static int64_t decimal(char *s, int decimals) {
+  int64_t v;
+  int neg, d;
+
+  if (*s == '\0')
+    return NONE;
+  neg = *s == '-';
+  s += neg;
+  for (v = 0; *s >= '0' && *s <= '9'; s++)
+    v = v * 10 + (*s - '0');
+  d = 0;
+  if (*s == '.')
+    for (s++; *s >= '0' && *s <= '9' && d < decimals; s++, d++)
+      v = v * 10 + (*s - '0');
+  for (; d < decimals; d++)
+    v *= 10;
+  return neg ? -v : v;
+}
+
+/**
+ * degrees7() - NMEA (d)ddmm.mmmm and hemisphere to 1e-7 degrees
+ * Return: 1e-7 degrees
+ */
+static int32_t degrees7(char *s, char *hemisphere) {
+  int64_t m;
+  int32_t d7;
+
+  m = decimal(s, 6); /* dddmm.mmmmmm x 1e6 */
+  d7 = (int32_t)(m / 100000000 * 10000000 +
+                 (m % 100000000 * 10 + 30) / 60); /* minutes => degrees */
+  return *hemisphere == 'S' || *hemisphere == 'W' ? -d7 : d7;
+}
+
+/**
+ * checksum() - does the sentence match its *hh
+ * Return: 1 if it does (or has none), 0 if not
+ */
+static int checksum(char *line) {
+  unsigned int sum, given;
+  char *p;
+
+  sum = 0;
+  for (p = line + 1; *p && *p != '*'; p++)
+    sum ^= (unsigned char)*p;
+  if (*p != '*')
+    return 1;
+  if (sscanf(p + 1, "%2x", &given) != 1)
+    return 0;
+  return sum == given;
+}
+
+/**
+ * fields() - split a sentence at commas (and the *)
+ * Return: number of fields, field[0] is "$GPGGA"
+ */
+static int fields(char *line, char **field, int max) {
+  int n;
+
+  n = 0;
+  field[n++] = line;
+  for (; *line && n < max; line++)
+    if (*line == ',' || *line == '*') {
+      *line = '\0';
+      field[n++] = line + 1;
+    }
+  return n;
+}
+
+/* the fix of the sentences read so far, written when the time changes */
+static struct exportfix pending;
+static int pendingms = -1;  /* ms of the day of pending, -1 = none */
+static int pendingpos;      /* pending has a position */
+static int pendingdate;     /* yyyymmdd from its RMC, 0 = none */
+static int lastdate;        /* yyyymmdd of the last RMC */
+static int64_t lastdays;    /* lastdate as days since 1970 */
+
+/**
+ * days() - yyyymmdd as days since 1970
+ * Return: days
+ */
+static int64_t days(int date) {
+  struct tm tm;
+
+  memset(&tm, 0, sizeof(tm));
+  tm.tm_year = date / 10000 - 1900;
+  tm.tm_mon = date / 100 % 100 - 1;
+  tm.tm_mday = date % 100;
+  return (int64_t)timegm(&tm) / 86400;
+}
+
+/**
+ * epoch() - a sentence with time hhmmss.sss: write pending if this is a
+ *  new fix
+ * Return: nothing
+ */
+static void epoch(char *hhmmss) {
+  int ms, t;
+
+  t = (int)decimal(hhmmss, 3); /* hhmmss x 1000 */
+  ms = t / 10000000 * 3600000 + t / 100000 % 100 * 60000 + t % 100000;
+  if (ms == pendingms)
+    return;
+  if (pendingms >= 0 && pendingpos) {
+    if (pendingdate == 0) /* no RMC this fix, the last one's date */
+      pendingdate = lastdate;
+    if (pendingdate) {
+      if (pendingdate != lastdate) {
+        lastdate = pendingdate;
+        lastdays = days(lastdate);
+      }
+      pending.ms = lastdays * 86400000 + pendingms;
+      writefix(&pending);
+    }
+  }
+  pendingms = ms;
+  pendingpos = FALSE;
+  pendingdate = 0;
+  pending.altitudemm = pending.satellites = pending.hdop10 = NONE;
+  pending.speed100 = pending.course10 = pending.magvar10 = NONE;
+}
+
+/**
+ * sentence() - one NMEA line
+ * Return: nothing
+ */
+static void sentence(char *line) {
+  char *f[24];
+  int n, ddmmyy;
+  int64_t v;
+
+  line = strrchr(line, '$'); /* after any UBX frame bytes */
+  if (!line || strlen(line) < 7 || !checksum(line))
+    return;
+  if (strncmp(line + 3, "GGA,", 4) == 0) {
+    n = fields(line, f, 24);
+    if (n < 10 || f[6][0] == '\0' || f[6][0] == '0' || f[2][0] == '\0')
+      return; /* no fix */
+    epoch(f[1]);
+    pending.latitude7 = degrees7(f[2], f[3]);
+    pending.longitude7 = degrees7(f[4], f[5]);
+    pending.satellites = (int)decimal(f[7], 0);
+    pending.hdop10 = (int)decimal(f[8], 1);
+    pending.altitudemm = (int32_t)decimal(f[9], 3);
+    pendingpos = TRUE;
+  } else if (strncmp(line + 3, "RMC,", 4) == 0) {
+    n = fields(line, f, 24);
+    if (n < 10 || f[2][0] != 'A')
+      return; /* no fix */
+    epoch(f[1]);
+    pending.latitude7 = degrees7(f[3], f[4]);
+    pending.longitude7 = degrees7(f[5], f[6]);
+    v = decimal(f[7], 2); /* knots */
+    pending.speed100 = v == NONE ? NONE : (int)(v * 1.852 + 0.5);
+    pending.course10 = (int)decimal(f[8], 1);
+    ddmmyy = (int)decimal(f[9], 0);
+    if (ddmmyy > 0)
+      pendingdate = 20000000 + ddmmyy % 100 * 10000 + ddmmyy / 100 % 100 * 100 +
+                    ddmmyy / 10000;
+    if (n > 11 && (v = decimal(f[10], 1)) != NONE)
+      pending.magvar10 = (int)(f[11][0] == 'W' ? -v : v);
+    pendingpos = TRUE;
+  }
+}
+
+/**
+ * nmeaexport() - every fix of an NMEA log
+ * Return: 0, 1 if unreadable
+ */
+static int nmeaexport(int fd) {
+  static char in[BUFSIZE + MAXLINE + 1];
+  char *p, *end, *nl;
+  ssize_t got;
+  int carry;
+
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  carry = 0; /* bytes of a line cut by the last block */
+  while ((got = read(fd, in + carry, BUFSIZE)) > 0) {
+    end = in + carry + got;
+    for (p = in; (nl = memchr(p, '\n', end - p)) != NULL; p = nl + 1) {
+      if (nl > p && nl[-1] == '\r')
+        nl[-1] = '\0';
+      *nl = '\0';
+      if (nl - p < MAXLINE)
+        sentence(p);
+    }
+    carry = end - p;
+    if (carry > MAXLINE) /* binary, not a line */
+      carry = 0;
+    memmove(in, p, carry);
+  }
+  epoch("999999.999"); /* write the last fix */
+  return got < 0;
+}
+
+/*
+ * binary track log
+ */
+
+/**
+ * getvarint() - decode one zig-zag varint, as trackquery.c
+ * Return: the number
+ */
+static int64_t getvarint(unsigned char **p, unsigned char *end) {
+  uint64_t z;
+  int shift;
+
+  z = 0;
+  for (shift = 0; *p < end && shift < 64; shift += 7) {
+    z |= (uint64_t)(**p & 0x7f) << shift;
+    if (!(*(*p)++ & 0x80))
+      break;
+  }
+  return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+}
+
+/**
+ * trackexport() - every fix of a binary track log, from the chunk with
+ *  the first fix at or after from
+ * Return: 0, 1 if unreadable
+ */
+static int trackexport(char *name) {
+  static unsigned char chunk[TRACKCHUNK];
+  struct trackchunk *head = (struct trackchunk *)chunk;
+  struct trackindex index;
+  struct exportfix f;
+  unsigned char *p, *end;
+  char file[300];
+  long nchunk, c, low, high, mid;
+  int datfd, idxfd, i;
+  struct stat st;
+
+  snprintf(file, sizeof(file), "%s.idx", name);
+  idxfd = open(file, O_RDONLY);
+  snprintf(file, sizeof(file), "%s.dat", name);
+  datfd = open(file, O_RDONLY);
+  if (idxfd < 0 || datfd < 0) {
+    perror(file);
+    return 1;
+  }
+  fstat(idxfd, &st);
+  nchunk = st.st_size / sizeof(struct trackindex);
+
+  /* last chunk starting at or before from */
+  low = 0;
+  high = nchunk - 1;
+  while (low <= high) {
+    mid = (low + high) / 2;
+    pread(idxfd, &index, sizeof(index), mid * sizeof(index));
+    if (index.first / 1000000 <= from)
+      low = mid + 1;
+    else
+      high = mid - 1;
+  }
+  posix_fadvise(datfd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  f.satellites = f.hdop10 = f.speed100 = f.course10 = f.magvar10 = NONE;
+  for (c = high < 0 ? 0 : high; c < nchunk; c++) {
+    if (pread(datfd, chunk, TRACKCHUNK, (off_t)c * TRACKCHUNK) != TRACKCHUNK)
+      break;
+    if (head->magic != TRACKMAGIC ||
+        head->bytes > TRACKCHUNK - sizeof(struct trackchunk))
+      continue;
+    if (head->first / 1000000 > to)
+      break;
+    f.ms = head->first / 1000000;
+    f.longitude7 = head->longitude7;
+    f.latitude7 = head->latitude7;
+    f.altitudemm = head->altitudemm;
+    writefix(&f);
+    p = chunk + sizeof(struct trackchunk);
+    end = p + head->bytes;
+    for (i = 1; i < head->nfix && p < end; i++) {
+      f.ms += getvarint(&p, end);
+      f.longitude7 += (int32_t)getvarint(&p, end);
+      f.latitude7 += (int32_t)getvarint(&p, end);
+      f.altitudemm += (int32_t)getvarint(&p, end);
+      writefix(&f);
+    }
+  }
+  close(datfd);
+  close(idxfd);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  struct timespec t0, t1;
+  char file[300];
+  struct stat st;
+  double seconds;
+  int opt, fd, err;
+
+  while ((opt = getopt(argc, argv, "jb:e:")) != -1) {
+    switch (opt) {
+    case 'j':
+      geojson = 1;
+      break;
+    case 'b':
+      from = parsetime(optarg);
+      break;
+    case 'e':
+      to = parsetime(optarg);
+      break;
+    default:
+      optind = argc; /* usage */
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: trackexport [-j] [-b yyyymmddhhmmss] "
+                    "[-e yyyymmddhhmmss] nmealog|tracklog > out\n");
+    return 1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  start(argv[optind]);
+  snprintf(file, sizeof(file), "%s.idx", argv[optind]);
+  if (stat(file, &st) == 0) {
+    err = trackexport(argv[optind]);
+    snprintf(file, sizeof(file), "%s.dat", argv[optind]);
+  } else {
+    snprintf(file, sizeof(file), "%s", argv[optind]);
+    fd = open(file, O_RDONLY);
+    if (fd < 0) {
+      perror(file);
+      return 1;
+    }
+    err = nmeaexport(fd);
+    close(fd);
+  }
+  finish();
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+  stat(file, &st);
+  fprintf(stderr, "%ld fixes from %s, %.0f MB in %.2f s (%.0f MB/s)\n", nfix,
+          file, st.st_size / 1e6, seconds,
+          seconds > 0.0 ? st.st_size / 1e6 / seconds : 0.0);
+  return err;
+}
@@ -0,0 +1,256 @@
+/**
+ * DOC: --  trackquery.c  -- where was the unit at a given time
+ *  Peter Thompson   -- Nov 2019
+ *
+ *  reads the pmtgpsd binary track log (pmtgpsd.conf tracklog, see
+ *  gpstrack.c and struct trackchunk in pmtgps.h):
+ *    trackquery /var/log/pmtgpsd-track
+ *        chunks, fixes, time covered, bytes per fix
+ *    trackquery /var/log/pmtgpsd-track 20191115123000
+ *        the last fix at or before 12:30:00 UTC Nov 15 2019
+ *    trackquery /var/log/pmtgpsd-track 20191115123000 20191115124500
+ *        every fix from 12:30 to 12:45
+ *  a time is yyyymmddhhmmss[.sss] UTC.  Shows how to search the log:
+ *  mmap tracklog.idx, binary search it for the chunk, read and decode
+ *  that one chunk - a few hundred microseconds for a year of fixes.
+ *
+ * cross-compile with:
+ *  arm-linux-gnueabihf-gcc -o trackquery  trackquery.c -I../include
+ * X86 compile with:
+ *  gcc -o trackquery  trackquery.c -I../include
+ */
+#define _DEFAULT_SOURCE /* timegm() */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pmtgps.h" // struct trackchunk, struct trackindex
+
+/**
+ * struct trackfix -- one decoded fix
+ */
+struct trackfix {
+  int64_t ms; /* UTC, milliseconds since 1970 */
+  int32_t longitude7, latitude7, altitudemm;
+};
+
+static struct trackfix fixes[TRACKCHUNK]; /* a chunk has fewer than this */
+
+/**
+ * getvarint() - decode one zig-zag varint, as gpstrack.c putvarint()
+ * @p    input, moved past the varint
+ * @end  end of the input
+ * Return: the number
+ */
+static int64_t getvarint(unsigned char **p, unsigned char *end) {
+  uint64_t z;
+  int shift;
+
+  z = 0;
+  for (shift = 0; *p < end && shift < 64; shift += 7) {
+    z |= (uint64_t)(**p & 0x7f) << shift;
+    if (!(*(*p)++ & 0x80))
+      break;
+  }
+  return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+}
+
+/**
+ * decode() - every fix in one chunk
+ * Return: number of fixes, -1 if the chunk is not a track chunk
+ */
+static int decode(unsigned char *chunk) {
+  struct trackchunk *head = (struct trackchunk *)chunk;
+  unsigned char *p, *end;
+  int n;
+
+  if (head->magic != TRACKMAGIC ||
+      head->bytes > TRACKCHUNK - sizeof(struct trackchunk))
+    return -1;
+  fixes[0].ms = head->first / 1000000;
+  fixes[0].longitude7 = head->longitude7;
+  fixes[0].latitude7 = head->latitude7;
+  fixes[0].altitudemm = head->altitudemm;
+  p = chunk + sizeof(struct trackchunk);
+  end = p + head->bytes;
+  for (n = 1; n < head->nfix && p < end; n++) {
+    fixes[n].ms = fixes[n - 1].ms + getvarint(&p, end);
+    fixes[n].longitude7 = fixes[n - 1].longitude7 + getvarint(&p, end);
+    fixes[n].latitude7 = fixes[n - 1].latitude7 + getvarint(&p, end);
+    fixes[n].altitudemm = fixes[n - 1].altitudemm + getvarint(&p, end);
+  }
+  return n;
+}
+
+/**
+ * findchunk() - binary search the index
+ * Return: the last chunk starting at or before ns, -1 if none
+ */
+static long findchunk(struct trackindex *index, long nchunk, int64_t ns) {
+  long low, high, mid;
+
+  low = 0;
+  high = nchunk - 1;
+  while (low <= high) {
+    mid = (low + high) / 2;
+    if (index[mid].first <= ns)
+      low = mid + 1;
+    else
+      high = mid - 1;
+  }
+  return high;
+}
+
+/**
+ * readchunk() - read and decode chunk n of tracklog.dat
+ * Return: number of fixes, -1 if unreadable
+ */
+static int readchunk(int fd, long n) {
+  static unsigned char chunk[TRACKCHUNK];
+
+  if (pread(fd, chunk, TRACKCHUNK, (off_t)n * TRACKCHUNK) != TRACKCHUNK)
+    return -1;
+  return decode(chunk);
+}
+
+/**
+ * parsetime() - yyyymmddhhmmss[.sss] UTC
+ * Return: nanoseconds since 1970
+ */
+static int64_t parsetime(char *s) {
+  struct tm tm;
+  double seconds;
+
+  memset(&tm, 0, sizeof(tm));
+  if (sscanf(s, "%4d%2d%2d%2d%2d%lf", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+             &tm.tm_hour, &tm.tm_min, &seconds) != 6) {
+    fprintf(stderr, "time %s is not yyyymmddhhmmss\n", s);
+    exit(1);
+  }
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  return (int64_t)timegm(&tm) * 1000000000 + (int64_t)(seconds * 1e9);
+}
+
+/**
+ * printfix() - one fix, UTC and decimal degrees
+ * Return: nothing
+ */
+static void printfix(struct trackfix *f) {
+  char when[32];
+  time_t t;
+
+  t = f->ms / 1000;
+  strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+  printf("%s.%03d  %12.7f %11.7f  %8.3fm\n", when, (int)(f->ms % 1000),
+         f->longitude7 * 1e-7, f->latitude7 * 1e-7, f->altitudemm * 1e-3);
+}
+
+/**
+ * elapsed() - microseconds since a CLOCK_MONOTONIC time
+ * Return: microseconds
+ */
+static double elapsed(struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1e6 +
+         (now.tv_nsec - start->tv_nsec) * 1e-3;
+}
+
+int main(int argc, char *argv[]) {
+  char name[256];
+  struct trackindex *index;
+  struct timespec start;
+  struct stat st;
+  int64_t from, to;
+  long nchunk, c, total;
+  int idxfd, datfd, i, n;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: trackquery tracklog [from [to]]\n");
+    return 1;
+  }
+  snprintf(name, sizeof(name), "%s.idx", argv[1]);
+  idxfd = open(name, O_RDONLY);
+  snprintf(name, sizeof(name), "%s.dat", argv[1]);
+  datfd = open(name, O_RDONLY);
+  if (idxfd < 0 || datfd < 0) {
+    perror(name);
+    return 1;
+  }
+  fstat(idxfd, &st);
+  nchunk = st.st_size / sizeof(struct trackindex);
+  if (nchunk == 0) {
+    printf("%s: empty\n", argv[1]);
+    return 0;
+  }
+  index = mmap(0, st.st_size, PROT_READ, MAP_SHARED, idxfd, 0);
+  if (index == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+
+  /* no time: summary of the whole log */
+  if (argc == 2) {
+    total = 0;
+    for (c = 0; c < nchunk; c++)
+      if ((n = readchunk(datfd, c)) > 0)
+        total += n;
+    fstat(datfd, &st);
+    printf("%ld chunks, %ld fixes, %.1f bytes/fix (%ld bytes)\n", nchunk,
+           total, total ? (double)st.st_size / total : 0.0, (long)st.st_size);
+    n = readchunk(datfd, 0);
+    if (n > 0) {
+      printf("first ");
+      printfix(&fixes[0]);
+    }
+    n = readchunk(datfd, nchunk - 1);
+    if (n > 0) {
+      printf("last  ");
+      printfix(&fixes[n - 1]);
+    }
+    return 0;
+  }
+
+  /* one time: the fix then */
+  from = parsetime(argv[2]);
+  if (argc == 3) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    c = findchunk(index, nchunk, from);
+    n = c < 0 ? -1 : readchunk(datfd, c);
+    if (n <= 0) {
+      printf("no fix at or before %s\n", argv[2]);
+      return 1;
+    }
+    for (i = n - 1; i > 0 && fixes[i].ms * 1000000 > from; i--)
+      ;
+    printfix(&fixes[i]);
+    printf("chunk %ld of %ld, %.0f us\n", c, nchunk, elapsed(&start));
+    return 0;
+  }
+
+  /* a range: every fix in it */
+  to = parsetime(argv[3]);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  total = 0;
+  c = findchunk(index, nchunk, from);
+  for (c = c < 0 ? 0 : c; c < nchunk && index[c].first <= to; c++) {
+    if (index[c].last < from)
+      continue;
+    n = readchunk(datfd, c);
+    for (i = 0; i < n; i++)
+      if (fixes[i].ms * 1000000 >= from && fixes[i].ms * 1000000 <= to) {
+        printfix(&fixes[i]);
+        total++;
+      }
+  }
+  printf("%ld fixes, %.0f us\n", total, elapsed(&start));
+  return 0;
+}
@@ -0,0 +1,285 @@
+/**
+ * DOC: --  trailbuild.c  -- make a pmtgpsd trail network file
+ *  Peter Thompson   -- Nov 2019
+ *
+ *  trailbuild percylake.trails percylake.trl
+ *  reads trails as text, writes the binary network pmtgpsd maps for map
+ *  matching (pmtgpsd.conf trailfile, see gpsmatch.c and struct
+ *  trailfile in pmtgps.h).  Text, # starts a comment, commas are spaces:
+ *      trail name
+ *      longitude latitude
+ *      longitude latitude
+ *      ...
+ *  every trail is 2 or more points joined by straight pieces.  Trails
+ *  join where they have a point with the same longitude latitude (to
+ *  1e-7 degrees), so a junction must be a point of both trails.
+ *
+ *  the grid is ~100 m cells, every piece listed in each cell its box
+ *  touches, so pmtgpsd only looks at the pieces near a fix.
+ *
+ * X86 compile with:
+ *  gcc -o trailbuild  trailbuild.c -I../include -lm
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pmtgps.h" // struct trailfile, trailnode, trailedge
+
+#define EARTHRADIUS 6371000.0 /* meters, mean, as gpsmatch.c */
+#define DEG2RAD(x) ((x) * M_PI / 180.0)
+#define CELL 100.0      /* meters, grid cell */
+#define MAXCELL 4000000 /* cells, bigger cells beyond that */
+
+/**
+ * struct point -- a trail point as read
+ */
+struct point {
+  int32_t longitude7, latitude7;
+  uint32_t trail;
+  uint32_t node; /* after merging */
+  uint32_t order; /* place in the file */
+};
+
+static struct point *point;
+static uint32_t npoint, ntrail;
+
+/**
+ * bylocation() - qsort points by longitude7, latitude7
+ */
+static int bylocation(const void *a, const void *b) {
+  const struct point *p = a, *q = b;
+
+  if (p->longitude7 != q->longitude7)
+    return p->longitude7 < q->longitude7 ? -1 : 1;
+  if (p->latitude7 != q->latitude7)
+    return p->latitude7 < q->latitude7 ? -1 : 1;
+  return 0;
+}
+
+/**
+ * byorder() - qsort points back to file order
+ */
+static int byorder(const void *a, const void *b) {
+  const struct point *p = a, *q = b;
+
+  return p->order < q->order ? -1 : p->order > q->order;
+}
+
+/**
+ * distance() - great circle distance between 2 nodes
+ * Return: meters
+ */
+static double distance(struct trailnode *a, struct trailnode *b) {
+  double lat1, lat2, dlat, dlong, h;
+
+  lat1 = DEG2RAD(a->latitude7 * 1e-7);
+  lat2 = DEG2RAD(b->latitude7 * 1e-7);
+  dlat = lat2 - lat1;
+  dlong = DEG2RAD((b->longitude7 - a->longitude7) * 1e-7);
+  h = sin(dlat / 2) * sin(dlat / 2) +
+      cos(lat1) * cos(lat2) * sin(dlong / 2) * sin(dlong / 2);
+  return 2.0 * EARTHRADIUS * asin(sqrt(h));
+}
+
+/**
+ * readtrails() - read the text file into point[]
+ * Return: number of points
+ */
+static uint32_t readtrails(FILE *fp) {
+  char line[200], *c;
+  double longitude, latitude;
+  uint32_t max;
+  int started;
+
+  max = 0;
+  started = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    c = strchr(line, '#');
+    if (c)
+      *c = '\0';
+    for (c = line; *c; c++)
+      if (*c == ',')
+        *c = ' ';
+    if (strncmp(line, "trail", 5) == 0) {
+      ntrail += started;
+      started = 1;
+      continue;
+    }
+    if (sscanf(line, "%lf %lf", &longitude, &latitude) != 2 || !started)
+      continue;
+    if (npoint == max) {
+      max = max ? 2 * max : 1024;
+      point = realloc(point, max * sizeof(struct point));
+    }
+    point[npoint].longitude7 = (int32_t)lround(longitude * 1e7);
+    point[npoint].latitude7 = (int32_t)lround(latitude * 1e7);
+    point[npoint].trail = ntrail;
+    point[npoint].order = npoint;
+    npoint++;
+  }
+  ntrail += started;
+  return npoint;
+}
+
+int main(int argc, char *argv[]) {
+  struct trailfile h;
+  struct trailnode *node;
+  struct trailedge *edge;
+  uint32_t *nodestart, *nodeedge, *cellstart, *celledge;
+  uint32_t i, e, c, x, y, x0, x1, y0, y1, ncell, nlist;
+  int32_t east7, north7;
+  FILE *fp;
+
+  if (argc != 3) {
+    fprintf(stderr, "usage: trailbuild trails.txt trails.trl\n");
+    return 1;
+  }
+  fp = fopen(argv[1], "r");
+  if (!fp) {
+    perror(argv[1]);
+    return 1;
+  }
+  readtrails(fp);
+  fclose(fp);
+  if (npoint < 2) {
+    fprintf(stderr, "%s: no trails\n", argv[1]);
+    return 1;
+  }
+  memset(&h, 0, sizeof(h));
+  h.magic = TRAILMAGIC;
+  h.ntrail = ntrail;
+
+  /* nodes: points at the same place are one node */
+  qsort(point, npoint, sizeof(struct point), bylocation);
+  node = malloc(npoint * sizeof(struct trailnode));
+  for (i = 0; i < npoint; i++) {
+    if (i == 0 || bylocation(&point[i], &point[i - 1]) != 0) {
+      node[h.nnode].longitude7 = point[i].longitude7;
+      node[h.nnode].latitude7 = point[i].latitude7;
+      h.nnode++;
+    }
+    point[i].node = h.nnode - 1;
+  }
+  qsort(point, npoint, sizeof(struct point), byorder);
+
+  /* edges: consecutive points of a trail */
+  edge = malloc(npoint * sizeof(struct trailedge));
+  for (i = 1; i < npoint; i++)
+    if (point[i].trail == point[i - 1].trail &&
+        point[i].node != point[i - 1].node) {
+      edge[h.nedge].from = point[i - 1].node;
+      edge[h.nedge].to = point[i].node;
+      edge[h.nedge].trail = point[i].trail;
+      edge[h.nedge].length =
+          (float)distance(&node[point[i - 1].node], &node[point[i].node]);
+      h.nedge++;
+    }
+
+  /* edges of each node, count then fill */
+  nodestart = calloc(h.nnode + 1, sizeof(uint32_t));
+  nodeedge = malloc(2 * h.nedge * sizeof(uint32_t));
+  for (e = 0; e < h.nedge; e++) {
+    nodestart[edge[e].from + 1]++;
+    nodestart[edge[e].to + 1]++;
+  }
+  for (i = 0; i < h.nnode; i++)
+    nodestart[i + 1] += nodestart[i];
+  for (e = 0; e < h.nedge; e++) {
+    nodeedge[nodestart[edge[e].from]++] = e;
+    nodeedge[nodestart[edge[e].to]++] = e;
+  }
+  for (i = h.nnode; i > 0; i--) /* filling moved starts on, back */
+    nodestart[i] = nodestart[i - 1];
+  nodestart[0] = 0;
+
+  /* grid over the nodes */
+  h.west7 = east7 = node[0].longitude7;
+  h.south7 = north7 = node[0].latitude7;
+  for (i = 1; i < h.nnode; i++) {
+    if (node[i].longitude7 < h.west7)
+      h.west7 = node[i].longitude7;
+    if (node[i].longitude7 > east7)
+      east7 = node[i].longitude7;
+    if (node[i].latitude7 < h.south7)
+      h.south7 = node[i].latitude7;
+    if (node[i].latitude7 > north7)
+      north7 = node[i].latitude7;
+  }
+  h.celly7 = (int32_t)(CELL / (DEG2RAD(1.0) * EARTHRADIUS) * 1e7);
+  h.cellx7 = (int32_t)(h.celly7 /
+                       cos(DEG2RAD((h.south7 + (double)north7) * 0.5e-7)));
+  while ((double)((east7 - h.west7) / h.cellx7 + 1) *
+             ((north7 - h.south7) / h.celly7 + 1) >
+         MAXCELL) {
+    h.cellx7 *= 2;
+    h.celly7 *= 2;
+  }
+  h.gridw = (east7 - h.west7) / h.cellx7 + 1;
+  h.gridh = (north7 - h.south7) / h.celly7 + 1;
+  ncell = h.gridw * h.gridh;
+
+  /* edges of each cell: count, then fill */
+  cellstart = calloc(ncell + 1, sizeof(uint32_t));
+  celledge = NULL;
+  nlist = 0;
+  for (c = 0; c < 2; c++) {
+    for (e = 0; e < h.nedge; e++) {
+      x0 = (node[edge[e].from].longitude7 - h.west7) / h.cellx7;
+      x1 = (node[edge[e].to].longitude7 - h.west7) / h.cellx7;
+      y0 = (node[edge[e].from].latitude7 - h.south7) / h.celly7;
+      y1 = (node[edge[e].to].latitude7 - h.south7) / h.celly7;
+      if (x0 > x1) {
+        x = x0;
+        x0 = x1;
+        x1 = x;
+      }
+      if (y0 > y1) {
+        y = y0;
+        y0 = y1;
+        y1 = y;
+      }
+      for (y = y0; y <= y1; y++)
+        for (x = x0; x <= x1; x++)
+          if (c == 0)
+            cellstart[x + y * h.gridw + 1]++;
+          else
+            celledge[cellstart[x + y * h.gridw]++] = e;
+    }
+    if (c == 0) {
+      for (i = 0; i < ncell; i++)
+        cellstart[i + 1] += cellstart[i];
+      nlist = cellstart[ncell];
+      celledge = malloc((nlist + 1) * sizeof(uint32_t));
+    } else {
+      for (i = ncell; i > 0; i--)
+        cellstart[i] = cellstart[i - 1];
+      cellstart[0] = 0;
+    }
+  }
+
+  fp = fopen(argv[2], "wb");
+  if (!fp) {
+    perror(argv[2]);
+    return 1;
+  }
+  fwrite(&h, sizeof(h), 1, fp);
+  fwrite(node, sizeof(struct trailnode), h.nnode, fp);
+  fwrite(edge, sizeof(struct trailedge), h.nedge, fp);
+  fwrite(nodestart, sizeof(uint32_t), h.nnode + 1, fp);
+  fwrite(nodeedge, sizeof(uint32_t), 2 * h.nedge, fp);
+  fwrite(cellstart, sizeof(uint32_t), ncell + 1, fp);
+  fwrite(celledge, sizeof(uint32_t), nlist, fp);
+  if (fclose(fp) != 0) {
+    perror(argv[2]);
+    return 1;
+  }
+  printf("%u trails, %u nodes, %u pieces, %u x %u grid, %ld bytes\n",
+         h.ntrail, h.nnode, h.nedge, h.gridw, h.gridh,
+         (long)(sizeof(h) + h.nnode * sizeof(struct trailnode) +
+                h.nedge * sizeof(struct trailedge) +
+                (h.nnode + 1 + 2 * h.nedge + ncell + 1 + nlist) * 4));
+  return 0;
+}